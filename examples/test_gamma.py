@@ -42,9 +42,15 @@ y = y.astype(np.float32)
 y = np.require(y, requirements=['A', 'C', 'O', 'W'])
 
 
+print('======== Base Tuning ==========')
+t = gt()
+base, report = SGTree_NNS_L2.tune_base(x, use_multi_core=cores)
+print(report)
+print("Tuning time:", gt() - t, "seconds")
+
 print('======== SG Tree ==========')
 t = gt()
-ct = SGTree_NNS_L2.from_matrix(x, use_multi_core=cores, new_base=1.2)
+ct = SGTree_NNS_L2.from_matrix(x, use_multi_core=cores, new_base=base)
 b_t = gt() - t
 #ct.display()
 print("Building time:", b_t, "seconds")
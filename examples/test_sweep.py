@@ -0,0 +1,52 @@
+"""
+Copyright (c) 2021 The authors of SG Tree All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+"""
+
+import time
+import numpy as np
+
+from graphgrove.scc import SCC
+
+gt = time.time
+
+np.random.seed(123)
+
+print('======== Building Graph ==========')
+N = 300
+k = 10
+x = np.random.randn(N, 5).astype(np.float32)
+x /= np.linalg.norm(x, axis=1, keepdims=True)
+sims = x @ x.T
+nbrs = np.argsort(-sims, axis=1)[:, 1:k+1]
+row = np.repeat(np.arange(N), k).astype(np.uint32)
+col = nbrs.reshape(-1).astype(np.uint32)
+sim = sims[row, col].astype(np.float32)
+
+def partitions(tree):
+  return [sorted(sorted(n.descendants()) for n in l.nodes) for l in tree.levels]
+
+print('======== Sweep vs Single Fits ==========')
+# schedules sharing and differing in their first threshold
+schedules = [[0.95, 0.3, 0.1], [0.1, 0.3, 0.1], [0.95, 0.3, 0.05], [0.95, 0.5, 0.1]]
+t = gt()
+trees = SCC.sweep(schedules, N, row, col, sim)
+print("Sweep time:", gt() - t, "seconds")
+
+for thresholds, tree in zip(schedules, trees):
+  single = SCC.init(np.array(thresholds, dtype=np.float32))
+  single.fit_on_large_batch(N, row, col, sim)
+  same = partitions(tree) == partitions(single)
+  print(thresholds, [len(l.nodes) for l in tree.levels], 'matches single fit' if same else 'DIFFERS from single fit')
+  assert same
@@ -26,7 +26,7 @@ import covertreec
 
 class Node(object):
   """CoverTree node from c++."""
-  base_vars = ['this', 'uid', 'level', 'point', 'maxdistUB']
+  base_vars = ['this', 'uid', 'level', 'point', 'maxdistUB', 'duplicates']
 
   def __init__(self, this):
     info = covertreec.node_property(this)
@@ -74,8 +74,8 @@ class NNS_L2(object):
     return covertreec.size(self.this)
 
   @classmethod
-  def from_matrix(cls, points, trunc=-1, use_multi_core=-1):
-    ptr = covertreec.new(points, trunc, use_multi_core)
+  def from_matrix(cls, points, trunc=-1, use_multi_core=-1, medoid_sample=0):
+    ptr = covertreec.new(points, trunc, use_multi_core, medoid_sample)
     return cls(ptr)
 
   @classmethod
@@ -105,7 +105,12 @@ class NNS_L2(object):
                          points,
                          k=10,
                          use_multi_core=-1,
-                         return_points=False):
+                         return_points=False,
+                         expand_duplicates=False):
+    """With expand_duplicates, exact duplicates count as neighbours of their
+    own (results are padded with -1 and inf if the tree is smaller than k)."""
+    if expand_duplicates:
+      return covertreec.kNearestNeighboursExpanded(self.this, points, k, use_multi_core)
     return covertreec.kNearestNeighbours(self.this, points, k, use_multi_core,
                                          return_points)
 
@@ -113,7 +118,10 @@ class NNS_L2(object):
                   points,
                   r=1.0,
                   use_multi_core=-1,
-                  return_points=False):
+                  return_points=False,
+                  expand_duplicates=False):
+    if expand_duplicates:
+      return covertreec.RangeSearchExpanded(self.this, points, r, use_multi_core)
     return covertreec.RangeSearch(self.this, points, r, use_multi_core,
                                   return_points)
 
@@ -132,6 +140,26 @@ class NNS_L2(object):
   def test_nesting(self):
     return covertreec.test_nesting(self.this)
 
+  def verify(self, checks=('covering', 'separation', 'nesting', 'maxdist', 'levels'),
+             use_multi_core=-1, max_report=10, early_exit=False):
+    """Check tree invariants on all cores.
+
+    covering: children within the covering distance of their parent,
+    separation: siblings further apart than the separating distance,
+    nesting: nested copies hold the same point and the other children are
+    separated from them, maxdist: every descendant within maxdistUB of a
+    node, levels: children one level below their parent.
+    Returns (nodes checked, violations found, complete, first violations),
+    each violation a (check, uid, other uid, level, dist, bound) tuple; with
+    early_exit the check stops after max_report violations.
+    """
+    names = ('covering', 'separation', 'nesting', 'maxdist', 'levels')
+    unknown = set(checks) - set(names)
+    if unknown:
+      raise ValueError('unknown checks: {}'.format(sorted(unknown)))
+    mask = sum(1 << i for i, name in enumerate(names) if name in checks)
+    return covertreec.verify(self.this, mask, use_multi_core, max_report, early_exit)
+
   def spreadout(self, k):
     return covertreec.spreadout(self.this, k)
   
@@ -153,12 +181,12 @@ class MIPS(NNS_L2):
     return covertreec.size(self.this)
 
   @classmethod
-  def from_matrix(cls, points, trunc=-1, user_max=None, use_multi_core=-1):
+  def from_matrix(cls, points, trunc=-1, user_max=None, use_multi_core=-1, medoid_sample=0):
     # Find norm of points
     norm2 = (points**2).sum(1)
     phi2 = np.max(norm2) if user_max is None else user_max
     modified_points = np.hstack((points, np.sqrt(phi2 - norm2)[:, np.newaxis]))
-    ptr = covertreec.new(modified_points, trunc, use_multi_core)
+    ptr = covertreec.new(modified_points, trunc, use_multi_core, medoid_sample)
     return cls(ptr, phi2)
 
   @classmethod
@@ -232,11 +260,11 @@ class MCSS(NNS_L2):
     return (MCSS.from_string, (buff,))
 
   @classmethod
-  def from_matrix(cls, points, trunc=-1, use_multi_core=-1):
+  def from_matrix(cls, points, trunc=-1, use_multi_core=-1, medoid_sample=0):
     # Find norm of points
     norm = np.sqrt((points**2).sum(1))
     modified_points = points / norm[:, np.newaxis]
-    ptr = covertreec.new(modified_points, trunc, use_multi_core)
+    ptr = covertreec.new(modified_points, trunc, use_multi_core, medoid_sample)
     return cls(ptr)
 
   @classmethod
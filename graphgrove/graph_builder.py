@@ -20,6 +20,7 @@ from scipy.sparse import coo_matrix
 import time
 from graphgrove.covertree import NNS_L2 as CoverTree_NNS_L2
 from graphgrove.sgtree import NNS_L2 as SGTree_NNS_L2
+from graphgrove.sgtree import FlatIndex
 
 def to_coo(values, idx, offset, K):
     K = np.minimum(K, idx.shape[1])
@@ -28,6 +29,12 @@ def to_coo(values, idx, offset, K):
     cols = np.reshape(idx, [-1])
     return data[rows!=cols], rows[rows!=cols], cols[rows!=cols]
 
+def flat_topk(vectors, query, k, cores):
+    """Inner products of the k most similar vectors and their indices, by brute force."""
+    index = FlatIndex.from_matrix(vectors, metric='ip')
+    idx, scores = index.search(query, min(k, vectors.shape[0]), use_multi_core=cores)
+    return scores, idx.astype(np.int32)
+
 def unit_norm(X):
     norms = np.linalg.norm(X, axis=1, keepdims=True)
     norms[norms == 0] = 1.0
@@ -140,18 +147,40 @@ class Cosine_CoverTree(Index):
         if not self.assume_unit_normed:
             query = unit_norm(query)
         if self.index is None:
-            scores = query @ self.two_vector_cache.T
-            sorted_ord = np.argsort(scores, axis=1)
-            topk_idx = sorted_ord[:, :np.minimum(self.k, self.two_vector_cache.shape[0])]
-            return scores[topk_idx], topk_idx
+            return flat_topk(self.two_vector_cache, query, self.k, self.cores)
         else:
             results = self.index.kNearestNeighbours(query, min(self.k, self.num_points), use_multi_core=self.cores)
             return (2 - results[1].astype(np.float32) ** 2) / 2, results[0].astype(np.int32)
 
 
 class Cosine_SGTree(Cosine_CoverTree):
-    def __init__(self, k, cores=4, add_noise=True, noise_amount=1e-6, assume_unit_normed=True):
+    def __init__(self, k, cores=4, add_noise=True, noise_amount=1e-6, assume_unit_normed=True, reverse_neighbors=False):
         super(Cosine_SGTree, self).__init__(k, cores, add_noise, noise_amount, assume_unit_normed)
+        # also emit edges from earlier points to new points that enter their k nearest
+        self.reverse_neighbors = reverse_neighbors
+
+    def update_graph(self, new_vectors):
+        if not self.reverse_neighbors or self.index is None:
+            return super(Cosine_SGTree, self).update_graph(new_vectors)
+        if not self.assume_unit_normed:
+            new_vectors = unit_norm(new_vectors)
+        id_of_vector_start = self.num_points - new_vectors.shape[0]
+        t0 = time.time()
+        indices, dists, (rev_row, rev_col, rev_dist) = self.index.knn_update(
+            new_vectors, np.arange(id_of_vector_start, self.num_points), max(self.k - 1, 1), use_multi_core=self.cores)
+        t1 = time.time()
+        self.total_knn_time += t1 - t0
+        t0 = time.time()
+        keep = indices >= 0
+        row = np.concatenate([np.repeat(np.arange(id_of_vector_start, self.num_points), keep.sum(axis=1)), rev_row])
+        col = np.concatenate([indices[keep], rev_col])
+        data = (2 - np.concatenate([dists[keep], rev_dist]).astype(np.float32) ** 2) / 2
+        if len(row) > 0:
+            self.latest_update = [row.astype(np.int32), col.astype(np.int32), data]
+        else:
+            self.latest_update = None
+        t1 = time.time()
+        self.total_graph_update_time += t1-t0
 
     def build(self, vectors):
         c = 0
@@ -184,10 +213,7 @@ class Cosine_SGTreeBeam(Cosine_SGTree):
         if not self.assume_unit_normed:
             query = unit_norm(query)
         if self.index is None:
-            scores = query @ self.two_vector_cache.T
-            sorted_ord = np.argsort(scores, axis=1)
-            topk_idx = sorted_ord[:, :np.minimum(self.k, self.two_vector_cache.shape[0])]
-            return scores[topk_idx], topk_idx
+            return flat_topk(self.two_vector_cache, query, self.k, self.cores)
         else:
             results = self.index.kNearestNeighboursBeam(query, min(self.k, self.num_points),
                                                         use_multi_core=self.cores, beam_size=self.beam_size)
@@ -255,6 +281,24 @@ class Cosine_FaissFlat(Index):
         results = self.index.search(query, min(self.k, self.num_points))
         return results[0].astype(np.float32), results[1].astype(np.int32)
 
+class Cosine_Flat(Cosine_FaissFlat):
+    """Exact inner product search with the native FlatIndex, e.g. as ground truth."""
+    def build(self, vectors):
+        t0 = time.time()
+        if self.add_noise:
+            vectors += np.random.randn(vectors.shape[0], vectors.shape[1]) * self.noise_amount
+        self.num_points += vectors.shape[0]
+        if not self.assume_unit_normed:
+            vectors = unit_norm(vectors)
+        self.index = FlatIndex(vectors.shape[1], metric='ip')
+        self.index.add(vectors)
+        t1 = time.time()
+        self.total_insert_time += t1 - t0
+
+    def topk(self, query):
+        results = self.index.search(query, min(self.k, self.num_points), use_multi_core=self.cores)
+        return results[1].astype(np.float32), results[0].astype(np.int32)
+
 class Cosine_FaissHNSW(Index):
 
     def __init__(self, k,
@@ -27,9 +27,24 @@ class LLAMA(object):
   def __del__(self):
     llamac.delete(self.this)
 
-  def cluster(self): 
-    """Run the DAG-clustering process."""
-    llamac.cluster(self.this)
+  def cluster(self, verbose=True, progress=None): 
+    """Run the DAG-clustering process, logging each round to stdout if verbose.
+    progress, a graphgrove.progress.Progress, counts the rounds and may cancel."""
+    llamac.cluster(self.this, int(verbose), 0 if progress is None else progress.handle(llamac))
+
+  def profile(self):
+    """Return what each round of cluster() did.
+
+    Returns:
+    a dict of arrays with one entry per round: seconds spent in each phase
+    (one_nn_time, propose_parents_time, contract_time, prune_time), active
+    nodes at the start of the round (nodes), graph edges left for the next
+    round (edges), child-parent edges made (parent_edges), the most parents
+    of one child (max_parents) and the approximate bytes held in neighbor
+    maps and descendant sets (neighbor_bytes, descendant_bytes). Also the
+    seconds spent building the descendants (set_descendants_time).
+    """
+    return llamac.profile(self.this)
 
   def assignments(self):
     """Return clusters of the DAG-structure discovered.
@@ -68,7 +83,7 @@ class LLAMA(object):
   def from_graph(cls, coo_graph, 
            num_rounds, cores=4, linkage=2, 
            max_num_parents=5, max_num_neighbors=100, 
-           thresholds=None, lowest_value=-10000):
+           thresholds=None, lowest_value=-10000, counts=None, verbose=True, progress=None):
     """Instantiate a LLAMA object with the given graph & hyperparameters.
 
     Arguments:
@@ -83,6 +98,10 @@ class LLAMA(object):
     max_num_neighbors -- maximum number of neigbhors any node can have in the graph (default 100).
     thresholds -- None (for no threshold use). Or a numpy array (float32) of the minimum similarity to allow in an agglomeration (default None).
     lowest_value -- value used for missing / minimum similarity (default -10000)
+    counts -- None, or the number of identical points each point stands for, e.g. 1 + its
+          duplicates in an SG Tree; needs approx_average linkage (default None).
+    verbose -- print a summary of the graph while building it (default True).
+    progress -- None, or a graphgrove.progress.Progress counting the edges read; it may cancel (default None).
     """
     rows, cols, sims = coo_graph.row.astype(np.uint32), coo_graph.col.astype(np.uint32), coo_graph.data.astype(np.float32)
     if len(rows.shape) == 1:
@@ -103,5 +122,9 @@ class LLAMA(object):
         linkage = 2
       else:
         raise Exception('Unknown linkage %s. Options are single, average, approx_average' % linkage)
-    ptr = llamac.new(rows, cols, sims, linkage, num_rounds, thresholds, cores, max_num_parents, max_num_neighbors, lowest_value)
-    return cls(ptr)
+    ptr = llamac.new(rows, cols, sims, linkage, num_rounds, thresholds, cores, max_num_parents, max_num_neighbors, lowest_value, int(verbose),
+                     0 if progress is None else progress.handle(llamac))
+    llama = cls(ptr)
+    if counts is not None:
+      llamac.set_point_counts(ptr, np.ascontiguousarray(counts, dtype=np.float32))
+    return llama
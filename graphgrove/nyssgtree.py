@@ -75,9 +75,19 @@ class NNS_Nys(object):
     return sgtreec.size(self.this)
 
   @classmethod
-  def from_matrix(cls, points, pointsProj, trunc=-1, use_multi_core=-1):
-    ptr = sgtreec.new(points, pointsProj, trunc, use_multi_core)
-    return cls(ptr)
+  def from_matrix(cls, points, pointsProj, trunc=-1, use_multi_core=-1, external_points=False):
+    """Build from points and their projections, both (N, D) float32 in row order.
+
+    With external_points the nodes keep only the projections and read the
+    original points by uid from points, which may be a np.memmap; the tree
+    keeps a reference to it. Points inserted later with a uid past N are
+    stored in their node as usual.
+    """
+    ptr = sgtreec.new(points, pointsProj, trunc, use_multi_core, external_points)
+    tree = cls(ptr)
+    if external_points:
+      tree.points = points
+    return tree
 
   @classmethod
   def from_string(cls, buff):
@@ -202,5 +212,8 @@ class NNS_Nys(object):
     sgtreec.rebuildLevel(self.this, level)
 
   def update_vector(self, points, points_proj):
+    # externally held points are read from the new matrix from now on
+    if hasattr(self, 'points'):
+      self.points = points
     return sgtreec.updateVectors(self.this, points, points_proj)
   
@@ -0,0 +1,92 @@
+"""
+Copyright (c) 2021 The authors of SG Tree All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+"""
+
+import threading
+
+import llamac
+import sccc
+import sgtreec
+
+
+class Progress(object):
+  """Progress and cancellation of long SG Tree, SCC and LLAMA operations.
+
+  SG Tree builds and batch inserts, SCC fits and LLAMA graph building and
+  clustering given this object as progress count their steps into it, from
+  any thread, instead of drawing a progress bar. Workers add to their own
+  counters once per block of points or edges and check for cancellation at
+  the same time; cancel() makes the running operations stop at their next
+  block and raise the error of their module with the message 'cancelled'.
+  A cancelled build returns no tree or graph, a cancelled insert keeps the
+  points and edges added so far and a cancelled clustering the finished
+  rounds. These calls release the GIL, so another thread can poll status()
+  or cancel.
+
+  If callback is given it is called as callback(done, total) every interval
+  seconds from a Python thread while a with block on this object runs.
+  """
+
+  def __init__(self, callback=None, interval=0.5):
+    self.ptrs = {module: module.progress_new() for module in (sgtreec, sccc, llamac)}
+    self.callback = callback
+    self.interval = interval
+    self.stopped = threading.Event()
+    self.poller = None
+
+  def __enter__(self):
+    if self.callback is not None:
+      self.stopped.clear()
+      self.poller = threading.Thread(target=self._poll, daemon=True)
+      self.poller.start()
+    return self
+
+  def __exit__(self, *exc):
+    if self.poller is not None:
+      self.stopped.set()
+      self.poller.join()
+      self.poller = None
+      self.callback(*self.status()[:2])
+    return False
+
+  def __del__(self):
+    for module, ptr in self.ptrs.items():
+      module.progress_delete(ptr)
+
+  def _poll(self):
+    while not self.stopped.wait(self.interval):
+      self.callback(*self.status()[:2])
+
+  def handle(self, module):
+    """The counter passed to the calls of the C extension module."""
+    return self.ptrs[module]
+
+  def status(self):
+    """(steps done, steps expected, cancelled) over the operations so far."""
+    done, total, cancelled = 0, 0, False
+    for module, ptr in self.ptrs.items():
+      d, t, c = module.progress_status(ptr)
+      done += d
+      total += t
+      cancelled = cancelled or c
+    return done, total, cancelled
+
+  def cancel(self):
+    for module, ptr in self.ptrs.items():
+      module.progress_cancel(ptr)
+
+  @property
+  def cancelled(self):
+    return self.status()[2]
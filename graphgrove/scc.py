@@ -84,12 +84,19 @@ class SCC(object):
   def levels(self):
     return [Level(l) for l in sccc.levels(self.this)]
 
-  def fit(self):
-    sccc.fit(self.this)
+  def fit(self, progress=None):
+    sccc.fit(self.this, 0 if progress is None else progress.handle(sccc))
 
   def set_marking_strategy(self, strat):
     sccc.set_marking_strategy(self.this, strat)
 
+  def set_point_counts(self, counts):
+    """Number of identical points each point stands for, e.g. 1 + its duplicates in an SG Tree.
+
+    Must be set before the points are added; their edge similarities are
+    scaled by the product of the counts so that average linkage is unchanged."""
+    sccc.set_point_counts(self.this, np.ascontiguousarray(counts, dtype=np.float32))
+
   def knn_time(self):
     return sccc.knn_time(self.this)
 
@@ -138,35 +145,55 @@ class SCC(object):
   def insert_mb(self, matrix, uids, cores=4, k=25, beam=50):
     sccc.insert_mb(self.this, matrix, uids, k, cores, beam)
 
-  def add_edges(self, row, col, sim):
+  def add_edges(self, row, col, sim, progress=None):
     if len(row.shape) == 1:
       row = row[:, None]
     if len(col.shape) == 1:
       col = col[:, None]
     if len(sim.shape) == 1:
       sim = sim[:, None]
-    sccc.add_graph_edges_mb(self.this, row.astype(np.uint32), col.astype(np.uint32), sim.astype(np.float32))
+    sccc.add_graph_edges_mb(self.this, row.astype(np.uint32), col.astype(np.uint32), sim.astype(np.float32),
+                            0 if progress is None else progress.handle(sccc))
+
+  def update_on_edges(self, progress=None):
+    sccc.update(self.this, 0 if progress is None else progress.handle(sccc))
+
+  def track_changes(self, on=True):
+    """Record which nodes change parent in each fit or update.
 
-  def update_on_edges(self):
-    sccc.update(self.this)
+    The record of the last fit or update is returned by changes().
+    """
+    sccc.track_changes(self.this, on)
 
-  def fit_on_large_batch(self, n, row, col, sim):
+  def changes(self):
+    """Parent changes made by the last fit or update while tracking.
+
+    Returns (level, node, old_parent, new_parent) arrays with one entry per
+    reparented node; node ids are those of the given level and parent ids
+    those of the level above. old_parent is -1 for new nodes and new_parent
+    is -1 for nodes removed from the tree.
+    """
+    return sccc.changes(self.this)
+
+  def fit_on_large_batch(self, n, row, col, sim, progress=None):
     if len(row.shape) == 1:
       row = row[:, None]
     if len(col.shape) == 1:
       col = col[:, None]
     if len(sim.shape) == 1:
       sim = sim[:, None]
-    sccc.fit_on_large_batch(self.this, n, row.astype(np.uint32), col.astype(np.uint32), sim.astype(np.float32))
+    sccc.fit_on_large_batch(self.this, n, row.astype(np.uint32), col.astype(np.uint32), sim.astype(np.float32),
+                            0 if progress is None else progress.handle(sccc))
 
-  def insert_graph_mb(self, row, col, sim):
+  def insert_graph_mb(self, row, col, sim, progress=None):
     if len(row.shape) == 1:
       row = row[:, None]
     if len(col.shape) == 1:
       col = col[:, None]
     if len(sim.shape) == 1:
       sim = sim[:, None]
-    sccc.insert_graph_mb(self.this, row.astype(np.uint32), col.astype(np.uint32), sim.astype(np.float32))
+    sccc.insert_graph_mb(self.this, row.astype(np.uint32), col.astype(np.uint32), sim.astype(np.float32),
+                         0 if progress is None else progress.handle(sccc))
 
   def roots(self):
     return [Node(x) for x in sccc.roots(self.this)]
@@ -174,4 +201,19 @@ class SCC(object):
   @classmethod
   def init(cls, thresholds, cores=1, cc_alg=1, pararallel_min_size=50000, verbosity=0):
     ptr = sccc.init(thresholds, cores, cc_alg, pararallel_min_size, verbosity)
-    return cls(ptr)
\ No newline at end of file
+    return cls(ptr)
+
+  @classmethod
+  def sweep(cls, schedules, n, row, col, sim, cores=1, cc_alg=1, pararallel_min_size=50000, verbosity=0):
+    """Fit one SCC per threshold schedule on the graph (row, col, sim) of n points.
+
+    The graph is loaded once per distinct first threshold and levels shared
+    by schedules with the same leading thresholds are computed once. The returned trees, in the order of
+    schedules, share these levels and cannot be updated afterwards.
+    """
+    schedules = [np.ascontiguousarray(t, dtype=np.float32) for t in schedules]
+    ptrs = sccc.sweep(schedules, cores, cc_alg, pararallel_min_size, verbosity, n,
+                      np.ascontiguousarray(row, dtype=np.uint32).reshape(-1, 1),
+                      np.ascontiguousarray(col, dtype=np.uint32).reshape(-1, 1),
+                      np.ascontiguousarray(sim, dtype=np.float32).reshape(-1, 1))
+    return [cls(ptr) for ptr in ptrs]
@@ -18,14 +18,47 @@ See the License for the specific language governing permissions and
 limitations under the License.
 """
 
+import asyncio
+import concurrent.futures
+import logging
 import pickle
 import numpy as np
 
 import sgtreec
 
+_TRACE_STEP = np.dtype([('query', '<u8'), ('level', '<i4'), ('children', '<u4')])
+
+def read_traces(filename):
+  """Decode a file written by NNS_L2.dump_traces or NearestNeighbour(filename=...).
+
+  Returns {query: int array of (level, children) rows} in visiting order.
+  The oldest query of a ring that wrapped around is incomplete and dropped.
+  """
+  with open(filename, 'rb') as f:
+    buff = f.read()
+  if buff[:4] != b'SGTR':
+    raise ValueError('%s is not a trace file' % filename)
+  _, _, num_rings = np.frombuffer(buff, dtype='<u4', count=3, offset=4)
+  offset = 16
+  traces = {}
+  for _ in range(num_rings):
+    written, n = np.frombuffer(buff, dtype='<u8', count=2, offset=offset)
+    steps = np.frombuffer(buff, dtype=_TRACE_STEP, count=n, offset=offset + 16)
+    offset += 16 + int(n) * _TRACE_STEP.itemsize
+    if n == 0:
+      continue
+    queries, starts = np.unique(steps['query'], return_index=True)
+    order = np.argsort(starts)
+    queries, starts = queries[order], starts[order]
+    ends = np.append(starts[1:], int(n))
+    first = 1 if written > n else 0
+    for q, b, e in zip(queries[first:], starts[first:], ends[first:]):
+      traces[int(q)] = np.stack((steps['level'][b:e], steps['children'][b:e]), axis=1)
+  return traces
+
 class Node(object):
   """SGTree node from c++."""
-  base_vars = ['this', 'uid', 'level', 'point', 'maxdistUB']
+  base_vars = ['this', 'uid', 'level', 'point', 'maxdistUB', 'duplicates']
 
   def __init__(self, this):
     info = sgtreec.node_property(this)
@@ -63,68 +96,248 @@ class NNS_L2(object):
       raise NotImplementedError('this pointer should be int or tuple')
 
   def __del__(self):
+    self.close()
+
+  def close(self):
+    """Free the native tree; the object cannot be used afterwards."""
+    if getattr(self, 'this', None) is None:
+      return
+    self.stop_rebalancer()
+    self.disable_cache()
+    self.disable_routing()
+    if getattr(self, 'density', None) is not None:
+      sgtreec.density_delete(self.density)
+      self.density = None
+    self.stop_tracing()
     sgtreec.delete(self.this)
+    self.this = None
+    self.root = None
 
   def __reduce__(self):
     buff = self.serialize()
     return (NNS_L2.from_string, (buff,))
+
+  def __reduce_ex__(self, protocol):
+    # protocol 5 lets the serialized tree travel as an out-of-band buffer;
+    # subclasses only override __reduce__, whose first argument is the tree
+    fn, args = self.__reduce__()
+    if protocol >= 5:
+      return (fn, (pickle.PickleBuffer(args[0]),) + tuple(args[1:]))
+    return (fn, args)
     
   def __len__(self):
     return sgtreec.size(self.this)
 
   @classmethod
-  def from_matrix(cls, points, trunc=-1, use_multi_core=-1, new_base=1.3):
-    ptr = sgtreec.new(points, trunc, use_multi_core, new_base)
+  def from_matrix(cls, points, trunc=-1, use_multi_core=-1, new_base=1.3, medoid_sample=0, progress=None):
+    """Build from a 2D matrix; new_base='auto' picks the base with tune_base()
+    and logs its report at INFO level.
+    medoid_sample > 0 estimates the mean and root from that many random points.
+    progress, a graphgrove.progress.Progress, counts the inserts and may cancel the build."""
+    if new_base == 'auto':
+      new_base, report = cls.tune_base(points, use_multi_core=use_multi_core)
+      logging.getLogger(__name__).info(report)
+    ptr = sgtreec.new(points, trunc, use_multi_core, new_base, medoid_sample,
+                      0 if progress is None else progress.handle(sgtreec))
     return cls(ptr)
 
+  @staticmethod
+  def tune_base(points, candidates=(1.1, 1.2, 1.3, 1.5, 1.7, 2.0), sample_size=20000,
+                num_queries=500, k=10, use_multi_core=-1):
+    """Build trial trees on a sample at each candidate base and return
+    (base, report) for the lowest predicted kNN time per query at the full
+    size of points: the microseconds per query measured on the larger
+    sample, scaled by how fast distance evaluations grow with size."""
+    return sgtreec.tune_base(points, np.asarray(candidates, dtype=np.float64),
+                             sample_size, num_queries, k, use_multi_core)
+
   @classmethod
   def from_string(cls, buff):
     ptr = sgtreec.deserialize(buff)
     return cls(ptr)
 
-  def insert(self, point, uid=None, use_multi_core=-1):
+  def insert(self, point, uid=None, use_multi_core=-1, progress=None):
     if len(point.shape) == 1:
       return sgtreec.insert(self.this, point, -1 if uid is None else uid)
     elif len(point.shape) == 2:
       if uid is None:
         N = sgtreec.size(self.this)
         uid = np.arange(N, N + point.shape[0])
-      return sgtreec.batchinsert(self.this, point, uid, use_multi_core)
+      return sgtreec.batchinsert(self.this, point, uid, use_multi_core,
+                                 0 if progress is None else progress.handle(sgtreec))
     else:
       print("Points to be inserted should be 1D or 2D matrix!")
 
   def remove(self, point):
     return sgtreec.remove(self.this, point)
 
-  def NearestNeighbour(self, points, use_multi_core=-1, return_points=False, filename='traces.json'):
+  def NearestNeighbour(self, points, use_multi_core=-1, return_points=False, filename=None):
+    """Nearest neighbours of points. Queries are traced as sampled by
+    start_tracing(); with filename, every query of this call is traced and
+    written there instead (see read_traces)."""
+    if filename is not None:
+      tracer = sgtreec.tracer_new(1, 1 << 20)
+      try:
+        ret_val = sgtreec.NearestNeighbour(self.this, points, use_multi_core,
+                                           return_points, tracer)
+        sgtreec.tracer_dump(tracer, filename)
+      finally:
+        sgtreec.tracer_delete(tracer)
+      return ret_val
     return sgtreec.NearestNeighbour(self.this, points, use_multi_core,
-                                       return_points, filename)
+                                       return_points, getattr(self, 'tracer', None) or 0)
+
+  def start_tracing(self, sample_every=1000, capacity=1 << 16):
+    """Record the path of one in sample_every NearestNeighbour queries per
+    thread, keeping the last capacity steps of each thread."""
+    self.stop_tracing()
+    self.tracer = sgtreec.tracer_new(sample_every, capacity)
+
+  def dump_traces(self, filename):
+    """Write the recorded paths in binary form; returns the number of queries sampled."""
+    return sgtreec.tracer_dump(self.tracer, filename)
+
+  def stop_tracing(self):
+    if getattr(self, 'tracer', None) is not None:
+      sgtreec.tracer_delete(self.tracer)
+      self.tracer = None
 
   def kNearestNeighbours(self,
                          points,
                          k=10,
                          use_multi_core=-1,
-                         return_points=False):
+                         return_points=False,
+                         expand_duplicates=False):
+    """With expand_duplicates, exact duplicates count as neighbours of their
+    own (results are padded with -1 and inf if the tree is smaller than k)."""
+    if expand_duplicates:
+      return sgtreec.kNearestNeighboursExpanded(self.this, points, k, use_multi_core)
+    if getattr(self, 'cache', None) is not None and not return_points:
+      return sgtreec.cache_knn(self.cache, points, k, 0, use_multi_core)
+    if getattr(self, 'routing', None) is not None and not return_points:
+      return sgtreec.routing_knn(self.routing, points, k, use_multi_core)
     return sgtreec.kNearestNeighbours(self.this, points, k, use_multi_core,
                                          return_points)
 
+  def kNearestNeighboursParallel(self, points, k=10, use_multi_core=-1):
+    """Exact kNN for a few latency sensitive queries: each query in turn splits
+    the subtrees left after a breadth first start over use_multi_core threads,
+    which share the best k-th distance found so far for pruning."""
+    return sgtreec.kNearestNeighboursParallel(self.this, points, k, use_multi_core)
+
   def kNearestNeighboursBeam(self,
                          points,
                          k=10,
                          beam_size=100,
                          use_multi_core=-1,
                          return_points=False):
+    if getattr(self, 'cache', None) is not None and not return_points:
+      return sgtreec.cache_knn(self.cache, points, k, beam_size, use_multi_core)
     return sgtreec.kNearestNeighboursBeam(self.this, points, k, use_multi_core,
                                          return_points, beam_size)
 
+  def kNearestNeighboursMulti(self, queries, k=10, use_multi_core=-1):
+    """k nearest neighbours of every vector of multi-vector queries, shaped
+    (m, dim) or (n, m, dim); the vectors of a query share one traversal.
+    Returns uids and dists shaped (m, k) or (n, m, k)."""
+    queries = np.ascontiguousarray(queries, dtype=np.float32)
+    uids, dists = sgtreec.kNearestNeighboursMulti(self.this, queries, k, use_multi_core)
+    if queries.ndim == 2:
+      return uids[0], dists[0]
+    return uids, dists
+
+  def multi_vector_search(self, queries, k=10, doc_ids=None, reduction='maxsim', num_docs=10, use_multi_core=-1):
+    """Rank documents for multi-vector queries shaped (m, dim) or (n, m, dim).
+
+    doc_ids maps every UID to its document (UIDs are documents if None). Each
+    retrieved vector scores r - dist, where r is the distance of the k-th
+    neighbour of its query vector. 'maxsim' sums the best score per query
+    vector and document, 'sum' adds all of them. Returns documents and scores
+    shaped (num_docs,) or (n, num_docs), padded with -1 and -inf.
+    """
+    queries = np.ascontiguousarray(queries, dtype=np.float32)
+    if reduction not in ('maxsim', 'sum'):
+      raise ValueError("reduction must be 'maxsim' or 'sum'")
+    docs, scores = sgtreec.MultiVectorSearch(self.this, queries, k, doc_ids,
+                                             1 if reduction == 'sum' else 0, num_docs, use_multi_core)
+    if queries.ndim == 2:
+      return docs[0], scores[0]
+    return docs, scores
+
+  def enable_cache(self, capacity=65536, shards=16, quantum=0.0):
+    """Answer repeated kNN queries from a result cache, invalidated by inserts.
+    With quantum > 0 queries are rounded to multiples of quantum, so
+    near-duplicates share one (approximate) answer."""
+    self.disable_cache()
+    self.cache = sgtreec.cache_new(self.this, capacity, shards, quantum)
+
+  def cache_stats(self):
+    """Return hits, misses, stale (misses invalidated by inserts) and size."""
+    if getattr(self, 'cache', None) is None:
+      return None
+    return sgtreec.cache_stats(self.cache)
+
+  def disable_cache(self):
+    if getattr(self, 'cache', None) is not None:
+      sgtreec.cache_delete(self.cache)
+      self.cache = None
+
+  def enable_routing(self, levels=3):
+    """Answer exact kNN queries from a flat copy of the top levels of the tree,
+    whose distances to a block of queries take one matrix product. The copy
+    is rebuilt by the first query after the tree changes."""
+    self.disable_routing()
+    self.routing = sgtreec.routing_new(self.this, levels)
+
+  def routing_size(self):
+    """Number of nodes in the routing table."""
+    if getattr(self, 'routing', None) is None:
+      return 0
+    return sgtreec.routing_size(self.routing)
+
+  def disable_routing(self):
+    if getattr(self, 'routing', None) is not None:
+      sgtreec.routing_delete(self.routing)
+      self.routing = None
+
+  def _density_index(self):
+    if getattr(self, 'density', None) is None:
+      self.density = sgtreec.density_new(self.this)
+    return self.density
+
+  def RangeCount(self, points, r=1.0, use_multi_core=-1):
+    """Number of points (with their duplicates) closer than r to every query;
+    subtrees entirely inside or outside the radius are counted at once."""
+    return sgtreec.density_count(self._density_index(), points, r, use_multi_core)
+
+  def KernelDensity(self, points, bandwidth=1.0, atol=1e-4, use_multi_core=-1):
+    """Sum of exp(-|x - q|^2 / (2 bandwidth^2)) over all points x for every query q,
+    and a bound on its error. Subtrees whose kernel values differ by at most
+    2 atol are summed at once, so each point is off by at most atol; divide by
+    len(tree) times (2 pi bandwidth^2)^(dim/2) for a normalized density."""
+    return sgtreec.density_kernel(self._density_index(), points, bandwidth, atol, use_multi_core)
+
   def RangeSearch(self,
                   points,
                   r=1.0,
                   use_multi_core=-1,
-                  return_points=False):
+                  return_points=False,
+                  expand_duplicates=False):
+    if expand_duplicates:
+      return sgtreec.RangeSearchExpanded(self.this, points, r, use_multi_core)
     return sgtreec.RangeSearch(self.this, points, r, use_multi_core,
                                   return_points)
 
+  def knn_update(self, points, uids, k, use_multi_core=-1):
+    """For a batch of points already inserted with uids, return their k
+    nearest neighbours (indices, dists), excluding themselves, and the reverse
+    edges (rows, cols, dists): points of earlier batches whose k nearest
+    neighbours now include the point cols of this batch. Neighbour lists are
+    tracked in the tree from the first call on."""
+    indices, dists, rows, cols, rdists = sgtreec.kNearestNeighboursUpdate(
+        self.this, points, np.asarray(uids, dtype=np.int64), k, use_multi_core)
+    return indices, dists, (rows, cols, rdists)
+
   def serialize(self):
     return sgtreec.serialize(self.this)
 
@@ -143,12 +356,281 @@ class NNS_L2(object):
   def test_nesting(self):
     return sgtreec.test_nesting(self.this)
 
+  def verify(self, checks=('covering', 'separation', 'nesting', 'maxdist', 'levels'),
+             use_multi_core=-1, max_report=10, early_exit=False):
+    """Check tree invariants on all cores, e.g. after a build, merge or rebalance.
+
+    covering: children within the covering distance of their parent,
+    separation: siblings further apart than the separating distance,
+    nesting: copies of a node below itself hold the same point,
+    maxdist: every descendant within maxdistUB of a node,
+    levels: children one level below their parent.
+    Returns (nodes checked, violations found, complete, first violations),
+    each violation a (check, uid, other uid, level, dist, bound) tuple; with
+    early_exit the check stops after max_report violations. Must not run
+    concurrently with inserts.
+    """
+    names = ('covering', 'separation', 'nesting', 'maxdist', 'levels')
+    unknown = set(checks) - set(names)
+    if unknown:
+      raise ValueError('unknown checks: {}'.format(sorted(unknown)))
+    mask = sum(1 << i for i, name in enumerate(names) if name in checks)
+    return sgtreec.verify(self.this, mask, use_multi_core, max_report, early_exit)
+
   def spreadout(self, k):
     return sgtreec.spreadout(self.this, k)
   
   def get_root(self):
     return Node(sgtreec.get_root(self.this))
 
+  def share(self, name, visits=None, hot_bytes=0):
+    """Write a read-only image to shared memory (name without '/') or a file.
+
+    visits, the (uids, levels, counts) of SharedNNS_L2.visit_counts(), lays
+    out the nodes on frequent query paths first; the leading nodes that fit in
+    hot_bytes can then be locked in memory with SharedNNS_L2.lock_hot()."""
+    return SharedNNS_L2.create(self, name, visits, hot_bytes)
+
+  def optimize_layout(self, name, sample, k=10, hot_bytes=1 << 20, use_multi_core=-1):
+    """Share the tree with the nodes visited most by the k nearest neighbour
+    queries of sample (e.g. a sample of the query log) laid out first."""
+    replay = SharedNNS_L2.create(self, name + '.replay')
+    replay.unlink()
+    replay.count_visits()
+    replay.kNearestNeighbours(sample, k, use_multi_core)
+    visits = replay.visit_counts()
+    del replay
+    return self.share(name, visits, hot_bytes)
+
+  def merge(self, other, uid_offset=0, use_multi_core=-1):
+    """Move all points of other, e.g. a shard built independently with the
+    same base, into this tree; uid_offset is added to their uids. Subtrees of
+    other are attached whole wherever they fit. other is closed afterwards."""
+    other.stop_rebalancer()
+    sgtreec.merge(self.this, other.this, uid_offset, use_multi_core)
+    other.close()
+
+  def rebalance(self, max_subtrees=4, threshold=2.0, min_size=64, use_multi_core=-1):
+    """Rebuild up to max_subtrees subtrees whose query cost is more than
+    threshold times the median; returns the number rebuilt. Node objects
+    below a rebuilt subtree root are invalidated."""
+    return sgtreec.rebalance(self.this, max_subtrees, threshold, min_size, use_multi_core)
+
+  def start_rebalancer(self, interval=60.0, max_subtrees=4, threshold=2.0, min_size=64, use_multi_core=1):
+    """Run rebalance() every interval seconds in a background thread."""
+    self.stop_rebalancer()
+    self.rebalancer = sgtreec.rebalancer_start(self.this, int(interval * 1000), max_subtrees,
+                                               threshold, min_size, use_multi_core)
+
+  def rebalancer_stats(self):
+    """Return (passes, subtrees rebuilt) of the background rebalancer."""
+    if getattr(self, 'rebalancer', None) is None:
+      return (0, 0)
+    return sgtreec.rebalancer_stats(self.rebalancer)
+
+  def stop_rebalancer(self):
+    if getattr(self, 'rebalancer', None) is not None:
+      sgtreec.rebalancer_stop(self.rebalancer)
+      self.rebalancer = None
+
+class AsyncNNS_L2(object):
+  """Micro-batching front end for single kNN queries from many threads.
+
+  submit() returns a concurrent.futures.Future resolved with (uids, dists).
+  A native dispatcher collects up to max_batch queries, waiting at most
+  max_wait_us for the batch to fill, and answers them together.
+  """
+
+  def __init__(self, tree, max_batch=64, max_wait_us=200, use_multi_core=-1):
+    self.tree = tree  # keeps the tree alive while queries are pending
+    self.this = sgtreec.batcher_start(tree.this, max_batch, max_wait_us, use_multi_core)
+
+  def __del__(self):
+    self.close()
+
+  def close(self):
+    """Answer all submitted queries and stop the dispatcher."""
+    if getattr(self, 'this', None) is not None:
+      sgtreec.batcher_stop(self.this)
+      self.this = None
+
+  def submit(self, point, k=10):
+    future = concurrent.futures.Future()
+    sgtreec.batcher_submit(self.this, np.ascontiguousarray(point, dtype=np.float32), k, future)
+    return future
+
+  async def kNearestNeighbours(self, point, k=10):
+    return await asyncio.wrap_future(self.submit(point, k))
+
+  def stats(self):
+    """Return (batches, queries) answered so far."""
+    return sgtreec.batcher_stats(self.this)
+
+class InsertLog(object):
+  """Write-ahead log of insertions into an NNS_L2 tree.
+
+  Batches are appended to the log before they are inserted, with fsync
+  batched every sync_bytes or sync_ms. checkpoint() snapshots the tree and
+  truncates the log; recover() rebuilds a tree from the snapshot and the log.
+  """
+
+  def __init__(self, path, dim, sync_bytes=1 << 20, sync_ms=100):
+    self.this = None
+    self.this = sgtreec.log_open(path, dim, sync_bytes, sync_ms)
+    self.path = path
+
+  def __del__(self):
+    self.close()
+
+  def __len__(self):
+    return sgtreec.log_size(self.this)
+
+  def close(self):
+    if self.this is not None:
+      sgtreec.log_close(self.this)
+      self.this = None
+
+  def insert(self, tree, points, uids=None, use_multi_core=-1):
+    """Log and insert a 2D batch; returns the number of points not inserted."""
+    if uids is None:
+      N = len(tree)
+      uids = np.arange(N, N + points.shape[0])
+    return sgtreec.log_batchinsert(self.this, tree.this, points, uids.astype(np.int64), use_multi_core)
+
+  def sync(self):
+    return sgtreec.log_sync(self.this)
+
+  def checkpoint(self, tree, snapshot_path):
+    return sgtreec.log_checkpoint(self.this, tree.this, snapshot_path)
+
+  @staticmethod
+  def recover(snapshot_path, log_path, use_multi_core=-1):
+    return NNS_L2(sgtreec.log_recover(snapshot_path, log_path, use_multi_core))
+
+class SharedNNS_L2(object):
+  """Read-only SGTree mapped from shared memory or a file.
+
+  Every process attaching the same name maps the same physical pages, and
+  pickling passes only the name, so forked or spawned workers share a single
+  copy of the index. Names without '/' live in /dev/shm.
+  """
+
+  def __init__(self, this, name):
+    self.this = this
+    self.name = name
+
+  def __del__(self):
+    sgtreec.detach(self.this)
+
+  def __reduce__(self):
+    return (SharedNNS_L2.attach, (self.name,))
+
+  def __len__(self):
+    return sgtreec.shared_size(self.this)
+
+  @classmethod
+  def create(cls, tree, name, visits=None, hot_bytes=0):
+    if visits is None:
+      shared = sgtreec.share(tree.this, name)
+    else:
+      uids, levels, counts = visits
+      shared = sgtreec.share(tree.this, name, np.ascontiguousarray(uids, dtype=np.uint32),
+                             np.ascontiguousarray(levels, dtype=np.int32),
+                             np.ascontiguousarray(counts, dtype=np.uint64), hot_bytes)
+    if not shared:
+      raise sgtreec.error('cannot share SG Tree as {}'.format(name))
+    return cls.attach(name)
+
+  @classmethod
+  def attach(cls, name):
+    return cls(sgtreec.attach(name), name)
+
+  def unlink(self):
+    """Remove the backing image; attached handles stay valid."""
+    return sgtreec.unlink(self.name)
+
+  def count_visits(self, enable=True):
+    """Count the nodes visited by queries of this handle from now on; False stops and clears."""
+    sgtreec.shared_count_visits(self.this, enable)
+
+  def visit_counts(self):
+    """(uids, levels, counts) of the visited nodes, see NNS_L2.share."""
+    return sgtreec.shared_visit_counts(self.this)
+
+  def lock_hot(self):
+    """mlock the pages of the hot nodes; False if e.g. RLIMIT_MEMLOCK is too low."""
+    return sgtreec.shared_lock_hot(self.this)
+
+  @property
+  def hot_size(self):
+    return sgtreec.shared_hot_size(self.this)
+
+  def NearestNeighbour(self, points, use_multi_core=-1, return_points=False):
+    return sgtreec.shared_NearestNeighbour(self.this, points, use_multi_core,
+                                           return_points)
+
+  def kNearestNeighbours(self,
+                         points,
+                         k=10,
+                         use_multi_core=-1,
+                         return_points=False):
+    return sgtreec.shared_kNearestNeighbours(self.this, points, k, use_multi_core,
+                                             return_points)
+
+  def kNearestNeighboursBeam(self,
+                         points,
+                         k=10,
+                         beam_size=100,
+                         use_multi_core=-1,
+                         return_points=False):
+    return sgtreec.shared_kNearestNeighboursBeam(self.this, points, k, use_multi_core,
+                                                 return_points, beam_size)
+
+  def RangeSearch(self, points, r=1.0, use_multi_core=-1):
+    return sgtreec.shared_RangeSearch(self.this, points, r, use_multi_core)
+
+class FlatIndex(object):
+  """Exact brute force search, for small sets, ground truth and re-ranking.
+
+  metric is 'l2' (distances, smallest first), 'ip' (inner products) or
+  'cosine' (largest first). Points get UIDs 0, 1, ... in the order they are
+  added. Scores of query blocks against point blocks come from one matrix
+  product each, with a running top k per query.
+  """
+
+  _METRICS = {'l2': 0, 'ip': 1, 'cosine': 2}
+
+  def __init__(self, dim, metric='l2'):
+    if metric not in FlatIndex._METRICS:
+      raise ValueError("metric must be 'l2', 'ip' or 'cosine'")
+    self.metric = metric
+    self.this = sgtreec.flat_new(dim, FlatIndex._METRICS[metric])
+
+  def __del__(self):
+    if getattr(self, 'this', None) is not None:
+      sgtreec.flat_delete(self.this)
+
+  def __len__(self):
+    return sgtreec.flat_size(self.this)
+
+  @classmethod
+  def from_matrix(cls, points, metric='l2'):
+    index = cls(points.shape[1], metric)
+    index.add(points)
+    return index
+
+  def add(self, points):
+    return sgtreec.flat_add(self.this, np.ascontiguousarray(points, dtype=np.float32))
+
+  def search(self, queries, k=10, use_multi_core=-1):
+    """UIDs and scores of the k best points per query, padded with -1."""
+    return sgtreec.flat_search(self.this, np.ascontiguousarray(queries, dtype=np.float32), k, use_multi_core)
+
+  def rerank(self, queries, candidates, k=10, use_multi_core=-1):
+    """Exact scores of one row of candidate UIDs per query (-1 is skipped), best k first."""
+    return sgtreec.flat_search(self.this, np.ascontiguousarray(queries, dtype=np.float32), k, use_multi_core,
+                               np.ascontiguousarray(candidates, dtype=np.int64))
+
 class MIPS(NNS_L2):
   """SGTree Class for maximum inner product search."""
 
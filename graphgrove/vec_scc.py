@@ -21,7 +21,7 @@ import numpy as np
 
 
 class Cosine_SCC(object):
-  def __init__(self, k=25, num_rounds=50, thresholds=None, index_name='cosine_sgtree', cores=12, cc_alg=0, par_minimum=100000, verbosity=0, beam_size=100, hnsw_max_degree=200, hnsw_ef_search=200, hnsw_ef_construction=200):
+  def __init__(self, k=25, num_rounds=50, thresholds=None, index_name='cosine_sgtree', cores=12, cc_alg=0, par_minimum=100000, verbosity=0, beam_size=100, hnsw_max_degree=200, hnsw_ef_search=200, hnsw_ef_construction=200, reverse_neighbors=False):
     self.k = k
     self.num_rounds = num_rounds
     self.thresholds = thresholds
@@ -46,7 +46,7 @@ class Cosine_SCC(object):
     if self.index_name.lower() == 'cosine_covertree':
       self.index = graph_builder.Cosine_CoverTree(self.k, self.cores)
     elif self.index_name.lower() == 'cosine_sgtree':
-      self.index = graph_builder.Cosine_SGTree(self.k, self.cores)
+      self.index = graph_builder.Cosine_SGTree(self.k, self.cores, reverse_neighbors=reverse_neighbors)
     elif self.index_name.lower() == 'cosine_sgtreebeam':
      self.index = graph_builder.Cosine_SGTreeBeam(self.k, cores=self.cores, beam_size=self.beam_size)
     elif self.index_name.lower() == 'cosine_faissflat':
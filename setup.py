@@ -40,7 +40,7 @@ class build_ext(_build_ext):
 
 
 sgtreec_module = Extension('sgtreec',
-        sources = ['src/sg_tree/sgtreecmodule.cxx', 'src/sg_tree/utils.cpp',  'src/sg_tree/sg_tree.cpp'],
+        sources = ['src/sg_tree/sgtreecmodule.cxx', 'src/sg_tree/utils.cpp',  'src/sg_tree/sg_tree.cpp', 'src/sg_tree/flat_sg_tree.cpp', 'src/sg_tree/insert_log.cpp', 'src/sg_tree/rebalancer.cpp', 'src/sg_tree/query_batcher.cpp', 'src/sg_tree/query_cache.cpp', 'src/sg_tree/query_tracer.cpp', 'src/sg_tree/routing_table.cpp', 'src/sg_tree/density_index.cpp', 'src/sg_tree/flat_index.cpp'],
         include_dirs=['lib/'],
         extra_compile_args=['-march=corei7-avx', '-pthread', '-std=c++14'], #, '-DPRINTVER'], #, '-D_FLOAT64_VER_'],
         extra_link_args=['-march=corei7-avx', '-pthread', '-std=c++14'] #,'-DPRINTVER'] #, '-D_FLOAT64_VER_'], #'-D_FLOAT64_VER_', '-DPRINTVER'
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ * Copyright (c) 2021 The authors of SCC All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stages of the offline clustering pipeline of dist/cluster:
+ *
+ *   corpus (.npy / .fvecs) -> SG Tree -> kNN graph (CSR) -> SCC or LLAMA -> labels
+ *
+ * Each stage lives in its own translation unit because the utils.h headers
+ * of SG Tree, SCC and LLAMA share an include guard; this header only uses
+ * standard types. Stages report failures by throwing std::runtime_error.
+ */
+
+#ifndef _CLUSTER_H
+#define _CLUSTER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace cluster
+{
+    // Dense float32 vectors, one per row
+    struct Corpus
+    {
+        const float* data = nullptr;
+        size_t n = 0;
+        size_t d = 0;
+
+        void* map = nullptr;            // mmapped .npy file backing data
+        size_t map_len = 0;
+        std::vector<float> owned;       // data when it had to be copied
+
+        Corpus() = default;
+        Corpus(const Corpus&) = delete;
+        Corpus& operator=(const Corpus&) = delete;
+        ~Corpus();
+
+        // Take a private copy of data, e.g. to normalize it
+        float* own();
+    };
+
+    // .npy (float32, C order, 2D) files are mapped, .fvecs files are copied
+    void load_corpus(const std::string& filename, Corpus& corpus);
+    void normalize(Corpus& corpus);
+
+    // Up to k neighbours per vertex, excluding the vertex itself. Identical points
+    // share one vertex, weighted by the number of points it stands for
+    struct KnnGraph
+    {
+        size_t n = 0;                   // vertices
+        unsigned k = 0;                 // most neighbours of a row
+        std::vector<uint64_t> offsets;  // n + 1, row i is [offsets[i], offsets[i+1])
+        std::vector<uint32_t> cols;
+        std::vector<float> sims;
+
+        size_t num_points = 0;
+        std::vector<uint32_t> vertex;   // vertex of each point, empty if there are no duplicates
+        std::vector<float> counts;      // points per vertex, empty if there are no duplicates
+    };
+
+    // Similarities are 1 - d^2/2 (cosine for unit vectors) or -d (l2)
+    void knn_graph(const Corpus& corpus, unsigned k, bool cosine, unsigned cores, double base, KnnGraph& graph);
+
+    // Writes a uint32 matrix row by row, as .npy or as raw binary:
+    //   "GGLB" | uint32 format | uint64 rows | uint64 cols | rows * cols uint32
+    class LabelWriter
+    {
+        FILE* fp = nullptr;
+        std::string filename;
+        bool npy;
+    public:
+        LabelWriter(const std::string& filename, bool npy);
+        LabelWriter(const LabelWriter&) = delete;
+        LabelWriter& operator=(const LabelWriter&) = delete;
+        ~LabelWriter();
+
+        void begin(uint64_t rows, uint64_t cols);
+        void write(const uint32_t* values, size_t count);
+        void close();
+    };
+
+    // Writes one row of num_points labels per level, level 0 first
+    void run_scc(const KnnGraph& graph, const std::vector<float>& thresholds, unsigned cores, LabelWriter& out);
+
+    // Writes one (round, node, point) row per point of each node of each round
+    void run_llama(const KnnGraph& graph, unsigned num_rounds, std::vector<float> thresholds, unsigned linkage,
+                   unsigned max_num_parents, unsigned max_num_neighbors, unsigned cores, LabelWriter& out);
+}
+
+#endif  // _CLUSTER_H
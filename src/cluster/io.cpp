@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ * Copyright (c) 2021 The authors of SCC All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cluster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cluster
+{
+
+/****************************** Corpus *************************************/
+
+Corpus::~Corpus()
+{
+    if (map != nullptr)
+        munmap(map, map_len);
+}
+
+float* Corpus::own()
+{
+    if (owned.empty() || data != owned.data())
+    {
+        owned.assign(data, data + n * d);
+        data = owned.data();
+        if (map != nullptr)
+        {
+            munmap(map, map_len);
+            map = nullptr;
+        }
+    }
+    return owned.data();
+}
+
+static bool ends_with(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Value of key in the python dict literal of an .npy header
+static std::string npy_field(const std::string& header, const std::string& key)
+{
+    size_t pos = header.find("'" + key + "'");
+    if (pos == std::string::npos)
+        throw std::runtime_error("npy header has no " + key);
+    pos = header.find(':', pos) + 1;
+    while (pos < header.size() && header[pos] == ' ')
+        ++pos;
+    size_t end = header[pos] == '(' ? header.find(')', pos) + 1 : header.find(',', pos);
+    return header.substr(pos, end - pos);
+}
+
+static void load_npy(const std::string& filename, Corpus& corpus)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("cannot open " + filename);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 10)
+    {
+        ::close(fd);
+        throw std::runtime_error(filename + " is not an npy file");
+    }
+    corpus.map_len = size_t(st.st_size);
+    corpus.map = mmap(nullptr, corpus.map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (corpus.map == MAP_FAILED)
+    {
+        corpus.map = nullptr;
+        throw std::runtime_error("cannot map " + filename);
+    }
+
+    const char* buff = static_cast<const char*>(corpus.map);
+    if (std::memcmp(buff, "\x93NUMPY", 6) != 0)
+        throw std::runtime_error(filename + " is not an npy file");
+    size_t header_len, offset;
+    if (buff[6] == 1)
+    {
+        uint16_t len;
+        std::memcpy(&len, buff + 8, sizeof(len));
+        header_len = len;
+        offset = 10;
+    }
+    else
+    {
+        uint32_t len;
+        std::memcpy(&len, buff + 8, sizeof(len));
+        header_len = len;
+        offset = 12;
+    }
+    if (offset + header_len > corpus.map_len)
+        throw std::runtime_error(filename + " has a truncated npy header");
+    std::string header(buff + offset, header_len);
+
+    if (npy_field(header, "descr") != "'<f4'")
+        throw std::runtime_error(filename + " must hold float32 values");
+    if (npy_field(header, "fortran_order") != "False")
+        throw std::runtime_error(filename + " must be in C order");
+    size_t rows = 0, cols = 0;
+    if (std::sscanf(npy_field(header, "shape").c_str(), "(%zu, %zu)", &rows, &cols) != 2)
+        throw std::runtime_error(filename + " must be a 2D array");
+
+    offset += header_len;
+    if (offset + rows * cols * sizeof(float) > corpus.map_len)
+        throw std::runtime_error(filename + " is truncated");
+    corpus.data = reinterpret_cast<const float*>(buff + offset);
+    corpus.n = rows;
+    corpus.d = cols;
+    madvise(corpus.map, corpus.map_len, MADV_SEQUENTIAL);
+}
+
+// Rows of int32 d | d * float32, read in chunks into a contiguous copy
+static void load_fvecs(const std::string& filename, Corpus& corpus)
+{
+    FILE* fp = fopen(filename.c_str(), "rb");
+    if (fp == NULL)
+        throw std::runtime_error("cannot open " + filename);
+    int32_t d = 0;
+    if (fread(&d, sizeof(d), 1, fp) != 1 || d <= 0)
+    {
+        fclose(fp);
+        throw std::runtime_error(filename + " is not an fvecs file");
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    size_t row_bytes = sizeof(int32_t) + size_t(d) * sizeof(float);
+    if (size_t(size) % row_bytes != 0)
+    {
+        fclose(fp);
+        throw std::runtime_error(filename + " does not hold vectors of one dimension");
+    }
+
+    corpus.n = size_t(size) / row_bytes;
+    corpus.d = size_t(d);
+    corpus.owned.resize(corpus.n * corpus.d);
+    std::vector<char> chunk(row_bytes * 4096);
+    for (size_t i = 0; i < corpus.n; )
+    {
+        size_t rows = std::min(corpus.n - i, size_t(4096));
+        if (fread(chunk.data(), row_bytes, rows, fp) != rows)
+        {
+            fclose(fp);
+            throw std::runtime_error("cannot read " + filename);
+        }
+        for (size_t r = 0; r < rows; ++r, ++i)
+        {
+            int32_t rd;
+            std::memcpy(&rd, chunk.data() + r * row_bytes, sizeof(rd));
+            if (rd != d)
+            {
+                fclose(fp);
+                throw std::runtime_error(filename + " does not hold vectors of one dimension");
+            }
+            std::memcpy(corpus.owned.data() + i * corpus.d, chunk.data() + r * row_bytes + sizeof(int32_t), corpus.d * sizeof(float));
+        }
+    }
+    fclose(fp);
+    corpus.data = corpus.owned.data();
+}
+
+void load_corpus(const std::string& filename, Corpus& corpus)
+{
+    if (ends_with(filename, ".fvecs"))
+        load_fvecs(filename, corpus);
+    else
+        load_npy(filename, corpus);
+    if (corpus.n < 2 || corpus.d == 0)
+        throw std::runtime_error(filename + " must hold at least two vectors");
+}
+
+void normalize(Corpus& corpus)
+{
+    float* data = corpus.own();
+    for (size_t i = 0; i < corpus.n; ++i)
+    {
+        float* row = data + i * corpus.d;
+        double norm = 0;
+        for (size_t j = 0; j < corpus.d; ++j)
+            norm += double(row[j]) * row[j];
+        if (norm > 0)
+        {
+            float scale = float(1.0 / std::sqrt(norm));
+            for (size_t j = 0; j < corpus.d; ++j)
+                row[j] *= scale;
+        }
+    }
+}
+
+/****************************** Labels *************************************/
+
+LabelWriter::LabelWriter(const std::string& filename, bool npy)
+    : filename(filename), npy(npy)
+{
+    fp = fopen(filename.c_str(), "wb");
+    if (fp == NULL)
+        throw std::runtime_error("cannot write " + filename);
+}
+
+LabelWriter::~LabelWriter()
+{
+    if (fp != NULL)
+        fclose(fp);
+}
+
+void LabelWriter::begin(uint64_t rows, uint64_t cols)
+{
+    bool ok;
+    if (npy)
+    {
+        // version 1.0 header, padded so the data starts at a multiple of 64
+        std::string header = "{'descr': '<u4', 'fortran_order': False, 'shape': ("
+            + std::to_string(rows) + ", " + std::to_string(cols) + "), }";
+        size_t total = 10 + header.size() + 1;
+        header.append((64 - total % 64) % 64, ' ');
+        header.push_back('\n');
+        uint16_t len = uint16_t(header.size());
+        ok = fwrite("\x93NUMPY\x01\x00", 1, 8, fp) == 8 && fwrite(&len, sizeof(len), 1, fp) == 1
+            && fwrite(header.data(), 1, header.size(), fp) == header.size();
+    }
+    else
+    {
+        uint32_t format = 1;
+        ok = fwrite("GGLB", 1, 4, fp) == 4 && fwrite(&format, sizeof(format), 1, fp) == 1
+            && fwrite(&rows, sizeof(rows), 1, fp) == 1 && fwrite(&cols, sizeof(cols), 1, fp) == 1;
+    }
+    if (!ok)
+        throw std::runtime_error("cannot write " + filename);
+}
+
+void LabelWriter::write(const uint32_t* values, size_t count)
+{
+    if (fwrite(values, sizeof(uint32_t), count, fp) != count)
+        throw std::runtime_error("cannot write " + filename);
+}
+
+void LabelWriter::close()
+{
+    int status = fclose(fp);
+    fp = NULL;
+    if (status != 0)
+        throw std::runtime_error("cannot write " + filename);
+}
+
+}
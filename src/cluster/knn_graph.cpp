@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ * Copyright (c) 2021 The authors of SCC All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cluster.h"
+#include "../sg_tree/sg_tree.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+namespace cluster
+{
+
+void knn_graph(const Corpus& corpus, unsigned k, bool cosine, unsigned cores, double base, KnnGraph& graph)
+{
+    Eigen::Map<matrixType> points(const_cast<float*>(corpus.data), corpus.d, corpus.n);
+    std::unique_ptr<SGTree> tree(SGTree::from_matrix(points, -1, cores, base));
+
+    // the tree keeps identical points on one node; each node's point becomes a vertex
+    std::vector<uint32_t> owner(corpus.n);
+    std::vector<bool> is_rep(corpus.n, false);
+    size_t num_duplicates = 0;
+    std::vector<SGTree::Node*> stack(1, tree->get_root());
+    while (!stack.empty())
+    {
+        SGTree::Node* current = stack.back();
+        stack.pop_back();
+        owner[current->UID] = current->UID;
+        is_rep[current->UID] = true;
+        for (unsigned uid : current->dup_uids)
+            owner[uid] = current->UID;
+        num_duplicates += current->dup_uids.size();
+        stack.insert(stack.end(), current->children.begin(), current->children.end());
+    }
+
+    std::vector<uint32_t> reps;
+    graph.num_points = corpus.n;
+    graph.vertex.clear();
+    graph.counts.clear();
+    if (num_duplicates > 0)
+    {
+        std::vector<uint32_t> vid(corpus.n);
+        for (size_t i = 0; i < corpus.n; ++i)
+            if (is_rep[i])
+            {
+                vid[i] = uint32_t(reps.size());
+                reps.push_back(uint32_t(i));
+            }
+        graph.vertex.resize(corpus.n);
+        graph.counts.assign(reps.size(), 0.0f);
+        for (size_t i = 0; i < corpus.n; ++i)
+        {
+            graph.vertex[i] = vid[owner[i]];
+            graph.counts[graph.vertex[i]] += 1.0f;
+        }
+        if (reps.size() < 2)
+            throw std::runtime_error("the corpus must hold at least two distinct vectors");
+    }
+    size_t n = num_duplicates > 0 ? reps.size() : corpus.n;
+
+    // rows are filled in k slots each, then packed to the neighbours found
+    k = unsigned(std::min(size_t(k), n - 1));
+    graph.n = n;
+    graph.k = k;
+    graph.cols.resize(n * k);
+    graph.sims.resize(n * k);
+    std::vector<uint64_t> found(n, 0);
+
+    utils::parallel_for(0, n, [&](size_t i)->void{
+        size_t point = num_duplicates > 0 ? reps[i] : i;
+        std::vector<std::pair<SGTree::Node*, scalar>> nn = tree->kNearestNeighbours(points.col(point), k + 1);
+        size_t offset = i * k;
+        size_t end = offset + k;
+        for (const auto& p : nn)
+        {
+            // skip the point itself
+            if (offset == end || p.first == NULL)
+                break;
+            if (size_t(p.first->UID) == point)
+                continue;
+            graph.cols[offset] = num_duplicates > 0 ? graph.vertex[p.first->UID] : uint32_t(p.first->UID);
+            graph.sims[offset++] = cosine ? 1.0f - 0.5f * p.second * p.second : -p.second;
+        }
+        found[i] = offset - i * k;
+    }, cores);
+
+    graph.offsets.resize(n + 1);
+    graph.offsets[0] = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint64_t offset = graph.offsets[i];
+        graph.offsets[i + 1] = offset + found[i];
+        if (offset == uint64_t(i) * k)
+            continue;
+        std::copy(graph.cols.begin() + i * k, graph.cols.begin() + i * k + found[i], graph.cols.begin() + offset);
+        std::copy(graph.sims.begin() + i * k, graph.sims.begin() + i * k + found[i], graph.sims.begin() + offset);
+    }
+    graph.cols.resize(graph.offsets[n]);
+    graph.sims.resize(graph.offsets[n]);
+}
+
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ * Copyright (c) 2021 The authors of SCC All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+# include <algorithm>
+# include <chrono>
+# include <cmath>
+# include <cstring>
+# include <exception>
+# include <iostream>
+# include <stdexcept>
+# include <string>
+# include <thread>
+# include <vector>
+
+# include "cluster.h"
+
+static const char* usage =
+    "usage: cluster --input corpus.npy|corpus.fvecs --output labels.npy [options]\n"
+    "\n"
+    "  --algorithm scc|llama     clustering to run (default scc)\n"
+    "  --k K                     neighbours per point in the graph (default 25)\n"
+    "  --metric cosine|l2        similarity 1 - d^2/2 of unit vectors, or -d (default cosine)\n"
+    "  --normalized              input is already unit normed, do not copy it to normalize\n"
+    "  --cores N                 threads (default: all)\n"
+    "  --base B                  SG Tree base (default 1.3)\n"
+    "  --thresholds t1,t2,...    SCC / LLAMA thresholds, one per level or round\n"
+    "  --geomspace a,b,num       num thresholds geometrically spaced from a to b\n"
+    "                            (SCC default 1.0,0.001,50)\n"
+    "  --rounds R                LLAMA rounds (default 10)\n"
+    "  --linkage L               LLAMA linkage: 0 single, 1 average, 2 approx. average (default 2)\n"
+    "  --max-parents P           LLAMA parents per node (default 5)\n"
+    "  --max-neighbors M         LLAMA neighbours per node (default 100)\n"
+    "  --format npy|bin          output format (default npy)\n"
+    "\n"
+    "SCC writes a uint32 matrix with one row of point labels per level, LLAMA\n"
+    "one (round, node, point) row per point in each node of each round.\n";
+
+struct Options
+{
+    std::string input;
+    std::string output;
+    std::string algorithm = "scc";
+    unsigned k = 25;
+    bool cosine = true;
+    bool normalized = false;
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    double base = 1.3;
+    std::vector<float> thresholds;
+    unsigned rounds = 10;
+    unsigned linkage = 2;
+    unsigned max_parents = 5;
+    unsigned max_neighbors = 100;
+    bool npy = true;
+};
+
+static std::vector<float> parse_floats(const std::string& s)
+{
+    std::vector<float> values;
+    size_t pos = 0;
+    while (pos <= s.size())
+    {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos)
+            end = s.size();
+        values.push_back(std::stof(s.substr(pos, end - pos)));
+        pos = end + 1;
+    }
+    return values;
+}
+
+static Options parse_options(int argc, char** argv)
+{
+    Options opts;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto value = [&]()->std::string{
+            if (i + 1 >= argc)
+                throw std::runtime_error(arg + " needs a value");
+            return argv[++i];
+        };
+        if (arg == "--input")
+            opts.input = value();
+        else if (arg == "--output")
+            opts.output = value();
+        else if (arg == "--algorithm")
+            opts.algorithm = value();
+        else if (arg == "--k")
+            opts.k = unsigned(std::stoul(value()));
+        else if (arg == "--metric")
+        {
+            std::string metric = value();
+            if (metric != "cosine" && metric != "l2")
+                throw std::runtime_error("--metric must be cosine or l2");
+            opts.cosine = metric == "cosine";
+        }
+        else if (arg == "--normalized")
+            opts.normalized = true;
+        else if (arg == "--cores")
+            opts.cores = std::max(unsigned(std::stoul(value())), 1u);
+        else if (arg == "--base")
+            opts.base = std::stod(value());
+        else if (arg == "--thresholds")
+            opts.thresholds = parse_floats(value());
+        else if (arg == "--geomspace")
+        {
+            std::vector<float> g = parse_floats(value());
+            if (g.size() != 3 || g[0] <= 0 || g[1] <= 0 || g[2] < 1)
+                throw std::runtime_error("--geomspace needs a,b,num with a, b > 0");
+            size_t num = size_t(g[2]);
+            opts.thresholds.clear();
+            for (size_t t = 0; t < num; ++t)
+                opts.thresholds.push_back(num == 1 ? g[0] : float(g[0] * std::pow(double(g[1]) / g[0], double(t) / (num - 1))));
+        }
+        else if (arg == "--rounds")
+            opts.rounds = unsigned(std::stoul(value()));
+        else if (arg == "--linkage")
+            opts.linkage = unsigned(std::stoul(value()));
+        else if (arg == "--max-parents")
+            opts.max_parents = unsigned(std::stoul(value()));
+        else if (arg == "--max-neighbors")
+            opts.max_neighbors = unsigned(std::stoul(value()));
+        else if (arg == "--format")
+            opts.npy = value() != "bin";
+        else
+            throw std::runtime_error("unknown option " + arg);
+    }
+    if (opts.input.empty() || opts.output.empty())
+        throw std::runtime_error("--input and --output are required");
+    if (opts.algorithm != "scc" && opts.algorithm != "llama")
+        throw std::runtime_error("--algorithm must be scc or llama");
+    if (opts.algorithm == "scc" && opts.thresholds.empty())
+        for (size_t t = 0; t < 50; ++t)
+            opts.thresholds.push_back(float(std::pow(0.001, double(t) / 49)));
+    return opts;
+}
+
+// Wall clock time of each stage, reported on stderr
+class StageTimer
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+public:
+    void done(const char* stage)
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::cerr << "[cluster] " << stage << " "
+                  << std::chrono::duration<double>(now - start).count() << " s" << std::endl;
+        start = now;
+    }
+};
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || std::strcmp(argv[1], "--help") == 0 || std::strcmp(argv[1], "-h") == 0)
+    {
+        std::cerr << usage;
+        return argc < 2 ? 1 : 0;
+    }
+    try
+    {
+        Options opts = parse_options(argc, argv);
+        StageTimer timer;
+
+        // the corpus and the tree are released once the graph is built
+        cluster::KnnGraph graph;
+        {
+            cluster::Corpus corpus;
+            cluster::load_corpus(opts.input, corpus);
+            if (opts.cosine && !opts.normalized)
+                cluster::normalize(corpus);
+            timer.done("load");
+            std::cerr << "[cluster] " << corpus.n << " points of dimension " << corpus.d << std::endl;
+
+            cluster::knn_graph(corpus, opts.k, opts.cosine, opts.cores, opts.base, graph);
+            timer.done("knn graph");
+        }
+
+        cluster::LabelWriter out(opts.output, opts.npy);
+        if (opts.algorithm == "scc")
+            cluster::run_scc(graph, opts.thresholds, opts.cores, out);
+        else
+            cluster::run_llama(graph, opts.rounds, opts.thresholds, opts.linkage,
+                               opts.max_parents, opts.max_neighbors, opts.cores, out);
+        out.close();
+        timer.done(opts.algorithm == "scc" ? "scc" : "llama");
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "cluster: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Success
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ * Copyright (c) 2021 The authors of SCC All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cluster.h"
+#include "../llama/llama.h"
+
+#include <memory>
+#include <utility>
+
+namespace cluster
+{
+
+void run_llama(const KnnGraph& graph, unsigned num_rounds, std::vector<float> thresholds, unsigned linkage,
+               unsigned max_num_parents, unsigned max_num_neighbors, unsigned cores, LabelWriter& out)
+{
+    const scalar lowest_value = -10000.0;
+    thresholds.resize(num_rounds, lowest_value);
+
+    std::vector<uint32_t> rows(graph.cols.size());
+    for (size_t i = 0; i < graph.n; ++i)
+        for (uint64_t e = graph.offsets[i]; e < graph.offsets[i + 1]; ++e)
+            rows[e] = uint32_t(i);
+    std::vector<Eigen::VectorXf::Scalar> sims(graph.sims.begin(), graph.sims.end());
+    std::unique_ptr<LLAMA> llama(LLAMA::from_graph(std::move(rows), graph.cols, std::move(sims), linkage, num_rounds,
+                                                   thresholds.data(), cores, max_num_parents, max_num_neighbors, lowest_value));
+    // single linkage does not depend on counts, set average counts each vertex once
+    if (!graph.counts.empty() && linkage == 2)
+        llama->set_point_counts(std::vector<scalar>(graph.counts.begin(), graph.counts.end()));
+    llama->cluster();
+    llama->set_descendants();
+
+    // points of each vertex, [members_offsets[v], members_offsets[v+1])
+    std::vector<uint32_t> members_offsets, members;
+    if (!graph.vertex.empty())
+    {
+        members_offsets.assign(graph.n + 1, 0);
+        for (uint32_t v : graph.vertex)
+            members_offsets[v + 1]++;
+        for (size_t v = 0; v < graph.n; ++v)
+            members_offsets[v + 1] += members_offsets[v];
+        members.resize(graph.vertex.size());
+        std::vector<uint32_t> next(members_offsets.begin(), members_offsets.end() - 1);
+        for (size_t p = 0; p < graph.vertex.size(); ++p)
+            members[next[graph.vertex[p]]++] = uint32_t(p);
+    }
+
+    size_t total = 0;
+    for (size_t r = 0; r < llama->all_node2descendants_len; ++r)
+        for (size_t m = 0; m < llama->number_of_active_ids[r]; ++m)
+            for (node_id_t v : llama->all_node2descendants[r][m])
+                total += members.empty() ? 1 : members_offsets[v + 1] - members_offsets[v];
+
+    out.begin(total, 3);
+    std::vector<uint32_t> buff;
+    for (size_t r = 0; r < llama->all_node2descendants_len; ++r)
+    {
+        buff.clear();
+        for (size_t m = 0; m < llama->number_of_active_ids[r]; ++m)
+            for (node_id_t v : llama->all_node2descendants[r][m])
+            {
+                uint32_t first = members.empty() ? v : members_offsets[v];
+                uint32_t last = members.empty() ? v + 1 : members_offsets[v + 1];
+                for (uint32_t i = first; i < last; ++i)
+                {
+                    buff.push_back(uint32_t(r));
+                    buff.push_back(uint32_t(m));
+                    buff.push_back(members.empty() ? i : members[i]);
+                }
+            }
+        out.write(buff.data(), buff.size());
+    }
+}
+
+}
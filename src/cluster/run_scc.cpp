@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ * Copyright (c) 2021 The authors of SCC All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cluster.h"
+#include "../scc/scc.h"
+
+#include <climits>
+#include <memory>
+#include <stdexcept>
+
+namespace cluster
+{
+
+void run_scc(const KnnGraph& graph, const std::vector<float>& thresholds, unsigned cores, LabelWriter& out)
+{
+    if (thresholds.empty())
+        throw std::runtime_error("SCC needs at least one threshold");
+    std::vector<scalar> thresh(thresholds.begin(), thresholds.end());
+    std::unique_ptr<SCC> scc(SCC::init(thresh, cores, SCC::FAST_SV, 100000, SCC::NO_PRINT));
+
+    std::vector<uint32_t> rows(graph.cols.size());
+    for (size_t i = 0; i < graph.n; ++i)
+        for (uint64_t e = graph.offsets[i]; e < graph.offsets[i + 1]; ++e)
+            rows[e] = uint32_t(i);
+    std::vector<uint32_t> cols(graph.cols);
+    std::vector<scalar> sims(graph.sims.begin(), graph.sims.end());
+    if (!graph.counts.empty())
+    {
+        std::vector<scalar> counts(graph.counts.begin(), graph.counts.end());
+        scc->set_point_counts(counts);
+    }
+    // vertices are 0 .. n - 1
+    scc->insert_first_batch(graph.n - 1, rows, cols, sims);
+
+    // labels of level l are the ids of the level l ancestors of the points
+    const SCC::TreeLevel* round0 = scc->levels[0];
+    std::vector<SCC::TreeLevel::TreeNode*> ancestors(graph.n, NULL);
+    for (size_t i = 0; i < graph.n; ++i)
+    {
+        auto it = round0->nodeid2index.find(node_id_t(i));
+        if (it != round0->nodeid2index.end())
+            ancestors[i] = round0->nodes[it->second];
+    }
+    std::vector<uint32_t> labels(graph.n);
+    std::vector<uint32_t> point_labels(graph.vertex.size());
+    out.begin(scc->levels.size(), graph.num_points);
+    for (size_t l = 0; l < scc->levels.size(); ++l)
+    {
+        for (size_t i = 0; i < graph.n; ++i)
+        {
+            if (l > 0 && ancestors[i] != NULL)
+                ancestors[i] = scc->parent_of(ancestors[i]);
+            labels[i] = ancestors[i] != NULL ? ancestors[i]->this_id : UINT32_MAX;
+        }
+        if (graph.vertex.empty())
+            out.write(labels.data(), labels.size());
+        else
+        {
+            for (size_t p = 0; p < graph.vertex.size(); ++p)
+                point_labels[p] = labels[graph.vertex[p]];
+            out.write(point_labels.data(), point_labels.size());
+        }
+    }
+}
+
+}
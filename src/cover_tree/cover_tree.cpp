@@ -77,9 +77,11 @@ bool CoverTree::insert(CoverTree::Node* current, const pointType& p, unsigned UI
         std::cout << "dist_to_parent=" << dist_to_parent << ", parent=" << parent << std::endl << std::flush;
         #endif
 
+        // duplicates are kept on the existing node (the caller holds global_mut exclusively)
         if (dist_to_parent == 0) {
-            std::cout << "Duplicate entry!!!" << std::endl << std::flush;
-            return false;
+            parent->dup_uids.push_back(UID);
+            num_duplicates++;
+            return true;
         }
 
         // Q = Qi−1 ={q∈Q: d(p,q) ≤ 2^i}
@@ -403,6 +405,39 @@ std::vector<std::pair<CoverTree::Node*, scalar>> CoverTree::rangeNeighbours(cons
 }
 
 
+std::vector<std::pair<long, scalar>> CoverTree::expand_duplicates(const std::vector<std::pair<CoverTree::Node*, scalar>>& nnList, size_t limit) const
+{
+    std::shared_lock<std::shared_timed_mutex> guard(global_mut);
+    std::vector<std::pair<long, scalar>> expanded;
+    std::unordered_set<unsigned> seen;
+    for (const auto& nn : nnList)
+    {
+        if (limit > 0 && expanded.size() >= limit)
+            break;
+        // unfilled kNN slots, and the nested copies of a point already listed
+        if (nn.first == NULL || nn.second == std::numeric_limits<scalar>::max() || !seen.insert(nn.first->UID).second)
+            continue;
+        expanded.emplace_back(long(nn.first->UID), nn.second);
+        // the duplicates are kept on one of the nested copies of the point
+        for (CoverTree::Node* copy = nn.first; copy != NULL; )
+        {
+            for (unsigned uid : copy->dup_uids)
+            {
+                if (limit > 0 && expanded.size() >= limit)
+                    break;
+                expanded.emplace_back(long(uid), nn.second);
+            }
+            CoverTree::Node* next = NULL;
+            for (const auto& child : *copy)
+                if (child->UID == copy->UID)
+                    next = child;
+            copy = next;
+        }
+    }
+    return expanded;
+}
+
+
 /****************************** Furthest Neighbour *************************************/
 
 std::pair<CoverTree::Node*, scalar> CoverTree::FurthestNeighbour(const pointType &p) const
@@ -557,12 +592,15 @@ void CoverTree::PrePost(CoverTree::Node*& current, char*& pre, char*& post)
 
 size_t CoverTree::msg_size() const
 {
+    // duplicates follow as a count and (ID, UID) pairs, only if there are any
+    size_t dups = num_duplicates.load();
     return 2 * sizeof(unsigned)
         + sizeof(pointType::Scalar)*D*N
         + sizeof(int)*N
         + sizeof(unsigned)*N*2
         + sizeof(scalar)*N
-        + sizeof(unsigned)*N;
+        + sizeof(unsigned)*N
+        + (dups > 0 ? sizeof(unsigned) + sizeof(unsigned)*dups*2 : 0);
 }
 
 // Serialize to a buffer
@@ -592,14 +630,39 @@ char* CoverTree::serialize() const
     pos = preorder_pack(pos, root);
     pos = postorder_pack(pos, root);
 
+    // insert duplicates
+    unsigned dups = num_duplicates.load();
+    if (dups > 0)
+    {
+        std::copy((char*)&dups, (char*)&dups + sizeof(unsigned), pos);
+        pos += sizeof(unsigned);
+        std::stack<CoverTree::Node*> travel;
+        travel.push(root);
+        while (travel.size() > 0 && dups > 0)
+        {
+            CoverTree::Node* current = travel.top();
+            travel.pop();
+            for (unsigned i = 0; i < current->dup_uids.size() && dups > 0; ++i, --dups)
+            {
+                std::copy((char*)&(current->ID), (char*)&(current->ID) + sizeof(unsigned), pos);
+                pos += sizeof(unsigned);
+                std::copy((char*)&(current->dup_uids[i]), (char*)&(current->dup_uids[i]) + sizeof(unsigned), pos);
+                pos += sizeof(unsigned);
+            }
+            for (const auto& child : *current)
+                travel.push(child);
+        }
+    }
+
     //std::cout<<"Message size: " << msg_size() << ", " << pos - buff << std::endl;
 
     return buff;
 }
 
 // Deserialize from a buffer
-void CoverTree::deserialize(char* buff)
+void CoverTree::deserialize(char* buff, size_t len)
 {
+    char* start = buff;
     /** Convert char* buff into following buff = N | D | (points, levels) | List **/
     //char* save = buff;
 
@@ -618,6 +681,34 @@ void CoverTree::deserialize(char* buff)
     //reconstruction
     PrePost(root, buff, post);
 
+    // duplicates, present if the buffer is longer than the nodes
+    num_duplicates = 0;
+    if (size_t(post - start) + sizeof(unsigned) <= len)
+    {
+        unsigned dups = *((unsigned *)post);
+        post += sizeof(unsigned);
+        std::unordered_map<unsigned, CoverTree::Node*> nodes;
+        std::stack<CoverTree::Node*> travel;
+        travel.push(root);
+        while (travel.size() > 0)
+        {
+            CoverTree::Node* current = travel.top();
+            travel.pop();
+            nodes[current->ID] = current;
+            for (const auto& child : *current)
+                travel.push(child);
+        }
+        for (unsigned i = 0; i < dups; ++i, post += 2 * sizeof(unsigned))
+        {
+            auto it = nodes.find(*((unsigned *)post));
+            if (it != nodes.end())
+            {
+                it->second->dup_uids.push_back(*((unsigned *)(post + sizeof(unsigned))));
+                num_duplicates++;
+            }
+        }
+    }
+
     //delete[] save;
 }
 
@@ -652,31 +743,23 @@ CoverTree::CoverTree(const pointType& p, int truncateArg /*=-1*/)
 }
 
 //constructor: cover tree using points in the list between begin and end
-CoverTree::CoverTree(const Eigen::Map<matrixType>& pMatrix, int truncateArg /*=-1*/, unsigned cores /*=true*/)
+CoverTree::CoverTree(const Eigen::Map<matrixType>& pMatrix, int truncateArg /*=-1*/, unsigned cores /*=true*/, size_t medoid_sample /*=0*/)
 {
     size_t numPoints = pMatrix.cols();
     bool use_multi_core = cores != 0;
     this->cores = cores;
 
-    //1. Compute the mean of entire data
-    pointType mx = utils::ParallelAddMatrixNP(pMatrix).get_result()/(1.0*numPoints);
-
-    //2. Compute distance of every point from the mean || Variance
-    pointType dists = utils::ParallelDistanceComputeNP(pMatrix, mx).get_result();
-
-    //3. argsort the distance to find approximate mediod
-    std::vector<size_t> idx(numPoints);
-    std::iota(std::begin(idx), std::end(idx), 0);
-    auto comp_x = [&dists](size_t a, size_t b) { return dists[a] > dists[b]; };
-    std::sort(std::begin(idx), std::end(idx), comp_x);
+    //1-3. Mean, distance of every point from it and argsort to find approximate mediod,
+    //     on the shared thread pool (mean and mediod from a sample if medoid_sample > 0)
+    utils::BuildOrder order = utils::build_order(pMatrix, cores, medoid_sample);
+    const std::vector<size_t>& idx = order.order;
     std::cout<<"numPoints: " << numPoints << std::endl;
-    std::cout<<"Max distance: " << dists[idx[0]] << std::endl;
-    std::cout<<"Min distance: " << dists[idx[numPoints-1]] << std::endl;
+    std::cout<<"Max distance: " << order.dists[idx[0]] << std::endl;
+    std::cout<<"Min distance: " << order.dists[idx[numPoints-1]] << std::endl;
 
-    //4. Compute distance of every point from the mediod
-    mx = pMatrix.col(idx[numPoints-1]);
-    dists = utils::ParallelDistanceComputeNP(pMatrix, mx).get_result();
-    scalar max_dist = dists.maxCoeff();
+    //4. Distance of the farthest point from the mediod
+    pointType mx = pMatrix.col(idx[numPoints-1]);
+    scalar max_dist = order.max_dist;
 
     int scale_val = int(std::ceil(std::log(max_dist)/std::log(base)));
     std::cout<<"Scale chosen: " << scale_val << std::endl;
@@ -759,11 +842,11 @@ CoverTree::~CoverTree()
 /****************************** Public API for creation of Cover Trees *************************************/
 
 //contructor: using matrix in col-major form!
-CoverTree* CoverTree::from_matrix(const Eigen::Map<matrixType>& pMatrix, int truncate /*=-1*/, unsigned cores /*=true*/)
+CoverTree* CoverTree::from_matrix(const Eigen::Map<matrixType>& pMatrix, int truncate /*=-1*/, unsigned cores /*=true*/, size_t medoid_sample /*=0*/)
 {
     std::cout << "Cover Tree with base " << CoverTree::base << std::endl;
     std::cout << "Cover Tree with Number of Cores: " << cores << std::endl;
-    CoverTree* cTree = new CoverTree(pMatrix, truncate, cores);
+    CoverTree* cTree = new CoverTree(pMatrix, truncate, cores, medoid_sample);
     return cTree;
 }
 
@@ -850,6 +933,126 @@ bool CoverTree::check_nesting() const
 	return result;
 }
 
+CoverTree::Verification CoverTree::verify(unsigned checks, unsigned cores, size_t max_report, bool early_exit) const
+{
+    Verification result;
+    std::shared_lock<std::shared_timed_mutex> guard(global_mut);
+    if (root == NULL)
+        return result;
+
+    // distances are recomputed in another order than when the bounds were set
+    const scalar slack = scalar(1e-5);
+
+    std::mutex mtx;
+    std::atomic<size_t> num_nodes(0);
+    std::atomic<size_t> num_violations(0);
+    std::atomic<bool> stop(false);
+    auto report = [&](Check check, const CoverTree::Node* at, const CoverTree::Node* other, scalar dist, scalar bound)->void{
+        size_t found = num_violations.fetch_add(1) + 1;
+        if (found <= max_report)
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            result.first.push_back({check, at->UID, other->UID, at->level, dist, bound});
+        }
+        if (early_exit && found >= max_report)
+            stop = true;
+    };
+
+    // Checks between a node and its children
+    auto check_children = [&](CoverTree::Node* current)->void{
+        const scalar covdist = current->covdist();
+        const scalar sepdist = current->sepdist();
+        for (const auto& child : *current)
+        {
+            scalar d = current->dist(child);
+            if ((checks & Covering) && d > covdist + slack*(covdist + d))
+                report(Covering, current, child, d, covdist);
+            // the other children have to be separated from the nested copy of current
+            if ((checks & Nesting) && (child->UID == current->UID ? d > 0 : use_nesting && d < sepdist - slack*(sepdist + d)))
+                report(Nesting, current, child, d, child->UID == current->UID ? 0 : sepdist);
+            if ((checks & Levels) && child->level != current->level - 1)
+                report(Levels, current, child, scalar(child->level), scalar(current->level - 1));
+        }
+        // nested copies stand for their parent and are not separated from the other children
+        if (checks & Separation)
+            for (size_t i = 0; i < current->children.size() && !stop; ++i)
+            {
+                CoverTree::Node* a = current->children[i];
+                if (a->UID == current->UID)
+                    continue;
+                for (size_t j = i + 1; j < current->children.size(); ++j)
+                {
+                    CoverTree::Node* b = current->children[j];
+                    if (b->UID == current->UID)
+                        continue;
+                    scalar d = a->dist(b);
+                    if (d < sepdist - slack*(sepdist + d))
+                        report(Separation, a, b, d, sepdist);
+                }
+            }
+    };
+
+    // Units of work: the coarsest subtrees are split until there are enough for every thread;
+    // a split node is checked on its own, every unit with the path above it for maxdistUB
+    struct Unit
+    {
+        CoverTree::Node* node;
+        std::vector<CoverTree::Node*> path;
+        bool whole;
+    };
+    std::vector<Unit> units(1, Unit{root, {}, true});
+    size_t target = 4 * size_t(utils::pool_cores(cores));
+    while (units.size() < target)
+    {
+        size_t top = units.size();
+        for (size_t i = 0; i < units.size(); ++i)
+            if (units[i].whole && units[i].node->children.size() > 0 && (top == units.size() || units[i].node->level > units[top].node->level))
+                top = i;
+        if (top == units.size())
+            break;
+        units[top].whole = false;
+        std::vector<CoverTree::Node*> path = units[top].path;
+        path.push_back(units[top].node);
+        for (const auto& child : *units[top].node)
+            units.push_back(Unit{child, path, true});
+    }
+
+    utils::ThreadPool::shared().run(units.size(), [&](size_t u)->void{
+        std::vector<CoverTree::Node*> ancestors = units[u].path;
+        const size_t depth0 = ancestors.size();
+        std::vector<std::pair<CoverTree::Node*, size_t>> travel(1, std::make_pair(units[u].node, depth0));
+        size_t visited = 0;
+        while (travel.size() > 0 && !stop)
+        {
+            CoverTree::Node* current = travel.back().first;
+            ancestors.resize(travel.back().second);
+            travel.pop_back();
+            ++visited;
+
+            if (checks & MaxDist)
+                for (const auto& a : ancestors)
+                {
+                    scalar d = a->dist(current);
+                    if (d > a->maxdistUB + slack*(a->maxdistUB + d))
+                        report(MaxDist, a, current, d, a->maxdistUB);
+                }
+            check_children(current);
+
+            if (!units[u].whole)
+                break;
+            ancestors.push_back(current);
+            for (const auto& child : *current)
+                travel.emplace_back(child, ancestors.size());
+        }
+        num_nodes += visited;
+    }, cores);
+
+    result.nodes = num_nodes.load();
+    result.violations = num_violations.load();
+    result.complete = !stop;
+    return result;
+}
+
 void CoverTree::print_levels() const
 {
     std::stack<CoverTree::Node*> travel;
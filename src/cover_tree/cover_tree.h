@@ -27,6 +27,8 @@
 #include <shared_mutex>
 #include <stack>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <set>
 
@@ -54,6 +56,7 @@ public:
         unsigned ID;                        // mutable ID of current node
         unsigned UID;                       // external unique ID for current node
         std::string ext_prop;               // external encoded propertoes of current node
+        std::vector<unsigned> dup_uids;     // UIDs of points inserted at distance 0 from _p
 
         mutable std::shared_timed_mutex mut;// lock for current node
 
@@ -170,9 +173,10 @@ protected:
     bool id_valid;
 
     std::atomic<unsigned> N;            // Number of points in the cover tree
+    std::atomic<unsigned> num_duplicates{0}; // Number of points stored as dup_uids
     unsigned D;                         // Dimension of the points
 
-    std::shared_timed_mutex global_mut;	// lock for changing the root
+    mutable std::shared_timed_mutex global_mut;	// lock for changing the root
 
     /*** Insertion helper function ***/
     bool insert(Node* current, const pointType& p, unsigned UID, scalar dist_current);
@@ -193,7 +197,7 @@ public:
     // cover tree with one point as root
     CoverTree(const pointType& p, int truncate = -1);
     // cover tree using points in the list between begin and end
-    CoverTree(const Eigen::Map<matrixType>& pMatrix, int truncate = -1, unsigned cores = -1);
+    CoverTree(const Eigen::Map<matrixType>& pMatrix, int truncate = -1, unsigned cores = -1, size_t medoid_sample = 0);
 
     /*** Destructor ***/
     /*** Destructor: deallocating all memories by a post order traversal ***/
@@ -201,7 +205,7 @@ public:
 
 /************************* Public API ***********************************************/
     /*** Construct cover tree using all points in the matrix in row-major form ***/
-    static CoverTree* from_matrix(const Eigen::Map<matrixType>& pMatrix, int truncate = -1, unsigned cores = -1);
+    static CoverTree* from_matrix(const Eigen::Map<matrixType>& pMatrix, int truncate = -1, unsigned cores = -1, size_t medoid_sample = 0);
 
     /*** Get root ***/
     Node* get_root() {return root;}
@@ -221,17 +225,42 @@ public:
     /*** Range search ***/
     std::vector<std::pair<CoverTree::Node*, scalar>> rangeNeighbours(const pointType &queryPt, scalar range = 1.0) const;
 
+    /*** (UID, distance) of each distinct point of nnList followed by its exact duplicates, up to limit if > 0 ***/
+    std::vector<std::pair<long, scalar>> expand_duplicates(const std::vector<std::pair<Node*, scalar>>& nnList, size_t limit = 0) const;
+
     /*** Furthest Neighbour search ***/
     std::pair<CoverTree::Node*, scalar> FurthestNeighbour(const pointType &p) const;
 
     /*** Serialize/Desrialize: useful for Pickling ***/
     char* serialize() const;                                    // Serialize to a buffer
     size_t msg_size() const;
-    void deserialize(char* buff);                               // Deserialize from a buffer
+    void deserialize(char* buff, size_t len);                   // Deserialize from a buffer
 
     /*** Unit Tests ***/
     bool check_covering() const;
     bool check_nesting() const;
+
+    /*** Invariant checks of verify, or-ed together ***/
+    enum Check { Covering = 1, Separation = 2, Nesting = 4, MaxDist = 8, Levels = 16, AllChecks = 31 };
+    struct Violation
+    {
+        Check check;
+        unsigned UID;                   // node at fault, the ancestor for MaxDist
+        unsigned other;                 // child, sibling or descendant involved
+        int level;                      // level of the node at fault
+        scalar dist;                    // distance found (child level for Levels)
+        scalar bound;                   // bound it breaks
+    };
+    struct Verification
+    {
+        size_t nodes = 0;               // nodes checked
+        size_t violations = 0;          // violations found
+        bool complete = true;           // false if stopped early
+        std::vector<Violation> first;   // the first max_report of them
+    };
+    /*** Check invariants over subtrees on up to cores threads, stopping after max_report violations if early_exit;
+         not to be run concurrently with inserts ***/
+    Verification verify(unsigned checks = AllChecks, unsigned cores = -1, size_t max_report = 10, bool early_exit = false) const;
     void print_stats() const;
     void print_levels() const;
     void print_degrees() const;
@@ -243,7 +272,7 @@ public:
     friend std::ostream& operator<<(std::ostream& os, const CoverTree& ct);
 
     void calc_maxdist();
-    int get_tree_size() {return N.load();}
+    int get_tree_size() {return N.load() + num_duplicates.load();}
 };
 
 #endif  // _COVER_TREE_H
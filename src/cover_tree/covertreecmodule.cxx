@@ -33,9 +33,10 @@ static PyObject *new_covertreec(PyObject *self, PyObject *args)
 {
   int trunc;
   long use_multi_core;
+  Py_ssize_t medoid_sample = 0;
   PyArrayObject *in_array;
 
-  if (!PyArg_ParseTuple(args,"O!il:new_covertreec", &PyArray_Type, &in_array, &trunc, &use_multi_core))
+  if (!PyArg_ParseTuple(args,"O!il|n:new_covertreec", &PyArray_Type, &in_array, &trunc, &use_multi_core, &medoid_sample))
     return NULL;
 
   npy_intp numPoints = PyArray_DIM(in_array, 0);
@@ -45,7 +46,7 @@ static PyObject *new_covertreec(PyObject *self, PyObject *args)
   scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
   Eigen::Map<matrixType> pointMatrix(fnp, numDims, numPoints);
 
-  CoverTree* cTree = CoverTree::from_matrix(pointMatrix, trunc, use_multi_core);
+  CoverTree* cTree = CoverTree::from_matrix(pointMatrix, trunc, use_multi_core, size_t(std::max(medoid_sample, Py_ssize_t(0))));
   size_t int_ptr = reinterpret_cast< size_t >(cTree);
   size_t node_ptr = reinterpret_cast< size_t >(cTree->get_root());
 
@@ -573,6 +574,95 @@ static PyObject *covertreec_range(PyObject *self, PyObject *args) {
   return return_value;
 }
 
+static PyObject *covertreec_knn_expanded(PyObject *self, PyObject *args) {
+
+  long k, cores;
+  CoverTree *obj;
+  size_t int_ptr;
+  PyArrayObject *in_array;
+
+  if (!PyArg_ParseTuple(args, "nO!ll:covertreec_knn_expanded", &int_ptr, &PyArray_Type, &in_array, &k, &cores))
+    return NULL;
+
+  npy_intp idx[2] = {0,0};
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> queryPts(fnp, numDims, numPoints);
+  obj = reinterpret_cast< CoverTree * >(int_ptr);
+
+  npy_intp dims[2] = {numPoints, k};
+  PyObject *out_indices = PyArray_SimpleNew(2, dims, NPY_LONG);
+  PyObject *out_dist = PyArray_SimpleNew(2, dims, MY_NPY_FLOAT);
+  long *indices = reinterpret_cast<long *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_indices)));
+  scalar *dist = reinterpret_cast<scalar *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_dist)));
+
+  // nested copies of a point take several of the k nodes, ask for more until k points are found
+  long num_nodes = obj->get_tree_size();
+  auto query = [&](size_t i)->void{
+      long num = k;
+      std::vector<std::pair<long, scalar>> nn = obj->expand_duplicates(obj->kNearestNeighbours(queryPts.col(i), num), k);
+      while (long(nn.size()) < k && num < num_nodes)
+      {
+          num *= 2;
+          nn = obj->expand_duplicates(obj->kNearestNeighbours(queryPts.col(i), num), k);
+      }
+      for (long t = 0; t < k; ++t)
+      {
+        indices[k*i + t] = t < long(nn.size()) ? nn[t].first : -1;
+        dist[k*i + t] = t < long(nn.size()) ? nn[t].second : std::numeric_limits<scalar>::infinity();
+      }
+  };
+  utils::ThreadPool::shared().run(size_t(numPoints), query, utils::pool_cores(unsigned(cores)));
+
+  return Py_BuildValue("NN", out_indices, out_dist);
+}
+
+static PyObject *covertreec_range_expanded(PyObject *self, PyObject *args) {
+
+  scalar r=0.0;
+  long cores;
+  CoverTree *obj;
+  size_t int_ptr;
+  PyArrayObject *in_array;
+
+  if (!PyArg_ParseTuple(args, "nO!"PYTHON_FLOAT_CHAR"l:covertreec_range_expanded", &int_ptr, &PyArray_Type, &in_array, &r, &cores))
+    return NULL;
+
+  npy_intp idx[2] = {0,0};
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> queryPts(fnp, numDims, numPoints);
+  obj = reinterpret_cast< CoverTree * >(int_ptr);
+
+  std::vector<std::vector<std::pair<long, scalar>>> results(numPoints);
+  auto query = [&](size_t i)->void{
+      results[i] = obj->expand_duplicates(obj->rangeNeighbours(queryPts.col(i), r));
+  };
+  utils::ThreadPool::shared().run(size_t(numPoints), query, utils::pool_cores(unsigned(cores)));
+
+  PyObject *indices = PyList_New(numPoints);
+  PyObject *dist = PyList_New(numPoints);
+  for (npy_intp i = 0; i < numPoints; ++i)
+  {
+    npy_intp dims[1] = {(npy_intp) results[i].size()};
+    PyObject *neighbour_indices = PyArray_SimpleNew(1, dims, NPY_LONG);
+    PyObject *neighbour_dist = PyArray_SimpleNew(1, dims, MY_NPY_FLOAT);
+    long *point_indices = reinterpret_cast<long *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(neighbour_indices)));
+    scalar *point_dist = reinterpret_cast<scalar *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(neighbour_dist)));
+    for (size_t t = 0; t < results[i].size(); ++t)
+    {
+      point_indices[t] = results[i][t].first;
+      point_dist[t] = results[i][t].second;
+    }
+    PyList_SET_ITEM(indices, i, neighbour_indices);
+    PyList_SET_ITEM(dist, i, neighbour_dist);
+  }
+
+  return Py_BuildValue("NN", indices, dist);
+}
+
 static PyObject *covertreec_serialize(PyObject *self, PyObject *args)
 {
   CoverTree *obj;
@@ -596,7 +686,7 @@ static PyObject *covertreec_deserialize(PyObject *self, PyObject *args)
     return NULL;
 
   CoverTree* cTree = new CoverTree();
-  cTree->deserialize(buff);
+  cTree->deserialize(buff, len);
   size_t int_ptr = reinterpret_cast< size_t >(cTree);
   size_t node_ptr = reinterpret_cast< size_t >(cTree->get_root());
 
@@ -723,6 +813,37 @@ static PyObject *covertreec_test_nesting(PyObject *self, PyObject *args)
   Py_RETURN_FALSE;
 }
 
+static PyObject *covertreec_verify(PyObject *self, PyObject *args)
+{
+  CoverTree *obj;
+  size_t int_ptr;
+  unsigned checks;
+  long use_multi_core;
+  Py_ssize_t max_report;
+  int early_exit;
+
+  if (!PyArg_ParseTuple(args, "nIlnp:covertreec_verify", &int_ptr, &checks, &use_multi_core, &max_report, &early_exit))
+    return NULL;
+
+  obj = reinterpret_cast< CoverTree * >(int_ptr);
+  CoverTree::Verification result;
+  Py_BEGIN_ALLOW_THREADS
+  result = obj->verify(checks, unsigned(use_multi_core), size_t(std::max(max_report, Py_ssize_t(0))), early_exit != 0);
+  Py_END_ALLOW_THREADS
+
+  PyObject *first = PyList_New(0);
+  for (const auto& v : result.first)
+  {
+    const char *name = v.check == CoverTree::Covering ? "covering" : v.check == CoverTree::Separation ? "separation"
+                     : v.check == CoverTree::Nesting ? "nesting" : v.check == CoverTree::MaxDist ? "maxdist" : "levels";
+    PyObject *o = Py_BuildValue("sIIidd", name, v.UID, v.other, v.level, double(v.dist), double(v.bound));
+    PyList_Append(first, o);
+    Py_DECREF(o);
+  }
+  return Py_BuildValue("nnON", Py_ssize_t(result.nodes), Py_ssize_t(result.violations),
+                       result.complete ? Py_True : Py_False, first);
+}
+
 static PyObject *covertreec_node_children(PyObject *self, PyObject *args)
 {
   CoverTree::Node *obj;
@@ -780,6 +901,12 @@ static PyObject *covertreec_node_property(PyObject *self, PyObject *args)
   PyDict_SetItemString(results, "maxdistUB", o);
   Py_DECREF(o);
 
+  o = PyList_New(obj->dup_uids.size());
+  for (size_t i = 0; i < obj->dup_uids.size(); ++i)
+    PyList_SET_ITEM(o, i, PyLong_FromUnsignedLong(obj->dup_uids[i]));
+  PyDict_SetItemString(results, "duplicates", o);
+  Py_DECREF(o);
+
   o = PyBytes_FromStringAndSize(obj->ext_prop.c_str(), obj->ext_prop.length());
   PyDict_SetItemString(results, "others", o);
   Py_DECREF(o);
@@ -814,6 +941,8 @@ PyMODINIT_FUNC PyInit_covertreec(void)
     {"NearestNeighbour", covertreec_nn, METH_VARARGS, "Find the nearest neighbour."},
     {"kNearestNeighbours", covertreec_knn, METH_VARARGS, "Find the k nearest neighbours."},
     {"RangeSearch", covertreec_range, METH_VARARGS, "Find all the neighbours in range."},
+    {"kNearestNeighboursExpanded", covertreec_knn_expanded, METH_VARARGS, "Find the k nearest neighbours, counting exact duplicates."},
+    {"RangeSearchExpanded", covertreec_range_expanded, METH_VARARGS, "Find all the neighbours in range, with exact duplicates."},
     {"serialize", covertreec_serialize, METH_VARARGS, "Serialize the current Cover Tree."},
     {"deserialize", covertreec_deserialize, METH_VARARGS, "Construct a Cover Tree from deserializing."},
     {"display", covertreec_display, METH_VARARGS, "Display the Cover Tree."},
@@ -822,6 +951,7 @@ PyMODINIT_FUNC PyInit_covertreec(void)
     {"spreadout", covertreec_spreadout, METH_VARARGS, "Find well spreadout k points."},
     {"test_covering", covertreec_test_covering, METH_VARARGS, "Check if covering property is satisfied."},
     {"test_nesting", covertreec_test_nesting, METH_VARARGS, "Check if nesting property is satisfied."},
+    {"verify", covertreec_verify, METH_VARARGS, "Check the tree invariants in parallel and report the first violations."},
     {"node_children", covertreec_node_children, METH_VARARGS, "Get children nodes."},
     {"node_property", covertreec_node_property, METH_VARARGS, "Get node property."},
     {"get_root", covertreec_get_root, METH_VARARGS, "Get root node."},
@@ -26,6 +26,14 @@
 #include <atomic>
 #include <thread>
 #include <future>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <vector>
 
 #include <Eigen/Core>
 
@@ -133,6 +141,228 @@ namespace utils
         return f;
     }
 
+    /*** Worker threads shared by the parallel build helpers below ***/
+    class ThreadPool
+    {
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool stopping = false;
+
+        void work()
+        {
+            while (true)
+            {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lk(mtx);
+                    cv.wait(lk, [this]{ return stopping || !tasks.empty(); });
+                    if (tasks.empty())
+                        return;
+                    job = std::move(tasks.front());
+                    tasks.pop_front();
+                }
+                job();
+            }
+        }
+
+    public:
+        explicit ThreadPool(unsigned num_workers)
+        {
+            for (unsigned i = 0; i < num_workers; ++i)
+                workers.emplace_back(&ThreadPool::work, this);
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                stopping = true;
+            }
+            cv.notify_all();
+            for (auto& w : workers)
+                w.join();
+        }
+
+        // The calling thread works as well, so one worker less than the cores
+        static ThreadPool& shared()
+        {
+            static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+            return pool;
+        }
+
+        // Run task(0), ..., task(num_tasks-1) on at most cores threads, including the caller
+        template<class Task>
+        void run(size_t num_tasks, Task task, unsigned cores)
+        {
+            struct State
+            {
+                std::atomic<size_t> next;
+                std::atomic<size_t> done;
+                std::mutex mtx;
+                std::condition_variable cv;
+            };
+            auto state = std::make_shared<State>();
+            state->next = 0;
+            state->done = 0;
+            Task* shared_task = &task;
+
+            // helpers starting after all tasks are taken return without touching task
+            auto drain = [state, shared_task, num_tasks]()->void{
+                size_t i;
+                while ((i = state->next++) < num_tasks)
+                {
+                    (*shared_task)(i);
+                    if (++state->done == num_tasks)
+                    {
+                        std::lock_guard<std::mutex> lk(state->mtx);
+                        state->cv.notify_all();
+                    }
+                }
+            };
+
+            size_t helpers = std::min({size_t(cores > 0 ? cores - 1 : 0), workers.size(), num_tasks > 0 ? num_tasks - 1 : 0});
+            if (helpers > 0)
+            {
+                {
+                    std::lock_guard<std::mutex> lk(mtx);
+                    for (size_t i = 0; i < helpers; ++i)
+                        tasks.emplace_back(drain);
+                }
+                cv.notify_all();
+            }
+            drain();
+
+            std::unique_lock<std::mutex> lk(state->mtx);
+            state->cv.wait(lk, [&]{ return state->done.load() == num_tasks; });
+        }
+    };
+
+    // -1 (as passed from Python) means all cores
+    inline unsigned pool_cores(unsigned cores)
+    {
+        if (cores == unsigned(-1))
+            return std::max(std::thread::hardware_concurrency(), 1u);
+        return std::max(cores, 1u);
+    }
+
+    /*** Mean of the columns, reducing one partial sum per chunk ***/
+    inline pointType parallel_mean(const Eigen::Map<matrixType>& pMatrix, unsigned cores)
+    {
+        cores = pool_cores(cores);
+        const size_t numPoints = pMatrix.cols();
+        const size_t chunks = std::max(std::min(size_t(cores), numPoints / 1024), size_t(1));
+        std::vector<Eigen::VectorXd> partial(chunks, Eigen::VectorXd::Zero(pMatrix.rows()));
+        ThreadPool::shared().run(chunks, [&](size_t c)->void{
+            for (size_t i = numPoints * c / chunks; i < numPoints * (c + 1) / chunks; ++i)
+                partial[c] += pMatrix.col(i).template cast<double>();
+        }, cores);
+        for (size_t c = 1; c < chunks; ++c)
+            partial[0] += partial[c];
+        return (partial[0] / double(numPoints)).cast<scalar>();
+    }
+
+    /*** Distance of every column from vec, and of every column from vec2 if given ***/
+    inline pointType parallel_distances(const Eigen::Map<matrixType>& pMatrix, const pointType& vec, unsigned cores,
+                                        const pointType* vec2 = nullptr, scalar* max_dist2 = nullptr)
+    {
+        cores = pool_cores(cores);
+        const size_t numPoints = pMatrix.cols();
+        const size_t chunks = std::max(std::min(size_t(cores) * 4, numPoints / 1024), size_t(1));
+        pointType dists(numPoints);
+        std::vector<scalar> partial_max(chunks, 0);
+        ThreadPool::shared().run(chunks, [&](size_t c)->void{
+            for (size_t i = numPoints * c / chunks; i < numPoints * (c + 1) / chunks; ++i)
+            {
+                dists[i] = (pMatrix.col(i) - vec).norm();
+                if (vec2 != nullptr)
+                    partial_max[c] = std::max(partial_max[c], (pMatrix.col(i) - *vec2).norm());
+            }
+        }, cores);
+        if (max_dist2 != nullptr)
+            *max_dist2 = *std::max_element(partial_max.begin(), partial_max.end());
+        return dists;
+    }
+
+    /*** Indices by decreasing value: chunks are sorted in parallel, then merged pairwise ***/
+    inline std::vector<size_t> parallel_argsort_desc(const pointType& values, unsigned cores)
+    {
+        cores = pool_cores(cores);
+        const size_t n = values.size();
+        std::vector<size_t> idx(n);
+        std::iota(std::begin(idx), std::end(idx), 0);
+        auto comp_x = [&values](size_t a, size_t b) { return values[a] > values[b]; };
+
+        const size_t chunks = std::max(std::min(size_t(cores), n / 4096), size_t(1));
+        std::vector<size_t> bounds(chunks + 1);
+        for (size_t c = 0; c <= chunks; ++c)
+            bounds[c] = n * c / chunks;
+        ThreadPool::shared().run(chunks, [&](size_t c)->void{
+            std::sort(idx.begin() + bounds[c], idx.begin() + bounds[c + 1], comp_x);
+        }, cores);
+        for (size_t width = 1; width < chunks; width *= 2)
+        {
+            size_t pairs = (chunks + 2 * width - 1) / (2 * width);
+            ThreadPool::shared().run(pairs, [&](size_t p)->void{
+                size_t first = 2 * width * p;
+                size_t middle = std::min(first + width, chunks);
+                size_t last = std::min(first + 2 * width, chunks);
+                std::inplace_merge(idx.begin() + bounds[first], idx.begin() + bounds[middle], idx.begin() + bounds[last], comp_x);
+            }, cores);
+        }
+        return idx;
+    }
+
+    /*** Insertion order for building a tree: decreasing distance from the mean, approximate medoid last ***/
+    struct BuildOrder
+    {
+        std::vector<size_t> order;      // order.back() is the medoid, i.e. the root
+        pointType dists;                // distance of every point from the mean
+        scalar max_dist;                // distance of the farthest point from the medoid
+    };
+
+    // With medoid_sample > 0 the mean and medoid are estimated from that many random points,
+    // which saves a full pass over the data
+    inline BuildOrder build_order(const Eigen::Map<matrixType>& pMatrix, unsigned cores, size_t medoid_sample = 0)
+    {
+        const size_t numPoints = pMatrix.cols();
+        BuildOrder result;
+
+        if (medoid_sample > 0 && medoid_sample < numPoints)
+        {
+            std::mt19937_64 gen(0);
+            std::uniform_int_distribution<size_t> pick(0, numPoints - 1);
+            std::vector<size_t> sample(medoid_sample);
+            Eigen::VectorXd mean = Eigen::VectorXd::Zero(pMatrix.rows());
+            for (auto& s : sample)
+            {
+                s = pick(gen);
+                mean += pMatrix.col(s).template cast<double>();
+            }
+            pointType mx = (mean / double(medoid_sample)).cast<scalar>();
+            size_t medoid = sample[0];
+            for (const auto& s : sample)
+                if ((pMatrix.col(s) - mx).squaredNorm() < (pMatrix.col(medoid) - mx).squaredNorm())
+                    medoid = s;
+
+            pointType medoid_pt = pMatrix.col(medoid);
+            result.dists = parallel_distances(pMatrix, mx, cores, &medoid_pt, &result.max_dist);
+            result.order = parallel_argsort_desc(result.dists, cores);
+            result.order.erase(std::find(result.order.begin(), result.order.end(), medoid));
+            result.order.push_back(medoid);
+        }
+        else
+        {
+            pointType mx = parallel_mean(pMatrix, cores);
+            result.dists = parallel_distances(pMatrix, mx, cores);
+            result.order = parallel_argsort_desc(result.dists, cores);
+            pointType medoid_pt = pMatrix.col(result.order.back());
+            result.max_dist = parallel_distances(pMatrix, medoid_pt, cores).maxCoeff();
+        }
+        return result;
+    }
+
     template<typename T>
     void add_to_atomic(std::atomic<T>& foo, T& bar)
     {
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ * Copyright (c) 2021 The authors of SCC All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "graphgrove_impl.h"
+
+static thread_local std::string last_error;
+
+void gg::set_error(const std::string& msg)
+{
+    last_error = msg;
+}
+
+void gg::clear_error()
+{
+    last_error.clear();
+}
+
+int gg_api_version(void)
+{
+    return GG_API_VERSION;
+}
+
+const char* gg_last_error(void)
+{
+    return last_error.c_str();
+}
+
+void gg_free(void* buff)
+{
+    delete[] static_cast<char*>(buff);
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ * Copyright (c) 2021 The authors of SCC All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * C interface of libgraphgrove.
+ *
+ * All handles are opaque. Matrices are dense, row-major and float32
+ * (one point per row), exactly like the numpy arrays handed to the python
+ * bindings. Every query writes into buffers owned by the caller. Functions
+ * returning int report GG_OK on success and a negative error code otherwise;
+ * gg_last_error() then describes the failure for the calling thread.
+ */
+
+#ifndef _GRAPHGROVE_H
+#define _GRAPHGROVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GG_API_VERSION 1
+
+#define GG_OK 0
+#define GG_EINVAL -1
+#define GG_ENOMEM -2
+#define GG_EIO -3
+#define GG_EINTERNAL -4
+
+typedef struct gg_sgtree gg_sgtree_t;
+typedef struct gg_scc gg_scc_t;
+
+/*** Library ***/
+int gg_api_version(void);
+const char* gg_last_error(void);
+void gg_free(void* buff);
+
+/*** SG Tree ***/
+/* Build from n points of dimension d; cores = 0 uses a single thread. */
+gg_sgtree_t* gg_sgtree_build(const float* points, size_t n, size_t d,
+                             int truncate, unsigned cores, double base);
+/* Load from a buffer produced by gg_sgtree_serialize (or sgtreec.serialize). */
+gg_sgtree_t* gg_sgtree_load(const char* buff, size_t len);
+gg_sgtree_t* gg_sgtree_load_file(const char* filename);
+void gg_sgtree_free(gg_sgtree_t* tree);
+
+/* The buffer returned in *buff must be released with gg_free. */
+int gg_sgtree_serialize(const gg_sgtree_t* tree, char** buff, size_t* len);
+int gg_sgtree_save_file(const gg_sgtree_t* tree, const char* filename);
+
+size_t gg_sgtree_size(const gg_sgtree_t* tree);
+size_t gg_sgtree_dim(const gg_sgtree_t* tree);
+
+/* uids must lie in [0, UINT_MAX]; otherwise nothing is inserted and
+ * GG_EINVAL is returned. */
+int gg_sgtree_insert(gg_sgtree_t* tree, const float* points, const int64_t* uids,
+                     size_t n, unsigned cores);
+
+/* Batched exact k-NN: out_uids and out_dists hold nq * k entries. Slots
+ * without a neighbour (k larger than the tree) get uid -1. */
+int gg_sgtree_knn(const gg_sgtree_t* tree, const float* queries, size_t nq,
+                  unsigned k, unsigned cores, int64_t* out_uids, float* out_dists);
+/* Batched approximate k-NN using beam search. */
+int gg_sgtree_knn_beam(const gg_sgtree_t* tree, const float* queries, size_t nq,
+                       unsigned k, unsigned beam_size, unsigned cores,
+                       int64_t* out_uids, float* out_dists);
+
+/*** SCC ***/
+gg_scc_t* gg_scc_new(const float* thresholds, size_t num_thresholds, unsigned cores,
+                     unsigned cc_alg, size_t par_minimum, unsigned verbosity);
+void gg_scc_free(gg_scc_t* scc);
+
+/* Add similarity edges without updating the clustering. */
+int gg_scc_ingest(gg_scc_t* scc, const uint32_t* rows, const uint32_t* cols,
+                  const float* sims, size_t num_edges);
+/* Update the clustering with all edges ingested since the last fit. */
+int gg_scc_fit(gg_scc_t* scc);
+/* Ingest a full graph over points 0..num_points-1 and fit in one pass. */
+int gg_scc_fit_on_large_batch(gg_scc_t* scc, size_t num_points, const uint32_t* rows,
+                              const uint32_t* cols, const float* sims, size_t num_edges);
+
+size_t gg_scc_num_levels(const gg_scc_t* scc);
+size_t gg_scc_num_points(const gg_scc_t* scc);
+/* Cluster id of points 0..num_points-1 at the given level (0 = points).
+ * Points never observed get UINT32_MAX. */
+int gg_scc_level_labels(const gg_scc_t* scc, size_t level, uint32_t* out_labels,
+                        size_t num_points);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _GRAPHGROVE_H
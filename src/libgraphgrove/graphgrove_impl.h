@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ * Copyright (c) 2021 The authors of SCC All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Internal helpers shared by the translation units of libgraphgrove.
+ * The SG Tree and SCC wrappers live in separate translation units because
+ * their utils.h headers share an include guard.
+ */
+
+#ifndef _GRAPHGROVE_IMPL_H
+#define _GRAPHGROVE_IMPL_H
+
+#include <exception>
+#include <new>
+#include <string>
+
+#include "graphgrove.h"
+
+namespace gg
+{
+    // Record the error message reported by gg_last_error() on this thread
+    void set_error(const std::string& msg);
+    void clear_error();
+
+    // Run f, translating any escaping exception to a status code
+    template<class Function>
+    int guarded(const char* where, Function f)
+    {
+        clear_error();
+        try
+        {
+            return f();
+        }
+        catch (const std::bad_alloc&)
+        {
+            set_error(std::string(where) + ": out of memory");
+            return GG_ENOMEM;
+        }
+        catch (const std::exception& e)
+        {
+            set_error(std::string(where) + ": " + e.what());
+            return GG_EINTERNAL;
+        }
+        catch (...)
+        {
+            set_error(std::string(where) + ": unknown error");
+            return GG_EINTERNAL;
+        }
+    }
+
+    inline int invalid(const char* where, const char* what)
+    {
+        set_error(std::string(where) + ": " + what);
+        return GG_EINVAL;
+    }
+}
+
+#endif  // _GRAPHGROVE_IMPL_H
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2021 The authors of SCC All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "graphgrove_impl.h"
+#include "../scc/scc.h"
+
+#include <type_traits>
+
+static_assert(std::is_same<scalar, float>::value, "libgraphgrove exposes float32 similarities only");
+
+static SCC* as_scc(gg_scc_t* scc)
+{
+    return reinterpret_cast<SCC*>(scc);
+}
+
+static const SCC* as_scc(const gg_scc_t* scc)
+{
+    return reinterpret_cast<const SCC*>(scc);
+}
+
+gg_scc_t* gg_scc_new(const float* thresholds, size_t num_thresholds, unsigned cores,
+                     unsigned cc_alg, size_t par_minimum, unsigned verbosity)
+{
+    SCC* d = nullptr;
+    gg::guarded("gg_scc_new", [&]()->int{
+        if (thresholds == nullptr || num_thresholds == 0)
+            return gg::invalid("gg_scc_new", "need at least one threshold");
+        std::vector<scalar> threshs(thresholds, thresholds + num_thresholds);
+        d = SCC::init(threshs, std::max(cores, 1u), cc_alg, par_minimum, verbosity);
+        return GG_OK;
+    });
+    return reinterpret_cast<gg_scc_t*>(d);
+}
+
+void gg_scc_free(gg_scc_t* scc)
+{
+    delete as_scc(scc);
+}
+
+int gg_scc_ingest(gg_scc_t* scc, const uint32_t* rows, const uint32_t* cols,
+                  const float* sims, size_t num_edges)
+{
+    return gg::guarded("gg_scc_ingest", [&]()->int{
+        if (scc == nullptr || (num_edges > 0 && (rows == nullptr || cols == nullptr || sims == nullptr)))
+            return gg::invalid("gg_scc_ingest", "null argument");
+        std::vector<node_id_t> row_v(rows, rows + num_edges);
+        std::vector<node_id_t> col_v(cols, cols + num_edges);
+        std::vector<scalar> sims_v(sims, sims + num_edges);
+        as_scc(scc)->add_graph_edges_mb(row_v, col_v, sims_v);
+        return GG_OK;
+    });
+}
+
+int gg_scc_fit(gg_scc_t* scc)
+{
+    return gg::guarded("gg_scc_fit", [&]()->int{
+        if (scc == nullptr)
+            return gg::invalid("gg_scc_fit", "null argument");
+        as_scc(scc)->fit_on_graph();
+        return GG_OK;
+    });
+}
+
+int gg_scc_fit_on_large_batch(gg_scc_t* scc, size_t num_points, const uint32_t* rows,
+                              const uint32_t* cols, const float* sims, size_t num_edges)
+{
+    return gg::guarded("gg_scc_fit_on_large_batch", [&]()->int{
+        if (scc == nullptr || (num_edges > 0 && (rows == nullptr || cols == nullptr || sims == nullptr)))
+            return gg::invalid("gg_scc_fit_on_large_batch", "null argument");
+        if (as_scc(scc)->levels[0]->nodes.size() > 0)
+            return gg::invalid("gg_scc_fit_on_large_batch", "SCC already holds points");
+        for (size_t i = 0; i < num_edges; ++i)
+            if (rows[i] > num_points || cols[i] > num_points)
+                return gg::invalid("gg_scc_fit_on_large_batch", "edge endpoint out of range");
+        std::vector<node_id_t> row_v(rows, rows + num_edges);
+        std::vector<node_id_t> col_v(cols, cols + num_edges);
+        std::vector<scalar> sims_v(sims, sims + num_edges);
+        as_scc(scc)->insert_first_batch(num_points, row_v, col_v, sims_v);
+        return GG_OK;
+    });
+}
+
+size_t gg_scc_num_levels(const gg_scc_t* scc)
+{
+    return scc == nullptr ? 0 : as_scc(scc)->levels.size();
+}
+
+size_t gg_scc_num_points(const gg_scc_t* scc)
+{
+    return scc == nullptr ? 0 : as_scc(scc)->levels[0]->nodes.size();
+}
+
+int gg_scc_level_labels(const gg_scc_t* scc, size_t level, uint32_t* out_labels,
+                        size_t num_points)
+{
+    return gg::guarded("gg_scc_level_labels", [&]()->int{
+        if (scc == nullptr || (num_points > 0 && out_labels == nullptr))
+            return gg::invalid("gg_scc_level_labels", "null argument");
+        const SCC* obj = as_scc(scc);
+        if (level >= obj->levels.size())
+            return gg::invalid("gg_scc_level_labels", "level out of range");
+        const SCC::TreeLevel* round0 = obj->levels[0];
+        for (size_t i = 0; i < num_points; ++i)
+        {
+            out_labels[i] = UINT32_MAX;
+            auto it = round0->nodeid2index.find(node_id_t(i));
+            if (it == round0->nodeid2index.end())
+                continue;
+            SCC::TreeLevel::TreeNode* node = round0->nodes[it->second];
+            for (size_t l = 0; l < level && node != NULL; ++l)
+                node = obj->parent_of(node);
+            if (node != NULL)
+                out_labels[i] = node->this_id;
+        }
+        return GG_OK;
+    });
+}
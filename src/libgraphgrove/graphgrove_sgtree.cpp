@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "graphgrove_impl.h"
+#include "../sg_tree/sg_tree.h"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <type_traits>
+
+static_assert(std::is_same<scalar, float>::value, "libgraphgrove exposes float32 points only");
+
+static SGTree* as_tree(gg_sgtree_t* tree)
+{
+    return reinterpret_cast<SGTree*>(tree);
+}
+
+static const SGTree* as_tree(const gg_sgtree_t* tree)
+{
+    return reinterpret_cast<const SGTree*>(tree);
+}
+
+// Whether len is the serialized size implied by the N | D header of a buffer and
+// the count of duplicates after the nodes, if any (see SGTree::msg_size)
+static bool valid_msg_size(const char* buff, size_t len)
+{
+    size_t N = *reinterpret_cast<const unsigned*>(buff);
+    size_t D = *reinterpret_cast<const unsigned*>(buff + sizeof(unsigned));
+    size_t nodes = 2 * sizeof(unsigned)
+        + sizeof(pointType::Scalar)*D*N
+        + sizeof(int)*N
+        + sizeof(unsigned)*N*2
+        + sizeof(scalar)*N
+        + sizeof(unsigned)*N;
+    if (len == nodes)
+        return true;
+    if (len < nodes + sizeof(unsigned))
+        return false;
+    size_t dups = *reinterpret_cast<const unsigned*>(buff + nodes);
+    return len == nodes + sizeof(unsigned) + sizeof(unsigned)*dups*2;
+}
+
+// Write the result of one query into row i of the caller's buffers
+static void copy_neighbours(const std::vector<std::pair<SGTree::Node*, scalar>>& ct_nn,
+                            size_t i, unsigned k, int64_t* out_uids, float* out_dists)
+{
+    size_t offset = size_t(k)*i;
+    size_t found = std::min(ct_nn.size(), size_t(k));
+    for (size_t t = 0; t < found; ++t)
+    {
+        out_uids[offset] = ct_nn[t].first->UID;
+        out_dists[offset++] = ct_nn[t].second;
+    }
+    for (size_t t = found; t < k; ++t)
+    {
+        out_uids[offset] = -1;
+        out_dists[offset++] = std::numeric_limits<float>::infinity();
+    }
+}
+
+template<class Query>
+static int batched_query(const float* queries, size_t nq, size_t D, unsigned cores, Query query)
+{
+    Eigen::Map<matrixType> queryPts(const_cast<float*>(queries), D, nq);
+    if (cores > 1)
+        utils::parallel_for(0, nq, [&](size_t i)->void{ query(queryPts.col(i), i); }, cores);
+    else
+        for (size_t i = 0; i < nq; ++i)
+            query(queryPts.col(i), i);
+    return GG_OK;
+}
+
+gg_sgtree_t* gg_sgtree_build(const float* points, size_t n, size_t d,
+                             int truncate, unsigned cores, double base)
+{
+    SGTree* cTree = nullptr;
+    gg::guarded("gg_sgtree_build", [&]()->int{
+        if (points == nullptr || n == 0 || d == 0)
+            return gg::invalid("gg_sgtree_build", "need at least one point of non-zero dimension");
+        if (base <= 1.0)
+            return gg::invalid("gg_sgtree_build", "base must be greater than 1");
+        Eigen::Map<matrixType> pointMatrix(const_cast<float*>(points), d, n);
+        cTree = SGTree::from_matrix(pointMatrix, truncate, std::max(cores, 1u), base);
+        return GG_OK;
+    });
+    return reinterpret_cast<gg_sgtree_t*>(cTree);
+}
+
+gg_sgtree_t* gg_sgtree_load(const char* buff, size_t len)
+{
+    SGTree* cTree = nullptr;
+    gg::guarded("gg_sgtree_load", [&]()->int{
+        if (buff == nullptr || len < 2 * sizeof(unsigned) || !valid_msg_size(buff, len))
+            return gg::invalid("gg_sgtree_load", "buffer is not a serialized SG Tree");
+        cTree = new SGTree();
+        cTree->deserialize(const_cast<char*>(buff), len);
+        return GG_OK;
+    });
+    return reinterpret_cast<gg_sgtree_t*>(cTree);
+}
+
+gg_sgtree_t* gg_sgtree_load_file(const char* filename)
+{
+    std::vector<char> buff;
+    int status = gg::guarded("gg_sgtree_load_file", [&]()->int{
+        std::ifstream fin(filename, std::ios::binary);
+        if (!fin)
+        {
+            gg::set_error(std::string("gg_sgtree_load_file: cannot open ") + filename);
+            return GG_EIO;
+        }
+        buff.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+        return GG_OK;
+    });
+    if (status != GG_OK)
+        return nullptr;
+    return gg_sgtree_load(buff.data(), buff.size());
+}
+
+void gg_sgtree_free(gg_sgtree_t* tree)
+{
+    delete as_tree(tree);
+}
+
+int gg_sgtree_serialize(const gg_sgtree_t* tree, char** buff, size_t* len)
+{
+    return gg::guarded("gg_sgtree_serialize", [&]()->int{
+        if (tree == nullptr || buff == nullptr || len == nullptr)
+            return gg::invalid("gg_sgtree_serialize", "null argument");
+        *buff = as_tree(tree)->serialize();
+        *len = as_tree(tree)->msg_size();
+        return GG_OK;
+    });
+}
+
+int gg_sgtree_save_file(const gg_sgtree_t* tree, const char* filename)
+{
+    char* buff = nullptr;
+    size_t len = 0;
+    int status = gg_sgtree_serialize(tree, &buff, &len);
+    if (status != GG_OK)
+        return status;
+    status = gg::guarded("gg_sgtree_save_file", [&]()->int{
+        std::ofstream fout(filename, std::ios::binary);
+        if (!fout.write(buff, len))
+        {
+            gg::set_error(std::string("gg_sgtree_save_file: cannot write ") + filename);
+            return GG_EIO;
+        }
+        return GG_OK;
+    });
+    gg_free(buff);
+    return status;
+}
+
+size_t gg_sgtree_size(const gg_sgtree_t* tree)
+{
+    return tree == nullptr ? 0 : const_cast<SGTree*>(as_tree(tree))->get_tree_size();
+}
+
+size_t gg_sgtree_dim(const gg_sgtree_t* tree)
+{
+    if (tree == nullptr)
+        return 0;
+    SGTree::Node* root = const_cast<SGTree*>(as_tree(tree))->get_root();
+    return root == nullptr ? 0 : root->_p.rows();
+}
+
+int gg_sgtree_insert(gg_sgtree_t* tree, const float* points, const int64_t* uids,
+                     size_t n, unsigned cores)
+{
+    return gg::guarded("gg_sgtree_insert", [&]()->int{
+        size_t D = gg_sgtree_dim(tree);
+        if (D == 0 || (n > 0 && (points == nullptr || uids == nullptr)))
+            return gg::invalid("gg_sgtree_insert", "null argument");
+        for (size_t i = 0; i < n; ++i)
+            if (uids[i] < 0 || uids[i] > int64_t(std::numeric_limits<unsigned>::max()))
+                return gg::invalid("gg_sgtree_insert", "uid out of range");
+        SGTree* obj = as_tree(tree);
+        Eigen::Map<matrixType> insPts(const_cast<float*>(points), D, n);
+        std::atomic<size_t> failed(0);
+        auto insert_one = [&](size_t i)->void{
+            if (!obj->insert(insPts.col(i), unsigned(uids[i])))
+                failed.fetch_add(1, std::memory_order_relaxed);
+        };
+        if (cores > 1)
+            utils::parallel_for(0, n, insert_one, cores);
+        else
+            for (size_t i = 0; i < n; ++i)
+                insert_one(i);
+        if (failed.load() > 0)
+        {
+            gg::set_error("gg_sgtree_insert: " + std::to_string(failed.load()) + " points were not inserted");
+            return GG_EINTERNAL;
+        }
+        return GG_OK;
+    });
+}
+
+int gg_sgtree_knn(const gg_sgtree_t* tree, const float* queries, size_t nq,
+                  unsigned k, unsigned cores, int64_t* out_uids, float* out_dists)
+{
+    return gg::guarded("gg_sgtree_knn", [&]()->int{
+        size_t D = gg_sgtree_dim(tree);
+        if (D == 0 || k == 0 || (nq > 0 && (queries == nullptr || out_uids == nullptr || out_dists == nullptr)))
+            return gg::invalid("gg_sgtree_knn", "invalid argument");
+        const SGTree* obj = as_tree(tree);
+        return batched_query(queries, nq, D, cores, [&](const pointType& q, size_t i)->void{
+            copy_neighbours(obj->kNearestNeighbours(q, k), i, k, out_uids, out_dists);
+        });
+    });
+}
+
+int gg_sgtree_knn_beam(const gg_sgtree_t* tree, const float* queries, size_t nq,
+                       unsigned k, unsigned beam_size, unsigned cores,
+                       int64_t* out_uids, float* out_dists)
+{
+    return gg::guarded("gg_sgtree_knn_beam", [&]()->int{
+        size_t D = gg_sgtree_dim(tree);
+        if (D == 0 || k == 0 || beam_size == 0 || (nq > 0 && (queries == nullptr || out_uids == nullptr || out_dists == nullptr)))
+            return gg::invalid("gg_sgtree_knn_beam", "invalid argument");
+        const SGTree* obj = as_tree(tree);
+        return batched_query(queries, nq, D, cores, [&](const pointType& q, size_t i)->void{
+            copy_neighbours(obj->kNearestNeighboursBeam(q, k, beam_size), i, k, out_uids, out_dists);
+        });
+    });
+}
@@ -28,6 +28,8 @@
  * @param max_num_parents maximum number of parents any node can have
  * @param max_num_neighbors maximum number of neigbhors any node can have in the graph 
  * @param lowest_value value used for missing / minimum similarity
+ * @param verbosity 0 for no output
+ * @param progress counts the edges read and may cancel; NULL is returned if it stopped them early
  */
 LLAMA *LLAMA::from_graph(
     std::vector<uint32_t> r,
@@ -39,47 +41,119 @@ LLAMA *LLAMA::from_graph(
     unsigned cores,
     unsigned max_num_parents,
     unsigned max_num_neighbors,
-    scalar lowest_value)
+    scalar lowest_value,
+    unsigned verbosity,
+    utils::Progress *progress)
 {
     LLAMA *dagclust = NULL;
-    dagclust = new LLAMA(r, c, s, linkage, num_rounds, thresholds, cores, max_num_parents, max_num_neighbors, lowest_value);
+    dagclust = new LLAMA(r, c, s, linkage, num_rounds, thresholds, cores, max_num_parents, max_num_neighbors, lowest_value, verbosity, progress);
+    if (!dagclust->graph_complete)
+    {
+        delete dagclust;
+        return NULL;
+    }
     return dagclust;
 }
 
 /**
  * Run DAG structured clustering.
  */
-void LLAMA::cluster()
+bool LLAMA::cluster(utils::Progress *progress)
 {
-    std::cout << "Starting llama clustering... " << std::endl;
+    if (verbosity > 0)
+        std::cout << "Starting llama clustering... " << std::endl;
     auto st_cluster = utils::get_time();
     unsigned i = 0;
-    while (i < num_rounds)
+    // One step per round, stopping between rounds once cancelled
+    utils::Reporter reporter(num_rounds, progress, false);
+    while (i < num_rounds && !reporter.cancelled())
     {
         auto st_round = utils::get_time();
-        std::cout << "Starting round " << i << " with " << active_nodes.size() << " nodes." << std::endl;
+        if (verbosity > 0)
+            std::cout << "Starting round " << i << " with " << active_nodes.size() << " nodes." << std::endl;
         if (active_nodes.size() == 1) {
             break;
         }
         perform_round(thresholds[i]);
         auto en_round = utils::get_time();
-        std::cout << "Ending round " << i << " with " << active_nodes.size() << " nodes in " << utils::timedur(st_round,en_round) << " seconds." << std::endl;
+        if (verbosity > 0)
+            std::cout << "Ending round " << i << " with " << active_nodes.size() << " nodes in " << utils::timedur(st_round,en_round) << " seconds." << std::endl;
+        reporter.get().add(1);
+        reporter.report();
         i += 1;
     }
     auto en_cluster = utils::get_time();
-    std::cout << "Ending llama clustering in " << utils::timedur(st_cluster, en_cluster) << " seconds." << std::endl;
+    if (verbosity > 0)
+        std::cout << "Ending llama clustering in " << utils::timedur(st_cluster, en_cluster) << " seconds." << std::endl;
     clustering_run = true;
+    return i >= num_rounds || active_nodes.size() == 1;
 }
 
 void LLAMA::perform_round(scalar threshold)
 {
+    RoundProfile round;
+    round.nodes = active_nodes.size();
+    auto st = get_time();
     one_nn(threshold);
+    auto en = get_time();
+    round.one_nn_time = sec(st, en);
+    st = en;
     propose_parents();
+    en = get_time();
+    round.propose_parents_time = sec(st, en);
+    st = en;
     contract();
+    en = get_time();
+    round.contract_time = sec(st, en);
+    st = en;
     prune_to_k_neighbors();
+    en = get_time();
+    round.prune_time = sec(st, en);
+    measure_round(round);
+    profile.push_back(round);
     round_id += 1;
 }
 
+// Approximate heap bytes of node based containers: each element plus the
+// links of its tree node, or plus its hash node and bucket
+template <class Container>
+static size_t tree_bytes(const Container &c)
+{
+    return c.size() * (sizeof(typename Container::value_type) + 4 * sizeof(void *));
+}
+
+template <class Container>
+static size_t hash_bytes(const Container &c)
+{
+    return c.size() * (sizeof(typename Container::value_type) + 2 * sizeof(void *)) + c.bucket_count() * sizeof(void *);
+}
+
+void LLAMA::measure_round(RoundProfile &round) const
+{
+    for (LLAMANode * m_node : active_nodes)
+        round.edges += m_node->neighbors.size();
+    round.edges /= 2;
+
+    // the children of each parent chosen in this round
+    const std::vector<node_id_t> *parent2children = all_parent2children.back();
+    std::vector<size_t> num_parents(round.nodes, 0);
+    for (size_t m = 0; m < number_of_active_ids.back(); ++m)
+    {
+        round.parent_edges += parent2children[m].size();
+        for (node_id_t c : parent2children[m])
+            if (c < num_parents.size())
+                round.max_parents = std::max(round.max_parents, ++num_parents[c]);
+    }
+
+    for (LLAMANode * m_node : graph_nodes)
+    {
+        round.neighbor_bytes += tree_bytes(m_node->neighbors) + tree_bytes(m_node->new_neighbors)
+            + hash_bytes(m_node->cc_edges);
+        round.descendant_bytes += tree_bytes(m_node->descendants) + tree_bytes(m_node->new_descendants)
+            + tree_bytes(m_node->leaf_sims) + tree_bytes(m_node->leafs);
+    }
+}
+
 void LLAMA::one_nn(scalar threshold)
 {
     for (LLAMANode * m_node : active_nodes) {
@@ -144,7 +218,6 @@ void LLAMA::contract()
 
 void LLAMA::contract_bag_average()
 {
-    auto c1_st = get_time();
     std::unordered_set<LLAMANode *> new_active_nodes;
 
     // Clear any old parents
@@ -171,7 +244,6 @@ void LLAMA::contract_bag_average()
         // std::cout << "Pruning to " << max_num_parents << " parents..." << std::endl;
         // Set parent_counts to be zeros
         // // std::cout << "Zeroing parent_counts..." << std::endl;
-        // auto prune_parents_st = get_time();
         for (LLAMANode * m_node: active_nodes) {
             m_node->parent_count = 0;
             m_node->new_node_count = 0;
@@ -253,10 +325,6 @@ void LLAMA::contract_bag_average()
         }
         // std::cout << "Selecting new_active_nodes...Done!" << std::endl;
         // std::cout << "Selecting new_active_nodes...Done! new_active_nodes.size()=" << new_active_nodes.size() << std::endl;
-
-        // auto prune_parents_end = get_time();
-        // auto pp_time = sec(prune_parents_end, prune_parents_st);
-        // std::cout << "Starting to prune parents...Done! in " << pp_time <<  " seconds." << std::endl;
     } else {
         for (LLAMANode * m_node: active_nodes) {
             new_active_nodes.insert(m_node->chosen_parent);
@@ -285,12 +353,7 @@ void LLAMA::contract_bag_average()
 
     save_parents(new_active_nodes);
 
-    auto c1_end = get_time();
-    auto c1_time = sec(c1_end, c1_st);
-    // std::cout << "Contract Step1: " << c1_time << " seconds." << std::endl;
-
     // now we add graph edges for the next round
-    auto c2_st = get_time();
     for (LLAMANode * m_node: active_nodes) {
         if (!m_node->skip)
         {
@@ -358,9 +421,6 @@ void LLAMA::contract_bag_average()
             m_node->new_neighbors.clear();
         }
     }
-    // auto c2_end = get_time();
-    // auto c2_time = sec(c2_st, c2_end);
-    // std::cout << "Contract Step2: " << c2_time << " seconds." << std::endl;
 
     // auto c3_st = get_time();
     active_nodes.clear();
@@ -378,7 +438,6 @@ void LLAMA::contract_bag_average()
 void LLAMA::contract_set_average()
 {
     // each node needs to do the following:
-    auto c1_st = get_time();
 
     if (round_id == 0)
     {
@@ -419,7 +478,6 @@ void LLAMA::contract_set_average()
     {
         // std::cout << "Starting to prune parents..." << std::endl;
         // std::cout << "Pruning to " << max_num_parents << " parents..." << std::endl;
-        auto prune_parents_st = get_time();
  
         // Set parent_counts to be zeros
         // std::cout << "Zeroing parent_counts..." << std::endl;
@@ -504,18 +562,10 @@ void LLAMA::contract_set_average()
         }
         // std::cout << "Selecting new_active_nodes...Done!" << std::endl;
         // std::cout << "Selecting new_active_nodes...Done! new_active_nodes.size()=" << new_active_nodes.size() << std::endl;
-
-        auto prune_parents_end = get_time();
-        auto pp_time = sec(prune_parents_end, prune_parents_st);
-        // std::cout << "Starting to prune parents...Done! in " << pp_time <<  " seconds." << std::endl;
     }
 
     save_parents(new_active_nodes);
 
-    auto c1_end = get_time();
-    auto c1_time = sec(c1_end, c1_st);
-    // std::cout << "Contract Step1: " << c1_time << " seconds." << std::endl;
-
     // collect my new descendants
     // std::cout << "Collecting descendants..." << std::endl;
 
@@ -552,7 +602,6 @@ void LLAMA::contract_set_average()
     // now we add graph edges for the next round
     // std::cout << "Computing distances..." << std::endl;
 
-    auto c2_st = get_time();
     for (LLAMANode * m_node : active_nodes)  {
         if (!m_node->skip)
         {
@@ -613,19 +662,13 @@ void LLAMA::contract_set_average()
             m_node->new_neighbors.clear();
         }
     }
-    auto c2_end = get_time();
-    auto c2_time = sec(c2_st, c2_end);
-    // std::cout << "Contract Step2: " << c2_time << " seconds." << std::endl;
 
-    auto c3_st = get_time();
     active_nodes.clear();
     for (LLAMANode * x : new_active_nodes)
     {
         active_nodes.push_back(x);
     }
 
-    auto c3_end = get_time();
-    auto c3_time = sec(c3_end, c3_st);
 
     // std::cout << "Contract Step3: " << c3_time << " seconds." << std::endl;
 }
@@ -633,7 +676,6 @@ void LLAMA::contract_set_average()
 void LLAMA::contract_single()
 {
     // each node needs to do the following:
-    auto c1_st = get_time();
     std::unordered_set<LLAMANode *> new_active_nodes;
 
     // Clear any old parents
@@ -658,7 +700,6 @@ void LLAMA::contract_single()
     {
         // std::cout << "Starting to prune parents..." << std::endl;
         // std::cout << "Pruning to " << max_num_parents << " parents..." << std::endl;
-        auto prune_parents_st = get_time();
         new_active_nodes.clear();
 
         // Set parent_counts to be zeros
@@ -746,20 +787,11 @@ void LLAMA::contract_single()
         }
         // std::cout << "Selecting new_active_ids...Done!" << std::endl;
         // std::cout << "Selecting new_active_ids...Done! new_active_ids.size()=" << new_active_ids.size() << std::endl;
-
-        auto prune_parents_end = get_time();
-        auto pp_time = sec(prune_parents_end, prune_parents_st);
-        // std::cout << "Starting to prune parents...Done! in " << pp_time <<  " seconds." << std::endl;
     }
 
     save_parents(new_active_nodes);
 
-    auto c1_end = get_time();
-    auto c1_time = sec(c1_end, c1_st);
-    // std::cout << "Contract Step1: " << c1_time << " seconds." << std::endl;
-
     // now we add graph edges for the next round
-    auto c2_st = get_time();
     for (LLAMANode * m_node : active_nodes) {
         if (!m_node->skip)
         {
@@ -844,19 +876,13 @@ void LLAMA::contract_single()
             m_node->new_neighbors.clear();
         }
     }
-    auto c2_end = get_time();
-    auto c2_time = sec(c2_st, c2_end);
-    // std::cout << "Contract Step2: " << c2_time << " seconds." << std::endl;
 
-    auto c3_st = get_time();
     active_nodes.clear();
     for (LLAMANode * x : new_active_nodes)
     {
         active_nodes.push_back(x);
     }
 
-    auto c3_end = get_time();
-    auto c3_time = sec(c3_end, c3_st);
 
     // std::cout << "Contract Step3: " << c3_time << " seconds." << std::endl;
 }
@@ -885,7 +911,6 @@ void LLAMA::get_child_parent_edges()
     {
         children.clear();
         parents.clear();
-        auto build_desc_st = get_time();
         // std::cout << "number of active ids: " << number_of_active_ids.size() << std::endl;
         int offset = 0;
         for (int r = 0; r < number_of_active_ids.size(); r++)
@@ -902,8 +927,6 @@ void LLAMA::get_child_parent_edges()
             // std::cout << "children.size() " << children.size() << std::endl;
             // std::cout << "parents.size() " << parents.size() << std::endl;
         }
-        auto build_desc_end = get_time();
-        auto build_desc_time = sec(build_desc_st, build_desc_end);
     }
 }
 
@@ -950,12 +973,7 @@ void LLAMA::set_descendants()
                                                 }
                                             });
         }
-        auto build_desc_end = get_time();
-        auto build_desc_time = sec(build_desc_st, build_desc_end);
-        // std::cout << "Building descendants...: " << build_desc_time << " seconds." << std::endl;
-
         // std::cout << "Set descendants_c...: " << std::endl;
-        auto build_desc_start1 = get_time();
         // rounds
         int offset = 0;
         std::map<node_id_t, node_id_t> uniqMap;
@@ -983,14 +1001,12 @@ void LLAMA::set_descendants()
             offset += number_of_active_ids[r];
         }
         // delete[] all_node2pruned;
-        auto build_desc_end1 = get_time();
-        auto build_desc_time1 = sec(build_desc_start1, build_desc_end1);
+        set_descendants_time = sec(build_desc_st, get_time());
     }
 }
 
 void LLAMA::save_parents(std::unordered_set<LLAMANode *> &parent_ids)
 {
-    auto sp_start = get_time();
     // if this is the first round
     if (round_id == 0)
     {
@@ -1041,8 +1057,6 @@ void LLAMA::save_parents(std::unordered_set<LLAMANode *> &parent_ids)
     }
     all_parent2children.push_back(this_round_children);
     all_map_active_ids_to_seq_id.push_back(parentid2idx);
-    auto sp_end = get_time();
-    auto sp_time = sec(sp_end, sp_start);
 }
 
 void LLAMA::propose_parents()
@@ -1080,15 +1094,20 @@ LLAMA::LLAMA(
     unsigned cores,
     unsigned max_num_parents,
     unsigned max_num_neighbors,
-    scalar lowest_value)
+    scalar lowest_value,
+    unsigned verbosity,
+    utils::Progress *progress)
 {
-    std::cout << "graphgrove - LLAMA Constructor....V0.0.2" << std::endl;
-    std::cout << "num rows .... " << r.size() << std::endl;
-    std::cout << "num cols .... " << c.size() << std::endl;
-    std::cout << "num sims .... " << s.size() << std::endl;
-    std::cout << "MAX_NODES .... " << MAX_NODES << std::endl;
-
-    std::cout << "parameters .... " << std::endl;
+    this->verbosity = verbosity;
+    if (verbosity > 0)
+    {
+        std::cout << "graphgrove - LLAMA Constructor....V0.0.2" << std::endl;
+        std::cout << "num rows .... " << r.size() << std::endl;
+        std::cout << "num cols .... " << c.size() << std::endl;
+        std::cout << "num sims .... " << s.size() << std::endl;
+        std::cout << "MAX_NODES .... " << MAX_NODES << std::endl;
+        std::cout << "parameters .... " << std::endl;
+    }
     this->num_rounds = num_rounds;
     this->thresholds = thresholds;
     this->cores = cores;
@@ -1096,22 +1115,26 @@ LLAMA::LLAMA(
     this->max_num_neighbors = max_num_neighbors;
     this->lowest_value = lowest_value;
     this->linkage = linkage;
-    std::cout << "num_rounds .... " << this->num_rounds << std::endl;
-    std::cout << "cores .... " << this->cores << std::endl;
-    std::cout << "linkage .... " << this->linkage << std::endl;
-    std::cout << "num_rounds .... " << this->num_rounds << std::endl;
-    std::cout << "max_num_parents .... " << this->max_num_parents << std::endl;
-    std::cout << "max_num_neighbors .... " << this->max_num_neighbors << std::endl;
-    std::cout << "lowest_value .... " << this->lowest_value << std::endl;
-    std::cout << "building edge graph...." << std::endl;
+    if (verbosity > 0)
+    {
+        std::cout << "num_rounds .... " << this->num_rounds << std::endl;
+        std::cout << "cores .... " << this->cores << std::endl;
+        std::cout << "linkage .... " << this->linkage << std::endl;
+        std::cout << "num_rounds .... " << this->num_rounds << std::endl;
+        std::cout << "max_num_parents .... " << this->max_num_parents << std::endl;
+        std::cout << "max_num_neighbors .... " << this->max_num_neighbors << std::endl;
+        std::cout << "lowest_value .... " << this->lowest_value << std::endl;
+        std::cout << "building edge graph...." << std::endl;
+    }
 
     init_all_nodes();
 
     std::unordered_set<LLAMANode *> uniq_nodes;
 
-    for (int i = 0; i < r.size(); i++)
+    // Once cancelled the remaining edges are dropped and from_graph discards the graph
+    utils::Reporter reporter(r.size(), progress, r.size() > 100000);
+    for (size_t i = 0; i < r.size() && reporter.tick(i); i++)
     {
-        utils::progressbar(i, r.size());
         LLAMANode * r_node = all_nodes[r[i]];
         LLAMANode * c_node = all_nodes[c[i]];
         if (r_node != c_node)
@@ -1125,13 +1148,32 @@ LLAMA::LLAMA(
         uniq_nodes.insert(r_node);
         uniq_nodes.insert(c_node);
     }
+    graph_complete = !reporter.stopped_early();
     for (const auto &x : uniq_nodes)
     {
         active_nodes.push_back(x);
     }
+    graph_nodes = active_nodes;
     num_points = active_nodes.size();
-    std::cout << "num_points .... " << this->num_points << std::endl;
-    std::cout << "building edge graph....Done!" << std::endl;
+    if (verbosity > 0)
+    {
+        std::cout << "num_points .... " << this->num_points << std::endl;
+        std::cout << "building edge graph....Done!" << std::endl;
+    }
+}
+
+void LLAMA::set_point_counts(const std::vector<scalar> &counts)
+{
+    for (LLAMANode * m_node : active_nodes)
+    {
+        if (m_node->ID < counts.size())
+            m_node->count = counts[m_node->ID];
+    }
+    for (LLAMANode * m_node : active_nodes)
+    {
+        for (auto &pair : m_node->neighbors)
+            pair.second *= m_node->count * pair.first->count;
+    }
 }
 
 void LLAMA::prune_to_k_neighbors()
@@ -1139,7 +1181,6 @@ void LLAMA::prune_to_k_neighbors()
     if (max_num_neighbors > 0)
     {
         // std::cout << date_get_time() << "Running prune_to_k_neighbors..." << std::endl;
-        auto st = get_time();
         for (LLAMANode * m_node: active_nodes) {
             std::priority_queue<std::pair<scalar, LLAMANode *>> pq;
             for (const auto &p :   m_node->neighbors)
@@ -1165,8 +1206,6 @@ void LLAMA::prune_to_k_neighbors()
                 }
             }
         }
-        auto en = get_time();
-        auto prune_time = sec(st, en);
         // std::cout << "Running prune_to_k_neighbors...Done in " << prune_time << " seconds." << std::endl;
     }
 }
\ No newline at end of file
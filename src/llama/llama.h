@@ -65,6 +65,7 @@ typedef uint32_t node_id_t;
 class LLAMA
 {
 public:
+    // NULL if progress was cancelled before every edge was read
     static LLAMA *from_graph(
         std::vector<uint32_t> r,
         std::vector<uint32_t> c,
@@ -75,7 +76,9 @@ public:
         unsigned cores,
         unsigned max_num_parents,
         unsigned max_num_neighbors,
-        scalar lowest_value);
+        scalar lowest_value,
+        unsigned verbosity = 1,
+        utils::Progress *progress = nullptr);
 
     LLAMA(
         std::vector<uint32_t> r,
@@ -87,7 +90,9 @@ public:
         unsigned cores,
         unsigned max_num_parents,
         unsigned max_num_neighbors,
-        scalar lowest_value);
+        scalar lowest_value,
+        unsigned verbosity = 1,
+        utils::Progress *progress = nullptr);
 
     // the maximum total allowable number of nodes
     const static size_t MAX_NODES = 2000000;
@@ -120,6 +125,28 @@ public:
     scalar *thresholds;
 
     bool clustering_run = false;
+    // false if progress was cancelled while reading the edges
+    bool graph_complete = true;
+
+    // 0 silent, 1 the graph summary and one line per round on stdout
+    unsigned verbosity = 1;
+
+    // Work done and memory held in each round of cluster()
+    struct RoundProfile
+    {
+        scalar one_nn_time = 0;             // seconds in each phase
+        scalar propose_parents_time = 0;
+        scalar contract_time = 0;
+        scalar prune_time = 0;
+        size_t nodes = 0;                   // active nodes at the start of the round
+        size_t edges = 0;                   // graph edges left for the next round
+        size_t parent_edges = 0;            // child -> parent edges of the round
+        size_t max_parents = 0;             // most parents of one child
+        size_t neighbor_bytes = 0;          // approx. heap bytes of the neighbor maps
+        size_t descendant_bytes = 0;        // approx. heap bytes of the descendant sets
+    };
+    std::vector<RoundProfile> profile;
+    scalar set_descendants_time = 0;
 
     class LLAMANode
     {
@@ -163,7 +190,13 @@ public:
         }
     };
 
-    void cluster();
+    // number of identical points behind each point, before clustering; only
+    // bag average linkage weighs points by count, the edge similarities are
+    // scaled by the product of the counts so that averages are unchanged
+    void set_point_counts(const std::vector<scalar> &counts);
+
+    // false if progress was cancelled before the last round
+    bool cluster(utils::Progress *progress = nullptr);
     void perform_round(scalar threshold);
     void propose_parents();
     void one_nn(scalar threshold);
@@ -184,6 +217,9 @@ public:
     std::unordered_map<node_id_t, node_id_t> cc_parents;
 
     std::vector<LLAMANode *> active_nodes;
+    // nodes of the input graph; the nodes of later rounds are drawn from these
+    std::vector<LLAMANode *> graph_nodes;
+    void measure_round(RoundProfile &round) const;
 
     std::vector<LLAMANode *> all_nodes;
     void init_all_nodes() {
@@ -231,7 +267,7 @@ public:
     scalar sec(std::chrono::time_point<std::chrono::high_resolution_clock> st,
                std::chrono::time_point<std::chrono::high_resolution_clock> en)
     {
-        return std::chrono::duration_cast<std::chrono::seconds>(en - st).count();
+        return std::chrono::duration<scalar>(en - st).count();
     }
 };
 
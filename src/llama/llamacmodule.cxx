@@ -45,8 +45,10 @@ static PyObject *new_llamac(PyObject *self, PyObject *args)
   long max_num_parents;
   long max_num_neighbors;
   double lowest_value;
+  long verbosity = 1;
+  size_t progress_ptr = 0;
 
-  if (!PyArg_ParseTuple(args, "O!O!O!llO!llld:new_llamac",
+  if (!PyArg_ParseTuple(args, "O!O!O!llO!llld|ln:new_llamac",
                         &PyArray_Type, &rows_in,
                         &PyArray_Type, &cols_in,
                         &PyArray_Type, &sims_in,
@@ -56,7 +58,9 @@ static PyObject *new_llamac(PyObject *self, PyObject *args)
                         &cores,
                         &max_num_parents,
                         &max_num_neighbors,
-                        &lowest_value))
+                        &lowest_value,
+                        &verbosity,
+                        &progress_ptr))
     return NULL;
 
   long rowsInDim = PyArray_DIM(rows_in, 0);
@@ -76,27 +80,120 @@ static PyObject *new_llamac(PyObject *self, PyObject *args)
   std::vector<node_id_t> row_v(row, row + rowsInDim);
   std::vector<node_id_t> col_v(col, col + colsInDim);
   std::vector<scalar> sims_v(sims, sims + simsInDim);
-  LLAMA *d = LLAMA::from_graph(row_v, col_v, sims_v, linkage, num_rounds, thresholds, cores, max_num_parents, max_num_neighbors, (scalar)lowest_value);
+  LLAMA *d;
+  Py_BEGIN_ALLOW_THREADS
+  d = LLAMA::from_graph(row_v, col_v, sims_v, linkage, num_rounds, thresholds, cores, max_num_parents, max_num_neighbors, (scalar)lowest_value, unsigned(verbosity),
+                       reinterpret_cast<utils::Progress *>(progress_ptr));
+  Py_END_ALLOW_THREADS
+  // NULL only if reading the edges stopped early
+  if (d == NULL)
+  {
+    PyErr_Format(LLAMAcError, "cancelled");
+    return NULL;
+  }
   size_t int_ptr = reinterpret_cast<size_t>(d);
   return Py_BuildValue("k", int_ptr);
 }
 
+static PyObject *llamac_set_point_counts(PyObject *self, PyObject *args)
+{
+  LLAMA *obj;
+  size_t int_ptr;
+  PyArrayObject *counts_in;
+
+  if (!PyArg_ParseTuple(args, "kO!:llamac_set_point_counts", &int_ptr, &PyArray_Type, &counts_in))
+    return NULL;
+
+  obj = reinterpret_cast<LLAMA *>(int_ptr);
+  if (obj->linkage != 2 || obj->clustering_run)
+  {
+    PyErr_Format(LLAMAcError, "point counts need approx. average linkage and must be set before clustering");
+    return NULL;
+  }
+
+  long countsInDim = PyArray_DIM(counts_in, 0);
+  long idx[2] = {0, 0};
+  scalar *counts = reinterpret_cast<scalar *>(PyArray_GetPtr(counts_in, idx));
+  obj->set_point_counts(std::vector<scalar>(counts, counts + countsInDim));
+
+  Py_RETURN_NONE;
+}
+
 static PyObject *llamac_cluster(PyObject *self, PyObject *args)
 {
 
   LLAMA *obj;
   size_t int_ptr;
+  long verbosity = 1;
+  size_t progress_ptr = 0;
 
   /*  parse the input, from python int to c++ int */
-  if (!PyArg_ParseTuple(args, "k:llamac_cluster", &int_ptr))
+  if (!PyArg_ParseTuple(args, "k|ln:llamac_cluster", &int_ptr, &verbosity, &progress_ptr))
     return NULL;
 
   obj = reinterpret_cast<LLAMA *>(int_ptr);
-  obj->cluster();
+  obj->verbosity = unsigned(verbosity);
+  bool finished;
+  Py_BEGIN_ALLOW_THREADS
+  finished = obj->cluster(reinterpret_cast<utils::Progress *>(progress_ptr));
+  Py_END_ALLOW_THREADS
+  // the rounds finished before the cancellation are kept
+  if (!finished)
+  {
+    PyErr_Format(LLAMAcError, "cancelled");
+    return NULL;
+  }
 
   Py_RETURN_NONE;
 }
 
+static PyObject *llamac_profile(PyObject *self, PyObject *args)
+{
+  LLAMA *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "k:llamac_profile", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast<LLAMA *>(int_ptr);
+  const std::vector<LLAMA::RoundProfile> &profile = obj->profile;
+  npy_intp dims[1] = {(npy_intp) profile.size()};
+
+  PyObject *results = PyDict_New();
+  auto add_times = [&](const char *name, scalar LLAMA::RoundProfile::*field) {
+    PyObject *arr = PyArray_SimpleNew(1, dims, NPY_FLOAT64);
+    double *data = reinterpret_cast<double *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(arr)));
+    for (size_t r = 0; r < profile.size(); r++)
+      data[r] = profile[r].*field;
+    PyDict_SetItemString(results, name, arr);
+    Py_DECREF(arr);
+  };
+  auto add_counts = [&](const char *name, size_t LLAMA::RoundProfile::*field) {
+    PyObject *arr = PyArray_SimpleNew(1, dims, NPY_INT64);
+    int64_t *data = reinterpret_cast<int64_t *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(arr)));
+    for (size_t r = 0; r < profile.size(); r++)
+      data[r] = int64_t(profile[r].*field);
+    PyDict_SetItemString(results, name, arr);
+    Py_DECREF(arr);
+  };
+  add_times("one_nn_time", &LLAMA::RoundProfile::one_nn_time);
+  add_times("propose_parents_time", &LLAMA::RoundProfile::propose_parents_time);
+  add_times("contract_time", &LLAMA::RoundProfile::contract_time);
+  add_times("prune_time", &LLAMA::RoundProfile::prune_time);
+  add_counts("nodes", &LLAMA::RoundProfile::nodes);
+  add_counts("edges", &LLAMA::RoundProfile::edges);
+  add_counts("parent_edges", &LLAMA::RoundProfile::parent_edges);
+  add_counts("max_parents", &LLAMA::RoundProfile::max_parents);
+  add_counts("neighbor_bytes", &LLAMA::RoundProfile::neighbor_bytes);
+  add_counts("descendant_bytes", &LLAMA::RoundProfile::descendant_bytes);
+
+  PyObject *o = PyFloat_FromDouble(obj->set_descendants_time);
+  PyDict_SetItemString(results, "set_descendants_time", o);
+  Py_DECREF(o);
+
+  return Py_BuildValue("N", results);
+}
+
 static PyObject *llamac_all_nodes_coo(PyObject *self, PyObject *args)
 {
 
@@ -236,6 +333,49 @@ static PyObject *delete_llamac(PyObject *self, PyObject *args)
   return Py_BuildValue("k", int_ptr);
 }
 
+static PyObject *llamac_progress_new(PyObject *self, PyObject *args)
+{
+  utils::Progress *obj = new utils::Progress;
+  size_t int_ptr = reinterpret_cast<size_t>(obj);
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *llamac_progress_status(PyObject *self, PyObject *args)
+{
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:llamac_progress_status", &int_ptr))
+    return NULL;
+
+  utils::Progress *obj = reinterpret_cast<utils::Progress *>(int_ptr);
+  return Py_BuildValue("nnO", Py_ssize_t(obj->done()), Py_ssize_t(obj->expected()), obj->cancelled() ? Py_True : Py_False);
+}
+
+static PyObject *llamac_progress_cancel(PyObject *self, PyObject *args)
+{
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:llamac_progress_cancel", &int_ptr))
+    return NULL;
+
+  reinterpret_cast<utils::Progress *>(int_ptr)->cancel();
+  Py_RETURN_NONE;
+}
+
+static PyObject *llamac_progress_delete(PyObject *self, PyObject *args)
+{
+  utils::Progress *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:llamac_progress_delete", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast<utils::Progress *>(int_ptr);
+  delete obj;
+
+  return Py_BuildValue("n", int_ptr);
+}
+
 PyMODINIT_FUNC PyInit_llamac(void)
 {
   PyObject *m;
@@ -243,9 +383,15 @@ PyMODINIT_FUNC PyInit_llamac(void)
       {"new", new_llamac, METH_VARARGS, "Initialize."},
       {"delete", delete_llamac, METH_VARARGS, "Delete."},
       {"cluster", llamac_cluster, METH_VARARGS, "Run alg."},
+      {"profile", llamac_profile, METH_VARARGS, "Per round timings and sizes."},
+      {"set_point_counts", llamac_set_point_counts, METH_VARARGS, "Set the number of identical points behind each point."},
       {"get_descendants", llamac_all_nodes_coo, METH_VARARGS, "get descendants coo."},
       {"get_child_parent_edges", llamac_child_parent_coo, METH_VARARGS, "get coo."},
       {"get_round", llamac_get_round_coo, METH_VARARGS, "get round descendants coo."},
+      {"progress_new", llamac_progress_new, METH_VARARGS, "Create a progress counter for long operations."},
+      {"progress_status", llamac_progress_status, METH_VARARGS, "Steps done, steps expected and whether cancelled."},
+      {"progress_cancel", llamac_progress_cancel, METH_VARARGS, "Stop the operations reporting into a progress counter."},
+      {"progress_delete", llamac_progress_delete, METH_VARARGS, "Delete a progress counter."},
       {NULL, NULL, 0, NULL}};
   static struct PyModuleDef mdef = {PyModuleDef_HEAD_INIT,
                                     "llamac",
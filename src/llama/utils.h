@@ -26,6 +26,9 @@
 #include <atomic>
 #include <thread>
 #include <future>
+#include <functional>
+#include <chrono>
+#include <algorithm>
 
 #include <Eigen/Core>
 
@@ -264,6 +267,129 @@ namespace utils
         return f;
     }
 
+    /*** Progress and cancellation of a long operation ***/
+    // Workers add finished steps to per-thread counters once per block of
+    // elements and stop at the next block once cancelled; a reporting thread
+    // (or another caller) sums the counters whenever it likes.
+    class Progress
+    {
+        // padded by hand to a cache line each, over-aligned types would need aligned new
+        struct Slot
+        {
+            std::atomic<size_t> done{0};
+            char pad[64 - sizeof(std::atomic<size_t>)];
+        };
+        static const unsigned num_slots = 64;
+        Slot slots[num_slots];
+        std::atomic<size_t> total{0};
+        std::atomic<bool> stop{false};
+
+        static unsigned thread_slot()
+        {
+            static std::atomic<unsigned> next{0};
+            thread_local unsigned slot = next++ % num_slots;
+            return slot;
+        }
+
+    public:
+        std::function<void(size_t, size_t)> callback;  // (done, total), called by reporting threads
+
+        void expect(size_t steps) { total.fetch_add(steps, std::memory_order_relaxed); }
+        void add(size_t steps) { slots[thread_slot()].done.fetch_add(steps, std::memory_order_relaxed); }
+        void cancel() { stop.store(true, std::memory_order_relaxed); }
+        bool cancelled() const { return stop.load(std::memory_order_relaxed); }
+
+        size_t expected() const { return total.load(std::memory_order_relaxed); }
+        size_t done() const
+        {
+            size_t sum = 0;
+            for (unsigned i = 0; i < num_slots; ++i)
+                sum += slots[i].done.load(std::memory_order_relaxed);
+            return sum;
+        }
+    };
+
+    /*** Counts one loop into the given progress, or draws a bar on stderr if there is none ***/
+    class Reporter
+    {
+        Progress local;
+        Progress* progress;
+        size_t total;
+        size_t counted = 0;             // steps of a serial loop already added
+        size_t reached = 0;             // and finished
+        bool draw;
+        bool stopped = false;           // a serial loop left before its end
+        int drawn = -1;                 // last tenth drawn
+
+    public:
+        static const size_t block = 1024;
+
+        Reporter(size_t total, Progress* into, bool bar = true)
+            : progress(into), total(total), draw(false)
+        {
+            if (progress == nullptr)
+            {
+                progress = &local;
+                draw = bar;
+            }
+            progress->expect(total);
+        }
+
+        ~Reporter()
+        {
+            progress->add(reached - counted);
+            report();
+            if (draw && drawn >= 0)
+                std::cerr << std::endl;
+        }
+
+        Progress& get() { return *progress; }
+        bool cancelled() const { return progress->cancelled(); }
+        bool stopped_early() const { return stopped; }
+
+        // From the thread that waits for the workers only
+        void report()
+        {
+            size_t done = progress->done();
+            if (progress->callback)
+                progress->callback(done, progress->expected());
+            if (!draw || total == 0)
+                return;
+            int tenth = int(std::min(done, total) * 10 / total);
+            if (tenth == drawn)
+                return;
+            drawn = tenth;
+            const unsigned w = 50, c = unsigned(tenth) * w / 10;
+            std::cerr << std::setw(3) << tenth * 10 << "% [";
+            for (unsigned x = 0; x < c; x++) std::cerr << "=";
+            for (unsigned x = c; x < w; x++) std::cerr << " ";
+            std::cerr << "]\r" << std::flush;
+        }
+
+        // For serial loops, called with the index of every element; false once cancelled
+        bool tick(size_t i)
+        {
+            reached = i + 1;
+            if ((i & (block - 1)) != 0)
+                return true;
+            progress->add(i - counted);
+            counted = i;
+            report();
+            if (!progress->cancelled())
+                return true;
+            reached = i;
+            stopped = true;
+            return false;
+        }
+    };
+
+    /*** True once progress, if any, is cancelled ***/
+    inline bool cancelled(const Progress* progress)
+    {
+        return progress != nullptr && progress->cancelled();
+    }
+
+
     template<typename T>
     void add_to_atomic(std::atomic<T>& foo, T& bar)
     {
@@ -38,7 +38,7 @@ std::map<int, std::atomic<unsigned>> SGTree::Node::dist_count;
 #endif
 
 /******************************* Insert ***********************************************/
-bool SGTree::insert(SGTree::Node* current, const pointType& p, const pointType& p_proj, unsigned UID, scalar dist_current)
+bool SGTree::insert(SGTree::Node* current, const pointType& p, const pointType& p_proj, unsigned UID, scalar dist_current, const scalar* p_ext)
 {
     bool result = false;
 #ifdef DEBUG
@@ -101,7 +101,7 @@ bool SGTree::insert(SGTree::Node* current, const pointType& p, const pointType&
         {
             // create a new child, a copy of the current node (with new id, but same UID)
             int new_id = N++;
-            Node * new_child = current->setChild(current->_p, current->_p_proj, current->UID, new_id);
+            Node * new_child = current->setChild(current->_p, current->_p_proj, current->UID, new_id, current->_p_ext);
             result = true;
             current->mut.unlock();
 
@@ -112,12 +112,12 @@ bool SGTree::insert(SGTree::Node* current, const pointType& p, const pointType&
             }
 
             // now insert the new point into the new child.
-            insert(new_child, p, p_proj, UID, dist_current);
+            insert(new_child, p, p_proj, UID, dist_current, p_ext);
         }
         else
         {
             current->mut.unlock();
-            result = insert(current, p, p_proj, UID, dist_current);
+            result = insert(current, p, p_proj, UID, dist_current, p_ext);
         }
 
     }
@@ -128,7 +128,7 @@ bool SGTree::insert(SGTree::Node* current, const pointType& p, const pointType&
         if (child->maxdistUB < dist_child)
            child->maxdistUB = dist_child;
         current->mut.unlock_shared();
-        result = insert(child, p, p_proj,  UID, dist_child);
+        result = insert(child, p, p_proj,  UID, dist_child, p_ext);
     }
     else
     {
@@ -139,7 +139,7 @@ bool SGTree::insert(SGTree::Node* current, const pointType& p, const pointType&
         if (num_children==current->children.size())
         {
             int new_id = N++;
-            current->setChild(p, p_proj, UID, new_id);
+            current->setChild(p, p_proj, UID, new_id, p_ext);
             result = true;
             current->mut.unlock();
 
@@ -152,7 +152,7 @@ bool SGTree::insert(SGTree::Node* current, const pointType& p, const pointType&
         else
         {
             current->mut.unlock();
-            result = insert(current, p, p_proj, UID, dist_current);
+            result = insert(current, p, p_proj, UID, dist_current, p_ext);
         }
     }
     return result;
@@ -195,7 +195,7 @@ void SGTree::calc_maxdist()
     }
 }
 
-bool SGTree::insert(const pointType& p, const pointType& p_proj, unsigned UID)
+bool SGTree::insert(const pointType& p, const pointType& p_proj, unsigned UID, const scalar* p_ext)
 {
     bool result = false;
     id_valid = false;
@@ -226,7 +226,7 @@ bool SGTree::insert(const pointType& p, const pointType& p_proj, unsigned UID)
             if (parent != NULL)
             {
                 parent->children.pop_back();
-                std::pair<SGTree::Node*, scalar> fni = FurthestNeighbour(current->_p);
+                std::pair<SGTree::Node*, scalar> fni = FurthestNeighbour(current->point());
                 current->level = root->level + 1;
                 current->maxdistUB = fni.second;
                 if (root != current) {
@@ -241,7 +241,9 @@ bool SGTree::insert(const pointType& p, const pointType& p_proj, unsigned UID)
             }
         }
         SGTree::Node* temp = new SGTree::Node;
-        temp->_p = p;
+        temp->_p_ext = p_ext;
+        if (temp->_p_ext == NULL)
+            temp->_p = p;
         temp->_p_proj = p_proj;
         temp->level = root->level + 1;
         temp->ID = N++;
@@ -258,7 +260,7 @@ bool SGTree::insert(const pointType& p, const pointType& p_proj, unsigned UID)
     else
     {
         // std::cout << "insert normal " << std::endl;
-        result = insert(root, p, p_proj, UID, curr_root_dist);
+        result = insert(root, p, p_proj, UID, curr_root_dist, p_ext);
         // std::cout << "insert beam " << std::endl;
     }
     global_mut.unlock_shared();
@@ -845,8 +847,14 @@ std::pair<SGTree::Node*, scalar> SGTree::rejectionSampleOne(const pointType &p)
 }
 
 /****************************** Dynamic Updates *************************************/
-void SGTree::update_vectors(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixType>& pMatrixProj) const
+void SGTree::update_vectors(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixType>& pMatrixProj)
 {
+    // points held externally now live in pMatrix, which must outlive the tree
+    if (originals != NULL)
+    {
+        originals = pMatrix.data();
+        num_originals = pMatrix.cols();
+    }
     std::stack<SGTree::Node*> travel;
     if (root != NULL)
         travel.push(root);
@@ -861,7 +869,11 @@ void SGTree::update_vectors(const Eigen::Map<matrixType>& pMatrix, const Eigen::
                 travel.push(child);
         }
 
-        current->_p = pMatrix.col(current->UID);
+        current->_p_ext = external(current->UID);
+        if (current->_p_ext == NULL)
+            current->_p = pMatrix.col(current->UID);
+        else
+            current->_p.resize(0);
         current->_p_proj = pMatrixProj.col(current->UID);
     }
 }
@@ -869,6 +881,7 @@ void SGTree::update_vectors(const Eigen::Map<matrixType>& pMatrix, const Eigen::
 void SGTree::rebuild_subtree(SGTree::Node * node) {
     std::vector<pointType> all_descendants;
     std::vector<pointType> all_descendants_proj;
+    std::vector<const scalar*> all_descendants_ext;
     std::vector<unsigned> uids;
     std::vector<SGTree::Node *> frontier;
     frontier.push_back(node);
@@ -876,8 +889,9 @@ void SGTree::rebuild_subtree(SGTree::Node * node) {
         SGTree::Node * cur = frontier.back();
         frontier.pop_back();
         for (SGTree::Node * kid : cur->children) {
-            all_descendants.push_back(kid->_p);
+            all_descendants.push_back(kid->_p);     // empty if held externally
             all_descendants_proj.push_back(kid->_p_proj);
+            all_descendants_ext.push_back(kid->_p_ext);
             uids.push_back(kid->UID);
             frontier.push_back(kid);
         }
@@ -889,7 +903,10 @@ void SGTree::rebuild_subtree(SGTree::Node * node) {
     node->children.clear();
     for (int i = 0; i < uids.size(); ++i) {
         // ignore value passed to dist current.
-        insert(node, all_descendants[i], all_descendants_proj[i], uids[i], 1000.0);
+        if (all_descendants_ext[i] != NULL)
+            insert(node, Eigen::Map<const pointType>(all_descendants_ext[i], D), all_descendants_proj[i], uids[i], 1000.0, all_descendants_ext[i]);
+        else
+            insert(node, all_descendants[i], all_descendants_proj[i], uids[i], 1000.0);
     }
 }
 
@@ -1030,8 +1047,8 @@ std::pair<SGTree::Node*, scalar> SGTree::FurthestNeighbour(const pointType &p) c
 char* SGTree::preorder_pack(char* buff, SGTree::Node* current) const
 {
     // copy current node
-    size_t shift = current->_p.rows() * sizeof(pointType::Scalar);
-    char* start = (char*)current->_p.data();
+    size_t shift = D * sizeof(pointType::Scalar);
+    char* start = (char*)current->point().data();
     char* end = start + shift;
     std::copy(start, end, buff);
     buff += shift;
@@ -1220,7 +1237,7 @@ SGTree::SGTree(const pointType& p, int truncateArg /*=-1*/)
 }
 
 //constructor: cover tree using points in the list between begin and end
-SGTree::SGTree(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixType>& pMatrixProj, int truncateArg /*=-1*/, unsigned cores /*=true*/)
+SGTree::SGTree(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixType>& pMatrixProj, int truncateArg /*=-1*/, unsigned cores /*=true*/, bool external_points /*=false*/)
 {
     size_t numPoints = pMatrix.cols();
     bool use_multi_core = cores > 1;
@@ -1254,9 +1271,16 @@ SGTree::SGTree(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixTyp
     truncate_level = truncateArg;
     N = 1;
     D = unsigned(mx.rows());
+    if (external_points)
+    {
+        originals = pMatrix.data();
+        num_originals = numPoints;
+    }
 
     root = new SGTree::Node;
-    root->_p = mx;
+    root->_p_ext = external(idx[numPoints-1]);
+    if (root->_p_ext == NULL)
+        root->_p = mx;
     root->_p_proj = mx_proj;
     root->level = scale_val; //-1000;
     root->maxdistUB = max_dist; // powdict[scale_val+1024];
@@ -1272,7 +1296,7 @@ SGTree::SGTree(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixTyp
             for (size_t i = 0; i < numPoints-1; ++i){
                 // std::cout << "Insert i " << i << " idx[i] " << idx[i] << std::endl;
                 utils::progressbar(i, numPoints);
-                if(!insert(pMatrix.col(idx[i]), pMatrixProj.col(idx[i]), idx[i]))
+                if(!insert(pMatrix.col(idx[i]), pMatrixProj.col(idx[i]), idx[i], external(idx[i])))
                     std::cout << "Insert failed!!! " << idx[i] << std::endl;
             }
         }
@@ -1281,14 +1305,14 @@ SGTree::SGTree(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixTyp
             for (size_t i = 0; i < 50000; ++i){
                 // std::cout << "Insert i " << i << " idx[i] " << idx[i] << std::endl;
                 utils::progressbar(i, 50000);
-                if(!insert(pMatrix.col(idx[i]), pMatrixProj.col(idx[i]), idx[i]))
+                if(!insert(pMatrix.col(idx[i]), pMatrixProj.col(idx[i]), idx[i], external(idx[i])))
                     std::cout << "Insert failed!!! " << idx[i] << std::endl;
             }
             utils::progressbar(50000, 50000);
             std::cerr<<std::endl;
             utils::parallel_for_progressbar(50000, numPoints-1, [&](size_t i)->void{
                 // std::cout << "Insert i " << i << " idx[i] " << idx[i] << std::endl;
-                if(!insert(pMatrix.col(idx[i]), pMatrixProj.col(idx[i]), idx[i]))
+                if(!insert(pMatrix.col(idx[i]), pMatrixProj.col(idx[i]), idx[i], external(idx[i])))
                     std::cout << "Insert failed!!! " << idx[i] << std::endl;
             }, cores);
         }
@@ -1297,7 +1321,7 @@ SGTree::SGTree(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixTyp
     {
         for (size_t i = 0; i < numPoints-1; ++i){
             utils::progressbar(i, numPoints);
-            if(!insert(pMatrix.col(idx[i]), pMatrixProj.col(idx[i]), idx[i]))
+            if(!insert(pMatrix.col(idx[i]), pMatrixProj.col(idx[i]), idx[i], external(idx[i])))
                 std::cout << "Insert failed!!! " << idx[i] <<  std::endl;
         }
     }
@@ -1333,11 +1357,11 @@ SGTree::~SGTree()
 /****************************** Public API for creation of Cover Trees *************************************/
 
 //contructor: using matrix in col-major form!
-SGTree* SGTree::from_matrix(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixType>& pMatrixOther, int truncate /*=-1*/, unsigned cores /*=true*/)
+SGTree* SGTree::from_matrix(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixType>& pMatrixOther, int truncate /*=-1*/, unsigned cores /*=true*/, bool external_points /*=false*/)
 {
     std::cout << "NysSG Tree [v009] with base " << SGTree::base << std::endl;
     std::cout << "NysSG Tree with Number of Cores: " << cores << std::endl;
-    SGTree* cTree = new SGTree(pMatrix, pMatrixOther, truncate, cores);
+    SGTree* cTree = new SGTree(pMatrix, pMatrixOther, truncate, cores, external_points);
     return cTree;
 }
 
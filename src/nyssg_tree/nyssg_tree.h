@@ -49,8 +49,9 @@ public:
     /*** structure for each node ***/
     struct Node
     {
-        pointType _p;                       // point associated with the node
+        pointType _p;                       // point associated with the node, empty if held externally
         pointType _p_proj;                  // if set, projected point associated with the node
+        const scalar* _p_ext = NULL;        // if set, the point in an external matrix instead of _p
         std::vector<Node*> children;        // list of children
         int level;                          // current level of the node
         scalar maxdistUB;                   // upper bound of distance to any of descendants
@@ -76,12 +77,20 @@ public:
         {
             return powdict[level + 1023];
         }
-        scalar dot(const pointType& pp) const   // inner product
+        Eigen::Map<const pointType> point() const   // point associated with the node, wherever it is stored
+        {
+            if (_p_ext != NULL)
+                return Eigen::Map<const pointType>(_p_ext, _p_proj.rows());
+            return Eigen::Map<const pointType>(_p.data(), _p.rows());
+        }
+        template<class Derived>
+        scalar dot(const Eigen::MatrixBase<Derived>& pp) const   // inner product
         {
             scalar dots = _p_proj.dot(pp);
             return dots;
         }
-        scalar dist(const pointType& pp) const   // inner product converted to dissimilarity between current node and point pp
+        template<class Derived>
+        scalar dist(const Eigen::MatrixBase<Derived>& pp) const   // inner product converted to dissimilarity between current node and point pp
         {
             scalar dots = _p_proj.dot(pp);
             return std::exp(-dots);
@@ -90,17 +99,20 @@ public:
 
         scalar dist(const Node* n) const         // inner proudct convereted to dissimilarity between current node and node n
         {
-            return dist(n->_p);
+            return dist(n->point());
         }
 
         Node* setChild(
                        const pointType& pIns,    // insert a new child of current node with point pIns
                        const pointType& pInsProj,
                        unsigned UID = 0,
-                       int new_id=-1)
+                       int new_id=-1,
+                       const scalar* pInsExt = NULL)  // if set, pIns as stored in an external matrix
         {
             Node* temp = new Node;
-            temp->_p = pIns;
+            if (pInsExt == NULL)
+                temp->_p = pIns;
+            temp->_p_ext = pInsExt;
             temp->_p_proj = pInsProj;
             temp->level = level - 1;
             temp->maxdistUB = 0; // powdict[level + 1024];
@@ -145,15 +157,15 @@ public:
         /*** Pretty print ***/
         friend std::ostream& operator<<(std::ostream& os, const Node& ct)
         {
-            if (ct._p.rows() < 6)
+            if (ct.point().rows() < 6)
             {
                 Eigen::IOFormat CommaInitFmt(Eigen::StreamPrecision, Eigen::DontAlignCols, ", ", ", ", "", "", "[", "]");
-                os << "(" << ct._p.format(CommaInitFmt) << ":" << ct.level << ":" << ct.maxdistUB <<  ":" << ct.ID << ")";
+                os << "(" << ct.point().format(CommaInitFmt) << ":" << ct.level << ":" << ct.maxdistUB <<  ":" << ct.ID << ")";
             }
             else
             {
                 Eigen::IOFormat CommaInitFmt(Eigen::StreamPrecision, Eigen::DontAlignCols, ", ", ", ", "", "", "", "");
-                os << "([" << ct._p.head<3>().format(CommaInitFmt) << ", ..., " << ct._p.tail<3>().format(CommaInitFmt) << "]:" << ct.level << ":" << ct.maxdistUB <<  ":" << ct.ID << ")";
+                os << "([" << ct.point().head<3>().format(CommaInitFmt) << ", ..., " << ct.point().tail<3>().format(CommaInitFmt) << "]:" << ct.level << ":" << ct.maxdistUB <<  ":" << ct.ID << ")";
             }
             return os;
         }
@@ -171,8 +183,19 @@ protected:
 
     std::shared_timed_mutex global_mut; // lock for changing the root
 
+    /*** Original points kept outside the nodes, by UID, when only projections are stored ***/
+    const scalar* originals = NULL;     // column major D x num_originals
+    size_t num_originals = 0;
+
+    /*** Where the original point of UID lives in the external matrix, NULL to store it inline;
+         only points taken from that matrix (construction, update_vectors) are bound to it ***/
+    const scalar* external(unsigned UID) const
+    {
+        return UID < num_originals ? originals + size_t(UID) * D : NULL;
+    }
+
     /*** Insertion helper function ***/
-    bool insert(Node* current, const pointType& p, const pointType& p_proj,  unsigned UID, scalar dist_current);
+    bool insert(Node* current, const pointType& p, const pointType& p_proj,  unsigned UID, scalar dist_current, const scalar* p_ext = NULL);
 
     /*** Serialize/Desrialize helper function ***/
     char* preorder_pack(char* buff, Node* current) const;       // Pre-order traversal
@@ -187,7 +210,8 @@ public:
     // cover tree with one point as root
     SGTree(const pointType& p, int truncate = -1);
     // cover tree using points in the list between begin and end
-    SGTree(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixType>& pMatrixProj, int truncate = -1, unsigned cores = -1);
+    // (keeping only the projections in the nodes if external_points, pMatrix must then outlive the tree)
+    SGTree(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixType>& pMatrixProj, int truncate = -1, unsigned cores = -1, bool external_points = false);
 
     /*** Destructor ***/
     /*** Destructor: deallocating all memories by a post order traversal ***/
@@ -195,13 +219,13 @@ public:
 
 /************************* Public API ***********************************************/
     /*** Construct cover tree using all points in the matrix in row-major form ***/
-    static SGTree* from_matrix(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixType>& pMatrixOther, int truncate = -1, unsigned cores = -1);
+    static SGTree* from_matrix(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixType>& pMatrixOther, int truncate = -1, unsigned cores = -1, bool external_points = false);
 
     /*** Get root ***/
     Node* get_root() {return root;}
 
-    /*** Insert point p into the cover tree ***/
-    bool insert(const pointType& p, const pointType& p_proj,  unsigned UID);
+    /*** Insert point p into the cover tree, p_ext if p is a column of the external matrix ***/
+    bool insert(const pointType& p, const pointType& p_proj,  unsigned UID, const scalar* p_ext = NULL);
 
     /*** Remove point p into the cover tree ***/
     bool remove(const pointType& p) {return false;}
@@ -229,7 +253,7 @@ public:
     std::vector<std::pair<SGTree::Node*, scalar>> rejectionSampling(const pointType &p, unsigned num_samples) const;
 
     /*** Updating ***/
-    void update_vectors(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixType>& pMatrixProj) const;
+    void update_vectors(const Eigen::Map<matrixType>& pMatrix, const Eigen::Map<matrixType>& pMatrixProj);
     void rebuild_subtree(SGTree::Node * node);
     void rebuild_level(int level);
 
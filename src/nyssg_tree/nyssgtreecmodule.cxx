@@ -36,10 +36,11 @@ static PyObject *new_sgtreec(PyObject *self, PyObject *args)
 {
   int trunc;
   long use_multi_core;
+  int external_points = 0;
   PyArrayObject *in_array;
   PyArrayObject *in_array_proj;
 
-  if (!PyArg_ParseTuple(args,"O!O!il:new_sgtreec", &PyArray_Type, &in_array, &PyArray_Type, &in_array_proj, &trunc, &use_multi_core))
+  if (!PyArg_ParseTuple(args,"O!O!il|p:new_sgtreec", &PyArray_Type, &in_array, &PyArray_Type, &in_array_proj, &trunc, &use_multi_core, &external_points))
     return NULL;
 
   npy_intp numPoints = PyArray_DIM(in_array, 0);
@@ -52,7 +53,7 @@ static PyObject *new_sgtreec(PyObject *self, PyObject *args)
   scalar * fnp_proj = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array_proj, idx) );
   Eigen::Map<matrixType> pointMatrixProj(fnp_proj, numDims, numPoints);
 
-  SGTree* cTree = SGTree::from_matrix(pointMatrix, pointMatrixProj, trunc, use_multi_core);
+  SGTree* cTree = SGTree::from_matrix(pointMatrix, pointMatrixProj, trunc, use_multi_core, external_points != 0);
   size_t int_ptr = reinterpret_cast< size_t >(cTree);
   size_t node_ptr = reinterpret_cast< size_t >(cTree->get_root());
 
@@ -217,7 +218,7 @@ static PyObject *sgtreec_nn(PyObject *self, PyObject *args) {
             npy_intp offset = i;
             dist[offset] = ct_nn.second;
             indices[offset] = ct_nn.first->UID;
-            scalar *data = ct_nn.first->_p.data();
+            const scalar *data = ct_nn.first->point().data();
             offset = i*numDims;
             for(npy_intp j=0; j<numDims; ++j)
                 results[offset++] = data[j];
@@ -230,7 +231,7 @@ static PyObject *sgtreec_nn(PyObject *self, PyObject *args) {
             npy_intp offset = i;
             dist[offset] = ct_nn.second;
             indices[offset] = ct_nn.first->UID;
-            scalar *data = ct_nn.first->_p.data();
+            const scalar *data = ct_nn.first->point().data();
             offset = i*numDims;
             for(npy_intp j=0; j<numDims; ++j)
                 results[offset++] = data[j];
@@ -346,7 +347,7 @@ static PyObject *sgtreec_knn(PyObject *self, PyObject *args) {
             {
                 indices[offset] = ct_nn[t].first->UID;
                 dist[offset] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp inner_offset = (offset++)*numDims;
                 for(long j=0; j<numDims; ++j)
                     results[inner_offset++] = data[j];
@@ -363,7 +364,7 @@ static PyObject *sgtreec_knn(PyObject *self, PyObject *args) {
             {
                 indices[offset] = ct_nn[t].first->UID;
                 dist[offset] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp inner_offset = (offset++)*numDims;
                 for(long j=0; j<numDims; ++j)
                     results[inner_offset++] = data[j];
@@ -475,7 +476,7 @@ static PyObject *sgtreec_knn_beam(PyObject *self, PyObject *args) {
             {
                 indices[offset] = ct_nn[t].first->UID;
                 dist[offset] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp inner_offset = (offset++)*numDims;
                 for(long j=0; j<numDims; ++j)
                     results[inner_offset++] = data[j];
@@ -492,7 +493,7 @@ static PyObject *sgtreec_knn_beam(PyObject *self, PyObject *args) {
             {
                 indices[offset] = ct_nn[t].first->UID;
                 dist[offset] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp inner_offset = (offset++)*numDims;
                 for(long j=0; j<numDims; ++j)
                     results[inner_offset++] = data[j];
@@ -592,7 +593,7 @@ static PyObject *sgtreec_range(PyObject *self, PyObject *args) {
             {
                 point_indices[t] = ct_nn[t].first->UID;
                 point_dist[t] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp offset = t*numDims;
                 for(long j=0; j<numDims; ++j)
                     point_point[offset++] = data[j];
@@ -627,7 +628,7 @@ static PyObject *sgtreec_range(PyObject *self, PyObject *args) {
             {
                 point_indices[t] = ct_nn[t].first->UID;
                 point_dist[t] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp offset = t*numDims;
                 for(long j=0; j<numDims; ++j)
                     point_point[offset++] = data[j];
@@ -881,8 +882,8 @@ static PyObject *sgtreec_node_property(PyObject *self, PyObject *args)
 
   obj = reinterpret_cast< SGTree::Node * >(int_ptr);
 
-  npy_intp dims[1] = {obj->_p.rows()};
-  PyObject *point = PyArray_SimpleNewFromData(1, dims, MY_NPY_FLOAT, obj->_p.data());
+  npy_intp dims[1] = {obj->point().rows()};
+  PyObject *point = PyArray_SimpleNewFromData(1, dims, MY_NPY_FLOAT, const_cast< scalar * >(obj->point().data()));
   PyArray_CLEARFLAGS(reinterpret_cast<PyArrayObject *>(point), NPY_ARRAY_OWNDATA);
   PyArray_CLEARFLAGS(reinterpret_cast<PyArrayObject *>(point), NPY_ARRAY_WRITEABLE);
 
@@ -998,7 +999,7 @@ static PyObject *sgtreec_rejection_sample(PyObject *self, PyObject *args) {
             {
                 indices[offset] = ct_nn[t].first->UID;
                 dist[offset] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp inner_offset = (offset++)*numDims;
                 for(long j = 0; j < numDims; ++j)
                     results[inner_offset++] = data[j];
@@ -1012,7 +1013,7 @@ static PyObject *sgtreec_rejection_sample(PyObject *self, PyObject *args) {
             for(long t = 0; t < k; ++t) {
                 indices[offset] = ct_nn[t].first->UID;
                 dist[offset] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp inner_offset = (offset++)*numDims;
                 for(long j = 0; j < numDims; ++j)
                     results[inner_offset++] = data[j];
@@ -1112,7 +1113,7 @@ static PyObject *sgtreec_mh_cluster_sample_heuristic1(PyObject *self, PyObject *
             {
                 indices[offset] = ct_nn[t].first->UID;
                 dist[offset] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp inner_offset = (offset++)*numDims;
                 for(long j=0; j<numDims; ++j)
                     results[inner_offset++] = data[j];
@@ -1130,7 +1131,7 @@ static PyObject *sgtreec_mh_cluster_sample_heuristic1(PyObject *self, PyObject *
             {
                 indices[offset] = ct_nn[t].first->UID;
                 dist[offset] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp inner_offset = (offset++)*numDims;
                 for(long j=0; j<numDims; ++j)
                     results[inner_offset++] = data[j];
@@ -1238,7 +1239,7 @@ static PyObject *sgtreec_mh_cluster_sample_heuristic2(PyObject *self, PyObject *
             {
                 indices[offset] = ct_nn[t].first->UID;
                 dist[offset] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp inner_offset = (offset++)*numDims;
                 for(long j=0; j<numDims; ++j)
                     results[inner_offset++] = data[j];
@@ -1256,7 +1257,7 @@ static PyObject *sgtreec_mh_cluster_sample_heuristic2(PyObject *self, PyObject *
             {
                 indices[offset] = ct_nn[t].first->UID;
                 dist[offset] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp inner_offset = (offset++)*numDims;
                 for(long j=0; j<numDims; ++j)
                     results[inner_offset++] = data[j];
@@ -1363,7 +1364,7 @@ static PyObject *sgtreec_mh_cluster_sample(PyObject *self, PyObject *args) {
             {
                 indices[offset] = ct_nn[t].first->UID;
                 dist[offset] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp inner_offset = (offset++)*numDims;
                 for(long j=0; j<numDims; ++j)
                     results[inner_offset++] = data[j];
@@ -1381,7 +1382,7 @@ static PyObject *sgtreec_mh_cluster_sample(PyObject *self, PyObject *args) {
             {
                 indices[offset] = ct_nn[t].first->UID;
                 dist[offset] = ct_nn[t].second;
-                scalar *data = ct_nn[t].first->_p.data();
+                const scalar *data = ct_nn[t].first->point().data();
                 npy_intp inner_offset = (offset++)*numDims;
                 for(long j=0; j<numDims; ++j)
                     results[inner_offset++] = data[j];
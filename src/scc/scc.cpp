@@ -25,10 +25,13 @@
 /**
  * Perform batch setting fit. 
  */ 
-void SCC::fit() {
+bool SCC::fit(utils::Progress* progress) {
     size_t i = 1;
     assert(levels.size() == 1);
-    while (i <= num_levels) {
+    changes.clear();
+    // One step per level, stopping between levels once cancelled
+    utils::Reporter reporter(num_levels, progress, false);
+    while (i <= num_levels && !reporter.cancelled()) {
         auto st_fit = utils::get_time();
 
         if (verbosity == LEVEL_PRINT) {
@@ -54,6 +57,7 @@ void SCC::fit() {
         } else {
             levels.push_back(SCC::TreeLevel::par_from_previous( levels[i-1], thresholds[i]));
         }
+        record_changes(levels[i-1]->nodes);
         #ifdef DEBUG_SCC
         std::cout << "add level... done!" << std::endl;
         #endif
@@ -65,8 +69,12 @@ void SCC::fit() {
             levels[i-1]->summary_message();
         }
 
+        reporter.get().add(1);
+        reporter.report();
         i += 1;
     }
+    finish_changes();
+    return i > num_levels;
 }
 
 /**
@@ -75,6 +83,7 @@ void SCC::fit() {
 void SCC::fit_incremental() {
 
     size_t i = 1;
+    changes.clear();
     levels[0]->mark_for_first_round();
     auto st_fit = utils::get_time();
 
@@ -106,6 +115,8 @@ void SCC::fit_incremental() {
         } else {
             change_made = SCC::TreeLevel::par_update_levels(levels[i-1], thresholds[i], levels[i]);
         }
+        // prev_parent and parent of the marked nodes now hold the change
+        record_changes(levels[i-1]->marked_nodes);
 
         #ifdef TIME_SCC
         auto en_up = utils::get_time();
@@ -129,6 +140,7 @@ void SCC::fit_incremental() {
         }
         i += 1;
     }
+    finish_changes();
     #ifdef TIME_SCC
     auto en_fit = utils::get_time();
     std::cout << "#time fit_incremental " << utils::timedur(st_fit, en_fit) << std::endl;
@@ -1298,9 +1310,12 @@ SCC::TreeLevel* SCC::TreeLevel::from_previous(TreeLevel * prev_level, scalar thr
             auto st_graph = utils::get_time();
             for (const auto & neigh_pair: kid->neigh) {
                 SCC::TreeLevel::TreeNode * neigh_node = neigh_pair.first;
+                // deleted neighbors have no parent
+                if (neigh_node->deleted)
+                    continue;
                 SCC::TreeLevel::TreeNode * neigh_par_node = neigh_node->parent;
                 node_id_t neigh_par = neigh_par_node->this_id;
-                if (!neigh_node->deleted && neigh_par != u_node->this_id) {
+                if (neigh_par != u_node->this_id) {
                     u_node->neigh[neigh_par_node] += neigh_pair.second;
                 }
             }
@@ -1365,9 +1380,12 @@ SCC::TreeLevel* SCC::TreeLevel::par_from_previous(TreeLevel * prev_level, scalar
             auto st_graph = utils::get_time();
             for (const auto & neigh_pair: kid->neigh) {
                 SCC::TreeLevel::TreeNode * neigh_node = neigh_pair.first;
+                // deleted neighbors have no parent
+                if (neigh_node->deleted)
+                    continue;
                 SCC::TreeLevel::TreeNode * neigh_par_node = neigh_node->parent;
                 node_id_t neigh_par = neigh_par_node->this_id;
-                if (!neigh_node->deleted && neigh_par != u_node->this_id) {
+                if (neigh_par != u_node->this_id) {
                     u_node->neigh[neigh_par_node] += neigh_pair.second;
                 }
             }
@@ -1536,6 +1554,7 @@ bool SCC::TreeLevel::update_levels(TreeLevel * prev_level, scalar thresh, TreeLe
                 }
 
                 to_delete_next.insert(node->parent);
+                prev_level->scc->record_change(node, node->parent->this_id, SCC::NO_PARENT);
                 node->parent = NULL;
             } else if (node->parent != NULL) {
                 SCC::TreeLevel::TreeNode * par = node->parent;
@@ -1550,6 +1569,7 @@ bool SCC::TreeLevel::update_levels(TreeLevel * prev_level, scalar thresh, TreeLe
                 node->best_neighbors.clear();
                 node->neigh.clear();
                 node->marked_time = 0;
+                prev_level->scc->record_change(node, node->parent->this_id, SCC::NO_PARENT);
                 node->parent = NULL;
             } else {
                 #ifdef DEBUG_SCC
@@ -1656,9 +1676,12 @@ bool SCC::TreeLevel::update_levels(TreeLevel * prev_level, scalar thresh, TreeLe
 
             for (const auto & neigh_pair: kid->neigh) {
                 SCC::TreeLevel::TreeNode * neigh_node = neigh_pair.first;
+                // deleted neighbors have no parent
+                if (neigh_node->deleted)
+                    continue;
                 SCC::TreeLevel::TreeNode * neigh_par_node = neigh_node->parent;
                 node_id_t neigh_par = neigh_par_node->this_id;
-                if (!neigh_node->deleted && neigh_par != u_node->this_id) {
+                if (neigh_par != u_node->this_id) {
                     u_node->neigh[neigh_par_node] += neigh_pair.second;
                 }
             }
@@ -1874,6 +1897,7 @@ bool SCC::TreeLevel::par_update_levels(TreeLevel * prev_level, scalar thresh, Tr
                     node->sum.resize(0);
                 }
                 to_delete_next.insert(node->parent);
+                prev_level->scc->record_change(node, node->parent->this_id, SCC::NO_PARENT);
                 node->parent = NULL;
             } else if (node->parent != NULL) {
                 SCC::TreeLevel::TreeNode * par = node->parent;
@@ -1892,6 +1916,7 @@ bool SCC::TreeLevel::par_update_levels(TreeLevel * prev_level, scalar thresh, Tr
                     node->parent->sum -= node->sum;
                     node->parent->mean = node->parent->sum / ((scalar)par->count);
                 }
+                prev_level->scc->record_change(node, node->parent->this_id, SCC::NO_PARENT);
                 node->parent = NULL;
             } else {
                 #ifdef DEBUG_SCC
@@ -2000,9 +2025,12 @@ bool SCC::TreeLevel::par_update_levels(TreeLevel * prev_level, scalar thresh, Tr
 
             for (const auto & neigh_pair: kid->neigh) {
                 SCC::TreeLevel::TreeNode * neigh_node = neigh_pair.first;
+                // deleted neighbors have no parent
+                if (neigh_node->deleted)
+                    continue;
                 SCC::TreeLevel::TreeNode * neigh_par_node = neigh_node->parent;
                 node_id_t neigh_par = neigh_par_node->this_id;
-                if (!neigh_node->deleted && neigh_par != u_node->this_id) {
+                if (neigh_par != u_node->this_id) {
                     u_node->neigh[neigh_par_node] += neigh_pair.second;
                 }
             }
@@ -2135,6 +2163,11 @@ SCC::TreeLevel::TreeNode * SCC::TreeLevel::get_or_create_node(node_id_t a) {
 SCC::~SCC() {
     // std::cout << "SCC deconstructor start" << std::endl;
     //  std::flush(std::cout);
+    if (sweep_levels) {
+        // shared with the other trees of the sweep
+        levels.clear();
+        return;
+    }
     for (size_t idx=0; idx < levels.size(); idx++) {
         // std::cout << "SCC deconstructor delete level " << idx << std::endl;
         //  std::flush(std::cout);
@@ -2146,6 +2179,14 @@ SCC::~SCC() {
 }
 
 
+SCC::SweepLevels::~SweepLevels() {
+    for (TreeLevel * l : all) {
+        delete l;
+    }
+    all.clear();
+}
+
+
 SCC::TreeLevel::TreeNode::~TreeNode() {
     // std::cout << "node deconstructor start" << std::endl;
     //  std::flush(std::cout);
@@ -2208,7 +2249,7 @@ SCC::TreeLevel::TreeNode * SCC::record_point(node_id_t uid) {
                 // levels[0]->marked_nodes.push_back(n);
                 levels[0]->nodeid2index[i] = i;
                 n->level = levels[0];
-                n->count = 1;
+                n->count = point_count(i);
                 n->Z = (scalar) 1.0;
                 n->created_time = global_step;
                 n->last_updated = global_step;
@@ -2229,7 +2270,7 @@ SCC::TreeLevel::TreeNode * SCC::record_point(node_id_t uid) {
             // levels[0]->marked_nodes.push_back(n);
             levels[0]->nodeid2index[uid] = levels[0]->nodes.size()-1;
             n->level = levels[0];
-            n->count = 1;
+            n->count = point_count(uid);
             n->Z = (scalar) 1.0;
             n->created_time = global_step;
             n->last_updated = global_step;
@@ -2250,6 +2291,10 @@ SCC::TreeLevel::TreeNode * SCC::record_point(node_id_t uid) {
  ** * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
  */
 
+void SCC::set_point_counts(std::vector<scalar> &counts) {
+    point_counts = counts;
+}
+
 void SCC::clear_marked() {
     for (size_t l=0; l < levels.size(); l++) {
         levels[l]->marked_nodes.clear();
@@ -2263,10 +2308,18 @@ void SCC::clear_marked() {
  */
 
 
-void SCC::insert_first_batch(size_t num_points, std::vector<uint32_t> & r, 
-    std::vector<uint32_t>  &c, std::vector<scalar> &s) {
+bool SCC::insert_first_batch(size_t num_points, std::vector<uint32_t> & r, 
+    std::vector<uint32_t>  &c, std::vector<scalar> &s, utils::Progress* progress) {
+    if (!load_first_batch(num_points, r, c, s, progress))
+        return false;
+    bool fitted = fit(progress);
+    global_step += 1;
+    return fitted;
+}
+
+bool SCC::load_first_batch(size_t num_points, std::vector<uint32_t> & r, 
+    std::vector<uint32_t>  &c, std::vector<scalar> &s, utils::Progress* progress) {
     TreeLevel *round0 = levels[0];
-    auto st_knn = utils::get_time();
     round0->nodes.reserve(num_points);
     for (size_t i=0; i <= num_points; i++) {
         SCC::TreeLevel::TreeNode * n = new TreeLevel::TreeNode(i);
@@ -2274,43 +2327,177 @@ void SCC::insert_first_batch(size_t num_points, std::vector<uint32_t> & r,
         // levels[0]->marked_nodes.push_back(n);
         levels[0]->nodeid2index[i] = i;
         n->level = levels[0];
-        n->count = 1;
+        n->count = point_count(i);
         n->Z = (scalar) 1.0;
         n->created_time = global_step;
         n->last_updated = global_step;
         n->descendant_leafs.insert(i);
     }
     if (cores == 1) {
-        for (size_t i=0; i < r.size(); i++) {
-             if (i % 100000 ==0) {
-                std::cout << "\r Init " <<  i << " out of " << r.size() << "- " << (float) i*100.0 / (float) r.size() << "%" << " in " << utils::timedur(st_knn, utils::get_time()) << " seconds.";
-            }
+        utils::Reporter reporter(r.size(), progress, r.size() > 100000);
+        for (size_t i=0; i < r.size() && reporter.tick(i); i++) {
             SCC::TreeLevel::TreeNode* r_node = round0->nodes[r[i]]; 
             SCC::TreeLevel::TreeNode* c_node = round0->nodes[c[i]]; 
-            r_node->neigh[c_node] = s[i];
-            c_node->neigh[r_node] = s[i];
+            scalar sim = s[i] * r_node->count * c_node->count;
+            r_node->neigh[c_node] = sim;
+            c_node->neigh[r_node] = sim;
         }
+        return !reporter.stopped_early();
     } else {
-        utils::parallel_for(0, r.size(), [&](node_id_t i)->void{ 
-            if (i % 100000 ==0) {
-                round0->mtx.lock();
-                std::cout << "\r Init " <<  i << " out of " << r.size() << "- " << (float) i*100.0 / (float) r.size() << "%" << " in " << utils::timedur(st_knn, utils::get_time()) << " seconds.";
-                round0->mtx.unlock();
-            }
-
+        return utils::parallel_for_progressbar(0, r.size(), [&](node_id_t i)->void{ 
             SCC::TreeLevel::TreeNode* r_node = round0->nodes[r[i]]; 
             SCC::TreeLevel::TreeNode* c_node = round0->nodes[c[i]]; 
+            scalar sim = s[i] * r_node->count * c_node->count;
             r_node->mtx.lock();
-            r_node->neigh[c_node] = s[i];
+            r_node->neigh[c_node] = sim;
             r_node->mtx.unlock();
             c_node->mtx.lock();
-            c_node->neigh[r_node] = s[i];
+            c_node->neigh[r_node] = sim;
             c_node->mtx.unlock();
 
-        }, cores);
+        }, cores, progress);
     }
-    fit();
-    global_step += 1;
+}
+
+/**
+ * Fit one tree per threshold schedule on the same graph. The graph is loaded
+ * once per distinct first threshold into a first level shared by the schedules
+ * starting with it. Schedules agreeing on their first i
+ * thresholds produce the same first i+1 levels (a level's nodes only depend
+ * on the thresholds below it), so these are computed once in the trie of
+ * schedule prefixes; where schedules diverge, each branch gets its own copy
+ * of the next level and the branches continue in parallel.
+ */
+std::vector<SCC *> SCC::sweep(std::vector<std::vector<scalar>> &schedules, unsigned cores, unsigned cc_alg, size_t par_min, unsigned verbosity_level,
+    size_t num_points, std::vector<uint32_t> & r, std::vector<uint32_t>  &c, std::vector<scalar> &s) {
+    std::vector<SCC *> trees;
+    if (schedules.empty()) {
+        return trees;
+    }
+    std::shared_ptr<SweepLevels> pool = std::make_shared<SweepLevels>();
+    for (auto & thresh : schedules) {
+        SCC * scc = new SCC(thresh, cores, cc_alg, par_min, verbosity_level);
+        scc->sweep_levels = pool;
+        trees.push_back(scc);
+    }
+
+    // the first level is already computed with thresholds[0], so only
+    // schedules agreeing on it can share the loaded graph
+    std::vector<std::vector<size_t>> groups;
+    for (size_t j=0; j < trees.size(); j++) {
+        size_t g = 0;
+        while (g < groups.size() && schedules[groups[g][0]][0] != schedules[j][0]) {
+            g++;
+        }
+        if (g == groups.size()) {
+            groups.push_back(std::vector<size_t>());
+        }
+        groups[g].push_back(j);
+    }
+
+    for (const auto & group : groups) {
+        SCC * owner = trees[group[0]];
+        TreeLevel *round0 = new TreeLevel(schedules[group[0]][0], cores);
+        round0->scc = owner;
+        pool->all.push_back(round0);
+        for (size_t j : group) {
+            trees[j]->levels.push_back(round0);
+        }
+        owner->load_first_batch(num_points, r, c, s);
+        sweep_from(trees, group, 0);
+    }
+
+    for (SCC * scc : trees) {
+        scc->global_step += 1;
+    }
+    return trees;
+}
+
+SCC::TreeLevel::TreeNode * SCC::parent_of(const TreeLevel::TreeNode * node) const {
+    TreeLevel::TreeNode * par = node->parent;
+    size_t h = node->level->height + 1;
+    if (par == NULL || h >= levels.size() || par->level == levels[h]) {
+        return par;
+    }
+    const TreeLevel * above = levels[h];
+    auto it = above->nodeid2index.find(par->this_id);
+    return it == above->nodeid2index.end() ? NULL : above->nodes[it->second];
+}
+
+/**
+ * Continue the trees in group, which share their levels up to depth and
+ * their thresholds up to thresholds[depth].
+ */
+void SCC::sweep_from(std::vector<SCC *> &trees, std::vector<size_t> group, size_t depth) {
+    SCC * owner = trees[group[0]];
+    TreeLevel * level = owner->levels[depth];
+    auto st_fit = utils::get_time();
+
+    if (owner->verbosity == LEVEL_PRINT) {
+        std::cout << "Level Start - ";
+        level->summary_message();
+    }
+    level->compute();
+    if (owner->verbosity == LEVEL_PRINT) {
+        std::cout << "Level End - ";
+        level->summary_message();
+    }
+
+    // branch on the next threshold, trees without one end here
+    std::vector<std::vector<size_t>> branches;
+    std::vector<size_t> ended;
+    for (size_t j : group) {
+        if (depth + 1 >= trees[j]->thresholds.size()) {
+            ended.push_back(j);
+            continue;
+        }
+        scalar next = trees[j]->thresholds[depth + 1];
+        size_t b = 0;
+        while (b < branches.size() && trees[branches[b][0]]->thresholds[depth + 1] != next) {
+            b++;
+        }
+        if (b == branches.size()) {
+            branches.push_back(std::vector<size_t>());
+        }
+        branches[b].push_back(j);
+    }
+    if (!ended.empty()) {
+        branches.push_back(ended);
+    }
+
+    // the copies are formed one after another: each one repoints the parents of the shared level,
+    // which keeps those of the last branch. The parent ids agree in every branch, so the other
+    // trees resolve theirs by id with parent_of.
+    unsigned branch_cores = std::max(owner->cores / (unsigned) branches.size(), 1u);
+    for (const auto & branch : branches) {
+        SCC * scc = trees[branch[0]];
+        scalar next = depth + 1 < scc->thresholds.size() ? scc->thresholds[depth + 1] : scc->thresholds.back();
+        TreeLevel * t = NULL;
+        if (level->cores == 1 || level->nodes.size() < owner->par_minimum) {
+            t = SCC::TreeLevel::from_previous(level, next);
+        } else {
+            t = SCC::TreeLevel::par_from_previous(level, next);
+        }
+        t->scc = scc;
+        t->cores = branch_cores;
+        {
+            std::lock_guard<std::mutex> lk(owner->sweep_levels->mtx);
+            owner->sweep_levels->all.push_back(t);
+        }
+        for (size_t j : branch) {
+            trees[j]->levels.push_back(t);
+        }
+    }
+    auto en_fit = utils::get_time();
+    for (size_t j : group) {
+        trees[j]->total_time += utils::timedur(st_fit, en_fit);
+    }
+
+    // only touch their own levels from here on
+    size_t continuing = branches.size() - (ended.empty() ? 0 : 1);
+    utils::parallel_for(0, continuing, [&](size_t b)->void{
+        sweep_from(trees, branches[b], depth + 1);
+    }, (unsigned) continuing);
 }
 
 
@@ -2318,7 +2505,7 @@ void SCC::insert_first_batch(size_t num_points, std::vector<uint32_t> & r,
  * Observe new edges, update SCC
  */
 bool SCC::add_graph_edges_mb(std::vector<uint32_t> & r, 
-    std::vector<uint32_t>  &c, std::vector<scalar> &s) {
+    std::vector<uint32_t>  &c, std::vector<scalar> &s, utils::Progress* progress) {
     
     #ifdef DEBUG_SCC
     std::cout << "begin record --" <<std::endl;
@@ -2331,17 +2518,13 @@ bool SCC::add_graph_edges_mb(std::vector<uint32_t> & r,
     
     std::set<SCC::TreeLevel::TreeNode*> new_points;
 
-    bool should_log = r.size() > 1000000;
+    // Once cancelled the remaining edges are dropped, those recorded are fit by the next minibatch
+    utils::Reporter reporter(r.size(), progress, r.size() > 1000000);
     
-    for (size_t i=0; i < r.size(); i++) {
+    for (size_t i=0; i < r.size() && reporter.tick(i); i++) {
         #ifdef DEBUG_SCC
         std::cout << "r " << r[i] << " c " << c[i] << " s " << s[i] << std::endl;
         #endif
-        if (should_log) {
-            if (i % 1000000 ==0) {
-                std::cout << "\r Init " <<  i << " out of " << r.size() << "- " << (float) i*100.0 / (float) r.size() << "%" << " in " << utils::timedur(st_knn, utils::get_time()) << " seconds.";
-            }
-        }
         size_t num_pts = levels[0]->nodes.size();
         SCC::TreeLevel::TreeNode* r_node = record_point(r[i]);
         bool r_new = r_node->created_now;
@@ -2351,8 +2534,9 @@ bool SCC::add_graph_edges_mb(std::vector<uint32_t> & r,
         bool c_new = c_node->created_now;
         c_node->created_now = false;
 
-        r_node->neigh[c_node] = s[i];
-        c_node->neigh[r_node] = s[i];
+        scalar sim = s[i] * r_node->count * c_node->count;
+        r_node->neigh[c_node] = sim;
+        c_node->neigh[r_node] = sim;
         r_node->last_updated = global_step;
         c_node->last_updated = global_step;
 
@@ -2397,10 +2581,10 @@ bool SCC::add_graph_edges_mb(std::vector<uint32_t> & r,
     print_structure();
     #endif
     
-    return true;
+    return !reporter.stopped_early();
 }
 
-bool SCC::fit_on_graph() {
+bool SCC::fit_on_graph(utils::Progress* progress) {
     
     set_level_global_step();
     
@@ -2428,8 +2612,9 @@ bool SCC::fit_on_graph() {
     std::cout << "start fit --" <<std::endl;
     #endif
     
+    bool fitted = true;
     if (levels.size() == 1) {
-        fit();
+        fitted = fit(progress);
     } else{
         fit_incremental();
     }
@@ -2448,14 +2633,60 @@ bool SCC::fit_on_graph() {
     global_step += 1;
     minibatch_points.clear();
     observed_and_not_fit_marked.clear();
-    return true;
+    return fitted;
+}
+
+
+
+/**
+ * Append the nodes whose parent changed in the last update of their level.
+ * Only the marked nodes of a level can change parent, so the log grows
+ * with the update rather than with the tree.
+ */
+void SCC::record_changes(const std::vector<TreeLevel::TreeNode*> &nodes) {
+    if (!track_changes)
+        return;
+    for (SCC::TreeLevel::TreeNode * u_node: nodes) {
+        if (u_node->deleted || u_node->parent == NULL)
+            continue;
+        node_id_t old_parent = u_node->prev_parent == NULL ? NO_PARENT : u_node->prev_parent->this_id;
+        record_change(u_node, old_parent, u_node->parent->this_id);
+    }
 }
 
+/**
+ * Log that a node moved from old_parent to new_parent. Nodes emptied and
+ * refilled within one fit keep a single entry from their parent before
+ * the fit to their parent after it.
+ */
+void SCC::record_change(TreeLevel::TreeNode * node, node_id_t old_parent, node_id_t new_parent) {
+    if (!track_changes)
+        return;
+    uint64_t key = (uint64_t(node->level->height) << 32) | node->this_id;
+    auto it = change_index.find(key);
+    if (it != change_index.end()) {
+        changes[it->second].new_parent = new_parent;
+    } else if (old_parent != new_parent) {
+        change_index[key] = changes.size();
+        changes.push_back({node->level->height, node->this_id, old_parent, new_parent});
+    }
+}
 
+/**
+ * Drop the entries of nodes that ended the fit under the parent they
+ * started it with.
+ */
+void SCC::finish_changes() {
+    changes.erase(std::remove_if(changes.begin(), changes.end(), [](const ParentChange &c) {
+        return c.old_parent == c.new_parent;
+    }), changes.end());
+    change_index.clear();
+}
 
-bool SCC::insert_graph_mb(std::vector<uint32_t> & r,  std::vector<uint32_t>  &c, std::vector<scalar> &s) {
-   add_graph_edges_mb(r, c, s);
-   return fit_on_graph();
+bool SCC::insert_graph_mb(std::vector<uint32_t> & r,  std::vector<uint32_t>  &c, std::vector<scalar> &s, utils::Progress* progress) {
+   if (!add_graph_edges_mb(r, c, s, progress))
+       return false;
+   return fit_on_graph(progress);
 }
 
 
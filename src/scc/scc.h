@@ -17,11 +17,14 @@
 # ifndef _SCC_H
 # define _SCC_H
 
+#include <algorithm>
 #include <atomic>
 #include <fstream>
 #include <iostream>
 #include <stack>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <set>
 #include <unordered_set>
@@ -95,7 +98,25 @@ class SCC
         // how should we label the nodes for updates
         void set_marking_strategy(unsigned strat);
 
-        void fit();
+        // number of identical points each point stands for (1 if unset); edge
+        // similarities of weighted points are scaled by the product of their counts
+        void set_point_counts(std::vector<scalar> &counts);
+
+        // reparentings made by the last fit, fit_incremental or
+        // fit_on_graph, recorded only when track_changes is set.
+        // old_parent is NO_PARENT for new nodes, new_parent for removed ones.
+        struct ParentChange {
+            unsigned level;
+            node_id_t node;
+            node_id_t old_parent;
+            node_id_t new_parent;
+        };
+        constexpr static node_id_t NO_PARENT = UINT32_MAX;
+        bool track_changes = false;
+        std::vector<ParentChange> changes;
+
+        // false if progress was cancelled before the last level
+        bool fit(utils::Progress* progress = nullptr);
         void fit_incremental();
 
         SCC(std::vector<scalar> & thresh, unsigned cores);
@@ -105,17 +126,24 @@ class SCC
         static SCC * init(std::vector<scalar> &thresh, unsigned cores);
         static SCC * init(std::vector<scalar> &thresh, unsigned cores, unsigned cc_alg, size_t par_min, unsigned verbosity_level);
 
-        // add edges to the graph and update SCC
-        bool insert_graph_mb(std::vector<uint32_t> & r, std::vector<uint32_t>  &c, std::vector<scalar> &s);
+        // add edges to the graph and update SCC; these return false if progress was cancelled before the end
+        bool insert_graph_mb(std::vector<uint32_t> & r, std::vector<uint32_t>  &c, std::vector<scalar> &s, utils::Progress* progress = nullptr);
 
         // add edges to the graph 
-        bool add_graph_edges_mb(std::vector<uint32_t> & r, std::vector<uint32_t>  &c, std::vector<scalar> &s);
+        bool add_graph_edges_mb(std::vector<uint32_t> & r, std::vector<uint32_t>  &c, std::vector<scalar> &s, utils::Progress* progress = nullptr);
 
         // take the added edges and update SCC
-        bool fit_on_graph();
+        bool fit_on_graph(utils::Progress* progress = nullptr);
 
         // add the first set edges to the graph in large batch fashion
-        void insert_first_batch(size_t n, std::vector<uint32_t> & r, std::vector<uint32_t>  &c, std::vector<scalar> &s);
+        bool insert_first_batch(size_t n, std::vector<uint32_t> & r, std::vector<uint32_t>  &c, std::vector<scalar> &s, utils::Progress* progress = nullptr);
+
+        // fit one tree per threshold schedule on a single copy of the graph.
+        // levels shared by schedules with a common threshold prefix are
+        // computed once, the remaining levels of each schedule in parallel.
+        // the returned trees share those levels and are read-only.
+        static std::vector<SCC *> sweep(std::vector<std::vector<scalar>> &schedules, unsigned cores, unsigned cc_alg, size_t par_min, unsigned verbosity_level,
+            size_t n, std::vector<uint32_t> & r, std::vector<uint32_t>  &c, std::vector<scalar> &s);
 
         // remove the markers on updated nodes
         void clear_marked();
@@ -421,7 +449,31 @@ class SCC
         std::vector<TreeLevel::TreeNode*> minibatch_points;
         std::set<TreeLevel::TreeNode*> observed_and_not_fit_marked;
         std::vector<TreeLevel *> levels;
+        // parent of node in this tree. Levels shared by a sweep point their
+        // nodes into one branch only, the others are found by id in levels.
+        TreeLevel::TreeNode * parent_of(const TreeLevel::TreeNode * node) const;
         TreeLevel::TreeNode * record_point(node_id_t uid);
+        std::vector<scalar> point_counts;
+        scalar point_count(node_id_t uid) const { return uid < point_counts.size() ? point_counts[uid] : (scalar) 1.0; }
+
+        // append the parent changes of the given nodes of a level
+        void record_changes(const std::vector<TreeLevel::TreeNode*> &nodes);
+        void record_change(TreeLevel::TreeNode * node, node_id_t old_parent, node_id_t new_parent);
+        void finish_changes();
+        // entry in changes of each (level, node) changed in the current fit
+        std::unordered_map<uint64_t, size_t> change_index;
+
+        // owner of the levels of all trees from one sweep, freed with the last of them
+        struct SweepLevels {
+            std::mutex mtx;
+            std::vector<TreeLevel *> all;
+            ~SweepLevels();
+        };
+        std::shared_ptr<SweepLevels> sweep_levels;
+
+        // the graph of insert_first_batch, without fitting
+        bool load_first_batch(size_t n, std::vector<uint32_t> & r, std::vector<uint32_t>  &c, std::vector<scalar> &s, utils::Progress* progress = nullptr);
+        static void sweep_from(std::vector<SCC *> &trees, std::vector<size_t> group, size_t depth);
 
 };
 
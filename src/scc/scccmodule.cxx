@@ -31,6 +31,26 @@
 
 static PyObject *SCCcError;
 
+// trees from a sweep share their lower levels, so they cannot be updated
+static bool sccc_writable(SCC *obj)
+{
+  if (obj->sweep_levels) {
+    PyErr_Format(SCCcError, "SCC trees from a sweep are read-only");
+    return false;
+  }
+  return true;
+}
+
+// Raised after a call that stopped early because its progress was cancelled
+static bool sccc_finished(bool finished)
+{
+  if (!finished) {
+    PyErr_Format(SCCcError, "cancelled");
+    return false;
+  }
+  return true;
+}
+
 static PyObject *init_sccc(PyObject *self, PyObject *args)
 {
   PyArrayObject *thresholds;
@@ -56,13 +76,21 @@ static PyObject *sccc_fit(PyObject *self, PyObject *args) {
 
     SCC *obj;
     size_t int_ptr;
+    size_t progress_ptr = 0;
 
     /*  parse the input, from python int to c++ int */
-    if (!PyArg_ParseTuple(args, "k:sccc_fit", &int_ptr))
+    if (!PyArg_ParseTuple(args, "k|n:sccc_fit", &int_ptr, &progress_ptr))
         return NULL;
 
     obj = reinterpret_cast< SCC * >(int_ptr);
-    obj->fit();
+    if (!sccc_writable(obj))
+        return NULL;
+    bool finished;
+    Py_BEGIN_ALLOW_THREADS
+    finished = obj->fit(reinterpret_cast< utils::Progress * >(progress_ptr));
+    Py_END_ALLOW_THREADS
+    if (!sccc_finished(finished))
+        return NULL;
 
     Py_RETURN_NONE;
 }
@@ -71,13 +99,21 @@ static PyObject *sccc_update(PyObject *self, PyObject *args) {
 
     SCC *obj;
     size_t int_ptr;
+    size_t progress_ptr = 0;
 
     /*  parse the input, from python int to c++ int */
-    if (!PyArg_ParseTuple(args, "k:sccc_update", &int_ptr))
+    if (!PyArg_ParseTuple(args, "k|n:sccc_update", &int_ptr, &progress_ptr))
         return NULL;
 
     obj = reinterpret_cast< SCC * >(int_ptr);
-    obj->fit_on_graph();
+    if (!sccc_writable(obj))
+        return NULL;
+    bool finished;
+    Py_BEGIN_ALLOW_THREADS
+    finished = obj->fit_on_graph(reinterpret_cast< utils::Progress * >(progress_ptr));
+    Py_END_ALLOW_THREADS
+    if (!sccc_finished(finished))
+        return NULL;
 
     Py_RETURN_NONE;
 }
@@ -114,6 +150,74 @@ static PyObject *sccc_set_marking_strategy(PyObject *self, PyObject *args) {
     Py_RETURN_NONE;
 }
 
+static PyObject *sccc_set_point_counts(PyObject *self, PyObject *args) {
+
+  SCC *obj;
+  size_t int_ptr;
+  PyArrayObject *counts_in;
+
+  if (!PyArg_ParseTuple(args, "nO!:sccc_set_point_counts", &int_ptr, &PyArray_Type, &counts_in))
+    return NULL;
+
+  long countsInDim = PyArray_DIM(counts_in, 0);
+  long idx[2] = {0, 0};
+  scalar * counts = reinterpret_cast< scalar * >( PyArray_GetPtr(counts_in, idx) );
+  std::vector<scalar> counts_v(counts, counts + countsInDim);
+
+  obj = reinterpret_cast< SCC * >(int_ptr);
+  if (!sccc_writable(obj))
+    return NULL;
+
+  obj->set_point_counts(counts_v);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *sccc_track_changes(PyObject *self, PyObject *args) {
+
+  SCC *obj;
+  size_t int_ptr;
+  int track;
+
+  if (!PyArg_ParseTuple(args, "np:sccc_track_changes", &int_ptr, &track))
+    return NULL;
+
+  obj = reinterpret_cast< SCC * >(int_ptr);
+  obj->track_changes = track;
+  if (!track)
+    obj->changes.clear();
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *sccc_changes(PyObject *self, PyObject *args) {
+
+  SCC *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sccc_changes", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< SCC * >(int_ptr);
+  npy_intp dims[1] = {(npy_intp) obj->changes.size()};
+  PyObject *level = PyArray_SimpleNew(1, dims, NPY_UINT32);
+  PyObject *node = PyArray_SimpleNew(1, dims, NPY_UINT32);
+  PyObject *old_parent = PyArray_SimpleNew(1, dims, NPY_INT64);
+  PyObject *new_parent = PyArray_SimpleNew(1, dims, NPY_INT64);
+  uint32_t *l = reinterpret_cast< uint32_t * >(PyArray_DATA((PyArrayObject *)level));
+  uint32_t *n = reinterpret_cast< uint32_t * >(PyArray_DATA((PyArrayObject *)node));
+  int64_t *o = reinterpret_cast< int64_t * >(PyArray_DATA((PyArrayObject *)old_parent));
+  int64_t *p = reinterpret_cast< int64_t * >(PyArray_DATA((PyArrayObject *)new_parent));
+  for (size_t i = 0; i < obj->changes.size(); i++) {
+    const SCC::ParentChange &c = obj->changes[i];
+    l[i] = c.level;
+    n[i] = c.node;
+    o[i] = c.old_parent == SCC::NO_PARENT ? -1 : (int64_t) c.old_parent;
+    p[i] = c.new_parent == SCC::NO_PARENT ? -1 : (int64_t) c.new_parent;
+  }
+  return Py_BuildValue("NNNN", level, node, old_parent, new_parent);
+}
+
 static PyObject *sccc_insert_graph_mb(PyObject *self, PyObject *args) {
 
   SCC *obj;
@@ -121,8 +225,9 @@ static PyObject *sccc_insert_graph_mb(PyObject *self, PyObject *args) {
   PyArrayObject *rows_in;
   PyArrayObject *cols_in;
   PyArrayObject *sims_in;
+  size_t progress_ptr = 0;
   /*  parse the input, from python int to c++ int */
-  if (!PyArg_ParseTuple(args, "nO!O!O!:sccc_insert_graph_mb", &int_ptr, &PyArray_Type, &rows_in, &PyArray_Type, &cols_in, &PyArray_Type, &sims_in))
+  if (!PyArg_ParseTuple(args, "nO!O!O!|n:sccc_insert_graph_mb", &int_ptr, &PyArray_Type, &rows_in, &PyArray_Type, &cols_in, &PyArray_Type, &sims_in, &progress_ptr))
     return NULL;
 
   long rowsInDim = PyArray_DIM(rows_in, 0);
@@ -155,8 +260,15 @@ static PyObject *sccc_insert_graph_mb(PyObject *self, PyObject *args) {
   // std::cout << "CALLING INSERT GRAPH MB! " << std::endl;
  
   obj = reinterpret_cast< SCC * >(int_ptr);
+  if (!sccc_writable(obj))
+    return NULL;
 
-  obj->insert_graph_mb(row_v, col_v, sims_v);
+  bool finished;
+  Py_BEGIN_ALLOW_THREADS
+  finished = obj->insert_graph_mb(row_v, col_v, sims_v, reinterpret_cast< utils::Progress * >(progress_ptr));
+  Py_END_ALLOW_THREADS
+  if (!sccc_finished(finished))
+    return NULL;
   
   // std::cout << "returning!" << std::endl;
   return Py_BuildValue("k", int_ptr);
@@ -169,8 +281,9 @@ static PyObject *sccc_add_graph_edges_mb(PyObject *self, PyObject *args) {
   PyArrayObject *rows_in;
   PyArrayObject *cols_in;
   PyArrayObject *sims_in;
+  size_t progress_ptr = 0;
   /*  parse the input, from python int to c++ int */
-  if (!PyArg_ParseTuple(args, "nO!O!O!:sccc_add_graph_edges_mb", &int_ptr, &PyArray_Type, &rows_in, &PyArray_Type, &cols_in, &PyArray_Type, &sims_in))
+  if (!PyArg_ParseTuple(args, "nO!O!O!|n:sccc_add_graph_edges_mb", &int_ptr, &PyArray_Type, &rows_in, &PyArray_Type, &cols_in, &PyArray_Type, &sims_in, &progress_ptr))
     return NULL;
 
   long rowsInDim = PyArray_DIM(rows_in, 0);
@@ -203,8 +316,15 @@ static PyObject *sccc_add_graph_edges_mb(PyObject *self, PyObject *args) {
   // std::cout << "CALLING INSERT GRAPH MB! " << std::endl;
  
   obj = reinterpret_cast< SCC * >(int_ptr);
+  if (!sccc_writable(obj))
+    return NULL;
 
-  obj->add_graph_edges_mb(row_v, col_v, sims_v);
+  bool finished;
+  Py_BEGIN_ALLOW_THREADS
+  finished = obj->add_graph_edges_mb(row_v, col_v, sims_v, reinterpret_cast< utils::Progress * >(progress_ptr));
+  Py_END_ALLOW_THREADS
+  if (!sccc_finished(finished))
+    return NULL;
   
   // std::cout << "returning!" << std::endl;
   return Py_BuildValue("k", int_ptr);
@@ -219,8 +339,9 @@ static PyObject *sccc_insert_initial_batch(PyObject *self, PyObject *args) {
   PyArrayObject *rows_in;
   PyArrayObject *cols_in;
   PyArrayObject *sims_in;
+  size_t progress_ptr = 0;
   /*  parse the input, from python int to c++ int */
-  if (!PyArg_ParseTuple(args, "nlO!O!O!:sccc_insert_initial_batch", &int_ptr, &num_points, &PyArray_Type, &rows_in, &PyArray_Type, &cols_in, &PyArray_Type, &sims_in))
+  if (!PyArg_ParseTuple(args, "nlO!O!O!|n:sccc_insert_initial_batch", &int_ptr, &num_points, &PyArray_Type, &rows_in, &PyArray_Type, &cols_in, &PyArray_Type, &sims_in, &progress_ptr))
     return NULL;
 
   long rowsInDim = PyArray_DIM(rows_in, 0);
@@ -253,13 +374,111 @@ static PyObject *sccc_insert_initial_batch(PyObject *self, PyObject *args) {
   // std::cout << "CALLING INSERT GRAPH MB! " << std::endl;
  
   obj = reinterpret_cast< SCC * >(int_ptr);
+  if (!sccc_writable(obj))
+    return NULL;
 
-  obj->insert_first_batch((size_t) num_points, row_v, col_v, sims_v);
+  bool finished;
+  Py_BEGIN_ALLOW_THREADS
+  finished = obj->insert_first_batch((size_t) num_points, row_v, col_v, sims_v, reinterpret_cast< utils::Progress * >(progress_ptr));
+  Py_END_ALLOW_THREADS
+  if (!sccc_finished(finished))
+    return NULL;
   
   // std::cout << "returning!" << std::endl;
   return Py_BuildValue("k", int_ptr);
 }
 
+static PyObject *sccc_progress_new(PyObject *self, PyObject *args)
+{
+  utils::Progress *obj = new utils::Progress;
+  size_t int_ptr = reinterpret_cast< size_t >(obj);
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sccc_progress_status(PyObject *self, PyObject *args)
+{
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sccc_progress_status", &int_ptr))
+    return NULL;
+
+  utils::Progress *obj = reinterpret_cast< utils::Progress * >(int_ptr);
+  return Py_BuildValue("nnO", Py_ssize_t(obj->done()), Py_ssize_t(obj->expected()), obj->cancelled() ? Py_True : Py_False);
+}
+
+static PyObject *sccc_progress_cancel(PyObject *self, PyObject *args)
+{
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sccc_progress_cancel", &int_ptr))
+    return NULL;
+
+  reinterpret_cast< utils::Progress * >(int_ptr)->cancel();
+  Py_RETURN_NONE;
+}
+
+static PyObject *sccc_progress_delete(PyObject *self, PyObject *args)
+{
+  utils::Progress *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sccc_progress_delete", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< utils::Progress * >(int_ptr);
+  delete obj;
+
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sccc_sweep(PyObject *self, PyObject *args)
+{
+  PyObject *schedules_in;
+  long cores;
+  long cc_alg;
+  long par_min;
+  long verbo_level;
+  long num_points;
+  PyArrayObject *rows_in;
+  PyArrayObject *cols_in;
+  PyArrayObject *sims_in;
+
+  if (!PyArg_ParseTuple(args, "O!lllllO!O!O!:sccc_sweep", &PyList_Type, &schedules_in, &cores, &cc_alg, &par_min, &verbo_level,
+                        &num_points, &PyArray_Type, &rows_in, &PyArray_Type, &cols_in, &PyArray_Type, &sims_in))
+    return NULL;
+
+  long idx[2] = {0, 0};
+  std::vector<std::vector<scalar>> schedules;
+  for (Py_ssize_t i = 0; i < PyList_Size(schedules_in); i++) {
+    PyObject *item = PyList_GetItem(schedules_in, i);
+    if (!PyArray_Check(item) || PyArray_DIM((PyArrayObject *) item, 0) == 0) {
+      PyErr_Format(SCCcError, "schedule %zd is not a non-empty array of thresholds", i);
+      return NULL;
+    }
+    PyArrayObject *thresholds = (PyArrayObject *) item;
+    scalar * thresh = reinterpret_cast< scalar * >( PyArray_GetPtr(thresholds, idx) );
+    schedules.push_back(std::vector<scalar>(thresh, thresh + PyArray_DIM(thresholds, 0)));
+  }
+
+  node_id_t * row = reinterpret_cast< node_id_t * >( PyArray_GetPtr(rows_in, idx) );
+  node_id_t * col = reinterpret_cast< node_id_t * >( PyArray_GetPtr(cols_in, idx) );
+  scalar * sims = reinterpret_cast< scalar * >( PyArray_GetPtr(sims_in, idx) );
+  std::vector<node_id_t> row_v(row, row + PyArray_DIM(rows_in, 0));
+  std::vector<node_id_t> col_v(col, col + PyArray_DIM(cols_in, 0));
+  std::vector<scalar> sims_v(sims, sims + PyArray_DIM(sims_in, 0));
+
+  std::vector<SCC *> trees = SCC::sweep(schedules, (unsigned) cores, (unsigned) cc_alg, (size_t) par_min, (unsigned) verbo_level,
+                                        (size_t) num_points, row_v, col_v, sims_v);
+
+  PyObject *o;
+  PyObject *results = PyList_New(0);
+  for (SCC * t : trees) {
+    o = PyLong_FromSize_t(reinterpret_cast<size_t>(t));
+    PyList_Append(results, o);
+    Py_DECREF(o);
+  }
+  return Py_BuildValue("N", results);
+}
 
 static PyObject *sccc_roots(PyObject *self, PyObject *args)
 {
@@ -650,7 +869,10 @@ PyMODINIT_FUNC PyInit_sccc(void)
     {"fit_on_large_batch", sccc_insert_initial_batch, METH_VARARGS, "Initialize on a large batch of data at once."}, 
     {"add_graph_edges_mb", sccc_add_graph_edges_mb, METH_VARARGS, "Add edges, but dont update SCC yet. "}, 
     {"fit", sccc_fit, METH_VARARGS, "Run SCC."},
+    {"sweep", sccc_sweep, METH_VARARGS, "Fit one SCC per threshold schedule on one graph."},
     {"update", sccc_update, METH_VARARGS, "Update SCC."},
+    {"track_changes", sccc_track_changes, METH_VARARGS, "Record the parent changes made by each fit or update."},
+    {"changes", sccc_changes, METH_VARARGS, "Level, node, old parent and new parent of the last recorded changes."},
     {"roots", sccc_roots, METH_VARARGS, "Tallest level of the tree."},
     {"node_children", sccc_node_children, METH_VARARGS, "Get children nodes of a node in lower level."},
     {"pruned_children", sccc_node_pruned_children, METH_VARARGS, "Get children nodes."},
@@ -674,6 +896,11 @@ PyMODINIT_FUNC PyInit_sccc(void)
     {"level_property", sccc_level_property, METH_VARARGS, "Get level property."},
     {"descendants", sccc_node_descendants, METH_VARARGS, "Get node descendants."},
     {"set_marking_strategy", sccc_set_marking_strategy, METH_VARARGS, "Set the way we will mark nodes."},
+    {"set_point_counts", sccc_set_point_counts, METH_VARARGS, "Set the number of identical points behind each point."},
+    {"progress_new", sccc_progress_new, METH_VARARGS, "Create a progress counter for long operations."},
+    {"progress_status", sccc_progress_status, METH_VARARGS, "Steps done, steps expected and whether cancelled."},
+    {"progress_cancel", sccc_progress_cancel, METH_VARARGS, "Stop the operations reporting into a progress counter."},
+    {"progress_delete", sccc_progress_delete, METH_VARARGS, "Delete a progress counter."},
     {NULL, NULL, 0, NULL}
   };
   static struct PyModuleDef mdef = {PyModuleDef_HEAD_INIT,
@@ -27,6 +27,9 @@
 #include <atomic>
 #include <thread>
 #include <future>
+#include <mutex>
+#include <functional>
+#include <chrono>
 
 #include <Eigen/Core>
 
@@ -122,63 +125,173 @@ namespace utils
         return f;
     }
 
-    template<class UnaryFunction>
-    UnaryFunction parallel_for_progressbar(size_t first, size_t last, UnaryFunction f, unsigned cores=-1)
+    /*** Progress and cancellation of a long operation ***/
+    // Workers add finished steps to per-thread counters once per block of
+    // elements and stop at the next block once cancelled; a reporting thread
+    // (or another caller) sums the counters whenever it likes.
+    class Progress
     {
-        if (cores == -1) {
-            cores = std::thread::hardware_concurrency();
+        // padded by hand to a cache line each, over-aligned types would need aligned new
+        struct Slot
+        {
+            std::atomic<size_t> done{0};
+            char pad[64 - sizeof(std::atomic<size_t>)];
+        };
+        static const unsigned num_slots = 64;
+        Slot slots[num_slots];
+        std::atomic<size_t> total{0};
+        std::atomic<bool> stop{false};
+
+        static unsigned thread_slot()
+        {
+            static std::atomic<unsigned> next{0};
+            thread_local unsigned slot = next++ % num_slots;
+            return slot;
         }
-        // std::cerr << "Cores: " << cores << std::endl;
-        const size_t total_length = last - first;
-        const size_t chunk_length = total_length / cores;
 
-        if(total_length <= 10000)
+    public:
+        std::function<void(size_t, size_t)> callback;  // (done, total), called by reporting threads
+
+        void expect(size_t steps) { total.fetch_add(steps, std::memory_order_relaxed); }
+        void add(size_t steps) { slots[thread_slot()].done.fetch_add(steps, std::memory_order_relaxed); }
+        void cancel() { stop.store(true, std::memory_order_relaxed); }
+        bool cancelled() const { return stop.load(std::memory_order_relaxed); }
+
+        size_t expected() const { return total.load(std::memory_order_relaxed); }
+        size_t done() const
         {
-            auto task = [&f,&chunk_length](size_t start, size_t end)->void{
-                for (; start < end; ++start){
-                    f(start);
-                }
-            };
+            size_t sum = 0;
+            for (unsigned i = 0; i < num_slots; ++i)
+                sum += slots[i].done.load(std::memory_order_relaxed);
+            return sum;
+        }
+    };
 
-            size_t chunk_start = first;
-            std::vector<std::future<void>>  for_threads;
-            for (unsigned i = 0; i < cores - 1; ++i)
+    /*** Counts one loop into the given progress, or draws a bar on stderr if there is none ***/
+    class Reporter
+    {
+        Progress local;
+        Progress* progress;
+        size_t total;
+        size_t counted = 0;             // steps of a serial loop already added
+        size_t reached = 0;             // and finished
+        bool draw;
+        bool stopped = false;           // a serial loop left before its end
+        int drawn = -1;                 // last tenth drawn
+
+    public:
+        static const size_t block = 1024;
+
+        Reporter(size_t total, Progress* into, bool bar = true)
+            : progress(into), total(total), draw(false)
+        {
+            if (progress == nullptr)
             {
-                const auto chunk_stop = chunk_start + chunk_length;
-                for_threads.push_back(std::async(std::launch::async, task, chunk_start, chunk_stop));
-                chunk_start = chunk_stop;
+                progress = &local;
+                draw = bar;
             }
-            for_threads.push_back(std::async(std::launch::async, task, chunk_start, last));
+            progress->expect(total);
+        }
 
-            for (auto& thread : for_threads)
-                thread.get();
+        ~Reporter()
+        {
+            progress->add(reached - counted);
+            report();
+            if (draw && drawn >= 0)
+                std::cerr << std::endl;
         }
-        else
+
+        Progress& get() { return *progress; }
+        bool cancelled() const { return progress->cancelled(); }
+        bool stopped_early() const { return stopped; }
+
+        // From the thread that waits for the workers only
+        void report()
         {
-            auto task = [&f,&chunk_length](size_t start, size_t end)->void{
-                for (; start < end; ++start){
-                    progressbar(start%chunk_length, chunk_length);
-                    f(start);
-                }
-            };
+            size_t done = progress->done();
+            if (progress->callback)
+                progress->callback(done, progress->expected());
+            if (!draw || total == 0)
+                return;
+            int tenth = int(std::min(done, total) * 10 / total);
+            if (tenth == drawn)
+                return;
+            drawn = tenth;
+            const unsigned w = 50, c = unsigned(tenth) * w / 10;
+            std::cerr << std::setw(3) << tenth * 10 << "% [";
+            for (unsigned x = 0; x < c; x++) std::cerr << "=";
+            for (unsigned x = c; x < w; x++) std::cerr << " ";
+            std::cerr << "]\r" << std::flush;
+        }
 
-            size_t chunk_start = first;
-            std::vector<std::future<void>>  for_threads;
-            for (unsigned i = 0; i < cores - 1; ++i)
+        // For serial loops, called with the index of every element; false once cancelled
+        bool tick(size_t i)
+        {
+            reached = i + 1;
+            if ((i & (block - 1)) != 0)
+                return true;
+            progress->add(i - counted);
+            counted = i;
+            report();
+            if (!progress->cancelled())
+                return true;
+            reached = i;
+            stopped = true;
+            return false;
+        }
+    };
+
+    /*** True once progress, if any, is cancelled ***/
+    inline bool cancelled(const Progress* progress)
+    {
+        return progress != nullptr && progress->cancelled();
+    }
+
+    /*** f on every index of [first, last), counted into the given progress (a bar if null); false if cancelled before the end ***/
+    template<class UnaryFunction>
+    bool parallel_for_progressbar(size_t first, size_t last, UnaryFunction f, unsigned cores=-1, Progress* into=nullptr)
+    {
+        cores = cores == unsigned(-1) ? std::max(std::thread::hardware_concurrency(), 1u) : std::max(cores, 1u);
+        if (first >= last)
+            return true;
+        const size_t total_length = last - first;
+        Reporter reporter(total_length, into, total_length > 10000);
+        Progress& progress = reporter.get();
+        std::atomic<bool> stopped{false};
+
+        // counting and the check for cancellation happen once per block
+        auto task = [&f, &progress, &stopped](size_t start, size_t end)->void{
+            while (start < end && !progress.cancelled())
             {
-                const auto chunk_stop = chunk_start + chunk_length;
-                for_threads.push_back(std::async(std::launch::async, task, chunk_start, chunk_stop));
-                chunk_start = chunk_stop;
+                const size_t stop = std::min(end, start + Reporter::block);
+                for (size_t i = start; i < stop; ++i)
+                    f(i);
+                progress.add(stop - start);
+                start = stop;
             }
-            for_threads.push_back(std::async(std::launch::async, task, chunk_start, last));
+            if (start < end)
+                stopped.store(true, std::memory_order_relaxed);
+        };
 
-            for (auto& thread : for_threads)
-                thread.get();
-            progressbar(chunk_length, chunk_length);
-            std::cerr << std::endl;
+        const size_t chunk_length = std::max(total_length / cores, size_t(1));
+        size_t chunk_start = first;
+        std::vector<std::future<void>>  for_threads;
+        for (unsigned i = 0; i < cores - 1 && chunk_start + chunk_length < last; ++i)
+        {
+            const auto chunk_stop = chunk_start + chunk_length;
+            for_threads.push_back(std::async(std::launch::async, task, chunk_start, chunk_stop));
+            chunk_start = chunk_stop;
         }
+        for_threads.push_back(std::async(std::launch::async, task, chunk_start, last));
 
-        return f;
+        // the calling thread only reports
+        for (auto& thread : for_threads)
+        {
+            while (thread.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+                reporter.report();
+            thread.get();
+        }
+        return !stopped.load();
     }
 
     template<typename T>
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "density_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+DensityIndex::DensityIndex(const SGTree& tree)
+    : tree(tree), counted(std::numeric_limits<size_t>::max())
+{
+    std::shared_lock<std::shared_timed_mutex> guard(tree.global_mut);
+    count();
+}
+
+size_t DensityIndex::points()
+{
+    std::shared_lock<std::shared_timed_mutex> guard(tree.global_mut);
+    count();
+    std::shared_lock<std::shared_timed_mutex> lk(mut);
+    return size.empty() ? 0 : size[0];
+}
+
+/****************************** Counting *************************************/
+
+void DensityIndex::count()
+{
+    const size_t version = tree.get_version();
+    {
+        std::shared_lock<std::shared_timed_mutex> lk(mut);
+        if (counted == version)
+            return;
+    }
+    std::unique_lock<std::shared_timed_mutex> lk(mut);
+    if (counted == version)
+        return;
+    // points inserted while counting raise the version again
+    counted = version;
+
+    nodes.clear();
+    first_child.clear();
+    num_children.clear();
+    own.clear();
+    if (tree.root == NULL)
+    {
+        size.clear();
+        return;
+    }
+
+    nodes.push_back(tree.root);
+    own.push_back(1 + unsigned(tree.root->dup_uids.size()));
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        SGTree::Node* node = nodes[i];
+        node->mut.lock_shared();
+        first_child.push_back(nodes.size());
+        num_children.push_back(unsigned(node->children.size()));
+        for (auto child : node->children)
+        {
+            nodes.push_back(child);
+            // a nested copy stands for the point of its parent
+            own.push_back((child->UID != node->UID ? 1u : 0u) + unsigned(child->dup_uids.size()));
+        }
+        node->mut.unlock_shared();
+    }
+
+    // Children follow their parents, so a reverse sweep finishes every subtree before its root
+    size = own;
+    for (size_t i = nodes.size(); i-- > 0; )
+        for (size_t c = first_child[i]; c < first_child[i] + num_children[i]; ++c)
+            size[i] += size[c];
+}
+
+/****************************** Queries *************************************/
+
+size_t DensityIndex::count_within(const pointType& p, scalar r) const
+{
+    size_t total = 0;
+    if (nodes.empty())
+        return total;
+
+    std::vector<std::pair<size_t, scalar>> travel;
+    travel.emplace_back(0, nodes[0]->dist(p));
+    while (travel.size() > 0)
+    {
+        const auto current = travel.back();
+        travel.pop_back();
+        const size_t i = current.first;
+        const scalar d = current.second;
+        const scalar radius = nodes[i]->maxdistUB;
+
+        if (d - radius >= r)
+            continue;
+        if (d + radius < r)
+        {
+            total += size[i];
+            continue;
+        }
+        if (d < r)
+            total += own[i];
+        for (size_t c = first_child[i]; c < first_child[i] + num_children[i]; ++c)
+            travel.emplace_back(c, nodes[c]->dist(p));
+    }
+    return total;
+}
+
+scalar DensityIndex::kernel_sum(const pointType& p, scalar bandwidth, scalar atol, scalar* error) const
+{
+    double total = 0, spent = 0;
+    if (!nodes.empty())
+    {
+        const double scale = -0.5 / (double(bandwidth) * bandwidth);
+        auto kernel = [scale](double d) { return std::exp(scale * d * d); };
+
+        std::vector<std::pair<size_t, scalar>> travel;
+        travel.emplace_back(0, nodes[0]->dist(p));
+        while (travel.size() > 0)
+        {
+            const auto current = travel.back();
+            travel.pop_back();
+            const size_t i = current.first;
+            const double d = current.second;
+            const double radius = nodes[i]->maxdistUB;
+
+            // every point of the subtree lies between the near and far end of the ball
+            const double k_near = kernel(std::max(d - radius, 0.0));
+            const double k_far = kernel(d + radius);
+            if (k_near - k_far <= 2 * double(atol))
+            {
+                total += size[i] * 0.5 * (k_near + k_far);
+                spent += size[i] * 0.5 * (k_near - k_far);
+                continue;
+            }
+            total += own[i] * kernel(d);
+            for (size_t c = first_child[i]; c < first_child[i] + num_children[i]; ++c)
+                travel.emplace_back(c, nodes[c]->dist(p));
+        }
+    }
+    if (error != nullptr)
+        *error = scalar(spent);
+    return scalar(total);
+}
+
+void DensityIndex::rangeCount(const Eigen::Map<matrixType>& queries, scalar r, unsigned cores, long* counts)
+{
+    std::shared_lock<std::shared_timed_mutex> guard(tree.global_mut);
+    count();
+    std::shared_lock<std::shared_timed_mutex> lk(mut);
+    utils::parallel_for(0, queries.cols(), [&](size_t i)->void{
+        counts[i] = long(count_within(queries.col(i), r));
+    }, utils::pool_cores(cores));
+}
+
+void DensityIndex::kernelSum(const Eigen::Map<matrixType>& queries, scalar bandwidth, scalar atol, unsigned cores,
+                             scalar* sums, scalar* errors)
+{
+    std::shared_lock<std::shared_timed_mutex> guard(tree.global_mut);
+    count();
+    std::shared_lock<std::shared_timed_mutex> lk(mut);
+    utils::parallel_for(0, queries.cols(), [&](size_t i)->void{
+        sums[i] = kernel_sum(queries.col(i), bandwidth, atol, errors + i);
+    }, utils::pool_cores(cores));
+}
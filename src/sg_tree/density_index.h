@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+# ifndef _DENSITY_INDEX_H
+# define _DENSITY_INDEX_H
+
+#include <shared_mutex>
+#include <vector>
+
+#include "sg_tree.h"
+
+/*
+ * Number of points below every node of an SG Tree, for range counts and
+ * kernel density estimates that never list the points.
+ *
+ * A subtree whose covering ball (maxdistUB around its node) lies inside the
+ * range adds its size at once, one outside of it is skipped. For the
+ * Gaussian kernel exp(-d^2 / (2 h^2)) the kernel values of a subtree lie
+ * between those at the nearest and farthest end of its ball; a subtree is
+ * summed as its size times their midpoint once they differ by at most
+ * 2 atol, so every point is off by at most atol and the returned error
+ * bound adds up what each query actually spent of it.
+ *
+ * Exact duplicates count with their multiplicity, the nested copies of a
+ * node (same UID as its parent) do not count again. The sizes are taken
+ * again, under the tree lock, by the first query after the tree changed.
+ */
+class DensityIndex
+{
+protected:
+    const SGTree& tree;
+
+    mutable std::shared_timed_mutex mut;    // taken exclusively to recount
+    size_t counted;                         // tree version of the sizes
+
+    // Breadth first, so the children of a node are contiguous
+    std::vector<SGTree::Node*> nodes;
+    std::vector<size_t> first_child;
+    std::vector<unsigned> num_children;     // at the time of counting
+    std::vector<unsigned> own;              // points of the node itself
+    std::vector<unsigned> size;             // points in the subtree
+
+    /*** Recount if the tree changed; the caller holds tree.global_mut shared, not mut ***/
+    void count();
+
+    /*** Single queries, the caller holds mut and the tree lock shared ***/
+    size_t count_within(const pointType& p, scalar r) const;
+    scalar kernel_sum(const pointType& p, scalar bandwidth, scalar atol, scalar* error) const;
+
+public:
+    explicit DensityIndex(const SGTree& tree);
+
+    DensityIndex(const DensityIndex&) = delete;
+    DensityIndex& operator=(const DensityIndex&) = delete;
+
+    /*** Number of points closer than r to every column of queries ***/
+    void rangeCount(const Eigen::Map<matrixType>& queries, scalar r, unsigned cores, long* counts);
+    /*** Sum of exp(-|x - q|^2 / (2 bandwidth^2)) over all points x for every column q, and its error bound ***/
+    void kernelSum(const Eigen::Map<matrixType>& queries, scalar bandwidth, scalar atol, unsigned cores,
+                   scalar* sums, scalar* errors);
+
+    size_t points();
+};
+
+#endif  // _DENSITY_INDEX_H
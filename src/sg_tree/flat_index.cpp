@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flat_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+// Tile of one matrix product: point_block x query_block scores
+static const size_t query_block = 256;
+static const size_t point_block = 1024;
+
+namespace
+{
+    // The k smallest (key, UID) pairs seen so far, largest on top
+    struct TopK
+    {
+        typedef std::pair<scalar, long> Scored;
+        std::vector<Scored> heap;
+        unsigned k;
+
+        explicit TopK(unsigned k = 0) : k(k) { heap.reserve(k); }
+
+        scalar worst() const
+        {
+            return heap.size() < k ? std::numeric_limits<scalar>::max() : heap.front().first;
+        }
+
+        void offer(scalar key, long uid)
+        {
+            if (heap.size() < k)
+            {
+                heap.emplace_back(key, uid);
+                std::push_heap(heap.begin(), heap.end());
+            }
+            else if (key < heap.front().first)
+            {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.back() = Scored(key, uid);
+                std::push_heap(heap.begin(), heap.end());
+            }
+        }
+    };
+}
+
+FlatIndex::FlatIndex(unsigned dim, Metric metric)
+    : D(dim), metric(metric), data(dim, 0), N(0)
+{ }
+
+size_t FlatIndex::size() const
+{
+    std::shared_lock<std::shared_timed_mutex> lk(mut);
+    return N;
+}
+
+void FlatIndex::add(const Eigen::Map<matrixType>& points)
+{
+    std::unique_lock<std::shared_timed_mutex> lk(mut);
+    const size_t count = points.cols();
+    if (N + count > size_t(data.cols()))
+        data.conservativeResize(Eigen::NoChange, std::max(N + count, 2 * size_t(data.cols())));
+    data.middleCols(N, count) = points;
+
+    base.resize(N + count);
+    mult.resize(N + count);
+    for (size_t i = N; i < N + count; ++i)
+    {
+        scalar norm2 = data.col(i).squaredNorm();
+        switch (metric)
+        {
+            case Metric::L2:        // |x|^2 - 2 x.q, |q|^2 is the same for all points
+                base[i] = norm2;
+                mult[i] = 2;
+                break;
+            case Metric::Inner:
+                base[i] = 0;
+                mult[i] = 1;
+                break;
+            case Metric::Cosine:    // |q| is the same for all points
+                base[i] = 0;
+                mult[i] = norm2 > 0 ? 1 / std::sqrt(norm2) : 0;
+                break;
+        }
+    }
+    N += count;
+}
+
+scalar FlatIndex::exact(size_t i, const pointType& q, scalar qnorm) const
+{
+    switch (metric)
+    {
+        case Metric::L2:
+            return (data.col(i) - q).norm();
+        case Metric::Inner:
+            return data.col(i).dot(q);
+        default:
+        {
+            scalar norm = data.col(i).norm();
+            return norm > 0 && qnorm > 0 ? data.col(i).dot(q) / (norm * qnorm) : 0;
+        }
+    }
+}
+
+/****************************** Search *************************************/
+
+// Best first by exact score, padded with -1 and the worst score
+static void write_best(const std::vector<std::pair<scalar, long>>& best, unsigned k, bool smaller_first,
+                       long* uids, scalar* scores)
+{
+    for (unsigned t = 0; t < k; ++t)
+    {
+        if (t < best.size())
+        {
+            uids[t] = best[t].second;
+            scores[t] = smaller_first ? best[t].first : -best[t].first;
+        }
+        else
+        {
+            uids[t] = -1;
+            scores[t] = smaller_first ? std::numeric_limits<scalar>::infinity() : -std::numeric_limits<scalar>::infinity();
+        }
+    }
+}
+
+void FlatIndex::search(const Eigen::Map<matrixType>& queries, unsigned k, unsigned cores, long* uids, scalar* scores) const
+{
+    std::shared_lock<std::shared_timed_mutex> lk(mut);
+    cores = utils::pool_cores(cores);
+    const size_t numQueries = queries.cols();
+    const size_t queryBlocks = (numQueries + query_block - 1) / query_block;
+    const size_t pointBlocks = std::max((N + point_block - 1) / point_block, size_t(1));
+    // Few queries: split the points over the threads as well
+    const size_t parts = std::min(std::max(size_t(cores) / std::max(queryBlocks, size_t(1)), size_t(1)), pointBlocks);
+
+    std::vector<TopK> found(parts * numQueries, TopK(k));
+    utils::ThreadPool::shared().run(queryBlocks * parts, [&](size_t task)->void{
+        const size_t qb = task / parts, part = task % parts;
+        const size_t qfirst = qb * query_block;
+        const size_t qcount = std::min(query_block, numQueries - qfirst);
+        const size_t first = N * part / parts, last = N * (part + 1) / parts;
+        TopK* heaps = found.data() + part * numQueries + qfirst;
+        for (size_t start = first; start < last; start += point_block)
+        {
+            const size_t count = std::min(point_block, last - start);
+            matrixType dots = data.middleCols(start, count).transpose() * queries.middleCols(qfirst, qcount);
+            for (size_t j = 0; j < qcount; ++j)
+            {
+                TopK& heap = heaps[j];
+                scalar worst = heap.worst();
+                const scalar* col = dots.col(j).data();
+                for (size_t i = 0; i < count; ++i)
+                {
+                    scalar key = base[start + i] - mult[start + i] * col[i];
+                    if (key < worst)
+                    {
+                        heap.offer(key, long(start + i));
+                        worst = heap.worst();
+                    }
+                }
+            }
+        }
+    }, cores);
+
+    const bool smaller_first = metric == Metric::L2;
+    utils::ThreadPool::shared().run(numQueries, [&](size_t j)->void{
+        TopK merged(k);
+        for (size_t part = 0; part < parts; ++part)
+            for (const auto& s : found[part * numQueries + j].heap)
+                merged.offer(s.first, s.second);
+        const pointType q = queries.col(j);
+        const scalar qnorm = q.norm();
+        std::vector<std::pair<scalar, long>> best;
+        for (const auto& s : merged.heap)
+        {
+            scalar score = exact(size_t(s.second), q, qnorm);
+            best.emplace_back(smaller_first ? score : -score, s.second);
+        }
+        std::sort(best.begin(), best.end());
+        write_best(best, k, smaller_first, uids + size_t(k) * j, scores + size_t(k) * j);
+    }, cores);
+}
+
+void FlatIndex::rerank(const Eigen::Map<matrixType>& queries, const long* candidates, unsigned num_candidates,
+                       unsigned k, unsigned cores, long* uids, scalar* scores) const
+{
+    std::shared_lock<std::shared_timed_mutex> lk(mut);
+    const bool smaller_first = metric == Metric::L2;
+    utils::ThreadPool::shared().run(queries.cols(), [&](size_t j)->void{
+        const pointType q = queries.col(j);
+        const scalar qnorm = q.norm();
+        const long* cand = candidates + size_t(num_candidates) * j;
+        TopK heap(k);
+        for (unsigned c = 0; c < num_candidates; ++c)
+        {
+            if (cand[c] < 0 || size_t(cand[c]) >= N)
+                continue;
+            scalar score = exact(size_t(cand[c]), q, qnorm);
+            heap.offer(smaller_first ? score : -score, cand[c]);
+        }
+        std::sort(heap.heap.begin(), heap.heap.end());
+        write_best(heap.heap, k, smaller_first, uids + size_t(k) * j, scores + size_t(k) * j);
+    }, utils::pool_cores(cores));
+}
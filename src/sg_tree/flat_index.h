@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+# ifndef _FLAT_INDEX_H
+# define _FLAT_INDEX_H
+
+#include <shared_mutex>
+#include <vector>
+
+#include "utils.h"
+
+/*
+ * Exact brute force search over a matrix of points, for sets too small for
+ * a tree, ground truth of benchmarks and re-ranking of approximate results.
+ *
+ * Scores of a block of queries against a block of points come from one
+ * matrix product, and every query keeps a heap of its k best while the
+ * block is scanned, so the full score matrix never exists. Query blocks
+ * and ranges of points run in parallel, the heaps of different ranges are
+ * merged at the end. The k winners are scored again exactly:
+ *
+ *   L2       distances |x - q|, smallest first
+ *   Inner    products x.q, largest first
+ *   Cosine   x.q / (|x| |q|), largest first
+ *
+ * Points get consecutive UIDs from 0 in the order they are added.
+ */
+class FlatIndex
+{
+public:
+    enum class Metric { L2 = 0, Inner = 1, Cosine = 2 };
+
+protected:
+    unsigned D;
+    Metric metric;
+
+    mutable std::shared_timed_mutex mut;    // taken exclusively to add points
+    matrixType data;                        // D x capacity, the first N columns are used
+    size_t N;
+    // Ranking keys are base - mult * x.q, smaller is better
+    std::vector<scalar> base;
+    std::vector<scalar> mult;
+
+    scalar exact(size_t i, const pointType& q, scalar qnorm) const;
+
+public:
+    FlatIndex(unsigned dim, Metric metric);
+
+    FlatIndex(const FlatIndex&) = delete;
+    FlatIndex& operator=(const FlatIndex&) = delete;
+
+    /*** Append the columns of points ***/
+    void add(const Eigen::Map<matrixType>& points);
+
+    /*** k best points for every column of queries (-1 past the size of the index) ***/
+    void search(const Eigen::Map<matrixType>& queries, unsigned k, unsigned cores, long* uids, scalar* scores) const;
+
+    /*** k best of num_candidates UIDs per query (-1 entries are skipped) ***/
+    void rerank(const Eigen::Map<matrixType>& queries, const long* candidates, unsigned num_candidates,
+                unsigned k, unsigned cores, long* uids, scalar* scores) const;
+
+    size_t size() const;
+    unsigned dim() const { return D; }
+};
+
+#endif  // _FLAT_INDEX_H
@@ -0,0 +1,569 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flat_sg_tree.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <queue>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char flat_magic[8] = {'S', 'G', 'F', 'L', 'A', 'T', '\0', '\0'};
+
+static bool is_shm_name(const std::string& name)
+{
+    return name.find('/') == std::string::npos;
+}
+
+static int open_image(const std::string& name, int flags)
+{
+    if (is_shm_name(name))
+        return shm_open(("/" + name).c_str(), flags, 0644);
+    return open(name.c_str(), flags, 0644);
+}
+
+// Replace an image by a fully written one; readers that mapped the old
+// image keep their pages. POSIX shared memory objects live in /dev/shm on
+// Linux, where they can be renamed like files.
+static bool rename_image(const std::string& from, const std::string& to)
+{
+    if (is_shm_name(to))
+        return std::rename(("/dev/shm/" + from).c_str(), ("/dev/shm/" + to).c_str()) == 0;
+    return std::rename(from.c_str(), to.c_str()) == 0;
+}
+
+static void unlink_image(const std::string& name)
+{
+    if (is_shm_name(name))
+        shm_unlink(("/" + name).c_str());
+    else
+        ::unlink(name.c_str());
+}
+
+static uint64_t align64(uint64_t offset)
+{
+    return (offset + 63) & ~uint64_t(63);
+}
+
+/****************************** Export *************************************/
+
+bool FlatSGTree::write(SGTree& tree, const std::string& name, const Heat* heat, size_t hot_bytes)
+{
+    std::shared_lock<std::shared_timed_mutex> guard(tree.global_mut);
+    SGTree::Node* root = tree.get_root();
+    if (root == NULL)
+    {
+        std::cerr << "Cannot share an empty SG Tree!" << std::endl;
+        return false;
+    }
+
+    // Without heat, number the nodes breadth first so that siblings are contiguous
+    std::vector<SGTree::Node*> order;
+    std::vector<uint32_t> first_child;
+    order.push_back(root);
+    if (heat == nullptr)
+    {
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            first_child.push_back(uint32_t(order.size()));
+            for (const auto& child : *order[i])
+                order.push_back(child);
+        }
+    }
+    else
+    {
+        // Siblings stay contiguous, but the child block of the hottest
+        // numbered node goes next (ties in numbering order), hottest child first
+        auto visits_of = [heat](const SGTree::Node* node) -> uint64_t {
+            auto it = heat->find(node_key(node->UID, node->level));
+            return it == heat->end() ? 0 : it->second;
+        };
+        std::priority_queue<std::pair<uint64_t, int64_t>> next;
+        next.emplace(visits_of(root), 0);
+        std::vector<std::pair<uint64_t, SGTree::Node*>> block;
+        first_child.resize(1);
+        while (!next.empty())
+        {
+            size_t i = size_t(-next.top().second);
+            const SGTree::Node* node = order[i];
+            next.pop();
+            first_child[i] = uint32_t(order.size());
+            block.clear();
+            for (const auto& child : *node)
+                block.emplace_back(visits_of(child), child);
+            std::stable_sort(block.begin(), block.end(),
+                [](const std::pair<uint64_t, SGTree::Node*>& a, const std::pair<uint64_t, SGTree::Node*>& b) { return a.first > b.first; });
+            for (const auto& child : block)
+            {
+                next.emplace(child.first, -int64_t(order.size()));
+                order.push_back(child.second);
+            }
+            first_child.resize(order.size());
+        }
+    }
+
+    const uint64_t num_nodes = order.size();
+    const uint64_t D = root->_p.rows();
+    const uint64_t node_bytes = sizeof(scalar)*(D + 1) + sizeof(int32_t) + 3*sizeof(uint32_t);
+
+    Header h;
+    std::memset(&h, 0, sizeof(Header));
+    std::memcpy(h.magic, flat_magic, sizeof(flat_magic));
+    h.version = layout_version;
+    h.scalar_size = sizeof(scalar);
+    h.num_nodes = num_nodes;
+    h.dim = D;
+    h.root_level = root->level;
+    h.base = tree.base;
+    h.points_offset = align64(sizeof(Header));
+    h.level_offset = align64(h.points_offset + sizeof(scalar)*num_nodes*D);
+    h.maxdist_offset = align64(h.level_offset + sizeof(int32_t)*num_nodes);
+    h.uid_offset = align64(h.maxdist_offset + sizeof(scalar)*num_nodes);
+    h.child_offset = align64(h.uid_offset + sizeof(uint32_t)*num_nodes);
+    h.child_count_offset = align64(h.child_offset + sizeof(uint32_t)*num_nodes);
+    h.total_size = h.child_count_offset + sizeof(uint32_t)*num_nodes;
+    h.num_hot = heat == nullptr ? 0 : std::min(num_nodes, uint64_t(hot_bytes / node_bytes));
+
+    // Truncating the live image would SIGBUS readers that mapped it, so
+    // write a new image beside it and rename it into place
+    const std::string tmp = name + ".tmp." + std::to_string(getpid());
+    int fd = open_image(tmp, O_CREAT | O_RDWR | O_TRUNC);
+    if (fd < 0)
+    {
+        std::cerr << "Cannot create shared SG Tree " << tmp << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (ftruncate(fd, h.total_size) != 0)
+    {
+        std::cerr << "Cannot resize shared SG Tree " << tmp << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        unlink_image(tmp);
+        return false;
+    }
+    void* addr = mmap(NULL, h.total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        std::cerr << "Cannot map shared SG Tree " << tmp << ": " << std::strerror(errno) << std::endl;
+        unlink_image(tmp);
+        return false;
+    }
+
+    char* buff = static_cast<char*>(addr);
+    scalar* pts = reinterpret_cast<scalar*>(buff + h.points_offset);
+    int32_t* lvl = reinterpret_cast<int32_t*>(buff + h.level_offset);
+    scalar* mdist = reinterpret_cast<scalar*>(buff + h.maxdist_offset);
+    uint32_t* uid = reinterpret_cast<uint32_t*>(buff + h.uid_offset);
+    uint32_t* cbegin = reinterpret_cast<uint32_t*>(buff + h.child_offset);
+    uint32_t* ccount = reinterpret_cast<uint32_t*>(buff + h.child_count_offset);
+
+    for (uint64_t i = 0; i < num_nodes; ++i)
+    {
+        const SGTree::Node* node = order[i];
+        std::copy(node->_p.data(), node->_p.data() + D, pts + i*D);
+        lvl[i] = node->level;
+        mdist[i] = node->maxdistUB;
+        uid[i] = node->UID;
+        cbegin[i] = first_child[i];
+        ccount[i] = uint32_t(node->children.size());
+    }
+
+    // Publish the header last so a half written image never validates
+    std::memcpy(buff, &h, sizeof(Header));
+    msync(addr, h.total_size, MS_SYNC);
+    munmap(addr, h.total_size);
+    if (!rename_image(tmp, name))
+    {
+        std::cerr << "Cannot publish shared SG Tree " << name << ": " << std::strerror(errno) << std::endl;
+        unlink_image(tmp);
+        return false;
+    }
+    return true;
+}
+
+/****************************** Attach *************************************/
+
+FlatSGTree* FlatSGTree::attach(const std::string& name)
+{
+    int fd = open_image(name, O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Cannot open shared SG Tree " << name << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header))
+    {
+        std::cerr << "Shared SG Tree " << name << " is truncated!" << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        std::cerr << "Cannot map shared SG Tree " << name << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+
+    FlatSGTree* ft = new FlatSGTree();
+    ft->base_addr = static_cast<const char*>(addr);
+    ft->mapped_size = st.st_size;
+    ft->header = reinterpret_cast<const Header*>(addr);
+
+    const Header& h = *ft->header;
+    if (std::memcmp(h.magic, flat_magic, sizeof(flat_magic)) != 0
+        || h.version != layout_version
+        || h.scalar_size != sizeof(scalar)
+        || h.total_size > ft->mapped_size
+        || h.num_nodes == 0)
+    {
+        std::cerr << "Shared SG Tree " << name << " is invalid or was written by an incompatible build!" << std::endl;
+        delete ft;
+        return nullptr;
+    }
+
+    ft->points = reinterpret_cast<const scalar*>(ft->base_addr + h.points_offset);
+    ft->levels = reinterpret_cast<const int32_t*>(ft->base_addr + h.level_offset);
+    ft->maxdist = reinterpret_cast<const scalar*>(ft->base_addr + h.maxdist_offset);
+    ft->uids = reinterpret_cast<const uint32_t*>(ft->base_addr + h.uid_offset);
+    ft->child_begin = reinterpret_cast<const uint32_t*>(ft->base_addr + h.child_offset);
+    ft->child_count = reinterpret_cast<const uint32_t*>(ft->base_addr + h.child_count_offset);
+    ft->D = unsigned(h.dim);
+    return ft;
+}
+
+void FlatSGTree::count_visits(bool enable)
+{
+    std::lock_guard<std::mutex> lock(visits_mut);
+    if (!visits)
+    {
+        if (!enable)
+            return;
+        visits.reset(new std::atomic<uint64_t>[size()]);
+    }
+    counting.store(false, std::memory_order_relaxed);
+    for (size_t i = 0; i < size(); ++i)
+        visits[i].store(0, std::memory_order_relaxed);
+    counting.store(enable, std::memory_order_release);
+}
+
+FlatSGTree::Heat FlatSGTree::visit_counts() const
+{
+    std::lock_guard<std::mutex> lock(visits_mut);
+    Heat heat;
+    if (visits)
+        for (size_t i = 0; i < size(); ++i)
+        {
+            uint64_t count = visits[i].load(std::memory_order_relaxed);
+            if (count > 0)
+                heat[node_key(uids[i], levels[i])] = count;
+        }
+    return heat;
+}
+
+bool FlatSGTree::lock_hot()
+{
+    if (hot_locked || header->num_hot == 0)
+        return hot_locked;
+    const uint64_t n = header->num_hot;
+    const uint64_t D = header->dim;
+    const std::pair<uint64_t, uint64_t> ranges[] = {
+        {header->points_offset, sizeof(scalar)*n*D},
+        {header->level_offset, sizeof(int32_t)*n},
+        {header->maxdist_offset, sizeof(scalar)*n},
+        {header->uid_offset, sizeof(uint32_t)*n},
+        {header->child_offset, sizeof(uint32_t)*n},
+        {header->child_count_offset, sizeof(uint32_t)*n}};
+    const uint64_t page = uint64_t(sysconf(_SC_PAGESIZE));
+    for (const auto& range : ranges)
+    {
+        // mlock needs page aligned addresses; the mapping itself is
+        uint64_t first = range.first & ~(page - 1);
+        if (mlock(base_addr + first, range.first + range.second - first) != 0)
+        {
+            std::cerr << "Cannot lock the hot nodes of a shared SG Tree: " << std::strerror(errno) << std::endl;
+            munlock(base_addr, mapped_size);
+            return false;
+        }
+    }
+    hot_locked = true;
+    return true;
+}
+
+FlatSGTree::~FlatSGTree()
+{
+    if (base_addr != nullptr)
+        munmap(const_cast<char*>(base_addr), mapped_size);
+}
+
+bool FlatSGTree::unlink(const std::string& name)
+{
+    if (is_shm_name(name))
+        return shm_unlink(("/" + name).c_str()) == 0;
+    return ::unlink(name.c_str()) == 0;
+}
+
+/****************************** Nearest Neighbour *************************************/
+
+std::pair<unsigned, scalar> FlatSGTree::NearestNeighbour(const pointType &p) const
+{
+    std::pair<unsigned, scalar> nn(0, dist(0, p));
+    std::vector<std::pair<unsigned, scalar>> travel;
+    unsigned curNode;
+    scalar curDist;
+
+    // Scratch memory
+    std::vector<int> local_idx;
+    std::vector<scalar> local_dists;
+    auto comp_x = [&local_dists](int a, int b) { return local_dists[a] > local_dists[b]; };
+
+    // Initialize with root
+    travel.push_back(nn);
+
+    // Pop, print and then push the children
+    while (travel.size() > 0)
+    {
+        // Pop
+        curNode = travel.back().first;
+        curDist = travel.back().second;
+        travel.pop_back();
+        visit(curNode);
+
+        // If the current node is the nearest neighbour
+        if (curDist < nn.second)
+        {
+            nn.first = curNode;
+            nn.second = curDist;
+        }
+
+        // Now push children in sorted order if potential NN among them
+        const unsigned first_child = child_begin[curNode];
+        const unsigned num_children = child_count[curNode];
+        local_idx.resize(num_children);
+        local_dists.resize(num_children);
+        std::iota(local_idx.begin(), local_idx.end(), 0);
+        for (unsigned i = 0; i < num_children; ++i)
+            local_dists[i] = dist(first_child + i, p);
+        std::sort(std::begin(local_idx), std::end(local_idx), comp_x);
+
+        const scalar best_dist_now = nn.second;
+        for (const auto& child_idx : local_idx)
+        {
+            unsigned child = first_child + child_idx;
+            scalar dist_child = local_dists[child_idx];
+            if (best_dist_now > dist_child - maxdist[child])
+                travel.emplace_back(child, dist_child);
+        }
+    }
+    return nn;
+}
+
+/****************************** k-Nearest Neighbours *************************************/
+
+std::vector<std::pair<unsigned, scalar>> FlatSGTree::kNearestNeighbours(const pointType &p, unsigned numNbrs) const
+{
+    // Do the worst initialization
+    std::pair<unsigned, scalar> dummy(unsigned(-1), std::numeric_limits<scalar>::max());
+    // List of k-nearest points till now
+    std::vector<std::pair<unsigned, scalar>> nnList(numNbrs, dummy);
+
+    // Iteration variables
+    std::vector<std::pair<unsigned, scalar>> travel;
+    unsigned curNode;
+    scalar curDist;
+
+    // Scratch memory
+    std::vector<int> local_idx;
+    std::vector<scalar> local_dists;
+    auto comp_x = [&local_dists](int a, int b) { return local_dists[a] > local_dists[b]; };
+    auto comp_pair = [](std::pair<unsigned, scalar> a, std::pair<unsigned, scalar> b) { return a.second < b.second; };
+
+    // Initialize with root
+    travel.emplace_back(0, dist(0, p));
+
+    // Pop, print and then push the children
+    while (travel.size() > 0)
+    {
+        // Pop
+        const auto current = travel.back();
+        curNode = current.first;
+        curDist = current.second;
+        visit(curNode);
+
+        // If the current node is eligible to get into the list
+        if(curDist < nnList.back().second)
+        {
+            nnList.insert(
+                std::upper_bound( nnList.begin(), nnList.end(), current, comp_pair ),
+                current
+            );
+            nnList.pop_back();
+        }
+        travel.pop_back();
+
+        // Now push children in sorted order if potential NN among them
+        const unsigned first_child = child_begin[curNode];
+        const unsigned num_children = child_count[curNode];
+        local_idx.resize(num_children);
+        local_dists.resize(num_children);
+        std::iota(local_idx.begin(), local_idx.end(), 0);
+        for (unsigned i = 0; i < num_children; ++i)
+            local_dists[i] = dist(first_child + i, p);
+        std::sort(local_idx.begin(), local_idx.end(), comp_x);
+
+        const scalar best_dist_now = nnList.back().second;
+        for (const auto& child_idx : local_idx)
+        {
+            unsigned child = first_child + child_idx;
+            scalar dist_child = local_dists[child_idx];
+            if (best_dist_now > dist_child - maxdist[child])
+                travel.emplace_back(child, dist_child);
+        }
+    }
+    return nnList;
+}
+
+std::vector<std::pair<unsigned, scalar>> FlatSGTree::kNearestNeighboursBeam(const pointType &p, unsigned numNbrs, unsigned beamSize) const
+{
+    // Do the worst initialization
+    std::pair<unsigned, scalar> dummy(unsigned(-1), std::numeric_limits<scalar>::max());
+    // List of k-nearest points till now
+    std::vector<std::pair<unsigned, scalar>> nnList(numNbrs, dummy);
+
+    // Iteration variables
+    std::vector<std::pair<unsigned, scalar>> travel;
+    unsigned curNode;
+    scalar curDist;
+
+    // Scratch memory
+    std::vector<int> local_idx;
+    std::vector<scalar> local_dists;
+    auto comp_x = [&local_dists](int a, int b) { return local_dists[a] > local_dists[b]; };
+    auto comp_pair = [](std::pair<unsigned, scalar> a, std::pair<unsigned, scalar> b) { return a.second < b.second; };
+
+    // Initialize with root
+    travel.emplace_back(0, dist(0, p));
+
+    // Pop, print and then push the children
+    while (travel.size() > 0)
+    {
+        // Pop
+        const auto current = travel.front();
+        curNode = current.first;
+        curDist = current.second;
+        visit(curNode);
+
+        // If the current node is eligible to get into the list
+        if(curDist < nnList.back().second)
+        {
+            nnList.insert(
+                std::upper_bound( nnList.begin(), nnList.end(), current, comp_pair ),
+                current
+            );
+            nnList.pop_back();
+        }
+        travel.erase(travel.begin());
+
+        // Now push children in sorted order if potential NN among them
+        const unsigned first_child = child_begin[curNode];
+        const unsigned num_children = child_count[curNode];
+        local_idx.resize(num_children);
+        local_dists.resize(num_children);
+        std::iota(local_idx.begin(), local_idx.end(), 0);
+        for (unsigned i = 0; i < num_children; ++i)
+            local_dists[i] = dist(first_child + i, p);
+        std::sort(local_idx.begin(), local_idx.end(), comp_x);
+
+        const scalar best_dist_now = nnList.back().second;
+        for (const auto& child_idx : local_idx)
+        {
+            unsigned child = first_child + child_idx;
+            scalar dist_child = local_dists[child_idx];
+            if (best_dist_now > dist_child - maxdist[child])
+            {
+                std::pair<unsigned, scalar> pair_to_add(child, dist_child);
+                travel.insert(
+                    std::upper_bound( travel.begin(), travel.end(), pair_to_add, comp_pair),
+                    pair_to_add
+                );
+                if (travel.size() > beamSize)
+                    travel.pop_back();
+            }
+        }
+    }
+    return nnList;
+}
+
+/****************************** Range Neighbours Search *************************************/
+
+std::vector<std::pair<unsigned, scalar>> FlatSGTree::rangeNeighbours(const pointType &p, scalar range) const
+{
+    // List of nearest neighbors in the range
+    std::vector<std::pair<unsigned, scalar>> nnList;
+
+    // Iteration variables
+    std::vector<std::pair<unsigned, scalar>> travel;
+    unsigned curNode;
+    scalar curDist;
+
+    // Scratch memory
+    std::vector<int> local_idx;
+    std::vector<scalar> local_dists;
+    auto comp_x = [&local_dists](int a, int b) { return local_dists[a] > local_dists[b]; };
+
+    // Initialize with root
+    travel.emplace_back(0, dist(0, p));
+
+    // Pop, print and then push the children
+    while (travel.size() > 0)
+    {
+        // Pop
+        const auto current = travel.back();
+        curNode = current.first;
+        curDist = current.second;
+        visit(curNode);
+
+        // If the current node is eligible to get into the list
+        if (curDist < range)
+            nnList.push_back(current);
+        travel.pop_back();
+
+        // Now push children in sorted order if potential NN among them
+        const unsigned first_child = child_begin[curNode];
+        const unsigned num_children = child_count[curNode];
+        local_idx.resize(num_children);
+        local_dists.resize(num_children);
+        std::iota(local_idx.begin(), local_idx.end(), 0);
+        for (unsigned i = 0; i < num_children; ++i)
+            local_dists[i] = dist(first_child + i, p);
+        std::sort(local_idx.begin(), local_idx.end(), comp_x);
+
+        for (const auto& child_idx : local_idx)
+        {
+            unsigned child = first_child + child_idx;
+            scalar dist_child = local_dists[child_idx];
+            if (range > dist_child - maxdist[child])
+                travel.emplace_back(child, dist_child);
+        }
+    }
+    return nnList;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+# ifndef _FLAT_SG_TREE_H
+# define _FLAT_SG_TREE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "sg_tree.h"
+
+/*
+ * Read-only, pointer-free image of an SG Tree that can be mapped by many
+ * processes at once. The children of node i are the contiguous range
+ * [child_begin[i], child_begin[i] + child_count[i]). Nodes are stored in
+ * breadth-first order, or, given the visit counts of a sample of queries,
+ * hottest child blocks first: the nodes on frequent query paths and their
+ * points then share a few pages at the front of each array, the first
+ * num_hot of which can be locked in memory. A name without '/' refers to a
+ * POSIX shared memory object (/dev/shm on Linux), anything else to a file.
+ */
+class FlatSGTree
+{
+public:
+    /*** On-disk header, followed by 64 byte aligned arrays ***/
+    struct Header
+    {
+        char magic[8];                  // "SGFLAT\0\0"
+        uint32_t version;               // layout version
+        uint32_t scalar_size;           // sizeof(scalar) of the writer
+        uint64_t num_nodes;             // number of nodes (and points)
+        uint64_t dim;                   // dimension of the points
+        int32_t root_level;             // level of the root
+        float base;                     // base used to build the tree
+        uint64_t points_offset;         // scalar[num_nodes * dim]
+        uint64_t level_offset;          // int32_t[num_nodes]
+        uint64_t maxdist_offset;        // scalar[num_nodes]
+        uint64_t uid_offset;            // uint32_t[num_nodes]
+        uint64_t child_offset;          // uint32_t[num_nodes]
+        uint64_t child_count_offset;    // uint32_t[num_nodes]
+        uint64_t num_hot;               // leading nodes worth locking in memory
+        uint64_t total_size;            // size of the whole image in bytes
+    };
+
+    static constexpr uint32_t layout_version = 2;
+
+    /*** Visits per node, keyed by node_key(UID, level) which is unique in a tree ***/
+    typedef std::unordered_map<uint64_t, uint64_t> Heat;
+    static uint64_t node_key(unsigned uid, int level) { return (uint64_t(uid) << 32) | uint32_t(level); }
+
+protected:
+    const char* base_addr = nullptr;    // start of the mapping
+    size_t mapped_size = 0;
+    const Header* header = nullptr;
+
+    const scalar* points = nullptr;
+    const int32_t* levels = nullptr;
+    const scalar* maxdist = nullptr;
+    const uint32_t* uids = nullptr;
+    const uint32_t* child_begin = nullptr;
+    const uint32_t* child_count = nullptr;
+    unsigned D = 0;
+
+    // per node, allocated by the first count_visits(true) and only freed with the tree,
+    // since queries running while counting stops may still add to them
+    std::unique_ptr<std::atomic<uint64_t>[]> visits;
+    std::atomic<bool> counting{false};
+    mutable std::mutex visits_mut;
+    bool hot_locked = false;
+
+    FlatSGTree() = default;
+
+    void visit(unsigned node) const
+    {
+        if (counting.load(std::memory_order_acquire))
+            visits[node].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    scalar dist(unsigned node, const pointType& p) const
+    {
+        return (Eigen::Map<const pointType>(points + size_t(node)*D, D) - p).norm();
+    }
+
+public:
+    ~FlatSGTree();
+
+    FlatSGTree(const FlatSGTree&) = delete;
+    FlatSGTree& operator=(const FlatSGTree&) = delete;
+
+    /*** Write the image of tree to name; no insertions may run meanwhile.
+     *   With heat, hot child blocks come first and the leading nodes that fit
+     *   in hot_bytes are marked hot ***/
+    static bool write(SGTree& tree, const std::string& name, const Heat* heat = nullptr, size_t hot_bytes = 0);
+    /*** Map the image stored at name read-only, nullptr on failure ***/
+    static FlatSGTree* attach(const std::string& name);
+    /*** Remove the shared memory object or file backing name ***/
+    static bool unlink(const std::string& name);
+
+    /*** Count the nodes visited by queries from now on (false stops and clears) ***/
+    void count_visits(bool enable);
+    Heat visit_counts() const;
+
+    /*** mlock the hot prefix of each array; false if it cannot be locked ***/
+    bool lock_hot();
+    size_t hot_size() const { return header->num_hot; }
+
+    /*** Accessors: nodes are identified by their index in the image ***/
+    size_t size() const { return header->num_nodes; }
+    unsigned dim() const { return D; }
+    unsigned uid(unsigned node) const { return uids[node]; }
+    const scalar* point(unsigned node) const { return points + size_t(node)*D; }
+
+    /*** Same traversals as SGTree, returning node indices ***/
+    std::pair<unsigned, scalar> NearestNeighbour(const pointType &p) const;
+    std::vector<std::pair<unsigned, scalar>> kNearestNeighbours(const pointType &p, unsigned numNbrs = 10) const;
+    std::vector<std::pair<unsigned, scalar>> kNearestNeighboursBeam(const pointType &p, unsigned numNbrs, unsigned beamSize) const;
+    std::vector<std::pair<unsigned, scalar>> rangeNeighbours(const pointType &p, scalar range = 1.0) const;
+};
+
+#endif  // _FLAT_SG_TREE_H
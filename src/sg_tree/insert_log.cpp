@@ -0,0 +1,469 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "insert_log.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char log_magic[8] = {'S', 'G', 'W', 'A', 'L', '\0', '\0', '\0'};
+static const char snapshot_magic[8] = {'S', 'G', 'S', 'N', 'A', 'P', '\0', '\0'};
+
+static bool write_all(int fd, const char* buff, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t written = ::write(fd, buff, len);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        buff += written;
+        len -= written;
+    }
+    return true;
+}
+
+// Makes a rename into the directory of path durable
+static bool sync_dir(const std::string& path)
+{
+    const size_t slash = path.find_last_of('/');
+    const std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int dfd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dfd < 0)
+        return false;
+    bool ok = fsync(dfd) == 0;
+    close(dfd);
+    return ok;
+}
+
+static bool read_file(const std::string& path, std::vector<char>& buff)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    buff.resize(st.st_size);
+    size_t done = 0;
+    while (done < buff.size())
+    {
+        ssize_t got = ::read(fd, buff.data() + done, buff.size() - done);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            break;
+        done += got;
+    }
+    close(fd);
+    buff.resize(done);
+    return true;
+}
+
+static bool read_at(int fd, char* buff, size_t len, size_t pos)
+{
+    while (len > 0)
+    {
+        ssize_t got = ::pread(fd, buff, len, pos);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        buff += got;
+        pos += got;
+        len -= got;
+    }
+    return true;
+}
+
+uint64_t InsertLog::checksum(const char* buff, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= uint8_t(buff[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/****************************** Open/Close *************************************/
+
+InsertLog::InsertLog(const std::string& path, unsigned dim, size_t sync_bytes, unsigned sync_ms)
+    : path(path), D(dim), sync_bytes(sync_bytes), sync_ms(sync_ms)
+{
+}
+
+InsertLog* InsertLog::open(const std::string& path, unsigned dim, size_t sync_bytes, unsigned sync_ms)
+{
+    InsertLog* wal = new InsertLog(path, dim, sync_bytes, sync_ms);
+
+    // A log is only ever created whole by write_header(), so an existing
+    // file without a complete header is damaged rather than new
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 && errno == ENOENT)
+    {
+        if (!wal->write_header())
+        {
+            delete wal;
+            return nullptr;
+        }
+    }
+    else
+    {
+        wal->fd = ::open(path.c_str(), O_RDWR);
+        if (wal->fd < 0 || fstat(wal->fd, &st) != 0)
+        {
+            std::cerr << "Cannot open insert log " << path << ": " << std::strerror(errno) << std::endl;
+            delete wal;
+            return nullptr;
+        }
+        const size_t file_size = st.st_size;
+
+        LogHeader h;
+        if (file_size < sizeof(LogHeader) || !read_at(wal->fd, reinterpret_cast<char*>(&h), sizeof(LogHeader), 0))
+        {
+            std::cerr << "Insert log " << path << " is truncated!" << std::endl;
+            delete wal;
+            return nullptr;
+        }
+        if (std::memcmp(h.magic, log_magic, sizeof(log_magic)) != 0 || h.version != format_version
+            || h.scalar_size != sizeof(scalar) || h.dim != dim)
+        {
+            std::cerr << "Insert log " << path << " does not match this tree!" << std::endl;
+            delete wal;
+            return nullptr;
+        }
+        wal->generation = h.generation;
+
+        // Walk the batch headers to the end of the last complete batch;
+        // payloads are only read by recover(). Appends are sequential, so
+        // only the last batch can be torn: check its checksum alone.
+        size_t pos = sizeof(LogHeader);
+        size_t last = pos;
+        const size_t row = row_size(dim);
+        BatchHeader b;
+        while (pos + sizeof(BatchHeader) <= file_size
+               && read_at(wal->fd, reinterpret_cast<char*>(&b), sizeof(BatchHeader), pos))
+        {
+            size_t payload = size_t(b.count) * row;
+            if (pos + sizeof(BatchHeader) + payload > file_size)
+                break;
+            last = pos;
+            pos += sizeof(BatchHeader) + payload;
+        }
+        if (last < pos)
+        {
+            read_at(wal->fd, reinterpret_cast<char*>(&b), sizeof(BatchHeader), last);
+            std::vector<char> payload(size_t(b.count) * row);
+            if (!read_at(wal->fd, payload.data(), payload.size(), last + sizeof(BatchHeader))
+                || checksum(payload.data(), payload.size()) != b.checksum)
+                pos = last;
+        }
+        if (pos < file_size)
+        {
+            std::cerr << "Dropping " << file_size - pos << " bytes of incomplete insert log" << std::endl;
+            if (ftruncate(wal->fd, pos) != 0)
+            {
+                delete wal;
+                return nullptr;
+            }
+        }
+        wal->offset = pos;
+        lseek(wal->fd, pos, SEEK_SET);
+    }
+
+    if (sync_ms > 0)
+        wal->flusher = std::thread(&InsertLog::flush_loop, wal);
+    return wal;
+}
+
+InsertLog::~InsertLog()
+{
+    {
+        std::lock_guard<std::mutex> lk(write_mut);
+        closing = true;
+    }
+    flusher_cv.notify_all();
+    if (flusher.joinable())
+        flusher.join();
+    if (fd >= 0)
+    {
+        sync_locked();
+        close(fd);
+    }
+}
+
+bool InsertLog::write_header()
+{
+    LogHeader h;
+    std::memset(&h, 0, sizeof(LogHeader));
+    std::memcpy(h.magic, log_magic, sizeof(log_magic));
+    h.version = format_version;
+    h.scalar_size = sizeof(scalar);
+    h.dim = D;
+    h.generation = generation;
+
+    // The new log replaces the old one by rename, so a crash leaves either
+    // the whole old log or the header of the new generation
+    std::string tmp_path = path + ".tmp";
+    int nfd = ::open(tmp_path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (nfd < 0 || !write_all(nfd, reinterpret_cast<const char*>(&h), sizeof(LogHeader)) || fdatasync(nfd) != 0
+        || rename(tmp_path.c_str(), path.c_str()) != 0 || !sync_dir(path))
+    {
+        std::cerr << "Cannot write insert log " << path << ": " << std::strerror(errno) << std::endl;
+        if (nfd >= 0)
+            close(nfd);
+        return false;
+    }
+    if (fd >= 0)
+        close(fd);
+    fd = nfd;
+    offset = sizeof(LogHeader);
+    unsynced = 0;
+    return true;
+}
+
+/****************************** Append *************************************/
+
+bool InsertLog::sync_locked()
+{
+    if (unsynced == 0)
+        return true;
+    if (fdatasync(fd) != 0)
+    {
+        std::cerr << "Cannot sync insert log " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    unsynced = 0;
+    return true;
+}
+
+bool InsertLog::sync()
+{
+    std::lock_guard<std::mutex> lk(write_mut);
+    return sync_locked();
+}
+
+void InsertLog::flush_loop()
+{
+    std::unique_lock<std::mutex> lk(write_mut);
+    while (!closing)
+    {
+        flusher_cv.wait_for(lk, std::chrono::milliseconds(sync_ms));
+        if (!closing)
+            sync_locked();
+    }
+}
+
+bool InsertLog::append(const Eigen::Map<matrixType>& pts, const long* uids)
+{
+    const size_t count = pts.cols();
+    if (count == 0)
+        return true;
+    if (pts.rows() != D)
+    {
+        std::cerr << "Insert log expects points of dimension " << D << std::endl;
+        return false;
+    }
+
+    // Encode outside the lock
+    const size_t row = row_size(D);
+    std::vector<char> buff(sizeof(BatchHeader) + count*row);
+    char* pos = buff.data() + sizeof(BatchHeader);
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t uid = uint32_t(uids[i]);
+        std::memcpy(pos, &uid, sizeof(uint32_t));
+        std::memcpy(pos + sizeof(uint32_t), pts.col(i).data(), sizeof(scalar)*D);
+        pos += row;
+    }
+    BatchHeader b;
+    b.count = uint32_t(count);
+    b.reserved = 0;
+    b.checksum = checksum(buff.data() + sizeof(BatchHeader), count*row);
+    std::memcpy(buff.data(), &b, sizeof(BatchHeader));
+
+    std::lock_guard<std::mutex> lk(write_mut);
+    if (!write_all(fd, buff.data(), buff.size()))
+    {
+        std::cerr << "Cannot append to insert log " << path << ": " << std::strerror(errno) << std::endl;
+        // roll back a partial write so later batches stay readable
+        if (ftruncate(fd, offset) != 0 || lseek(fd, offset, SEEK_SET) < 0)
+            std::cerr << "Insert log " << path << " may end in a torn batch" << std::endl;
+        return false;
+    }
+    offset += buff.size();
+    unsynced += buff.size();
+    if (unsynced >= sync_bytes)
+        return sync_locked();
+    return true;
+}
+
+size_t InsertLog::insert(SGTree& tree, const Eigen::Map<matrixType>& pts, const long* uids, unsigned cores)
+{
+    std::shared_lock<std::shared_timed_mutex> lk(apply_mut);
+    if (!append(pts, uids))
+        return pts.cols();
+
+    std::atomic<size_t> failed(0);
+    auto insert_one = [&](size_t i)->void{
+        if (!tree.insert(pts.col(i), uids[i]))
+            failed.fetch_add(1, std::memory_order_relaxed);
+    };
+    if (cores > 1)
+        utils::parallel_for(0, pts.cols(), insert_one, cores);
+    else
+        for (size_t i = 0; i < size_t(pts.cols()); ++i)
+            insert_one(i);
+    return failed.load();
+}
+
+/****************************** Snapshot *************************************/
+
+bool InsertLog::checkpoint(SGTree& tree, const std::string& snapshot_path)
+{
+    // No batch may be logged but not yet applied while the snapshot is taken
+    std::unique_lock<std::shared_timed_mutex> apply_lk(apply_mut);
+    std::lock_guard<std::mutex> lk(write_mut);
+    if (!sync_locked())
+        return false;
+
+    SnapshotHeader h;
+    std::memset(&h, 0, sizeof(SnapshotHeader));
+    std::memcpy(h.magic, snapshot_magic, sizeof(snapshot_magic));
+    h.version = format_version;
+    h.base = tree.base;
+    h.generation = generation;
+    h.log_offset = offset;
+    h.tree_size = tree.msg_size();
+
+    char* buff = tree.serialize();
+    std::string tmp_path = snapshot_path + ".tmp";
+    int sfd = ::open(tmp_path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    bool ok = sfd >= 0
+        && write_all(sfd, reinterpret_cast<const char*>(&h), sizeof(SnapshotHeader))
+        && write_all(sfd, buff, h.tree_size)
+        && fsync(sfd) == 0;
+    if (sfd >= 0)
+        close(sfd);
+    delete[] buff;
+    if (!ok || rename(tmp_path.c_str(), snapshot_path.c_str()) != 0 || !sync_dir(snapshot_path))
+    {
+        std::cerr << "Cannot write snapshot " << snapshot_path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // The snapshot covers the whole log: start the next generation, or
+    // keep appending to this one, which recover() replays from log_offset
+    generation += 1;
+    if (write_header())
+        return true;
+    generation -= 1;
+    return false;
+}
+
+SGTree* InsertLog::recover(const std::string& snapshot_path, const std::string& log_path, unsigned cores)
+{
+    std::vector<char> snap;
+    SnapshotHeader h;
+    if (!read_file(snapshot_path, snap) || snap.size() < sizeof(SnapshotHeader))
+    {
+        std::cerr << "Cannot read snapshot " << snapshot_path << std::endl;
+        return nullptr;
+    }
+    std::memcpy(&h, snap.data(), sizeof(SnapshotHeader));
+    if (std::memcmp(h.magic, snapshot_magic, sizeof(snapshot_magic)) != 0 || h.version != format_version
+        || snap.size() != sizeof(SnapshotHeader) + h.tree_size)
+    {
+        std::cerr << "Snapshot " << snapshot_path << " is invalid!" << std::endl;
+        return nullptr;
+    }
+
+    SGTree* tree = new SGTree();
+    tree->deserialize(snap.data() + sizeof(SnapshotHeader), h.tree_size);
+    tree->base = h.base;
+    delete[] tree->powdict;
+    tree->powdict = tree->compute_pow_table();
+    tree->max_scale = tree->root->level;
+    snap.clear();
+    snap.shrink_to_fit();
+
+    std::vector<char> log;
+    if (!read_file(log_path, log) || log.size() < sizeof(LogHeader))
+        return tree;
+    LogHeader lh;
+    std::memcpy(&lh, log.data(), sizeof(LogHeader));
+    if (std::memcmp(lh.magic, log_magic, sizeof(log_magic)) != 0 || lh.dim != tree->D)
+    {
+        std::cerr << "Insert log " << log_path << " does not match snapshot " << snapshot_path << std::endl;
+        delete tree;
+        return nullptr;
+    }
+
+    size_t pos;
+    if (lh.generation == h.generation)
+        pos = h.log_offset;                 // crashed before the log was truncated
+    else if (lh.generation == h.generation + 1)
+        pos = sizeof(LogHeader);
+    else
+    {
+        std::cerr << "Insert log " << log_path << " is from generation " << lh.generation
+                  << " but snapshot " << snapshot_path << " is from generation " << h.generation << std::endl;
+        delete tree;
+        return nullptr;
+    }
+
+    // Collect the rows of all complete batches after the snapshot
+    const unsigned D = tree->D;
+    const size_t row = row_size(D);
+    std::vector<const char*> rows;
+    while (pos + sizeof(BatchHeader) <= log.size())
+    {
+        BatchHeader b;
+        std::memcpy(&b, log.data() + pos, sizeof(BatchHeader));
+        const char* payload = log.data() + pos + sizeof(BatchHeader);
+        if (pos + sizeof(BatchHeader) + size_t(b.count)*row > log.size()
+            || checksum(payload, size_t(b.count)*row) != b.checksum)
+            break;
+        for (uint32_t i = 0; i < b.count; ++i)
+            rows.push_back(payload + i*row);
+        pos += sizeof(BatchHeader) + size_t(b.count)*row;
+    }
+
+    auto replay = [&](size_t i)->void{
+        uint32_t uid;
+        std::memcpy(&uid, rows[i], sizeof(uint32_t));
+        pointType p(D);
+        std::memcpy(p.data(), rows[i] + sizeof(uint32_t), sizeof(scalar)*D);
+        tree->insert(p, uid);
+    };
+    if (cores > 1)
+        utils::parallel_for_progressbar(0, rows.size(), replay, cores);
+    else
+        for (size_t i = 0; i < rows.size(); ++i)
+            replay(i);
+    return tree;
+}
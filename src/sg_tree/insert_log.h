@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+# ifndef _INSERT_LOG_H
+# define _INSERT_LOG_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+
+#include "sg_tree.h"
+
+/*
+ * Append-only write-ahead log of SG Tree insertions with snapshots.
+ *
+ * Every batch is written as one checksummed record (UID + point per row)
+ * before it is inserted. fdatasync is batched: it runs once sync_bytes have
+ * been written or, from a background thread, every sync_ms milliseconds.
+ * checkpoint() writes a snapshot of the tree and starts a new log
+ * generation; recover() loads the snapshot and replays the log tail in
+ * parallel. A torn record at the end of the log is dropped on open.
+ */
+class InsertLog
+{
+public:
+    struct LogHeader
+    {
+        char magic[8];                  // "SGWAL\0\0\0"
+        uint32_t version;
+        uint32_t scalar_size;
+        uint64_t dim;
+        uint64_t generation;            // bumped by every checkpoint
+    };
+
+    struct BatchHeader
+    {
+        uint32_t count;                 // number of rows in the batch
+        uint32_t reserved;
+        uint64_t checksum;              // FNV-1a of the rows
+    };
+
+    struct SnapshotHeader
+    {
+        char magic[8];                  // "SGSNAP\0\0"
+        uint32_t version;
+        float base;                     // base of the snapshotted tree
+        uint64_t generation;            // log generation covered by the snapshot
+        uint64_t log_offset;            // log bytes already in the snapshot
+        uint64_t tree_size;             // bytes of SGTree::serialize() that follow
+    };
+
+    static constexpr uint32_t format_version = 1;
+
+protected:
+    int fd = -1;
+    std::string path;
+    unsigned D;
+    uint64_t generation = 0;
+    uint64_t offset = 0;                // end of the last complete batch
+
+    size_t sync_bytes;                  // sync after this many unsynced bytes
+    unsigned sync_ms;                   // sync at least this often
+    size_t unsynced = 0;
+
+    std::mutex write_mut;               // serializes appends and syncs
+    std::shared_timed_mutex apply_mut;  // shared: log+insert, exclusive: checkpoint
+
+    std::thread flusher;
+    std::condition_variable flusher_cv;
+    bool closing = false;
+
+    InsertLog(const std::string& path, unsigned dim, size_t sync_bytes, unsigned sync_ms);
+
+    bool write_header();
+    bool sync_locked();
+    void flush_loop();
+
+    static uint64_t checksum(const char* buff, size_t len);
+    static size_t row_size(unsigned dim) { return sizeof(uint32_t) + sizeof(scalar)*dim; }
+
+public:
+    ~InsertLog();
+
+    InsertLog(const InsertLog&) = delete;
+    InsertLog& operator=(const InsertLog&) = delete;
+
+    /*** Open or create the log at path, nullptr on failure ***/
+    static InsertLog* open(const std::string& path, unsigned dim, size_t sync_bytes = 1 << 20, unsigned sync_ms = 100);
+
+    /*** Append one batch (columns of pts) to the log ***/
+    bool append(const Eigen::Map<matrixType>& pts, const long* uids);
+
+    /*** Log a batch and insert it into tree; returns number of failed inserts ***/
+    size_t insert(SGTree& tree, const Eigen::Map<matrixType>& pts, const long* uids, unsigned cores);
+
+    /*** Force all appended batches to disk ***/
+    bool sync();
+
+    /*** Snapshot tree to snapshot_path and truncate the log ***/
+    bool checkpoint(SGTree& tree, const std::string& snapshot_path);
+
+    /*** Load the snapshot and replay the log written after it ***/
+    static SGTree* recover(const std::string& snapshot_path, const std::string& log_path, unsigned cores);
+
+    uint64_t size() const { return offset; }
+};
+
+#endif  // _INSERT_LOG_H
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "query_batcher.h"
+
+#include <algorithm>
+#include <chrono>
+
+QueryBatcher::QueryBatcher(const SGTree& tree, unsigned max_batch, unsigned max_wait_us, unsigned cores, Completion done)
+    : tree(tree), max_batch(std::max(max_batch, 1u)), max_wait_us(max_wait_us), cores(cores), done(done),
+      head(&stub), tail(&stub), queued(0), sleeping(false), num_batches(0), num_requests(0)
+{
+    stub.next = NULL;
+    dispatcher = std::thread(&QueryBatcher::run, this);
+}
+
+QueryBatcher::~QueryBatcher()
+{
+    {
+        std::lock_guard<std::mutex> lk(mut);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (dispatcher.joinable())
+        dispatcher.join();
+}
+
+/****************************** Queue *************************************/
+
+void QueryBatcher::push(Request* r)
+{
+    r->next.store(NULL, std::memory_order_relaxed);
+    Request* prev = head.exchange(r, std::memory_order_acq_rel);
+    prev->next.store(r, std::memory_order_release);
+}
+
+QueryBatcher::Request* QueryBatcher::pop()
+{
+    Request* first = tail;
+    Request* next = first->next.load(std::memory_order_acquire);
+    if (first == &stub)
+    {
+        if (next == NULL)
+            return NULL;
+        tail = next;
+        first = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next != NULL)
+    {
+        tail = next;
+        return first;
+    }
+    // first is the last request, unless a producer is half way through push
+    if (first != head.load(std::memory_order_acquire))
+        return NULL;
+    push(&stub);
+    next = first->next.load(std::memory_order_acquire);
+    if (next != NULL)
+    {
+        tail = next;
+        return first;
+    }
+    return NULL;
+}
+
+void QueryBatcher::submit(Request* r)
+{
+    push(r);
+    queued.fetch_add(1);
+    // Only wake the dispatcher if it is waiting
+    if (sleeping.load())
+    {
+        std::lock_guard<std::mutex> lk(mut);
+        cv.notify_one();
+    }
+}
+
+/****************************** Dispatcher *************************************/
+
+void QueryBatcher::run()
+{
+    std::vector<Request*> batch;
+    matrixType queries;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lk(mut);
+            sleeping = true;
+            cv.wait(lk, [this]{ return stopping || queued.load() > 0; });
+            sleeping = false;
+            if (queued.load() == 0)
+                break;
+        }
+
+        // Collect until the batch is full or the oldest request waited max_wait_us
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(max_wait_us);
+        while (batch.size() < max_batch)
+        {
+            Request* r = pop();
+            if (r != NULL)
+            {
+                queued.fetch_sub(1);
+                batch.push_back(r);
+                continue;
+            }
+            if (queued.load() > 0)
+            {
+                // a producer is still linking its request in
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lk(mut);
+            if (stopping)
+                break;
+            sleeping = true;
+            bool more = cv.wait_until(lk, deadline, [this]{ return stopping || queued.load() > 0; });
+            sleeping = false;
+            if (!more)
+                break;
+        }
+
+        // Requests with the same k share one blocked traversal, split into
+        // contiguous blocks of queries across the shared pool
+        std::sort(batch.begin(), batch.end(), [](const Request* a, const Request* b) { return a->k < b->k; });
+        const unsigned D = tree.get_dim();
+        const unsigned workers = std::min(utils::pool_cores(cores), unsigned(batch.size()));
+        const size_t per_block = (batch.size() + workers - 1) / workers;
+        std::vector<std::pair<size_t, size_t>> blocks;
+        for (size_t first = 0; first < batch.size(); )
+        {
+            size_t last = first + 1;
+            while (last < batch.size() && last - first < per_block && batch[last]->k == batch[first]->k)
+                ++last;
+            blocks.emplace_back(first, last);
+            first = last;
+        }
+        queries.resize(D, batch.size());
+        for (size_t i = 0; i < batch.size(); ++i)
+            queries.col(i) = batch[i]->point;
+
+        auto query = [&](size_t b)->void{
+            const size_t first = blocks[b].first;
+            const unsigned k = batch[first]->k;
+            Eigen::Map<matrixType> block(queries.data() + first * D, D, blocks[b].second - first);
+            std::vector<std::vector<std::pair<SGTree::Node*, scalar>>> nn = tree.kNearestNeighboursMulti(block, k);
+            for (size_t j = 0; j < nn.size(); ++j)
+            {
+                Request* r = batch[first + j];
+                r->uids.resize(k);
+                r->dists.resize(k);
+                for (unsigned t = 0; t < k; ++t)
+                {
+                    r->uids[t] = nn[j][t].first != NULL ? long(nn[j][t].first->UID) : -1L;
+                    r->dists[t] = nn[j][t].second;
+                }
+            }
+        };
+        if (workers > 1 && blocks.size() > 1)
+            utils::ThreadPool::shared().run(blocks.size(), query, workers);
+        else
+            for (size_t b = 0; b < blocks.size(); ++b)
+                query(b);
+
+        num_batches++;
+        num_requests += batch.size();
+        done(batch);
+        batch.clear();
+    }
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+# ifndef _QUERY_BATCHER_H
+# define _QUERY_BATCHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "sg_tree.h"
+
+/*
+ * Coalesces single kNN queries submitted from many threads into batches.
+ *
+ * submit() pushes onto a lock-free multi-producer queue. A dispatcher thread
+ * starts a batch with the first waiting request, keeps collecting until
+ * max_batch requests are in or max_wait_us have passed, runs requests with
+ * the same k as blocked multi-query searches on up to cores threads of the
+ * shared pool and hands the batch to the completion callback, which takes
+ * over the requests.
+ */
+class QueryBatcher
+{
+public:
+    struct Request
+    {
+        pointType point;
+        unsigned k;
+        void* tag;                      // owned by the caller, e.g. a future
+        std::vector<long> uids;         // -1 past the size of the tree
+        std::vector<scalar> dists;
+        std::atomic<Request*> next;
+    };
+
+    typedef std::function<void(std::vector<Request*>&)> Completion;
+
+protected:
+    const SGTree& tree;
+    unsigned max_batch;
+    unsigned max_wait_us;
+    unsigned cores;
+    Completion done;
+
+    // Intrusive MPSC queue, producers swap head, the dispatcher owns tail
+    std::atomic<Request*> head;
+    Request* tail;
+    Request stub;
+    std::atomic<size_t> queued;
+
+    std::mutex mut;
+    std::condition_variable cv;
+    std::atomic<bool> sleeping;
+    bool stopping = false;
+
+    std::atomic<size_t> num_batches;
+    std::atomic<size_t> num_requests;
+
+    std::thread dispatcher;
+
+    void push(Request* r);
+    Request* pop();
+    void run();
+
+public:
+    QueryBatcher(const SGTree& tree, unsigned max_batch, unsigned max_wait_us, unsigned cores, Completion done);
+    /*** Answers every submitted request, then stops the dispatcher ***/
+    ~QueryBatcher();
+
+    QueryBatcher(const QueryBatcher&) = delete;
+    QueryBatcher& operator=(const QueryBatcher&) = delete;
+
+    /*** Queue a request, never blocks ***/
+    void submit(Request* r);
+
+    unsigned dim() const { return tree.get_dim(); }
+    size_t batches() const { return num_batches.load(); }
+    size_t requests() const { return num_requests.load(); }
+};
+
+#endif  // _QUERY_BATCHER_H
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "query_cache.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+static inline uint64_t mix(uint64_t h, uint64_t v)
+{
+    // splitmix64 finalizer over the running hash
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+QueryCache::QueryCache(const SGTree& tree, const Options& opts)
+    : tree(tree), opts(opts), num_hits(0), num_misses(0), num_stale(0)
+{
+    this->opts.shards = std::max(opts.shards, 1u);
+    size_t per_shard = std::max(opts.capacity / this->opts.shards, size_t(1));
+    shards.reset(new Shard[this->opts.shards]);
+    for (unsigned s = 0; s < this->opts.shards; ++s)
+    {
+        shards[s].slots.resize(per_shard);
+        shards[s].index.reserve(per_shard);
+    }
+}
+
+uint64_t QueryCache::make_key(const pointType& p, unsigned k, unsigned beam, std::vector<int32_t>& key) const
+{
+    key.resize(p.size());
+    if (opts.quantum > 0)
+    {
+        for (Eigen::Index i = 0; i < p.size(); ++i)
+        {
+            double q = std::nearbyint(double(p[i]) / opts.quantum);
+            key[i] = int32_t(std::max(std::min(q, double(INT_MAX)), double(INT_MIN)));
+        }
+    }
+    else
+    {
+        // bitwise, -0.0 and 0.0 only cost a duplicate entry
+        for (Eigen::Index i = 0; i < p.size(); ++i)
+        {
+            float f = float(p[i]);
+            std::memcpy(&key[i], &f, sizeof(f));
+        }
+    }
+
+    uint64_t h = mix(uint64_t(k), uint64_t(beam));
+    for (auto c : key)
+        h = mix(h, uint64_t(uint32_t(c)));
+    return h;
+}
+
+/****************************** Lookup *************************************/
+
+bool QueryCache::lookup(const pointType& p, unsigned k, unsigned beam, size_t version, long* uids, scalar* dists)
+{
+    std::vector<int32_t> key;
+    uint64_t h = make_key(p, k, beam, key);
+    Shard& shard = shards[h % opts.shards];
+
+    std::lock_guard<std::mutex> lk(shard.mut);
+    auto it = shard.index.find(h);
+    if (it == shard.index.end())
+        return false;
+    Entry& e = shard.slots[it->second];
+    if (e.k != k || e.beam != beam || e.key != key)
+        return false;
+    if (e.version != version)
+    {
+        num_stale++;
+        return false;
+    }
+    e.referenced = true;
+    std::copy(e.uids.begin(), e.uids.end(), uids);
+    std::copy(e.dists.begin(), e.dists.end(), dists);
+    return true;
+}
+
+void QueryCache::store(const pointType& p, unsigned k, unsigned beam, size_t version, const long* uids, const scalar* dists)
+{
+    std::vector<int32_t> key;
+    uint64_t h = make_key(p, k, beam, key);
+    Shard& shard = shards[h % opts.shards];
+
+    std::lock_guard<std::mutex> lk(shard.mut);
+    size_t slot;
+    auto it = shard.index.find(h);
+    if (it != shard.index.end())
+    {
+        // same key recomputed, or a hash collision replacing the older entry
+        slot = it->second;
+    }
+    else
+    {
+        // CLOCK: skip recently used slots once, clearing their bit
+        while (shard.slots[shard.hand].used && shard.slots[shard.hand].referenced)
+        {
+            shard.slots[shard.hand].referenced = false;
+            shard.hand = (shard.hand + 1) % shard.slots.size();
+        }
+        slot = shard.hand;
+        shard.hand = (shard.hand + 1) % shard.slots.size();
+        if (shard.slots[slot].used)
+            shard.index.erase(shard.slots[slot].hash);
+        shard.index[h] = slot;
+    }
+
+    Entry& e = shard.slots[slot];
+    e.hash = h;
+    e.key.swap(key);
+    e.k = k;
+    e.beam = beam;
+    e.version = version;
+    e.uids.assign(uids, uids + k);
+    e.dists.assign(dists, dists + k);
+    e.used = true;
+    e.referenced = false;
+}
+
+/****************************** Queries *************************************/
+
+void QueryCache::kNearestNeighbours(const pointType& p, unsigned k, unsigned beam, long* uids, scalar* dists)
+{
+    // Read the version first: an insert finishing during the query makes the entry stale, never wrong
+    size_t version = tree.get_version();
+    if (lookup(p, k, beam, version, uids, dists))
+    {
+        num_hits++;
+        return;
+    }
+    num_misses++;
+
+    std::vector<std::pair<SGTree::Node*, scalar>> nn = beam > 0 ? tree.kNearestNeighboursBeam(p, k, beam)
+                                                                : tree.kNearestNeighbours(p, k);
+    for (unsigned t = 0; t < k; ++t)
+    {
+        uids[t] = nn[t].first != NULL ? long(nn[t].first->UID) : -1L;
+        dists[t] = nn[t].second;
+    }
+    store(p, k, beam, version, uids, dists);
+}
+
+void QueryCache::clear()
+{
+    for (unsigned s = 0; s < opts.shards; ++s)
+    {
+        std::lock_guard<std::mutex> lk(shards[s].mut);
+        for (auto& e : shards[s].slots)
+            e = Entry();
+        shards[s].index.clear();
+        shards[s].hand = 0;
+    }
+}
+
+size_t QueryCache::size()
+{
+    size_t total = 0;
+    for (unsigned s = 0; s < opts.shards; ++s)
+    {
+        std::lock_guard<std::mutex> lk(shards[s].mut);
+        total += shards[s].index.size();
+    }
+    return total;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+# ifndef _QUERY_CACHE_H
+# define _QUERY_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "sg_tree.h"
+
+/*
+ * Result cache in front of kNN and beam kNN queries on an SG Tree.
+ *
+ * Entries are keyed by the query vector, k and the beam size (0 for exact
+ * kNN). With quantum > 0 every coordinate is rounded to a multiple of
+ * quantum first, so near-duplicate queries share the answer of the first
+ * one. The cache is split into shards, each with its own lock and CLOCK
+ * eviction. Every entry records the tree version it was computed at, so an
+ * insert into the tree invalidates all earlier entries.
+ */
+class QueryCache
+{
+public:
+    struct Options
+    {
+        size_t capacity = 65536;        // entries over all shards
+        unsigned shards = 16;
+        scalar quantum = 0;             // 0 keys on the exact query
+    };
+
+protected:
+    struct Entry
+    {
+        uint64_t hash;
+        std::vector<int32_t> key;       // quantized or bitwise copy of the query
+        unsigned k;
+        unsigned beam;
+        size_t version;
+        std::vector<long> uids;
+        std::vector<scalar> dists;
+        bool used = false;
+        bool referenced = false;
+    };
+
+    struct Shard
+    {
+        std::mutex mut;
+        std::vector<Entry> slots;
+        std::unordered_map<uint64_t, size_t> index;
+        size_t hand = 0;
+    };
+
+    const SGTree& tree;
+    Options opts;
+    std::unique_ptr<Shard[]> shards;
+
+    std::atomic<size_t> num_hits;
+    std::atomic<size_t> num_misses;
+    std::atomic<size_t> num_stale;
+
+    uint64_t make_key(const pointType& p, unsigned k, unsigned beam, std::vector<int32_t>& key) const;
+    bool lookup(const pointType& p, unsigned k, unsigned beam, size_t version, long* uids, scalar* dists);
+    void store(const pointType& p, unsigned k, unsigned beam, size_t version, const long* uids, const scalar* dists);
+
+public:
+    QueryCache(const SGTree& tree, const Options& opts);
+
+    QueryCache(const QueryCache&) = delete;
+    QueryCache& operator=(const QueryCache&) = delete;
+
+    /*** k nearest neighbours of p into uids and dists (-1 past the size of the tree), beam = 0 is exact ***/
+    void kNearestNeighbours(const pointType& p, unsigned k, unsigned beam, long* uids, scalar* dists);
+
+    /*** Drop all entries ***/
+    void clear();
+
+    size_t hits() const { return num_hits.load(); }
+    size_t misses() const { return num_misses.load(); }
+    size_t stale() const { return num_stale.load(); }      // misses on entries outdated by inserts
+    size_t size();
+};
+
+#endif  // _QUERY_CACHE_H
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "query_tracer.h"
+
+#include <algorithm>
+#include <cstdio>
+
+static std::atomic<uint64_t> next_tracer_id(1);
+
+struct QueryTracer::LocalRings
+{
+    struct Held
+    {
+        uint64_t id;
+        std::shared_ptr<Rings> owner;
+        Ring* ring;
+    };
+    std::vector<Held> held;
+
+    ~LocalRings()
+    {
+        for (auto& h : held)
+        {
+            std::lock_guard<std::mutex> lk(h.owner->mut);
+            h.ring->in_use = false;
+        }
+    }
+};
+
+QueryTracer::QueryTracer(unsigned sample_every, size_t capacity)
+    : id(next_tracer_id++), sample_every(std::max(sample_every, 1u)), capacity(std::max(capacity, size_t(1))),
+      rings(std::make_shared<Rings>()), num_sampled(0)
+{
+}
+
+QueryTracer::Ring* QueryTracer::local_ring()
+{
+    thread_local LocalRings local;
+    for (const auto& h : local.held)
+        if (h.id == id)
+            return h.ring;
+
+    // Forget rings of deleted tracers
+    local.held.erase(std::remove_if(local.held.begin(), local.held.end(),
+                                    [](const LocalRings::Held& h) { return h.owner.use_count() == 1; }),
+                     local.held.end());
+
+    std::lock_guard<std::mutex> lk(rings->mut);
+    Ring* ring = nullptr;
+    for (const auto& r : rings->all)
+        if (!r->in_use)
+        {
+            ring = r.get();
+            break;
+        }
+    if (ring == nullptr)
+    {
+        rings->all.emplace_back(new Ring);
+        ring = rings->all.back().get();
+        ring->steps.resize(capacity);
+        ring->written = 0;
+        ring->countdown = 0;
+    }
+    ring->in_use = true;
+    local.held.push_back({id, rings, ring});
+    return ring;
+}
+
+bool QueryTracer::sample()
+{
+    Ring* ring = local_ring();
+    if (ring->countdown > 0)
+    {
+        ring->countdown--;
+        return false;
+    }
+    ring->countdown = sample_every - 1;
+    return true;
+}
+
+void QueryTracer::record(const std::vector<std::pair<int,int>>& trace)
+{
+    Ring* ring = local_ring();
+    uint64_t query = num_sampled++;
+    uint64_t w = ring->written.load(std::memory_order_relaxed);
+    for (const auto& t : trace)
+    {
+        ring->steps[w % capacity] = {query, int32_t(t.first), uint32_t(t.second)};
+        ++w;
+    }
+    ring->written.store(w, std::memory_order_release);
+}
+
+bool QueryTracer::dump(const char* filename)
+{
+    FILE* fp = fopen(filename, "wb");
+    if (fp == NULL)
+        return false;
+
+    std::lock_guard<std::mutex> lk(rings->mut);
+    uint32_t header[3] = {format, sample_every, uint32_t(rings->all.size())};
+    bool ok = fwrite("SGTR", 1, 4, fp) == 4 && fwrite(header, sizeof(uint32_t), 3, fp) == 3;
+    for (const auto& ring : rings->all)
+    {
+        uint64_t written = ring->written.load(std::memory_order_acquire);
+        uint64_t n = std::min(written, uint64_t(capacity));
+        ok = ok && fwrite(&written, sizeof(written), 1, fp) == 1 && fwrite(&n, sizeof(n), 1, fp) == 1;
+
+        // oldest first: the tail of the buffer from the write position, then its head
+        size_t first = written % capacity;
+        if (n == capacity)
+            ok = ok && fwrite(ring->steps.data() + first, sizeof(Step), capacity - first, fp) == capacity - first;
+        size_t head = n == capacity ? first : n;
+        ok = ok && fwrite(ring->steps.data(), sizeof(Step), head, fp) == head;
+    }
+    return fclose(fp) == 0 && ok;
+}
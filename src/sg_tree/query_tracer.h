@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+# ifndef _QUERY_TRACER_H
+# define _QUERY_TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+ * Sampled recording of the nodes visited by nearest neighbour queries.
+ *
+ * One in sample_every queries per thread is traced. Its path, one
+ * (level, number of children) step per visited node, goes into a ring
+ * buffer owned by the calling thread, so recording takes no lock; the
+ * oldest steps are overwritten once a ring is full. Rings of exited threads
+ * are reused, so short-lived worker threads do not add rings. dump() writes
+ * all rings in the binary format below, decoded by
+ * graphgrove.sgtree.read_traces:
+ *
+ *   "SGTR" | uint32 format | uint32 sample_every | uint32 num_rings
+ *   per ring: uint64 steps written | uint64 n | n * Step, oldest first
+ *
+ * Rings should be dumped while no traced queries run, otherwise their
+ * oldest steps may be torn.
+ */
+class QueryTracer
+{
+public:
+    struct Step
+    {
+        uint64_t query;                 // sequence number of the sampled query
+        int32_t level;
+        uint32_t children;
+    };
+
+protected:
+    struct Ring
+    {
+        std::vector<Step> steps;
+        std::atomic<uint64_t> written;
+        unsigned countdown;             // queries until the next sample
+        bool in_use;                    // owned by a live thread
+    };
+
+    // Shared with the threads holding a ring, which hand it back when they exit
+    struct Rings
+    {
+        std::mutex mut;                 // only taken when a thread first traces or exits
+        std::vector<std::unique_ptr<Ring>> all;
+    };
+    struct LocalRings;
+
+    const uint64_t id;                  // tells the rings of tracers at a reused address apart
+    unsigned sample_every;
+    size_t capacity;
+
+    std::shared_ptr<Rings> rings;
+    std::atomic<uint64_t> num_sampled;
+
+    Ring* local_ring();
+
+public:
+    static constexpr uint32_t format = 1;
+
+    /*** Trace one in sample_every queries, keeping the last capacity steps per thread ***/
+    QueryTracer(unsigned sample_every, size_t capacity);
+
+    QueryTracer(const QueryTracer&) = delete;
+    QueryTracer& operator=(const QueryTracer&) = delete;
+
+    /*** Whether the next query of the calling thread is traced ***/
+    bool sample();
+    /*** Append the path of a sampled query to the ring of the calling thread ***/
+    void record(const std::vector<std::pair<int,int>>& trace);
+
+    /*** Write all rings; returns false if the file cannot be written ***/
+    bool dump(const char* filename);
+
+    uint64_t sampled() const { return num_sampled.load(); }
+};
+
+#endif  // _QUERY_TRACER_H
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rebalancer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+
+// Per-node statistics in DFS pre-order, so that every subtree is a contiguous range
+struct NodeStat
+{
+    SGTree::Node* node;
+    long parent;                        // index of the parent, -1 for the root
+    size_t fanout;
+    size_t size;                        // number of nodes in the subtree
+    double cost;                        // sum over the subtree of the fanouts on the path from its root
+};
+
+struct SubtreeRebalancer::Snapshot
+{
+    SGTree::Node* old_root;
+    int level;
+    double old_cost;
+
+    // points[0] is the subtree root; the scratch tree uses indices as UIDs
+    std::vector<pointType> points;
+    std::vector<unsigned> ids;
+    std::vector<unsigned> uids;
+    std::vector<std::vector<unsigned>> dups;
+    std::vector<std::string> props;
+
+    std::unique_ptr<SGTree> scratch;    // owns the rebuilt subtree until it is swapped in
+};
+
+static void collect_stats(SGTree::Node* root, std::vector<NodeStat>& stats, bool lock_nodes)
+{
+    std::vector<std::pair<SGTree::Node*, long>> travel;
+    std::vector<SGTree::Node*> children;
+
+    travel.emplace_back(root, -1);
+    while (travel.size() > 0)
+    {
+        SGTree::Node* current = travel.back().first;
+        long parent = travel.back().second;
+        travel.pop_back();
+
+        // inserts may run concurrently, copy the children under the node lock
+        if (lock_nodes)
+            current->mut.lock_shared();
+        children = current->children;
+        if (lock_nodes)
+            current->mut.unlock_shared();
+
+        long idx = long(stats.size());
+        stats.push_back({current, parent, children.size(), 1, 0.0});
+        for (auto it = children.rbegin(); it != children.rend(); ++it)
+            travel.emplace_back(*it, idx);
+    }
+
+    // Descendants follow their ancestors, so a reverse sweep finishes every subtree before its root
+    for (size_t i = stats.size(); i-- > 0; )
+    {
+        NodeStat& s = stats[i];
+        s.cost += double(s.fanout) * double(s.size - 1);
+        if (s.parent >= 0)
+        {
+            stats[s.parent].size += s.size;
+            stats[s.parent].cost += s.cost;
+        }
+    }
+}
+
+/****************************** Rebuild *************************************/
+
+bool SubtreeRebalancer::rebuild(SGTree& tree, Snapshot& snap, unsigned cores)
+{
+    size_t n = snap.points.size();
+
+    snap.scratch.reset(new SGTree(snap.points[0]));
+    SGTree& scratch = *snap.scratch;
+    scratch.base = tree.base;
+    delete[] scratch.powdict;
+    scratch.powdict = scratch.compute_pow_table();
+    scratch.root->level = snap.level;
+    scratch.min_scale = snap.level;
+    scratch.max_scale = snap.level;
+
+    // As in the constructor, insert points farthest from the root first
+    std::vector<scalar> dists(n, 0);
+    for (size_t i = 1; i < n; ++i)
+        dists[i] = scratch.root->dist(snap.points[i]);
+    std::vector<size_t> idx(n - 1);
+    std::iota(std::begin(idx), std::end(idx), 1);
+    auto comp_x = [&dists](size_t a, size_t b) { return dists[a] > dists[b]; };
+    std::sort(std::begin(idx), std::end(idx), comp_x);
+    scratch.root->maxdistUB = n > 1 ? dists[idx[0]] : 0;
+
+    std::atomic<size_t> failed(0);
+    auto insert_one = [&](size_t i)->void{
+        size_t j = idx[i];
+        if (!scratch.insert(scratch.root, snap.points[j], unsigned(j), dists[j]))
+            failed.fetch_add(1, std::memory_order_relaxed);
+    };
+    size_t sequential = cores > 1 ? std::min(idx.size(), size_t(50000)) : idx.size();
+    for (size_t i = 0; i < sequential; ++i)
+        insert_one(i);
+    if (sequential < idx.size())
+        utils::parallel_for(sequential, idx.size(), insert_one, cores);
+
+    // Exact duplicates (e.g. nested copies of a node) would be merged, such a subtree is left as it is
+    return failed.load() == 0 && scratch.num_duplicates.load() == 0;
+}
+
+bool SubtreeRebalancer::swap_in(SGTree& tree, Snapshot& snap)
+{
+    SGTree& scratch = *snap.scratch;
+    SGTree::Node* fresh = scratch.root;
+    std::vector<SGTree::Node*> stale;
+    std::vector<SGTree::Node*> travel;
+
+    {
+        std::unique_lock<std::shared_timed_mutex> guard(tree.global_mut);
+
+        std::unordered_map<unsigned, size_t> local;
+        for (size_t i = 0; i < snap.ids.size(); ++i)
+            local[snap.ids[i]] = i;
+
+        // Points inserted below the old root since the snapshot go into the new subtree
+        size_t seen = 0;
+        travel.push_back(snap.old_root);
+        while (travel.size() > 0)
+        {
+            SGTree::Node* current = travel.back();
+            travel.pop_back();
+            if (current != snap.old_root)
+                stale.push_back(current);
+            for (const auto& child : *current)
+                travel.push_back(child);
+
+            auto it = local.find(current->ID);
+            if (it != local.end())
+            {
+                // duplicates may have arrived since the snapshot
+                snap.dups[it->second] = current->dup_uids;
+                ++seen;
+                continue;
+            }
+            size_t i = snap.points.size();
+            snap.points.push_back(current->_p);
+            snap.ids.push_back(current->ID);
+            snap.uids.push_back(current->UID);
+            snap.dups.push_back(current->dup_uids);
+            snap.props.push_back(current->ext_prop);
+
+            scalar dist = fresh->dist(current->_p);
+            if (dist > fresh->maxdistUB)
+                fresh->maxdistUB = dist;
+            if (!scratch.insert(fresh, current->_p, unsigned(i), dist) || scratch.num_duplicates.load() > 0)
+                return false;
+        }
+        // Some point left the subtree (a leaf became the new root in insert)
+        if (seen != local.size())
+            return false;
+
+        // Restore IDs, UIDs and properties of the rebuilt nodes
+        int min_level = fresh->level;
+        travel.push_back(fresh);
+        while (travel.size() > 0)
+        {
+            SGTree::Node* current = travel.back();
+            travel.pop_back();
+            for (const auto& child : *current)
+                travel.push_back(child);
+
+            size_t i = current->UID;
+            current->ID = snap.ids[i];
+            current->UID = snap.uids[i];
+            current->dup_uids = snap.dups[i];
+            current->ext_prop = snap.props[i];
+            min_level = std::min(min_level, current->level);
+        }
+
+        // The subtree root stays in place (it may be the root of the tree), only its children change
+        snap.old_root->children.swap(fresh->children);
+        snap.old_root->maxdistUB = fresh->maxdistUB;
+        fresh->children.clear();
+        if (min_level < tree.min_scale)
+            tree.min_scale = min_level;
+        // ties may now resolve to other points, drop cached results
+        tree.version.fetch_add(1, std::memory_order_release);
+    }
+
+    // Queries hold the global lock, nobody can be inside the old subtree anymore
+    for (auto node : stale)
+        delete node;
+    return true;
+}
+
+/****************************** Pass *************************************/
+
+unsigned SubtreeRebalancer::rebalance(SGTree& tree, const Options& opts)
+{
+    // swap_in frees nodes, so queries take the global lock during the pass
+    SGTree::RestructureScope restructure(tree);
+    size_t min_size = std::max(opts.min_size, 2u);
+    std::vector<Snapshot> chosen;
+
+    {
+        std::shared_lock<std::shared_timed_mutex> guard(tree.global_mut);
+        if (tree.root == NULL)
+            return 0;
+
+        std::vector<NodeStat> stats;
+        collect_stats(tree.root, stats, true);
+
+        // Average path cost relative to the ideal log2(size), per subtree
+        std::vector<size_t> scored;
+        std::vector<double> score(stats.size(), 0.0);
+        for (size_t i = 0; i < stats.size(); ++i)
+        {
+            if (stats[i].size < min_size)
+                continue;
+            score[i] = stats[i].cost / stats[i].size / std::log2(double(stats[i].size));
+            scored.push_back(i);
+        }
+        if (scored.size() == 0)
+            return 0;
+
+        std::vector<double> sorted_score;
+        for (auto i : scored)
+            sorted_score.push_back(score[i]);
+        auto mid = sorted_score.begin() + sorted_score.size()/2;
+        std::nth_element(sorted_score.begin(), mid, sorted_score.end());
+        double limit = opts.threshold * (*mid);
+
+        // Worst first by cost above the limit, skipping overlapping subtrees
+        std::vector<std::pair<double, size_t>> candidates;
+        for (auto i : scored)
+            if (score[i] > limit)
+                candidates.emplace_back(stats[i].cost - limit*std::log2(double(stats[i].size))*stats[i].size, i);
+        std::sort(candidates.begin(), candidates.end(), std::greater<std::pair<double, size_t>>());
+
+        std::vector<std::pair<size_t, size_t>> ranges;
+        for (const auto& c : candidates)
+        {
+            if (ranges.size() >= opts.max_subtrees)
+                break;
+            size_t first = c.second, last = c.second + stats[c.second].size;
+            bool overlaps = false;
+            for (const auto& r : ranges)
+                overlaps |= first < r.second && r.first < last;
+            if (!overlaps)
+                ranges.emplace_back(first, last);
+        }
+
+        // Copy the points, so that the rebuild needs no lock on the tree
+        for (const auto& r : ranges)
+        {
+            Snapshot snap;
+            const NodeStat& s = stats[r.first];
+            snap.old_root = s.node;
+            snap.level = s.node->level;
+            snap.old_cost = s.cost;
+            for (size_t i = r.first; i < r.second; ++i)
+            {
+                SGTree::Node* node = stats[i].node;
+                snap.points.push_back(node->_p);
+                snap.ids.push_back(node->ID);
+                snap.uids.push_back(node->UID);
+                // concurrent inserts append duplicates under the node lock
+                node->mut.lock_shared();
+                snap.dups.push_back(node->dup_uids);
+                node->mut.unlock_shared();
+                snap.props.push_back(node->ext_prop);
+            }
+            chosen.push_back(std::move(snap));
+        }
+    }
+
+    unsigned swapped = 0;
+    for (auto& snap : chosen)
+    {
+        if (!rebuild(tree, snap, opts.cores))
+            continue;
+
+        std::vector<NodeStat> stats;
+        collect_stats(snap.scratch->root, stats, false);
+        if (stats[0].cost >= snap.old_cost)
+            continue;
+
+        if (swap_in(tree, snap))
+            ++swapped;
+    }
+    return swapped;
+}
+
+/****************************** Background thread *************************************/
+
+SubtreeRebalancer::SubtreeRebalancer(SGTree& tree, unsigned interval_ms, const Options& opts)
+    : tree(tree), opts(opts), interval_ms(interval_ms), passes(0), rebuilt(0)
+{
+    worker = std::thread(&SubtreeRebalancer::run, this);
+}
+
+SubtreeRebalancer::~SubtreeRebalancer()
+{
+    {
+        std::lock_guard<std::mutex> lk(mut);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (worker.joinable())
+        worker.join();
+}
+
+void SubtreeRebalancer::run()
+{
+    std::unique_lock<std::mutex> lk(mut);
+    while (!cv.wait_for(lk, std::chrono::milliseconds(interval_ms), [this]{ return stopping; }))
+    {
+        lk.unlock();
+        rebuilt += rebalance(tree, opts);
+        passes++;
+        lk.lock();
+    }
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+# ifndef _REBALANCER_H
+# define _REBALANCER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "sg_tree.h"
+
+/*
+ * Online maintenance of an SG Tree that degrades under streaming inserts.
+ *
+ * Every pass scores each subtree by its query cost, i.e. the average number
+ * of distance computations on the way from its root to one of its points,
+ * relative to log2 of its size. Subtrees scoring more than threshold times
+ * the median score (very high fanout or long chains) are rebuilt off to the
+ * side from a copy of their points, and swapped in under the global lock
+ * only if the rebuilt subtree is cheaper. Node IDs and UIDs are kept, so
+ * serialization and query results are unaffected.
+ */
+class SubtreeRebalancer
+{
+public:
+    struct Options
+    {
+        unsigned max_subtrees = 4;      // subtrees rebuilt per pass
+        scalar threshold = 2.0;         // rebuild when score > threshold * median score
+        unsigned min_size = 64;         // smaller subtrees are not scored
+        unsigned cores = 1;             // threads used to rebuild a subtree
+    };
+
+protected:
+    SGTree& tree;
+    Options opts;
+    unsigned interval_ms;
+
+    std::thread worker;
+    std::mutex mut;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    std::atomic<size_t> passes;
+    std::atomic<size_t> rebuilt;
+
+    void run();
+
+    /*** Copy of a subtree chosen for rebuilding ***/
+    struct Snapshot;
+    static bool rebuild(SGTree& tree, Snapshot& snap, unsigned cores);
+    static bool swap_in(SGTree& tree, Snapshot& snap);
+
+public:
+    /*** Rebalance tree every interval_ms milliseconds from a background thread ***/
+    SubtreeRebalancer(SGTree& tree, unsigned interval_ms, const Options& opts);
+    /*** Stops the background thread, waiting for a running pass ***/
+    ~SubtreeRebalancer();
+
+    SubtreeRebalancer(const SubtreeRebalancer&) = delete;
+    SubtreeRebalancer& operator=(const SubtreeRebalancer&) = delete;
+
+    /*** One pass; returns the number of subtrees swapped in ***/
+    static unsigned rebalance(SGTree& tree, const Options& opts);
+
+    size_t num_passes() const { return passes.load(); }
+    size_t num_rebuilt() const { return rebuilt.load(); }
+};
+
+#endif  // _REBALANCER_H
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "routing_table.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <numeric>
+
+// Queries sharing one matrix product
+static const size_t block_size = 64;
+
+RoutingTable::RoutingTable(const SGTree& tree, unsigned levels)
+    : tree(tree), levels(levels), version(0), built(false)
+{
+    std::shared_lock<std::shared_timed_mutex> guard(tree.global_mut);
+    refresh();
+}
+
+size_t RoutingTable::size()
+{
+    std::shared_lock<std::shared_timed_mutex> lk(mut);
+    return nodes.size();
+}
+
+/****************************** Build *************************************/
+
+void RoutingTable::refresh()
+{
+    {
+        std::shared_lock<std::shared_timed_mutex> lk(mut);
+        if (built && version == tree.get_version())
+            return;
+    }
+    std::unique_lock<std::shared_timed_mutex> lk(mut);
+    if (!built || version != tree.get_version())
+        build();
+}
+
+void RoutingTable::build()
+{
+    // Read the version first: a concurrent insert only makes the next query rebuild again
+    version = tree.get_version();
+    built = true;
+
+    nodes.clear();
+    last.clear();
+    if (tree.root != NULL)
+    {
+        // Breadth first, so the table holds whole levels
+        std::vector<SGTree::Node*> level(1, tree.root);
+        for (unsigned d = 0; !level.empty(); ++d)
+        {
+            std::vector<SGTree::Node*> next;
+            for (auto node : level)
+            {
+                nodes.push_back(node);
+                last.push_back(d == levels);
+                if (d < levels)
+                    next.insert(next.end(), node->children.begin(), node->children.end());
+            }
+            if (d == levels)
+                break;
+            level.swap(next);
+        }
+    }
+
+    points.resize(tree.D, nodes.size());
+    norms.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        points.col(i) = nodes[i]->_p;
+        norms[i] = nodes[i]->_p.squaredNorm();
+    }
+}
+
+/****************************** k-Nearest Neighbours *************************************/
+
+void RoutingTable::search(const pointType& p, const scalar* dots, unsigned k, long* uids, scalar* dists) const
+{
+    std::pair<SGTree::Node*, scalar> dummy(NULL, std::numeric_limits<scalar>::max());
+    std::vector<std::pair<SGTree::Node*, scalar>> nnList(k, dummy);
+    auto comp_pair = [](std::pair<SGTree::Node*, scalar> a, std::pair<SGTree::Node*, scalar> b) { return a.second < b.second; };
+    auto offer = [&](SGTree::Node* node, scalar d)->void{
+        if (d < nnList.back().second)
+        {
+            std::pair<SGTree::Node*, scalar> current(node, d);
+            nnList.insert(std::upper_bound(nnList.begin(), nnList.end(), current, comp_pair), current);
+            nnList.pop_back();
+        }
+    };
+
+    // |x|^2 - 2 x.q + |q|^2 is off by less than 2 (D + 4) eps (|x|^2 + |q|^2),
+    // so lower[i] does not exceed the distance computed node by node
+    const size_t M = nodes.size();
+    const scalar pnorm = p.squaredNorm();
+    const scalar slack = scalar(2 * (p.size() + 4)) * std::numeric_limits<scalar>::epsilon();
+    std::vector<scalar> lower(M);
+    std::vector<scalar> bound(M);
+    // maxdistUB is read now rather than at build time, inserts since may have raised it
+    for (size_t i = 0; i < M; ++i)
+    {
+        scalar d2 = norms[i] - 2 * dots[i] + pnorm - slack * (norms[i] + pnorm);
+        lower[i] = std::sqrt(std::max(d2, scalar(0)));
+        bound[i] = last[i] ? lower[i] - nodes[i]->maxdistUB : lower[i];
+    }
+
+    // Visit by increasing bound on anything in the subtree, until none can beat the k-th
+    std::vector<size_t> order(M);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&bound](size_t a, size_t b) { return bound[a] < bound[b]; });
+    std::vector<std::pair<SGTree::Node*, scalar>> frontier;
+    for (auto i : order)
+    {
+        if (bound[i] >= nnList.back().second)
+            break;
+        scalar d = nodes[i]->dist(p);
+        offer(nodes[i], d);
+        if (last[i] && !nodes[i]->children.empty())
+            frontier.emplace_back(nodes[i], d);
+    }
+
+    // Continue below the table as SGTree::kNearestNeighbours, nearest subtrees first
+    std::sort(frontier.begin(), frontier.end(), comp_pair);
+    std::vector<std::pair<SGTree::Node*, scalar>> travel;
+    std::vector<int> local_idx;
+    std::vector<scalar> local_dists;
+    auto comp_x = [&local_dists](int a, int b) { return local_dists[a] > local_dists[b]; };
+    auto push_children = [&](SGTree::Node* curNode)->void{
+        unsigned num_children = unsigned(curNode->children.size());
+        local_idx.resize(num_children);
+        local_dists.resize(num_children);
+        std::iota(local_idx.begin(), local_idx.end(), 0);
+        for (unsigned i = 0; i < num_children; ++i)
+            local_dists[i] = curNode->children[i]->dist(p);
+        std::sort(local_idx.begin(), local_idx.end(), comp_x);
+
+        const scalar best_dist_now = nnList.back().second;
+        for (const auto& child_idx : local_idx)
+        {
+            SGTree::Node* child = curNode->children[child_idx];
+            scalar dist_child = local_dists[child_idx];
+            if (best_dist_now > dist_child - child->maxdistUB)
+                travel.emplace_back(child, dist_child);
+        }
+    };
+    for (const auto& top : frontier)
+    {
+        if (top.second - top.first->maxdistUB >= nnList.back().second)
+            continue;
+        push_children(top.first);
+        while (travel.size() > 0)
+        {
+            const auto current = travel.back();
+            travel.pop_back();
+            offer(current.first, current.second);
+            push_children(current.first);
+        }
+    }
+
+    for (unsigned t = 0; t < k; ++t)
+    {
+        uids[t] = nnList[t].first != NULL ? long(nnList[t].first->UID) : -1L;
+        dists[t] = nnList[t].second;
+    }
+}
+
+void RoutingTable::kNearestNeighbours(const Eigen::Map<matrixType>& queries, unsigned k, unsigned cores, long* uids, scalar* dists)
+{
+    // One hold of global_mut over the version check, a rebuild and the whole batch,
+    // so no restructure can free the stored nodes in between
+    std::shared_lock<std::shared_timed_mutex> guard(tree.global_mut);
+    refresh();
+    std::shared_lock<std::shared_timed_mutex> lk(mut);
+
+    const size_t numPoints = queries.cols();
+    const size_t numBlocks = (numPoints + block_size - 1) / block_size;
+    utils::parallel_for(0, numBlocks, [&](size_t b)->void{
+        const size_t first = b * block_size;
+        const size_t count = std::min(block_size, numPoints - first);
+        // M x count, one column of dot products per query
+        matrixType dots = points.transpose() * queries.middleCols(first, count);
+        for (size_t j = 0; j < count; ++j)
+            search(queries.col(first + j), dots.col(j).data(), k, uids + k * (first + j), dists + k * (first + j));
+    }, std::min(utils::pool_cores(cores), unsigned(std::max(numBlocks, size_t(1)))));
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2021 The authors of SG Tree All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+# ifndef _ROUTING_TABLE_H
+# define _ROUTING_TABLE_H
+
+#include <shared_mutex>
+#include <vector>
+
+#include "sg_tree.h"
+
+/*
+ * Flat copy of the top levels of an SG Tree for exact kNN queries.
+ *
+ * The nodes within depth levels of the root are stored as the columns of
+ * one matrix, with their squared norms and covering radii. A block of
+ * queries then computes its distances to all of them with a single matrix
+ * product, instead of node by node while walking down. The product only
+ * gives lower bounds (rounding is bounded from the norms), so exact
+ * distances are computed for the nodes whose bound can beat the current
+ * k-th neighbour, and the usual traversal continues below the deepest
+ * stored nodes whose subtree can still hold a neighbour. Results equal
+ * SGTree::kNearestNeighbours.
+ *
+ * The table is rebuilt by the first query after the tree version changes,
+ * so it suits trees that are queried much more often than they change.
+ */
+class RoutingTable
+{
+protected:
+    const SGTree& tree;
+    unsigned levels;
+
+    mutable std::shared_timed_mutex mut;    // taken exclusively to rebuild
+    size_t version;
+    bool built;
+
+    matrixType points;                      // D x M, one column per stored node
+    std::vector<scalar> norms;              // squared norms of the columns
+    std::vector<SGTree::Node*> nodes;
+    std::vector<bool> last;                 // nodes of the deepest stored level, whose subtrees go on below the table
+
+    /*** Rebuild from the tree if it changed; the caller holds tree.global_mut shared, not mut ***/
+    void refresh();
+    void build();
+
+    /*** k nearest neighbours of p given its dot products with the columns ***/
+    void search(const pointType& p, const scalar* dots, unsigned k, long* uids, scalar* dists) const;
+
+public:
+    /*** Store the nodes within depth levels of the root ***/
+    RoutingTable(const SGTree& tree, unsigned levels);
+
+    RoutingTable(const RoutingTable&) = delete;
+    RoutingTable& operator=(const RoutingTable&) = delete;
+
+    /*** k nearest neighbours of every column into uids and dists (k per query, -1 past the size of the tree) ***/
+    void kNearestNeighbours(const Eigen::Map<matrixType>& queries, unsigned k, unsigned cores, long* uids, scalar* dists);
+
+    unsigned depth() const { return levels; }
+    size_t size();
+};
+
+#endif  // _ROUTING_TABLE_H
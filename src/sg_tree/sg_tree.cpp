@@ -16,7 +16,13 @@
 
 
 #include "sg_tree.h"
+#include <chrono>
+#include <iomanip>
 #include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 scalar* SGTree::compute_pow_table()
 {
@@ -76,11 +82,14 @@ bool SGTree::insert(SGTree::Node* current, const pointType& p, unsigned UID, sca
 
     if (dist_child <= 0.0)
     {
-        //release read lock then enter child
+        // exact duplicate, kept in the list of the existing node
+        Node* child = current->children[child_idx];
         current->mut.unlock_shared();
-        // std::cout << "Duplicate entry!!!" << std::endl;
-        // std::cout << current->children[child_idx]->_p << std::endl;
-        // std::cout << p << std::endl;
+        child->mut.lock();
+        child->dup_uids.push_back(UID);
+        child->mut.unlock();
+        num_duplicates.fetch_add(1, std::memory_order_relaxed);
+        result = true;
     }
     else if (use_nesting && dist_child > dist_current && dist_current <= current->sepdist(powdict))
     {
@@ -188,6 +197,49 @@ void SGTree::calc_maxdist()
     }
 }
 
+static unsigned reader_shard()
+{
+    static thread_local unsigned shard = unsigned(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    return shard;
+}
+
+SGTree::QueryGuard::QueryGuard(const SGTree& tree) : tree(tree)
+{
+    if (tree.restructuring.load() == 0)
+    {
+        unlocked = &tree.unlocked_readers[reader_shard() % reader_shards].count;
+        unlocked->fetch_add(1);
+        // a restructure that started meanwhile waits for this count, back off
+        if (tree.restructuring.load() == 0)
+            return;
+        unlocked->fetch_sub(1);
+        unlocked = nullptr;
+    }
+    tree.global_mut.lock_shared();
+}
+
+SGTree::QueryGuard::~QueryGuard()
+{
+    if (unlocked != nullptr)
+        unlocked->fetch_sub(1);
+    else
+        tree.global_mut.unlock_shared();
+}
+
+void SGTree::begin_restructure()
+{
+    restructuring.fetch_add(1);
+    // new queries now take global_mut; wait for those already running without it
+    for (auto& shard : unlocked_readers)
+        while (shard.count.load() != 0)
+            std::this_thread::yield();
+}
+
+void SGTree::end_restructure()
+{
+    restructuring.fetch_sub(1);
+}
+
 bool SGTree::insert(const pointType& p, unsigned UID)
 {
     bool result = false;
@@ -196,9 +248,11 @@ bool SGTree::insert(const pointType& p, unsigned UID)
     scalar curr_root_dist = root->dist(p);
     if (curr_root_dist <= 0.0)
     {
-        // std::cout << "Duplicate entry!!!" << std::endl;
-        // std::cout << root->_p << std::endl;
-        // std::cout << p << std::endl;
+        root->mut.lock();
+        root->dup_uids.push_back(UID);
+        root->mut.unlock();
+        num_duplicates.fetch_add(1, std::memory_order_relaxed);
+        result = true;
     }
     else if (curr_root_dist > root->covdist(powdict))
     {
@@ -250,9 +304,337 @@ bool SGTree::insert(const pointType& p, unsigned UID)
         // std::cout << "insert beam " << std::endl;
     }
     global_mut.unlock_shared();
+    // after the point is reachable, so that cached results at the new version include it
+    if (result)
+        version.fetch_add(1, std::memory_order_release);
     return result;
 }
 
+/******************************* Merge ***********************************************/
+// Hash of the coordinates of p, equal for points at distance 0
+static size_t point_hash(const pointType& p)
+{
+    size_t h = 0;
+    for (Eigen::Index i = 0; i < p.size(); ++i)
+        h ^= std::hash<scalar>()(p[i]) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+// Renumber a subtree taken from another tree and shift its levels up by shift
+void SGTree::adopt(SGTree::Node* sub, int shift)
+{
+    int lowest = std::numeric_limits<int>::max();
+    std::stack<SGTree::Node*> travel;
+    travel.push(sub);
+    while (travel.size() > 0)
+    {
+        SGTree::Node* current = travel.top();
+        travel.pop();
+        current->level += shift;
+        current->ID = N++;
+        num_duplicates.fetch_add(unsigned(current->dup_uids.size()), std::memory_order_relaxed);
+        lowest = std::min(lowest, current->level);
+        for (const auto& child : *current)
+            travel.push(child);
+    }
+
+    int local_min = min_scale.load();
+    while (local_min > lowest)
+    {
+        min_scale.compare_exchange_weak(local_min, lowest, std::memory_order_relaxed, std::memory_order_relaxed);
+        local_min = min_scale.load();
+    }
+}
+
+// Largest level shift of each node of the subtree sub that keeps the children of every
+// node below it separated, -1 where they already are not
+void SGTree::merge_room(SGTree::Node* sub, std::unordered_map<const SGTree::Node*, int>& room) const
+{
+    std::vector<SGTree::Node*> order;
+    std::stack<SGTree::Node*> travel;
+    travel.push(sub);
+    while (travel.size() > 0)
+    {
+        SGTree::Node* current = travel.top();
+        travel.pop();
+        order.push_back(current);
+        for (const auto& child : *current)
+            travel.push(child);
+    }
+
+    for (auto it = order.rbegin(); it != order.rend(); ++it)
+    {
+        SGTree::Node* current = *it;
+        int shift = std::numeric_limits<int>::max();
+        scalar min_sep = std::numeric_limits<scalar>::max();
+        size_t num_children = current->children.size();
+        for (size_t i = 0; i < num_children; ++i)
+        {
+            shift = std::min(shift, room[current->children[i]]);
+            for (size_t j = i + 1; j < num_children; ++j)
+                min_sep = std::min(min_sep, current->children[i]->dist(current->children[j]));
+        }
+        if (num_children > 1)
+        {
+            // children of a node at level l are more than sepdist(l) apart
+            int own = -1;
+            while (current->level + own + 1024 < 2048 && powdict[current->level + own + 1024] < min_sep)
+                ++own;
+            shift = std::min(shift, own);
+        }
+        room[current] = shift;
+    }
+}
+
+// Attach the subtree sub below current, where sub->_p is within the cover of current.
+// Follows the path an insert of sub->_p would take and hangs sub where that point would
+// become a new child, provided sub is not coarser than that level and moving it up keeps
+// its nodes separated (room, from merge_room). Returns false, leaving the tree unchanged
+// apart from looser maxdistUB bounds, otherwise.
+bool SGTree::merge(SGTree::Node* current, SGTree::Node* sub, scalar dist_current, int room)
+{
+    current->mut.lock_shared();
+
+    // Find the closest children
+    unsigned num_children = unsigned(current->children.size());
+    scalar dist_child = std::numeric_limits<scalar>::max();
+    int child_idx = -1;
+    for (unsigned i = 0; i < num_children; ++i)
+    {
+        scalar temp_dist = current->children[i]->UID != current->UID ? current->children[i]->dist(sub->_p) : dist_current;
+        if (temp_dist < dist_child)
+        {
+            dist_child = temp_dist;
+            child_idx = i;
+        }
+    }
+
+    if (dist_child <= current->sepdist(powdict))
+    {
+        // the point belongs below the child, so the subtree has to fit below it too
+        Node* child = current->children[child_idx];
+        current->mut.unlock_shared();
+        if (sub->level >= child->level)
+            return false;
+        scalar bound = dist_child + sub->maxdistUB;
+        if (child->maxdistUB < bound)
+            child->maxdistUB = bound;
+        return merge(child, sub, dist_child, room);
+    }
+    if (sub->level > current->level - 1 || current->level - 1 - sub->level > room)
+    {
+        current->mut.unlock_shared();
+        return false;
+    }
+
+    //release read lock then acquire write lock
+    current->mut.unlock_shared();
+    current->mut.lock();
+    // check if the merge is still valid, i.e. no other point was inserted else restart
+    if (num_children != current->children.size())
+    {
+        current->mut.unlock();
+        return merge(current, sub, dist_current, room);
+    }
+    // a finer subtree moves up as a whole: covering still holds with the larger radii,
+    // separation was checked by room
+    adopt(sub, current->level - 1 - sub->level);
+    current->children.push_back(sub);
+    current->mut.unlock();
+    return true;
+}
+
+// Place a subtree of the other tree, splitting it where it does not fit whole
+void SGTree::merge_unit(SGTree::Node* sub, const std::unordered_map<const SGTree::Node*, int>& room)
+{
+    bool placed = false;
+    global_mut.lock_shared();
+    scalar dist_root = root->dist(sub->_p);
+    if (dist_root > 0.0 && dist_root <= root->covdist(powdict) && sub->level < root->level)
+    {
+        scalar bound = dist_root + sub->maxdistUB;
+        if (root->maxdistUB < bound)
+            root->maxdistUB = bound;
+        placed = merge(root, sub, dist_root, room.at(sub));
+    }
+    global_mut.unlock_shared();
+    if (placed)
+        return;
+
+    // the point alone goes through a regular insert, which also grows the root if needed
+    std::vector<SGTree::Node*> children;
+    children.swap(sub->children);
+    insert(sub->_p, sub->UID);
+    for (unsigned uid : sub->dup_uids)
+        insert(sub->_p, uid);
+    delete sub;
+    for (const auto& child : children)
+        merge_unit(child, room);
+}
+
+bool SGTree::merge(SGTree& other, unsigned uid_offset, unsigned cores)
+{
+    if (&other == this || (root != NULL && other.root != NULL && (other.D != D || other.base != base)))
+        return false;
+
+    // merging frees nodes of both trees
+    RestructureScope restructure(*this);
+    RestructureScope restructure_other(other);
+    SGTree::Node* sub_root;
+    {
+        std::unique_lock<std::shared_timed_mutex> guard(other.global_mut);
+        sub_root = other.root;
+        other.root = NULL;
+        other.N = 0;
+        other.num_duplicates = 0;
+        other.version.fetch_add(1, std::memory_order_release);
+    }
+    if (sub_root == NULL)
+        return true;
+
+    std::stack<SGTree::Node*> travel;
+    travel.push(sub_root);
+    while (travel.size() > 0)
+    {
+        SGTree::Node* current = travel.top();
+        travel.pop();
+        current->UID += uid_offset;
+        for (auto& uid : current->dup_uids)
+            uid += uid_offset;
+        for (const auto& child : *current)
+            travel.push(child);
+    }
+
+    // An empty tree simply takes over the other one
+    if (root == NULL)
+    {
+        std::unique_lock<std::shared_timed_mutex> guard(global_mut);
+        D = other.D;
+        if (base != other.base)
+        {
+            base = other.base;
+            delete[] powdict;
+            powdict = compute_pow_table();
+        }
+        min_scale = sub_root->level;
+        adopt(sub_root, 0);
+        max_scale = sub_root->level;
+        root = sub_root;
+        id_valid = false;
+        version.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+
+    // Points of other equal to one of this tree join the dup_uids of its node;
+    // the subtrees below them are placed on their own
+    std::unordered_multimap<size_t, SGTree::Node*> points;
+    travel.push(root);
+    while (travel.size() > 0)
+    {
+        SGTree::Node* current = travel.top();
+        travel.pop();
+        points.emplace(point_hash(current->_p), current);
+        for (const auto& child : *current)
+            travel.push(child);
+    }
+    auto fold = [&](SGTree::Node* node)->bool{
+        auto range = points.equal_range(point_hash(node->_p));
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            SGTree::Node* same = it->second;
+            if (same->_p != node->_p)
+                continue;
+            same->mut.lock();
+            same->dup_uids.push_back(node->UID);
+            same->dup_uids.insert(same->dup_uids.end(), node->dup_uids.begin(), node->dup_uids.end());
+            same->mut.unlock();
+            num_duplicates.fetch_add(unsigned(1 + node->dup_uids.size()), std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    };
+
+    std::vector<SGTree::Node*> units;
+    std::stack<SGTree::Node*> pending;
+    pending.push(sub_root);
+    while (pending.size() > 0)
+    {
+        SGTree::Node* sub = pending.top();
+        pending.pop();
+        if (fold(sub))
+        {
+            for (const auto& child : *sub)
+                pending.push(child);
+            sub->children.clear();
+            delete sub;
+            continue;
+        }
+        units.push_back(sub);
+        travel.push(sub);
+        while (travel.size() > 0)
+        {
+            SGTree::Node* current = travel.top();
+            travel.pop();
+            for (size_t i = 0; i < current->children.size(); )
+            {
+                SGTree::Node* child = current->children[i];
+                if (!fold(child))
+                {
+                    travel.push(child);
+                    ++i;
+                    continue;
+                }
+                for (const auto& grandchild : *child)
+                    pending.push(grandchild);
+                child->children.clear();
+                delete child;
+                current->erase(i);
+            }
+        }
+    }
+    points.clear();
+
+    std::unordered_map<const SGTree::Node*, int> room;
+    for (const auto& sub : units)
+        merge_room(sub, room);
+
+    // Split the coarsest subtrees until there is enough work for every thread;
+    // their own points are inserted first, one by one
+    size_t target = 4 * size_t(utils::pool_cores(cores));
+    while (units.size() < target)
+    {
+        size_t top = units.size();
+        for (size_t i = 0; i < units.size(); ++i)
+            if (units[i]->children.size() > 0 && (top == units.size() || units[i]->level > units[top]->level))
+                top = i;
+        if (top == units.size())
+            break;
+        SGTree::Node* split = units[top];
+        units[top] = units.back();
+        units.pop_back();
+        units.insert(units.end(), split->children.begin(), split->children.end());
+        split->children.clear();
+        insert(split->_p, split->UID);
+        for (unsigned uid : split->dup_uids)
+            insert(split->_p, uid);
+        delete split;
+    }
+
+    id_valid = false;
+    utils::ThreadPool::shared().run(units.size(), [&](size_t i)->void{
+        merge_unit(units[i], room);
+    }, cores);
+
+    int local_max = max_scale.load();
+    while (local_max < root->level)
+    {
+        max_scale.compare_exchange_weak(local_max, root->level, std::memory_order_relaxed, std::memory_order_relaxed);
+        local_max = max_scale.load();
+    }
+    version.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
 /******************************* Remove ***********************************************/
 
 //TODO: Amortized implementation is needed
@@ -262,6 +644,7 @@ bool SGTree::insert(const pointType& p, unsigned UID)
 
 std::pair<SGTree::Node*, scalar> SGTree::NearestNeighbour(const pointType &p) const
 {
+    QueryGuard guard(*this);
     std::pair<SGTree::Node*, scalar> nn(root, root->dist(p));
     std::vector<std::pair<SGTree::Node*, scalar>> travel;
     SGTree::Node* curNode;
@@ -313,6 +696,7 @@ std::pair<SGTree::Node*, scalar> SGTree::NearestNeighbour(const pointType &p) co
 
 std::pair<SGTree::Node*, scalar> SGTree::NearestNeighbour(const pointType &p, std::vector<std::pair<int,int>>& trace) const
 {
+    QueryGuard guard(*this);
     std::pair<SGTree::Node*, scalar> nn(root, root->dist(p));
     std::vector<std::pair<SGTree::Node*, scalar>> travel;
     SGTree::Node* curNode;
@@ -367,8 +751,9 @@ std::pair<SGTree::Node*, scalar> SGTree::NearestNeighbour(const pointType &p, st
 
 /****************************** k-Nearest Neighbours *************************************/
 
-std::vector<std::pair<SGTree::Node*, scalar>> SGTree::kNearestNeighbours(const pointType &p, unsigned numNbrs) const
+std::vector<std::pair<SGTree::Node*, scalar>> SGTree::kNearestNeighbours(const pointType &p, unsigned numNbrs, size_t* dist_evals) const
 {
+    QueryGuard guard(*this);
     // Do the worst initialization
     std::pair<SGTree::Node*, scalar> dummy(NULL, std::numeric_limits<scalar>::max());
     // List of k-nearest points till now
@@ -387,6 +772,8 @@ std::vector<std::pair<SGTree::Node*, scalar>> SGTree::kNearestNeighbours(const p
 
     // Initialize with root
     travel.emplace_back(root, root->dist(p));
+    if (dist_evals != nullptr)
+        *dist_evals += 1;
 
     // Pop, print and then push the children
     while (travel.size() > 0)
@@ -416,6 +803,8 @@ std::vector<std::pair<SGTree::Node*, scalar>> SGTree::kNearestNeighbours(const p
         for (unsigned i = 0; i < num_children; ++i){
             local_dists[i] = curNode->children[i]->dist(p);
         }
+        if (dist_evals != nullptr)
+            *dist_evals += num_children;
         std::sort(local_idx.begin(), local_idx.end(), comp_x);
 
         const scalar best_dist_now = nnList.back().second;
@@ -432,8 +821,120 @@ std::vector<std::pair<SGTree::Node*, scalar>> SGTree::kNearestNeighbours(const p
 }
 
 
+std::vector<std::pair<SGTree::Node*, scalar>> SGTree::kNearestNeighboursParallel(const pointType &p, unsigned numNbrs, unsigned cores) const
+{
+    cores = utils::pool_cores(cores);
+    if (cores == 1)
+        return kNearestNeighbours(p, numNbrs);
+
+    QueryGuard guard(*this);
+    typedef std::pair<SGTree::Node*, scalar> Candidate;
+    Candidate dummy(NULL, std::numeric_limits<scalar>::max());
+    auto comp_pair = [](Candidate a, Candidate b) { return a.second < b.second; };
+    auto offer = [&comp_pair](std::vector<Candidate>& nnList, Candidate current)->void{
+        if (current.second < nnList.back().second)
+        {
+            nnList.insert(std::upper_bound(nnList.begin(), nnList.end(), current, comp_pair), current);
+            nnList.pop_back();
+        }
+    };
+
+    // Breadth first from the root until there are a few subtrees per thread
+    std::vector<Candidate> nnList(numNbrs, dummy);
+    std::vector<Candidate> frontier(1, Candidate(root, root->dist(p)));
+    offer(nnList, frontier[0]);
+    const size_t enough = 8 * size_t(cores);
+    while (frontier.size() < enough)
+    {
+        std::vector<Candidate> next;
+        for (const auto& current : frontier)
+        {
+            if (current.second - current.first->maxdistUB >= nnList.back().second)
+                continue;
+            for (auto child : current.first->children)
+            {
+                Candidate c(child, child->dist(p));
+                offer(nnList, c);
+                if (!child->children.empty())
+                    next.push_back(c);
+            }
+        }
+        if (next.empty())
+            return nnList;
+        frontier.swap(next);
+    }
+
+    // Most promising subtrees first, so the shared bound drops early
+    std::sort(frontier.begin(), frontier.end(), [](Candidate a, Candidate b) {
+        return a.second - a.first->maxdistUB < b.second - b.first->maxdistUB;
+    });
+
+    // Every list holds k real candidates once full, so the smallest k-th of any of them bounds the answer
+    std::atomic<scalar> bound(nnList.back().second);
+    auto tighten = [&bound](scalar kth)->void{
+        scalar cur = bound.load(std::memory_order_relaxed);
+        while (kth < cur && !bound.compare_exchange_weak(cur, kth, std::memory_order_relaxed));
+    };
+
+    std::vector<std::vector<Candidate>> found(frontier.size());
+    utils::ThreadPool::shared().run(frontier.size(), [&](size_t t)->void{
+        std::vector<Candidate>& local = found[t];
+        local.assign(numNbrs, dummy);
+        auto best = [&]()->scalar{ return std::min(local.back().second, bound.load(std::memory_order_relaxed)); };
+        if (frontier[t].second - frontier[t].first->maxdistUB >= best())
+            return;
+
+        std::vector<Candidate> travel;
+        std::vector<int> local_idx;
+        std::vector<scalar> local_dists;
+        auto comp_x = [&local_dists](int a, int b) { return local_dists[a] > local_dists[b]; };
+        SGTree::Node* curNode = frontier[t].first;
+        while (true)
+        {
+            unsigned num_children = unsigned(curNode->children.size());
+            local_idx.resize(num_children);
+            local_dists.resize(num_children);
+            std::iota(local_idx.begin(), local_idx.end(), 0);
+            for (unsigned i = 0; i < num_children; ++i)
+                local_dists[i] = curNode->children[i]->dist(p);
+            std::sort(local_idx.begin(), local_idx.end(), comp_x);
+
+            const scalar best_dist_now = best();
+            for (const auto& child_idx : local_idx)
+            {
+                Node* child = curNode->children[child_idx];
+                scalar dist_child = local_dists[child_idx];
+                if (best_dist_now > dist_child - child->maxdistUB)
+                    travel.emplace_back(child, dist_child);
+            }
+
+            if (travel.empty())
+                break;
+            const auto current = travel.back();
+            travel.pop_back();
+            curNode = current.first;
+            if (current.second < best())
+            {
+                offer(local, current);
+                tighten(local.back().second);
+            }
+        }
+    }, cores);
+
+    for (const auto& local : found)
+        for (const auto& current : local)
+        {
+            if (current.first == NULL)
+                break;
+            offer(nnList, current);
+        }
+    return nnList;
+}
+
+
 std::vector<std::pair<SGTree::Node*, scalar>> SGTree::kNearestNeighboursBeam(const pointType &p, unsigned numNbrs, unsigned beamSize) const
 {
+    QueryGuard guard(*this);
     // Do the worst initialization
     std::pair<SGTree::Node*, scalar> dummy(NULL, std::numeric_limits<scalar>::max());
     // List of k-nearest points till now
@@ -509,10 +1010,338 @@ std::vector<std::pair<SGTree::Node*, scalar>> SGTree::kNearestNeighboursBeam(con
     return nnList;
 }
 
+/****************************** Multi-vector k-Nearest Neighbours *************************************/
+
+std::vector<std::vector<std::pair<SGTree::Node*, scalar>>> SGTree::kNearestNeighboursMulti(const Eigen::Map<matrixType>& queries, unsigned numNbrs) const
+{
+    QueryGuard guard(*this);
+    const unsigned m = unsigned(queries.cols());
+    std::pair<SGTree::Node*, scalar> dummy(NULL, std::numeric_limits<scalar>::max());
+    std::vector<std::vector<std::pair<SGTree::Node*, scalar>>> nnLists(m, std::vector<std::pair<SGTree::Node*, scalar>>(numNbrs, dummy));
+    auto comp_pair = [](std::pair<SGTree::Node*, scalar> a, std::pair<SGTree::Node*, scalar> b) { return a.second < b.second; };
+    if (m == 0 || numNbrs == 0)
+        return nnLists;
+
+    // A frame is a node with the sub-queries still exploring it; their ids and
+    // distances to the node live in pool, the frame on top owning its tail
+    struct Frame
+    {
+        SGTree::Node* node;
+        size_t offset;
+        unsigned count;
+    };
+    std::vector<Frame> travel;
+    std::vector<std::pair<unsigned, scalar>> pool;
+
+    // Scratch memory
+    std::vector<std::pair<unsigned, scalar>> active;
+    matrixType block, sub;
+    Eigen::Matrix<scalar, Eigen::Dynamic, Eigen::Dynamic> gram;
+    std::vector<int> local_idx;
+    std::vector<scalar> local_order;
+    std::vector<std::vector<std::pair<unsigned, scalar>>> child_active;
+    auto comp_x = [&local_order](int a, int b) { return local_order[a] > local_order[b]; };
+
+    // Initialize with root
+    travel.push_back({root, 0, m});
+    for (unsigned q = 0; q < m; ++q)
+        pool.emplace_back(q, root->dist(queries.col(q)));
+
+    while (travel.size() > 0)
+    {
+        const Frame current = travel.back();
+        travel.pop_back();
+        SGTree::Node* curNode = current.node;
+        active.assign(pool.begin() + current.offset, pool.begin() + current.offset + current.count);
+        pool.resize(current.offset);
+
+        // Offer the node to every sub-query, keep those whose bound allows a closer descendant
+        size_t kept = 0;
+        for (const auto& a : active)
+        {
+            auto& nnList = nnLists[a.first];
+            if (a.second < nnList.back().second)
+            {
+                std::pair<SGTree::Node*, scalar> cand(curNode, a.second);
+                nnList.insert(std::upper_bound(nnList.begin(), nnList.end(), cand, comp_pair), cand);
+                nnList.pop_back();
+            }
+            // a little slack against rounding in the product form, an extra visit never changes the result
+            scalar best = nnList.back().second;
+            if (a.second - curNode->maxdistUB < best + scalar(1e-4)*(best + a.second))
+                active[kept++] = a;
+        }
+        active.resize(kept);
+        unsigned num_children = unsigned(curNode->children.size());
+        if (kept == 0 || num_children == 0)
+            continue;
+
+        // Distances of all children to all remaining sub-queries as one product,
+        // centred on the node so that the expansion of the norms stays accurate
+        block.resize(D, num_children);
+        sub.resize(D, kept);
+        for (unsigned i = 0; i < num_children; ++i)
+            block.col(i) = curNode->children[i]->_p - curNode->_p;
+        for (size_t j = 0; j < kept; ++j)
+            sub.col(j) = queries.col(active[j].first) - curNode->_p;
+        gram.noalias() = block.transpose() * sub;
+        pointType block_norms = block.colwise().squaredNorm().transpose();
+        pointType sub_norms = sub.colwise().squaredNorm().transpose();
+
+        local_idx.resize(num_children);
+        local_order.assign(num_children, std::numeric_limits<scalar>::max());
+        child_active.resize(std::max(child_active.size(), size_t(num_children)));
+        for (unsigned i = 0; i < num_children; ++i)
+        {
+            Node* child = curNode->children[i];
+            child_active[i].clear();
+            for (size_t j = 0; j < kept; ++j)
+            {
+                scalar d = std::sqrt(std::max(block_norms[i] + sub_norms[j] - 2*gram(i, j), scalar(0)));
+                scalar best = nnLists[active[j].first].back().second;
+                if (best + scalar(1e-4)*(best + d) > d - child->maxdistUB)
+                {
+                    child_active[i].emplace_back(active[j].first, d);
+                    local_order[i] = std::min(local_order[i], d);
+                }
+            }
+        }
+
+        // Closest children on top, as in kNearestNeighbours
+        std::iota(local_idx.begin(), local_idx.end(), 0);
+        std::sort(local_idx.begin(), local_idx.end(), comp_x);
+        for (const auto& child_idx : local_idx)
+        {
+            if (child_active[child_idx].empty())
+                continue;
+            travel.push_back({curNode->children[child_idx], pool.size(), unsigned(child_active[child_idx].size())});
+            pool.insert(pool.end(), child_active[child_idx].begin(), child_active[child_idx].end());
+        }
+    }
+
+    // Report exact distances, as the product form may be off in the last bits
+    for (unsigned q = 0; q < m; ++q)
+    {
+        for (auto& nn : nnLists[q])
+            if (nn.first != NULL)
+                nn.second = nn.first->dist(queries.col(q));
+        std::sort(nnLists[q].begin(), nnLists[q].end(), comp_pair);
+    }
+    return nnLists;
+}
+
+std::vector<std::pair<long, scalar>> SGTree::multiVectorSearch(const Eigen::Map<matrixType>& queries, unsigned numNbrs,
+                                                               const long* doc_of_uid, size_t num_uids,
+                                                               MultiVectorReduction reduction, unsigned numDocs) const
+{
+    std::vector<std::vector<std::pair<SGTree::Node*, scalar>>> nnLists = kNearestNeighboursMulti(queries, numNbrs);
+
+    // Scores are margins below the k-th distance of each sub-query, so that
+    // tokens retrieved for one sub-query and not another are comparable
+    std::unordered_map<long, scalar> scores;
+    std::unordered_map<long, scalar> best;
+    for (const auto& nnList : nnLists)
+    {
+        scalar radius = 0;
+        for (const auto& nn : nnList)
+            if (nn.first != NULL)
+                radius = nn.second;
+
+        best.clear();
+        for (const auto& nn : nnList)
+        {
+            if (nn.first == NULL)
+                continue;
+            long doc = doc_of_uid == nullptr ? long(nn.first->UID)
+                     : nn.first->UID < num_uids ? doc_of_uid[nn.first->UID] : -1L;
+            if (doc < 0)
+                continue;
+            scalar margin = radius - nn.second;
+            if (reduction == MultiVectorReduction::Sum)
+                scores[doc] += margin;
+            else
+            {
+                auto it = best.find(doc);
+                if (it == best.end())
+                    best.emplace(doc, margin);
+                else
+                    it->second = std::max(it->second, margin);
+            }
+        }
+        for (const auto& b : best)
+            scores[b.first] += b.second;
+    }
+
+    std::vector<std::pair<long, scalar>> ranked(scores.begin(), scores.end());
+    auto comp_score = [](const std::pair<long, scalar>& a, const std::pair<long, scalar>& b) {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    };
+    size_t top = std::min(size_t(numDocs), ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + top, ranked.end(), comp_score);
+    ranked.resize(top);
+    return ranked;
+}
+
+std::vector<std::pair<long, scalar>> SGTree::expand_duplicates(const std::vector<std::pair<SGTree::Node*, scalar>>& nnList, size_t limit)
+{
+    std::vector<std::pair<long, scalar>> expanded;
+    for (const auto& nn : nnList)
+    {
+        if (limit > 0 && expanded.size() >= limit)
+            break;
+        if (nn.first == NULL)
+            continue;
+        expanded.emplace_back(long(nn.first->UID), nn.second);
+        std::shared_lock<std::shared_timed_mutex> lock(nn.first->mut);
+        for (unsigned uid : nn.first->dup_uids)
+        {
+            if (limit > 0 && expanded.size() >= limit)
+                break;
+            expanded.emplace_back(long(uid), nn.second);
+        }
+    }
+    return expanded;
+}
+
+/****************************** Reverse k-Nearest Neighbours *************************************/
+
+// Tracked nodes with p closer than their k-th neighbour. A subtree is skipped when even its
+// closest possible point is further from p than the largest k-th distance in it.
+void SGTree::reverseNeighbours(const pointType& p, std::vector<std::pair<SGTree::Node*, scalar>>& found) const
+{
+    std::vector<std::pair<SGTree::Node*, scalar>> travel;
+    travel.emplace_back(root, root->dist(p));
+    while (travel.size() > 0)
+    {
+        SGTree::Node* curNode = travel.back().first;
+        scalar curDist = travel.back().second;
+        travel.pop_back();
+
+        scalar kthdist = curNode->kthdist.load(std::memory_order_relaxed);
+        if (kthdist >= 0 && curDist < kthdist)
+            found.emplace_back(curNode, curDist);
+
+        for (const auto& child : *curNode)
+        {
+            if (child->maxkthUB < 0)
+                continue;
+            scalar dist_child = child->dist(p);
+            if (dist_child - child->maxdistUB < child->maxkthUB)
+                travel.emplace_back(child, dist_child);
+        }
+    }
+}
+
+void SGTree::knn_update(const Eigen::Map<matrixType>& points, const long* UIDs, unsigned k, unsigned cores,
+                        std::vector<std::pair<long, scalar>>& forward,
+                        std::vector<std::vector<std::pair<unsigned, scalar>>>& reverse)
+{
+    cores = utils::pool_cores(cores);
+    const size_t numPoints = points.cols();
+    const scalar inf = std::numeric_limits<scalar>::infinity();
+    forward.assign(numPoints * k, std::make_pair(-1L, inf));
+    reverse.assign(numPoints, std::vector<std::pair<unsigned, scalar>>());
+
+    std::unordered_map<unsigned, size_t> batch;
+    for (size_t i = 0; i < numPoints; ++i)
+        batch[unsigned(UIDs[i])] = i;
+
+    // Forward lists, skipping the point itself
+    utils::parallel_for(0, numPoints, [&](size_t i)->void{
+        std::vector<std::pair<SGTree::Node*, scalar>> nnList = kNearestNeighbours(points.col(i), k + 1);
+        unsigned t = 0;
+        for (const auto& nn : nnList)
+        {
+            if (nn.first == NULL || t == k)
+                break;
+            if (nn.first->UID == unsigned(UIDs[i]))
+                continue;
+            forward[i * k + t++] = std::make_pair(long(nn.first->UID), nn.second);
+        }
+    }, cores);
+
+    QueryGuard guard(*this);
+
+    // The nodes of the batch and their ancestors, descending only into subtrees
+    // that can hold the point; a little slack against rounding in maxdistUB
+    std::vector<std::vector<SGTree::Node*>> paths(numPoints);
+    utils::parallel_for(0, numPoints, [&](size_t i)->void{
+        std::vector<std::pair<SGTree::Node*, size_t>> travel(1, std::make_pair(root, size_t(0)));
+        std::vector<SGTree::Node*> path;
+        while (travel.size() > 0)
+        {
+            SGTree::Node* current = travel.back().first;
+            path.resize(travel.back().second);
+            travel.pop_back();
+            path.push_back(current);
+            if (current->UID == unsigned(UIDs[i]))
+                paths[i].insert(paths[i].end(), path.begin(), path.end());
+            for (const auto& child : *current)
+            {
+                scalar dist_child = child->dist(points.col(i));
+                if (dist_child - child->maxdistUB < scalar(1e-4)*(1 + dist_child))
+                    travel.emplace_back(child, path.size());
+            }
+        }
+    }, cores);
+    std::vector<SGTree::Node*> touched;
+    for (const auto& path : paths)
+        touched.insert(touched.end(), path.begin(), path.end());
+    std::sort(touched.begin(), touched.end(), [](const SGTree::Node* a, const SGTree::Node* b) {
+        return a->level < b->level || (a->level == b->level && a < b);
+    });
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+    // Hand the lists to the nodes of the batch and tighten the summaries along
+    // their paths, children first; every other subtree keeps its summary
+    for (SGTree::Node* current : touched)
+    {
+        auto it = batch.find(current->UID);
+        if (it != batch.end())
+        {
+            current->knn_dists.clear();
+            for (unsigned t = 0; t < k && forward[it->second * k + t].first >= 0; ++t)
+                current->knn_dists.push_back(forward[it->second * k + t].second);
+            current->kthdist = current->knn_dists.size() < k ? inf : current->knn_dists.back();
+        }
+        current->maxkthUB = current->kthdist;
+        for (const auto& child : *current)
+            current->maxkthUB = std::max(current->maxkthUB, child->maxkthUB);
+    }
+
+    // Reverse lists; k-th distances only shrink, so the summaries stay upper bounds
+    utils::parallel_for(0, numPoints, [&](size_t i)->void{
+        std::vector<std::pair<SGTree::Node*, scalar>> found;
+        reverseNeighbours(points.col(i), found);
+        for (const auto& nn : found)
+        {
+            SGTree::Node* current = nn.first;
+            // the lists of the batch already hold each other
+            if (batch.count(current->UID) > 0)
+                continue;
+            std::unique_lock<std::shared_timed_mutex> lock(current->mut);
+            if (nn.second >= current->kthdist)
+                continue;
+            current->knn_dists.insert(std::upper_bound(current->knn_dists.begin(), current->knn_dists.end(), nn.second), nn.second);
+            if (current->knn_dists.size() > k)
+                current->knn_dists.pop_back();
+            if (current->knn_dists.size() == k)
+                current->kthdist = current->knn_dists.back();
+            reverse[i].emplace_back(current->UID, nn.second);
+        }
+        // copies of a node under nesting share its UID
+        std::sort(reverse[i].begin(), reverse[i].end());
+        reverse[i].erase(std::unique(reverse[i].begin(), reverse[i].end(),
+            [](const std::pair<unsigned, scalar>& a, const std::pair<unsigned, scalar>& b) { return a.first == b.first; }),
+            reverse[i].end());
+    }, cores);
+}
+
 /****************************** Range Neighbours Search *************************************/
 
 std::vector<std::pair<SGTree::Node*, scalar>> SGTree::rangeNeighbours(const pointType &p, scalar range) const
 {
+    QueryGuard guard(*this);
     // List of nearest neighbors in the range
     std::vector<std::pair<SGTree::Node*, scalar>> nnList;
 
@@ -719,17 +1548,21 @@ void SGTree::PrePost(SGTree::Node*& current, char*& pre, char*& post)
 
 size_t SGTree::msg_size() const
 {
+    // duplicates follow as a count and (ID, UID) pairs, only if there are any
+    size_t dups = num_duplicates.load();
     return 2 * sizeof(unsigned)
         + sizeof(pointType::Scalar)*D*N
         + sizeof(int)*N
         + sizeof(unsigned)*N*2
         + sizeof(scalar)*N
-        + sizeof(unsigned)*N;
+        + sizeof(unsigned)*N
+        + (dups > 0 ? sizeof(unsigned) + sizeof(unsigned)*dups*2 : 0);
 }
 
 // Serialize to a buffer
 char* SGTree::serialize() const
 {
+    QueryGuard guard(*this);
     //Covert following to char* buff with following order
     // N | D | (points, levels) | List
     char* buff = new char[msg_size()];
@@ -754,14 +1587,39 @@ char* SGTree::serialize() const
     pos = preorder_pack(pos, root);
     pos = postorder_pack(pos, root);
 
+    // insert duplicates
+    unsigned dups = num_duplicates.load();
+    if (dups > 0)
+    {
+        std::copy((char*)&dups, (char*)&dups + sizeof(unsigned), pos);
+        pos += sizeof(unsigned);
+        std::stack<SGTree::Node*> travel;
+        travel.push(root);
+        while (travel.size() > 0 && dups > 0)
+        {
+            SGTree::Node* current = travel.top();
+            travel.pop();
+            for (unsigned i = 0; i < current->dup_uids.size() && dups > 0; ++i, --dups)
+            {
+                std::copy((char*)&(current->ID), (char*)&(current->ID) + sizeof(unsigned), pos);
+                pos += sizeof(unsigned);
+                std::copy((char*)&(current->dup_uids[i]), (char*)&(current->dup_uids[i]) + sizeof(unsigned), pos);
+                pos += sizeof(unsigned);
+            }
+            for (const auto& child : *current)
+                travel.push(child);
+        }
+    }
+
     //std::cout<<"Message size: " << msg_size() << ", " << pos - buff << std::endl;
 
     return buff;
 }
 
 // Deserialize from a buffer
-void SGTree::deserialize(char* buff)
+void SGTree::deserialize(char* buff, size_t len)
 {
+    char* start = buff;
     /** Convert char* buff into following buff = N | D | (points, levels) | List **/
     //char* save = buff;
 
@@ -780,6 +1638,35 @@ void SGTree::deserialize(char* buff)
     //reconstruction
     PrePost(root, buff, post);
 
+    // duplicates, present if the buffer is longer than the nodes
+    num_duplicates = 0;
+    if (size_t(post - start) + sizeof(unsigned) <= len)
+    {
+        unsigned dups = *((unsigned *)post);
+        post += sizeof(unsigned);
+        std::unordered_map<unsigned, SGTree::Node*> nodes;
+        std::stack<SGTree::Node*> travel;
+        travel.push(root);
+        while (travel.size() > 0)
+        {
+            SGTree::Node* current = travel.top();
+            travel.pop();
+            nodes[current->ID] = current;
+            for (const auto& child : *current)
+                travel.push(child);
+        }
+        for (unsigned i = 0; i < dups; ++i, post += 2 * sizeof(unsigned))
+        {
+            auto it = nodes.find(*((unsigned *)post));
+            if (it != nodes.end())
+            {
+                it->second->dup_uids.push_back(*((unsigned *)(post + sizeof(unsigned))));
+                num_duplicates.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    version.fetch_add(1, std::memory_order_release);
+
     //delete[] save;
 }
 
@@ -819,7 +1706,8 @@ SGTree::SGTree(const pointType& p, int truncateArg /*=-1*/)
 }
 
 //constructor: cover tree using points in the list between begin and end
-SGTree::SGTree(const Eigen::Map<matrixType>& pMatrix, int truncateArg /*=-1*/, unsigned cores /*=true*/, double new_base)
+SGTree::SGTree(const Eigen::Map<matrixType>& pMatrix, int truncateArg /*=-1*/, unsigned cores /*=true*/, double new_base, size_t medoid_sample /*=0*/,
+               utils::Progress* progress /*=nullptr*/)
 {
     size_t numPoints = pMatrix.cols();
     bool use_multi_core = cores > 1;
@@ -830,25 +1718,17 @@ SGTree::SGTree(const Eigen::Map<matrixType>& pMatrix, int truncateArg /*=-1*/, u
     powdict = compute_pow_table();
     std::cout << "SG Tree with base " << base << std::endl;
 
-    //1. Compute the mean of entire data
-    pointType mx = utils::ParallelAddMatrixNP(pMatrix).get_result()/(1.0*numPoints);
-
-    //2. Compute distance of every point from the mean || Variance
-    pointType dists = utils::ParallelDistanceComputeNP(pMatrix, mx).get_result();
-
-    //3. argsort the distance to find approximate mediod
-    std::vector<size_t> idx(numPoints);
-    std::iota(std::begin(idx), std::end(idx), 0);
-    auto comp_x = [&dists](size_t a, size_t b) { return dists[a] > dists[b]; };
-    std::sort(std::begin(idx), std::end(idx), comp_x);
+    //1-3. Mean, distance of every point from it and argsort to find approximate mediod,
+    //     on the shared thread pool (mean and mediod from a sample if medoid_sample > 0)
+    utils::BuildOrder order = utils::build_order(pMatrix, cores, medoid_sample);
+    const std::vector<size_t>& idx = order.order;
     std::cout<<"numPoints: " << numPoints << std::endl;
-    std::cout<<"Max distance: " << dists[idx[0]] << std::endl;
-    std::cout<<"Min distance: " << dists[idx[numPoints-1]] << std::endl;
+    std::cout<<"Max distance: " << order.dists[idx[0]] << std::endl;
+    std::cout<<"Min distance: " << order.dists[idx[numPoints-1]] << std::endl;
 
-    //4. Compute distance of every point from the mediod
-    mx = pMatrix.col(idx[numPoints-1]);
-    dists = utils::ParallelDistanceComputeNP(pMatrix, mx).get_result();
-    scalar max_dist = dists.maxCoeff();
+    //4. Distance of the farthest point from the mediod
+    pointType mx = pMatrix.col(idx[numPoints-1]);
+    scalar max_dist = order.max_dist;
 
     int scale_val = int(std::ceil(std::log(max_dist)/std::log(base)));
     std::cout<<"Scale chosen: " << scale_val << std::endl;
@@ -866,37 +1746,30 @@ SGTree::SGTree(const Eigen::Map<matrixType>& pMatrix, int truncateArg /*=-1*/, u
     root->UID = idx[numPoints-1];
 
     std::cout << "(" << pMatrix.rows() << ", " << pMatrix.cols() << ")" << std::endl;
-    if (use_multi_core)
+    // Inserts stop early, leaving a smaller tree, once progress is cancelled
+    if (use_multi_core && numPoints > 50000)
     {
-        if (50000 >= numPoints)
         {
-            for (size_t i = 0; i < numPoints-1; ++i){
+            utils::Reporter reporter(50000, progress);
+            for (size_t i = 0; i < 50000 && reporter.tick(i); ++i){
                 // std::cout << "Insert i " << i << " idx[i] " << idx[i] << std::endl;
-                utils::progressbar(i, numPoints);
                 insert(pMatrix.col(idx[i]), idx[i]);
             }
+            built = !reporter.stopped_early();
         }
-        else
-        {
-            for (size_t i = 0; i < 50000; ++i){
+        if (built)
+            built = utils::parallel_for_progressbar(50000, numPoints-1, [&](size_t i)->void{
                 // std::cout << "Insert i " << i << " idx[i] " << idx[i] << std::endl;
-                utils::progressbar(i, 50000);
                 insert(pMatrix.col(idx[i]), idx[i]);
-            }
-            utils::progressbar(50000, 50000);
-            std::cerr<<std::endl;
-            utils::parallel_for_progressbar(50000, numPoints-1, [&](size_t i)->void{
-                // std::cout << "Insert i " << i << " idx[i] " << idx[i] << std::endl;
-                insert(pMatrix.col(idx[i]), idx[i]);
-            }, cores);
-        }
+            }, cores, progress);
     }
     else
     {
-        for (size_t i = 0; i < numPoints-1; ++i){
-            utils::progressbar(i, numPoints);
+        utils::Reporter reporter(numPoints-1, progress);
+        for (size_t i = 0; i < numPoints-1 && reporter.tick(i); ++i){
             insert(pMatrix.col(idx[i]), idx[i]);
         }
+        built = !reporter.stopped_early();
     }
    // calc_maxdist();
    // print_stats();
@@ -938,15 +1811,104 @@ SGTree* SGTree::from_matrix(const Eigen::Map<matrixType>& pMatrix, int truncate
 }
 
 //contructor: using matrix in col-major form!
-SGTree* SGTree::from_matrix(const Eigen::Map<matrixType>& pMatrix, int truncate /*=-1*/, unsigned cores /*=true*/, double new_base)
+SGTree* SGTree::from_matrix(const Eigen::Map<matrixType>& pMatrix, int truncate /*=-1*/, unsigned cores /*=true*/, double new_base, size_t medoid_sample /*=0*/,
+                            utils::Progress* progress /*=nullptr*/)
 {
     std::cout << "SG Tree [v008] with base " << new_base << std::endl;
     std::cout << "SG Tree with Number of Cores: " << cores << std::endl;
-    SGTree* cTree = new SGTree(pMatrix, truncate, cores, new_base);
+    SGTree* cTree = new SGTree(pMatrix, truncate, cores, new_base, medoid_sample, progress);
+    if (!cTree->built)
+    {
+        delete cTree;
+        return NULL;
+    }
     return cTree;
 }
 
 
+//pick the base: trial trees at two sample sizes give the cost per query and its growth with the size
+double SGTree::tune_base(const Eigen::Map<matrixType>& pMatrix, const std::vector<double>& candidates,
+                         unsigned sample_size, unsigned num_queries, unsigned k, unsigned cores, std::string& report)
+{
+    size_t numPoints = pMatrix.cols();
+    size_t dim = pMatrix.rows();
+    if (candidates.size() == 0 || numPoints < 4)
+    {
+        report = "Too few candidates or points to tune, using the default base.\n";
+        return base_default;
+    }
+
+    // Random held out queries and a random sample to build on
+    num_queries = std::max(1u, std::min(num_queries, unsigned(numPoints/10)));
+    size_t n2 = std::min(size_t(sample_size), numPoints - num_queries);
+    size_t n1 = std::max(n2/4, size_t(2));
+    std::vector<size_t> perm(numPoints);
+    std::iota(std::begin(perm), std::end(perm), 0);
+    std::mt19937 gen(0);
+    std::shuffle(perm.begin(), perm.end(), gen);
+    matrixType sample(dim, n2);
+    for (size_t i = 0; i < n2; ++i)
+        sample.col(i) = pMatrix.col(perm[i]);
+    matrixType queries(dim, num_queries);
+    for (size_t i = 0; i < num_queries; ++i)
+        queries.col(i) = pMatrix.col(perm[numPoints - 1 - i]);
+
+    // Distance evaluations per query at size n; the time per query (best of two runs) is
+    // measured too, as it also pays for the nodes visited, which a larger base makes fewer
+    auto evals_per_query = [&](size_t n, double new_base, double& usec)->double{
+        Eigen::Map<matrixType> part(sample.data(), dim, n);
+        SGTree trial(part, -1, cores, new_base);
+        size_t evals = 0;
+        usec = std::numeric_limits<double>::max();
+        for (int run = 0; run < 2; ++run)
+        {
+            evals = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < num_queries; ++i)
+                trial.kNearestNeighbours(queries.col(i), k, &evals);
+            std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+            usec = std::min(usec, elapsed.count() / num_queries);
+        }
+        return double(evals) / num_queries;
+    };
+
+    std::vector<double> cost1, cost2, usec2, growth, predicted;
+    for (const auto& b : candidates)
+    {
+        double usec;
+        cost1.push_back(evals_per_query(n1, b, usec));
+        cost2.push_back(evals_per_query(n2, b, usec));
+        usec2.push_back(usec);
+        // evaluations ~ n^growth, between logarithmic (0) and brute force (1)
+        double g = n2 > n1 ? std::log(cost2.back()/cost1.back()) / std::log(double(n2)/n1) : 1.0;
+        growth.push_back(std::min(std::max(g, 0.0), 1.0));
+        predicted.push_back(usec2.back() * std::pow(double(numPoints)/n2, growth.back()));
+    }
+    size_t best = std::min_element(predicted.begin(), predicted.end()) - predicted.begin();
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    out << "Base tuning on " << n2 << " of " << numPoints << " points, "
+        << num_queries << " held out queries, k=" << k << std::endl;
+    out << "  base  evals@" << n1 << "  evals@" << n2 << "  growth  usec@" << n2 << "  predicted usec@" << numPoints << std::endl;
+    for (size_t i = 0; i < candidates.size(); ++i)
+        out << "  " << std::setprecision(2) << candidates[i] << std::setprecision(1)
+            << "  " << cost1[i] << "  " << cost2[i] << "  " << std::setprecision(2) << growth[i]
+            << std::setprecision(1) << "  " << usec2[i] << "  " << predicted[i] << (i == best ? "  <-" : "") << std::endl;
+    out << "Chose base " << std::setprecision(2) << candidates[best] << std::setprecision(1) << ": "
+        << predicted[best] << " usec per query predicted at full scale, "
+        << cost2[best] * std::pow(double(numPoints)/n2, growth[best]) << " distance evaluations";
+    for (size_t i = 0; i < candidates.size(); ++i)
+        if (i != best && std::abs(candidates[i] - base_default) < 1e-6)
+            out << ", " << 100.0*(1.0 - predicted[best]/predicted[i]) << "% faster than the default base "
+                << std::setprecision(2) << base_default << std::setprecision(1);
+    out << "." << std::endl;
+    report = out.str();
+
+    return candidates[best];
+}
+
+
 /******************************************* Unit/Stat Testing ***************************************************/
 
 bool SGTree::check_covering() const
@@ -978,6 +1940,125 @@ bool SGTree::check_covering() const
     return result;
 }
 
+SGTree::Verification SGTree::verify(unsigned checks, unsigned cores, size_t max_report, bool early_exit) const
+{
+    Verification result;
+    QueryGuard guard(*this);
+    if (root == NULL)
+        return result;
+
+    // distances are recomputed in another order than when the bounds were set
+    const scalar slack = scalar(1e-5);
+
+    std::mutex mtx;
+    std::atomic<size_t> num_nodes(0);
+    std::atomic<size_t> num_violations(0);
+    std::atomic<bool> stop(false);
+    auto report = [&](Check check, const SGTree::Node* at, const SGTree::Node* other, scalar dist, scalar bound)->void{
+        size_t found = num_violations.fetch_add(1) + 1;
+        if (found <= max_report)
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            result.first.push_back({check, at->UID, other->UID, at->level, dist, bound});
+        }
+        if (early_exit && found >= max_report)
+            stop = true;
+    };
+
+    // Checks between a node and its children
+    auto check_children = [&](SGTree::Node* current)->void{
+        const scalar covdist = current->covdist(powdict);
+        const scalar sepdist = current->sepdist(powdict);
+        for (const auto& child : *current)
+        {
+            scalar d = current->dist(child);
+            if ((checks & Covering) && d > covdist + slack*(covdist + d))
+                report(Covering, current, child, d, covdist);
+            if ((checks & Nesting) && child->UID == current->UID && d > 0)
+                report(Nesting, current, child, d, 0);
+            if ((checks & Levels) && child->level != current->level - 1)
+                report(Levels, current, child, scalar(child->level), scalar(current->level - 1));
+        }
+        // nested copies stand for their parent and are not separated from the other children
+        if (checks & Separation)
+            for (size_t i = 0; i < current->children.size() && !stop; ++i)
+            {
+                SGTree::Node* a = current->children[i];
+                if (a->UID == current->UID)
+                    continue;
+                for (size_t j = i + 1; j < current->children.size(); ++j)
+                {
+                    SGTree::Node* b = current->children[j];
+                    if (b->UID == current->UID)
+                        continue;
+                    scalar d = a->dist(b);
+                    if (d < sepdist - slack*(sepdist + d))
+                        report(Separation, a, b, d, sepdist);
+                }
+            }
+    };
+
+    // Units of work: the coarsest subtrees are split until there are enough for every thread;
+    // a split node is checked on its own, every unit with the path above it for maxdistUB
+    struct Unit
+    {
+        SGTree::Node* node;
+        std::vector<SGTree::Node*> path;
+        bool whole;
+    };
+    std::vector<Unit> units(1, Unit{root, {}, true});
+    size_t target = 4 * size_t(utils::pool_cores(cores));
+    while (units.size() < target)
+    {
+        size_t top = units.size();
+        for (size_t i = 0; i < units.size(); ++i)
+            if (units[i].whole && units[i].node->children.size() > 0 && (top == units.size() || units[i].node->level > units[top].node->level))
+                top = i;
+        if (top == units.size())
+            break;
+        units[top].whole = false;
+        std::vector<SGTree::Node*> path = units[top].path;
+        path.push_back(units[top].node);
+        for (const auto& child : *units[top].node)
+            units.push_back(Unit{child, path, true});
+    }
+
+    utils::ThreadPool::shared().run(units.size(), [&](size_t u)->void{
+        std::vector<SGTree::Node*> ancestors = units[u].path;
+        const size_t depth0 = ancestors.size();
+        std::vector<std::pair<SGTree::Node*, size_t>> travel(1, std::make_pair(units[u].node, depth0));
+        size_t visited = 0;
+        while (travel.size() > 0 && !stop)
+        {
+            SGTree::Node* current = travel.back().first;
+            ancestors.resize(travel.back().second);
+            travel.pop_back();
+            ++visited;
+
+            if (checks & MaxDist)
+                for (const auto& a : ancestors)
+                {
+                    scalar d = a->dist(current);
+                    if (d > a->maxdistUB + slack*(a->maxdistUB + d))
+                        report(MaxDist, a, current, d, a->maxdistUB);
+                }
+            check_children(current);
+
+            if (!units[u].whole)
+                break;
+            ancestors.push_back(current);
+            for (const auto& child : *current)
+                travel.emplace_back(child, ancestors.size());
+        }
+        num_nodes += visited;
+    }, cores);
+
+    result.nodes = num_nodes.load();
+    result.violations = num_violations.load();
+    result.complete = !stop;
+    return result;
+}
+
 void SGTree::dump_tree(FILE* fp, SGTree::Node* node, int root_lvl, std::vector<std::vector<int>>& fanout_stats, std::vector<std::vector<float>>& distance_stats) const {
     fprintf(fp, "{\"d\":%f,", node->maxdistUB);
     fprintf(fp, "\"c\":[");
@@ -27,6 +27,7 @@
 #include <shared_mutex>
 #include <stack>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <cstdio>
 
@@ -50,7 +51,12 @@ public:
         scalar maxdistUB;                   // upper bound of distance to any of descendants
         unsigned ID;                        // mutable ID of current node
         unsigned UID;                       // external unique ID for current node
+        std::vector<unsigned> dup_uids;     // UIDs of points inserted at distance 0 from _p
         std::string ext_prop;               // external encoded propertoes of current node
+        std::vector<scalar> knn_dists;      // sorted distances to the neighbours tracked by knn_update
+        std::atomic<scalar> kthdist{-1};    // k-th of them (infinite while fewer), negative if untracked;
+                                            // written under mut, read without it by reverseNeighbours
+        scalar maxkthUB = -1;               // upper bound of kthdist of any of descendants
 
         mutable std::shared_timed_mutex mut;// lock for current node
 
@@ -152,18 +158,71 @@ protected:
     std::atomic<int> max_scale;         // Minimum scale
     int truncate_level;                 // Relative level below which the tree is truncated
     bool id_valid;
+    bool built = true;                  // false if a build from a matrix was cancelled before its last point
 
     scalar* compute_pow_table();
     scalar* powdict;
 
     std::atomic<unsigned> N;            // Number of points in the cover tree
+    std::atomic<unsigned> num_duplicates{0};    // Number of points kept as dup_uids of a node
     unsigned D;                         // Dimension of the points
 
-    std::shared_timed_mutex global_mut;	// lock for changing the root
+    mutable std::shared_timed_mutex global_mut;	// lock for changing the root or swapping subtrees
+    std::atomic<size_t> version{0};     // bumped after every change to the set of points
+
+    // Queries hold global_mut only while a restructure (a rebalancer pass or
+    // a merge) may free nodes. Otherwise they only count themselves in a
+    // per-thread shard, padded to its own cache line, which a starting
+    // restructure waits to drain.
+    struct ReaderShard
+    {
+        std::atomic<long> count{0};
+        char pad[64 - sizeof(std::atomic<long>)];
+    };
+    static constexpr unsigned reader_shards = 16;
+    mutable ReaderShard unlocked_readers[reader_shards];
+    std::atomic<unsigned> restructuring{0};
+
+    class QueryGuard
+    {
+        const SGTree& tree;
+        std::atomic<long>* unlocked = nullptr;
+    public:
+        explicit QueryGuard(const SGTree& tree);
+        ~QueryGuard();
+    };
+    void begin_restructure();
+    void end_restructure();
+    struct RestructureScope
+    {
+        SGTree& tree;
+        explicit RestructureScope(SGTree& tree) : tree(tree) { tree.begin_restructure(); }
+        ~RestructureScope() { tree.end_restructure(); }
+    };
 
     /*** Insertion helper function ***/
     bool insert(Node* current, const pointType& p, unsigned UID, scalar curr_dist);
 
+    /*** Merge helper functions ***/
+    bool merge(Node* current, Node* sub, scalar dist_current, int room);
+    void merge_unit(Node* sub, const std::unordered_map<const Node*, int>& room);
+    void merge_room(Node* sub, std::unordered_map<const Node*, int>& room) const;
+    void adopt(Node* sub, int shift);
+
+    /*** Reverse kNN helper function ***/
+    void reverseNeighbours(const pointType& p, std::vector<std::pair<Node*, scalar>>& found) const;
+
+    /*** Read-only shared image of the tree ***/
+    friend class FlatSGTree;
+    /*** Write-ahead insert log restores snapshots ***/
+    friend class InsertLog;
+    /*** Background rebuilding of degraded subtrees ***/
+    friend class SubtreeRebalancer;
+    /*** Flat copy of the top levels for batched kNN ***/
+    friend class RoutingTable;
+    /*** Subtree sizes for range counts and kernel sums ***/
+    friend class DensityIndex;
+
     /*** Serialize/Desrialize helper function ***/
     char* preorder_pack(char* buff, Node* current) const;       // Pre-order traversal
     char* postorder_pack(char* buff, Node* current) const;      // Post-order traversal
@@ -176,8 +235,9 @@ public:
     SGTree(int truncate = -1);
     // cover tree with one point as root
     SGTree(const pointType& p, int truncate = -1);
-    // cover tree using points in the list between begin and end
-    SGTree(const Eigen::Map<matrixType>& pMatrix, int truncate = -1, unsigned cores = -1, double new_base = 1.3);
+    // cover tree using points in the list between begin and end, counting the inserts into progress
+    SGTree(const Eigen::Map<matrixType>& pMatrix, int truncate = -1, unsigned cores = -1, double new_base = 1.3, size_t medoid_sample = 0,
+           utils::Progress* progress = nullptr);
 
     /*** Destructor ***/
     /*** Destructor: deallocating all memories by a post order traversal ***/
@@ -186,7 +246,13 @@ public:
 /************************* Public API ***********************************************/
     /*** Construct cover tree using all points in the matrix in row-major form ***/
     static SGTree* from_matrix(const Eigen::Map<matrixType>& pMatrix, int truncate = -1, unsigned cores = -1);
-    static SGTree* from_matrix(const Eigen::Map<matrixType>& pMatrix, int truncate = -1, unsigned cores = -1, double new_base = 1.3);
+    /*** NULL if progress was cancelled before every point was inserted ***/
+    static SGTree* from_matrix(const Eigen::Map<matrixType>& pMatrix, int truncate = -1, unsigned cores = -1, double new_base = 1.3, size_t medoid_sample = 0,
+                               utils::Progress* progress = nullptr);
+
+    /*** Pick the base with the lowest predicted kNN cost from trial trees on a sample ***/
+    static double tune_base(const Eigen::Map<matrixType>& pMatrix, const std::vector<double>& candidates,
+                            unsigned sample_size, unsigned num_queries, unsigned k, unsigned cores, std::string& report);
 
     /*** Get root ***/
     Node* get_root() {return root;}
@@ -194,6 +260,9 @@ public:
     /*** Insert point p into the cover tree ***/
     bool insert(const pointType& p, unsigned UID);
 
+    /*** Move all points of other into this tree, attaching its subtrees whole wherever they fit ***/
+    bool merge(SGTree& other, unsigned uid_offset = 0, unsigned cores = -1);
+
     /*** Remove point p into the cover tree ***/
     bool remove(const pointType& p) {return false;}
 
@@ -202,8 +271,24 @@ public:
     std::pair<SGTree::Node*, scalar> NearestNeighbour(const pointType &p, std::vector<std::pair<int,int>>& trace) const;
 
     /*** k-Nearest Neighbour search ***/
-    std::vector<std::pair<SGTree::Node*, scalar>> kNearestNeighbours(const pointType &p, unsigned k = 10) const;
+    std::vector<std::pair<SGTree::Node*, scalar>> kNearestNeighbours(const pointType &p, unsigned k = 10, size_t* dist_evals = nullptr) const;
     std::vector<std::pair<SGTree::Node*, scalar>> kNearestNeighboursBeam(const pointType &p, unsigned numNbrs, unsigned beamSize) const;
+    /*** Exact k-Nearest Neighbour search of one query on up to cores threads ***/
+    std::vector<std::pair<SGTree::Node*, scalar>> kNearestNeighboursParallel(const pointType &p, unsigned k, unsigned cores) const;
+    /*** Multi-vector search: one traversal for all columns of queries, child distances as one product per node ***/
+    std::vector<std::vector<std::pair<SGTree::Node*, scalar>>> kNearestNeighboursMulti(const Eigen::Map<matrixType>& queries, unsigned k) const;
+    enum class MultiVectorReduction { MaxSim, Sum };
+    // Top numDocs documents (doc_of_uid[UID], or the UID itself if null) scored over the k neighbours of every query vector
+    std::vector<std::pair<long, scalar>> multiVectorSearch(const Eigen::Map<matrixType>& queries, unsigned k,
+                                                           const long* doc_of_uid, size_t num_uids,
+                                                           MultiVectorReduction reduction, unsigned numDocs) const;
+    /*** UIDs of the result nodes followed by their duplicates, at most limit of them (0 for all) ***/
+    static std::vector<std::pair<long, scalar>> expand_duplicates(const std::vector<std::pair<Node*, scalar>>& nnList, size_t limit = 0);
+    /*** Streaming kNN graph: k neighbours of each point of a batch already inserted into the tree, and
+         for each of them the tracked points (UID, distance) that now have it among their k nearest ***/
+    void knn_update(const Eigen::Map<matrixType>& points, const long* UIDs, unsigned k, unsigned cores,
+                    std::vector<std::pair<long, scalar>>& forward,
+                    std::vector<std::vector<std::pair<unsigned, scalar>>>& reverse);
     /*** Range search ***/
     std::vector<std::pair<SGTree::Node*, scalar>> rangeNeighbours(const pointType &queryPt, scalar range = 1.0) const;
 
@@ -213,10 +298,32 @@ public:
     /*** Serialize/Desrialize: useful for Pickling ***/
     char* serialize() const;                                    // Serialize to a buffer
     size_t msg_size() const;
-    void deserialize(char* buff);                               // Deserialize from a buffer
+    void deserialize(char* buff, size_t len = 0);               // Deserialize from a buffer, len is needed for duplicates
 
     /*** Unit Tests ***/
     bool check_covering() const;
+
+    /*** Invariant checks of verify, or-ed together ***/
+    enum Check { Covering = 1, Separation = 2, Nesting = 4, MaxDist = 8, Levels = 16, AllChecks = 31 };
+    struct Violation
+    {
+        Check check;
+        unsigned UID;                   // node at fault, the ancestor for MaxDist
+        unsigned other;                 // child, sibling or descendant involved
+        int level;                      // level of the node at fault
+        scalar dist;                    // distance found (child level for Levels)
+        scalar bound;                   // bound it breaks
+    };
+    struct Verification
+    {
+        size_t nodes = 0;               // nodes checked
+        size_t violations = 0;          // violations found
+        bool complete = true;           // false if stopped early
+        std::vector<Violation> first;   // the first max_report of them
+    };
+    /*** Check invariants over subtrees on up to cores threads, stopping after max_report violations if early_exit;
+         not to be run concurrently with inserts ***/
+    Verification verify(unsigned checks = AllChecks, unsigned cores = -1, size_t max_report = 10, bool early_exit = false) const;
     void dump_tree(FILE* fp, SGTree::Node* node, int root_lvl, std::vector<std::vector<int>>& fanout_stats, std::vector<std::vector<float>>& distance_stats) const;
     void dump_tree(const char* filename) const;
     void print_stats() const;
@@ -230,7 +337,9 @@ public:
     friend std::ostream& operator<<(std::ostream& os, const SGTree& ct);
 
     void calc_maxdist();
-    int get_tree_size() {return N.load();}
+    int get_tree_size() {return N.load() + num_duplicates.load();}
+    unsigned get_dim() const {return D;}
+    size_t get_version() const {return version.load(std::memory_order_acquire);}
  
     };
 
@@ -20,6 +20,15 @@
 #include <Python.h>
 #include "numpy/arrayobject.h"
 #include "sg_tree.h"
+#include "flat_sg_tree.h"
+#include "insert_log.h"
+#include "rebalancer.h"
+#include "query_batcher.h"
+#include "query_cache.h"
+#include "routing_table.h"
+#include "density_index.h"
+#include "flat_index.h"
+#include "query_tracer.h"
 
 #include <future>
 #include <thread>
@@ -34,10 +43,13 @@ static PyObject *new_sgtreec(PyObject *self, PyObject *args)
   int trunc;
   long use_multi_core;
   double new_base;
+  Py_ssize_t medoid_sample = 0;
+  size_t progress_ptr = 0;
   PyArrayObject *in_array;
 
-  if (!PyArg_ParseTuple(args,"O!ild:new_sgtreec", &PyArray_Type, &in_array, &trunc, &use_multi_core, &new_base))
+  if (!PyArg_ParseTuple(args,"O!ild|nn:new_sgtreec", &PyArray_Type, &in_array, &trunc, &use_multi_core, &new_base, &medoid_sample, &progress_ptr))
     return NULL;
+  utils::Progress *progress = reinterpret_cast< utils::Progress * >(progress_ptr);
 
   npy_intp numPoints = PyArray_DIM(in_array, 0);
   npy_intp numDims = PyArray_DIM(in_array, 1);
@@ -46,7 +58,16 @@ static PyObject *new_sgtreec(PyObject *self, PyObject *args)
   scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
   Eigen::Map<matrixType> pointMatrix(fnp, numDims, numPoints);
 
-  SGTree* cTree = SGTree::from_matrix(pointMatrix, trunc, use_multi_core, new_base);
+  SGTree* cTree;
+  Py_BEGIN_ALLOW_THREADS
+  cTree = SGTree::from_matrix(pointMatrix, trunc, use_multi_core, new_base, size_t(std::max(medoid_sample, Py_ssize_t(0))), progress);
+  Py_END_ALLOW_THREADS
+  // NULL only if the build stopped before its last point
+  if (cTree == NULL)
+  {
+    PyErr_Format(SGtreecError, "cancelled");
+    return NULL;
+  }
   size_t int_ptr = reinterpret_cast< size_t >(cTree);
   size_t node_ptr = reinterpret_cast< size_t >(cTree->get_root());
 
@@ -68,6 +89,32 @@ static PyObject *delete_sgtreec(PyObject *self, PyObject *args)
 }
 
 
+static PyObject *sgtreec_tune_base(PyObject *self, PyObject *args)
+{
+  PyArrayObject *in_array;
+  PyArrayObject *base_array;
+  unsigned sample_size;
+  unsigned num_queries;
+  unsigned k;
+  long use_multi_core;
+
+  if (!PyArg_ParseTuple(args, "O!O!IIIl:sgtreec_tune_base", &PyArray_Type, &in_array, &PyArray_Type, &base_array, &sample_size, &num_queries, &k, &use_multi_core))
+    return NULL;
+
+  npy_intp idx[2] = {0,0};
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> pointMatrix(fnp, PyArray_DIM(in_array, 1), PyArray_DIM(in_array, 0));
+
+  double * bnp = reinterpret_cast< double * >( PyArray_DATA(base_array) );
+  std::vector<double> candidates(bnp, bnp + PyArray_SIZE(base_array));
+
+  unsigned cores = use_multi_core < 0 ? std::thread::hardware_concurrency() : std::max((unsigned) use_multi_core, 1u);
+  std::string report;
+  double base = SGTree::tune_base(pointMatrix, candidates, sample_size, num_queries, k, cores, report);
+
+  return Py_BuildValue("ds", base, report.c_str());
+}
+
 static PyObject *sgtreec_insert(PyObject *self, PyObject *args) {
 
   SGTree *obj;
@@ -98,12 +145,14 @@ static PyObject *sgtreec_batchinsert(PyObject *self, PyObject *args) {
   SGTree *obj;
   size_t int_ptr;
   long use_multi_core;
+  size_t progress_ptr = 0;
   PyArrayObject *in_array;
   PyArrayObject *uid_array;
 
   /*  parse the input, from python int to c++ int */
-  if (!PyArg_ParseTuple(args, "nO!O!l:sgtreec_batchinsert", &int_ptr, &PyArray_Type, &in_array, &PyArray_Type, &uid_array, &use_multi_core))
+  if (!PyArg_ParseTuple(args, "nO!O!l|n:sgtreec_batchinsert", &int_ptr, &PyArray_Type, &in_array, &PyArray_Type, &uid_array, &use_multi_core, &progress_ptr))
     return NULL;
+  utils::Progress *progress = reinterpret_cast< utils::Progress * >(progress_ptr);
 
   // int d = PyArray_NDIM(in_array);
   npy_intp idx[2] = {0,0};
@@ -122,19 +171,30 @@ static PyObject *sgtreec_batchinsert(PyObject *self, PyObject *args) {
 
   obj = reinterpret_cast< SGTree * >(int_ptr);
   // std::cout << "sgtreec_batchinsert use_multi_core " << use_multi_core << std::endl;
+  bool finished;
+  Py_BEGIN_ALLOW_THREADS
   if(use_multi_core > 0)
   {
-      utils::parallel_for_progressbar(0, numPoints, [&](npy_intp i)->void{
+      finished = utils::parallel_for_progressbar(0, numPoints, [&](npy_intp i)->void{
           if(!obj->insert(insPts.col(i), unp[i]))
                     std::cout << "Insert failed!!! " << unp[i] << std::endl;
-      }, use_multi_core);
+      }, use_multi_core, progress);
   }
   else
   {
-      for(npy_intp i = 0; i < numPoints; ++i) {
+      utils::Reporter reporter(numPoints, progress, false);
+      for(npy_intp i = 0; i < numPoints && reporter.tick(i); ++i) {
 		  if(!obj->insert(insPts.col(i), unp[i]))
                     std::cout << "Insert failed!!! " << unp[i] << std::endl;
 	  }
+      finished = !reporter.stopped_early();
+  }
+  Py_END_ALLOW_THREADS
+  // the points inserted before the cancellation stay in the tree
+  if (!finished)
+  {
+    PyErr_Format(SGtreecError, "cancelled");
+    return NULL;
   }
 
   Py_RETURN_NONE;
@@ -171,10 +231,10 @@ static PyObject *sgtreec_nn(PyObject *self, PyObject *args) {
   int return_points;
   PyArrayObject *in_array;
   PyObject *return_value; 
-  const char* filename;
+  size_t tracer_ptr = 0;
 
   /*  parse the input, from python int to c++ int */
-  if (!PyArg_ParseTuple(args, "nO!lps:sgtreec_nn", &int_ptr, &PyArray_Type, &in_array, &cores, &return_points, &filename))
+  if (!PyArg_ParseTuple(args, "nO!lp|n:sgtreec_nn", &int_ptr, &PyArray_Type, &in_array, &cores, &return_points, &tracer_ptr))
     return NULL;
 
   unsigned use_multi_core = (unsigned) cores;
@@ -186,6 +246,18 @@ static PyObject *sgtreec_nn(PyObject *self, PyObject *args) {
   Eigen::Map<matrixType> queryPts(fnp, numDims, numPoints);
 
   obj = reinterpret_cast< SGTree * >(int_ptr);
+  QueryTracer *tracer = reinterpret_cast< QueryTracer * >(tracer_ptr);
+
+  // Untraced queries take the plain path, sampled ones record into the ring of their thread
+  auto nearest = [obj, tracer](const pointType& p)->std::pair<SGTree::Node*, scalar>{
+    if (tracer == NULL || !tracer->sample())
+      return obj->NearestNeighbour(p);
+    thread_local std::vector<std::pair<int,int>> trace;
+    trace.clear();
+    std::pair<SGTree::Node*, scalar> nn = obj->NearestNeighbour(p, trace);
+    tracer->record(trace);
+    return nn;
+  };
 
   #ifdef PRINTVER
   SGTree::Node::dist_count.clear();
@@ -194,14 +266,13 @@ static PyObject *sgtreec_nn(PyObject *self, PyObject *args) {
   scalar *dist = new scalar[numPoints];
   long *indices = new long[numPoints];
   scalar *results = nullptr;
-  std::vector<std::vector<std::pair<int,int>>> traces((std::size_t)numPoints);
   if(return_points!=0)
   {
     results = new scalar[numDims*numPoints];
     if(use_multi_core > 0)
     {
         utils::parallel_for_progressbar(0, numPoints, [&](npy_intp i)->void{
-            std::pair<SGTree::Node*, scalar> ct_nn = obj->NearestNeighbour(queryPts.col(i), traces[i]);
+            std::pair<SGTree::Node*, scalar> ct_nn = nearest(queryPts.col(i));
             npy_intp offset = i;
             dist[offset] = ct_nn.second;
             indices[offset] = ct_nn.first->UID;
@@ -214,7 +285,7 @@ static PyObject *sgtreec_nn(PyObject *self, PyObject *args) {
     else
     {
         for(npy_intp i = 0; i < numPoints; ++i) {
-            std::pair<SGTree::Node*, scalar> ct_nn = obj->NearestNeighbour(queryPts.col(i), traces[i]);
+            std::pair<SGTree::Node*, scalar> ct_nn = nearest(queryPts.col(i));
             npy_intp offset = i;
             dist[offset] = ct_nn.second;
             indices[offset] = ct_nn.first->UID;
@@ -240,7 +311,7 @@ static PyObject *sgtreec_nn(PyObject *self, PyObject *args) {
     if(use_multi_core > 0)
     {
         utils::parallel_for_progressbar(0, numPoints, [&](npy_intp i)->void{
-            std::pair<SGTree::Node*, scalar> ct_nn = obj->NearestNeighbour(queryPts.col(i), traces[i]);
+            std::pair<SGTree::Node*, scalar> ct_nn = nearest(queryPts.col(i));
             npy_intp offset = i;
             dist[offset] = ct_nn.second;
             indices[offset] = ct_nn.first->UID;
@@ -249,7 +320,7 @@ static PyObject *sgtreec_nn(PyObject *self, PyObject *args) {
     else
     {
         for(npy_intp i = 0; i < numPoints; ++i) {
-            std::pair<SGTree::Node*, scalar> ct_nn = obj->NearestNeighbour(queryPts.col(i), traces[i]);
+            std::pair<SGTree::Node*, scalar> ct_nn = nearest(queryPts.col(i));
             npy_intp offset = i;
             dist[offset] = ct_nn.second;
             indices[offset] = ct_nn.first->UID;
@@ -274,23 +345,6 @@ static PyObject *sgtreec_nn(PyObject *self, PyObject *args) {
   std::cout << "Average number of distance computations: " << 1.0*tot_comp/numPoints << std::endl;
   #endif
 
-
-  FILE* fp = fopen(filename, "w");
-  fprintf(fp, "{\n");
-  for (std::size_t i = 0; i < traces.size(); i++) {
-    fprintf(fp, "\"%lu\": [", i);
-    for (std::size_t j = 0; j < traces[i].size(); j++) {
-        fprintf(fp, "[%d,%d]", traces[i][j].first, traces[i][j].second);
-        if (j < traces[i].size()-1)
-            fprintf(fp, ",");
-    }
-    fprintf(fp, "]");
-    if (i < traces.size()-1)
-        fprintf(fp, ",\n");
-  }
-  fprintf(fp, "}\n");
-  fclose(fp);
-
   return return_value;
 }
 
@@ -549,6 +603,318 @@ static PyObject *sgtreec_knn_beam(PyObject *self, PyObject *args) {
   return return_value;
 }
 
+// Multi-vector queries come as n x m x D, or m x D for a single one
+static bool multi_query_shape(PyArrayObject *in_array, unsigned dim, npy_intp& numQueries, npy_intp& numVectors)
+{
+  int nd = PyArray_NDIM(in_array);
+  if ((nd != 2 && nd != 3) || PyArray_DIM(in_array, nd-1) != dim || !PyArray_IS_C_CONTIGUOUS(in_array))
+  {
+    PyErr_Format(SGtreecError, "expected a contiguous array of multi-vector queries of dimension %u", dim);
+    return false;
+  }
+  numQueries = nd == 3 ? PyArray_DIM(in_array, 0) : 1;
+  numVectors = PyArray_DIM(in_array, nd-2);
+  return true;
+}
+
+static PyObject *sgtreec_knn_multi(PyObject *self, PyObject *args) {
+
+  SGTree *obj;
+  size_t int_ptr;
+  long k;
+  long cores;
+  PyArrayObject *in_array;
+
+  if (!PyArg_ParseTuple(args, "nO!ll:sgtreec_knn_multi", &int_ptr, &PyArray_Type, &in_array, &k, &cores))
+    return NULL;
+
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  npy_intp numQueries, numVectors;
+  if (!multi_query_shape(in_array, obj->get_dim(), numQueries, numVectors))
+    return NULL;
+  if (k <= 0)
+  {
+    PyErr_Format(SGtreecError, "expected k > 0");
+    return NULL;
+  }
+  npy_intp numDims = obj->get_dim();
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_DATA(in_array) );
+
+  npy_intp dims[3] = {numQueries, numVectors, k};
+  PyObject *out_indices = PyArray_SimpleNew(3, dims, NPY_LONG);
+  PyObject *out_dist = PyArray_SimpleNew(3, dims, MY_NPY_FLOAT);
+  if (out_indices == NULL || out_dist == NULL)
+  {
+    Py_XDECREF(out_indices);
+    Py_XDECREF(out_dist);
+    return NULL;
+  }
+  long *indices = reinterpret_cast<long *>( PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_indices)) );
+  scalar *dist = reinterpret_cast<scalar *>( PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_dist)) );
+
+  utils::ThreadPool::shared().run(numQueries, [&](size_t i)->void{
+    Eigen::Map<matrixType> queryPts(fnp + i*numVectors*numDims, numDims, numVectors);
+    std::vector<std::vector<std::pair<SGTree::Node*, scalar>>> ct_nn = obj->kNearestNeighboursMulti(queryPts, k);
+    npy_intp offset = i*numVectors*k;
+    for(npy_intp v = 0; v < numVectors; ++v)
+      for(long t = 0; t < k; ++t)
+      {
+        indices[offset] = ct_nn[v][t].first != NULL ? long(ct_nn[v][t].first->UID) : -1L;
+        dist[offset++] = ct_nn[v][t].second;
+      }
+  }, utils::pool_cores((unsigned) cores));
+
+  return Py_BuildValue("NN", out_indices, out_dist);
+}
+
+static PyObject *sgtreec_multi_search(PyObject *self, PyObject *args) {
+
+  SGTree *obj;
+  size_t int_ptr;
+  long k;
+  PyObject *doc_obj;
+  int reduction;
+  long num_docs;
+  long cores;
+  PyArrayObject *in_array;
+
+  if (!PyArg_ParseTuple(args, "nO!lOill:sgtreec_multi_search", &int_ptr, &PyArray_Type, &in_array, &k, &doc_obj, &reduction, &num_docs, &cores))
+    return NULL;
+
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  npy_intp numQueries, numVectors;
+  if (!multi_query_shape(in_array, obj->get_dim(), numQueries, numVectors))
+    return NULL;
+  if (k <= 0 || num_docs <= 0)
+  {
+    PyErr_Format(SGtreecError, "expected k > 0 and num_docs > 0");
+    return NULL;
+  }
+
+  // UID -> document, as int64
+  PyArrayObject *doc_array = NULL;
+  const long *doc_of_uid = nullptr;
+  size_t num_uids = 0;
+  if (doc_obj != Py_None)
+  {
+    doc_array = reinterpret_cast< PyArrayObject * >(PyArray_FROMANY(doc_obj, NPY_LONG, 1, 1, NPY_ARRAY_IN_ARRAY));
+    if (doc_array == NULL)
+      return NULL;
+    doc_of_uid = reinterpret_cast< const long * >(PyArray_DATA(doc_array));
+    num_uids = (size_t) PyArray_DIM(doc_array, 0);
+  }
+
+  npy_intp numDims = obj->get_dim();
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_DATA(in_array) );
+  npy_intp dims[2] = {numQueries, num_docs};
+  PyObject *out_docs = PyArray_SimpleNew(2, dims, NPY_LONG);
+  PyObject *out_scores = PyArray_SimpleNew(2, dims, MY_NPY_FLOAT);
+  if (out_docs == NULL || out_scores == NULL)
+  {
+    Py_XDECREF(out_docs);
+    Py_XDECREF(out_scores);
+    Py_XDECREF(doc_array);
+    return NULL;
+  }
+  long *docs = reinterpret_cast<long *>( PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_docs)) );
+  scalar *scores = reinterpret_cast<scalar *>( PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_scores)) );
+  SGTree::MultiVectorReduction red = reduction == 1 ? SGTree::MultiVectorReduction::Sum : SGTree::MultiVectorReduction::MaxSim;
+
+  utils::ThreadPool::shared().run(numQueries, [&](size_t i)->void{
+    Eigen::Map<matrixType> queryPts(fnp + i*numVectors*numDims, numDims, numVectors);
+    std::vector<std::pair<long, scalar>> ranked = obj->multiVectorSearch(queryPts, k, doc_of_uid, num_uids, red, num_docs);
+    npy_intp offset = i*num_docs;
+    for(long t = 0; t < num_docs; ++t)
+    {
+      docs[offset + t] = t < long(ranked.size()) ? ranked[t].first : -1L;
+      scores[offset + t] = t < long(ranked.size()) ? ranked[t].second : -std::numeric_limits<scalar>::infinity();
+    }
+  }, utils::pool_cores((unsigned) cores));
+
+  Py_XDECREF(doc_array);
+  return Py_BuildValue("NN", out_docs, out_scores);
+}
+
+static PyObject *sgtreec_knn_parallel(PyObject *self, PyObject *args) {
+
+  long k, use_multi_core;
+  SGTree *obj;
+  size_t int_ptr;
+  PyArrayObject *in_array;
+
+  if (!PyArg_ParseTuple(args, "nO!ll:sgtreec_knn_parallel", &int_ptr, &PyArray_Type, &in_array, &k, &use_multi_core))
+    return NULL;
+
+  npy_intp idx[2] = {0,0};
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> queryPts(fnp, numDims, numPoints);
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+
+  npy_intp dims[2] = {numPoints, k};
+  PyObject *out_indices = PyArray_SimpleNew(2, dims, NPY_LONG);
+  PyObject *out_dist = PyArray_SimpleNew(2, dims, MY_NPY_FLOAT);
+  long *indices = reinterpret_cast<long *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_indices)));
+  scalar *dist = reinterpret_cast<scalar *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_dist)));
+
+  // one query at a time, each on all cores
+  for (npy_intp i = 0; i < numPoints; ++i)
+  {
+      std::vector<std::pair<SGTree::Node*, scalar>> nn = obj->kNearestNeighboursParallel(queryPts.col(i), k, unsigned(use_multi_core));
+      for (long t = 0; t < k; ++t)
+      {
+        indices[k*i + t] = nn[t].first != NULL ? long(nn[t].first->UID) : -1L;
+        dist[k*i + t] = nn[t].second;
+      }
+  }
+
+  return Py_BuildValue("NN", out_indices, out_dist);
+}
+
+static PyObject *sgtreec_knn_expanded(PyObject *self, PyObject *args) {
+
+  long k, use_multi_core;
+  SGTree *obj;
+  size_t int_ptr;
+  PyArrayObject *in_array;
+
+  if (!PyArg_ParseTuple(args, "nO!ll:sgtreec_knn_expanded", &int_ptr, &PyArray_Type, &in_array, &k, &use_multi_core))
+    return NULL;
+
+  npy_intp idx[2] = {0,0};
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> queryPts(fnp, numDims, numPoints);
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+
+  npy_intp dims[2] = {numPoints, k};
+  PyObject *out_indices = PyArray_SimpleNew(2, dims, NPY_LONG);
+  PyObject *out_dist = PyArray_SimpleNew(2, dims, MY_NPY_FLOAT);
+  long *indices = reinterpret_cast<long *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_indices)));
+  scalar *dist = reinterpret_cast<scalar *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_dist)));
+
+  // the k nearest with duplicates are among the k nearest distinct points
+  utils::parallel_for(0, numPoints, [&](npy_intp i)->void{
+      std::vector<std::pair<long, scalar>> nn = SGTree::expand_duplicates(obj->kNearestNeighbours(queryPts.col(i), k), k);
+      for (long t = 0; t < k; ++t)
+      {
+        indices[k*i + t] = t < long(nn.size()) ? nn[t].first : -1;
+        dist[k*i + t] = t < long(nn.size()) ? nn[t].second : std::numeric_limits<scalar>::infinity();
+      }
+  }, utils::pool_cores(unsigned(use_multi_core)));
+
+  return Py_BuildValue("NN", out_indices, out_dist);
+}
+
+static PyObject *sgtreec_range_expanded(PyObject *self, PyObject *args) {
+
+  scalar r=0.0;
+  long use_multi_core;
+  SGTree *obj;
+  size_t int_ptr;
+  PyArrayObject *in_array;
+
+  if (!PyArg_ParseTuple(args, "nO!"PYTHON_FLOAT_CHAR"l:sgtreec_range_expanded", &int_ptr, &PyArray_Type, &in_array, &r, &use_multi_core))
+    return NULL;
+
+  npy_intp idx[2] = {0,0};
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> queryPts(fnp, numDims, numPoints);
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+
+  std::vector<std::vector<std::pair<long, scalar>>> results(numPoints);
+  utils::parallel_for(0, numPoints, [&](npy_intp i)->void{
+      results[i] = SGTree::expand_duplicates(obj->rangeNeighbours(queryPts.col(i), r));
+  }, utils::pool_cores(unsigned(use_multi_core)));
+
+  PyObject *indices = PyList_New(numPoints);
+  PyObject *dist = PyList_New(numPoints);
+  for (npy_intp i = 0; i < numPoints; ++i)
+  {
+    npy_intp dims[1] = {(npy_intp) results[i].size()};
+    PyObject *neighbour_indices = PyArray_SimpleNew(1, dims, NPY_LONG);
+    PyObject *neighbour_dist = PyArray_SimpleNew(1, dims, MY_NPY_FLOAT);
+    long *point_indices = reinterpret_cast<long *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(neighbour_indices)));
+    scalar *point_dist = reinterpret_cast<scalar *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(neighbour_dist)));
+    for (size_t t = 0; t < results[i].size(); ++t)
+    {
+      point_indices[t] = results[i][t].first;
+      point_dist[t] = results[i][t].second;
+    }
+    PyList_SET_ITEM(indices, i, neighbour_indices);
+    PyList_SET_ITEM(dist, i, neighbour_dist);
+  }
+
+  return Py_BuildValue("NN", indices, dist);
+}
+
+static PyObject *sgtreec_knn_update(PyObject *self, PyObject *args) {
+
+  SGTree *obj;
+  size_t int_ptr;
+  long k, use_multi_core;
+  PyArrayObject *in_array;
+  PyArrayObject *uid_array;
+
+  if (!PyArg_ParseTuple(args, "nO!O!ll:sgtreec_knn_update", &int_ptr, &PyArray_Type, &in_array, &PyArray_Type, &uid_array, &k, &use_multi_core))
+    return NULL;
+
+  npy_intp idx[2] = {0,0};
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  if (PyArray_DIM(uid_array, 0) != numPoints || k < 1)
+  {
+    PyErr_Format(SGtreecError, "Need one uid per point and k >= 1");
+    return NULL;
+  }
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> pts(fnp, numDims, numPoints);
+  npy_intp idx2[1] = {0};
+  long * unp = reinterpret_cast< long * >( PyArray_GetPtr(uid_array, idx2) );
+
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  std::vector<std::pair<long, scalar>> forward;
+  std::vector<std::vector<std::pair<unsigned, scalar>>> reverse;
+  obj->knn_update(pts, unp, unsigned(k), unsigned(use_multi_core), forward, reverse);
+
+  npy_intp dims[2] = {numPoints, k};
+  PyObject *out_indices = PyArray_SimpleNew(2, dims, NPY_LONG);
+  PyObject *out_dist = PyArray_SimpleNew(2, dims, MY_NPY_FLOAT);
+  long *indices = reinterpret_cast<long *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_indices)));
+  scalar *dist = reinterpret_cast<scalar *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_dist)));
+  for (size_t i = 0; i < forward.size(); ++i)
+  {
+    indices[i] = forward[i].first;
+    dist[i] = forward[i].second;
+  }
+
+  // reverse edges as (tracked point, point of the batch, distance)
+  npy_intp num_edges = 0;
+  for (const auto& r : reverse)
+    num_edges += npy_intp(r.size());
+  npy_intp edims[1] = {num_edges};
+  PyObject *out_rows = PyArray_SimpleNew(1, edims, NPY_LONG);
+  PyObject *out_cols = PyArray_SimpleNew(1, edims, NPY_LONG);
+  PyObject *out_edist = PyArray_SimpleNew(1, edims, MY_NPY_FLOAT);
+  long *rows = reinterpret_cast<long *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_rows)));
+  long *cols = reinterpret_cast<long *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_cols)));
+  scalar *edist = reinterpret_cast<scalar *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_edist)));
+  npy_intp e = 0;
+  for (npy_intp i = 0; i < numPoints; ++i)
+    for (const auto& nn : reverse[i])
+    {
+      rows[e] = nn.first;
+      cols[e] = unp[i];
+      edist[e++] = nn.second;
+    }
+
+  return Py_BuildValue("NNNNN", out_indices, out_dist, out_rows, out_cols, out_edist);
+}
+
 static PyObject *sgtreec_range(PyObject *self, PyObject *args) {
 
   scalar r=0.0;
@@ -735,13 +1101,14 @@ static PyObject *sgtreec_serialize(PyObject *self, PyObject *args)
 
 static PyObject *sgtreec_deserialize(PyObject *self, PyObject *args)
 {
-  char* buff;
-  size_t len;
-  if (!PyArg_ParseTuple(args, "y#:sgtreec_deserialize", &buff, &len))
+  Py_buffer buff;
+  // y* also accepts the out-of-band buffers of pickle protocol 5
+  if (!PyArg_ParseTuple(args, "y*:sgtreec_deserialize", &buff))
     return NULL;
 
   SGTree* cTree = new SGTree();
-  cTree->deserialize(buff);
+  cTree->deserialize(reinterpret_cast<char*>(buff.buf), size_t(buff.len));
+  PyBuffer_Release(&buff);
   size_t int_ptr = reinterpret_cast< size_t >(cTree);
   size_t node_ptr = reinterpret_cast< size_t >(cTree->get_root());
 
@@ -868,6 +1235,37 @@ static PyObject *sgtreec_test_covering(PyObject *self, PyObject *args)
   Py_RETURN_FALSE;
 }
 
+static PyObject *sgtreec_verify(PyObject *self, PyObject *args)
+{
+  SGTree *obj;
+  size_t int_ptr;
+  unsigned checks;
+  long use_multi_core;
+  Py_ssize_t max_report;
+  int early_exit;
+
+  if (!PyArg_ParseTuple(args, "nIlnp:sgtreec_verify", &int_ptr, &checks, &use_multi_core, &max_report, &early_exit))
+    return NULL;
+
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  SGTree::Verification result;
+  Py_BEGIN_ALLOW_THREADS
+  result = obj->verify(checks, unsigned(use_multi_core), size_t(std::max(max_report, Py_ssize_t(0))), early_exit != 0);
+  Py_END_ALLOW_THREADS
+
+  PyObject *first = PyList_New(0);
+  for (const auto& v : result.first)
+  {
+    const char *name = v.check == SGTree::Covering ? "covering" : v.check == SGTree::Separation ? "separation"
+                     : v.check == SGTree::Nesting ? "nesting" : v.check == SGTree::MaxDist ? "maxdist" : "levels";
+    PyObject *o = Py_BuildValue("sIIidd", name, v.UID, v.other, v.level, double(v.dist), double(v.bound));
+    PyList_Append(first, o);
+    Py_DECREF(o);
+  }
+  return Py_BuildValue("nnON", Py_ssize_t(result.nodes), Py_ssize_t(result.violations),
+                       result.complete ? Py_True : Py_False, first);
+}
+
 static PyObject *sgtreec_node_children(PyObject *self, PyObject *args)
 {
   SGTree::Node *obj;
@@ -925,6 +1323,15 @@ static PyObject *sgtreec_node_property(PyObject *self, PyObject *args)
   PyDict_SetItemString(results, "maxdistUB", o);
   Py_DECREF(o);
 
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(obj->mut);
+    o = PyList_New(obj->dup_uids.size());
+    for (size_t i = 0; i < obj->dup_uids.size(); ++i)
+      PyList_SET_ITEM(o, i, PyLong_FromUnsignedLong(obj->dup_uids[i]));
+  }
+  PyDict_SetItemString(results, "duplicates", o);
+  Py_DECREF(o);
+
   o = PyBytes_FromStringAndSize(obj->ext_prop.c_str(), obj->ext_prop.length());
   PyDict_SetItemString(results, "others", o);
   Py_DECREF(o);
@@ -947,6 +1354,1175 @@ static PyObject *sgtreec_node_save(PyObject *self, PyObject *args)
   Py_RETURN_NONE;
 }
 
+static PyObject *sgtreec_share(PyObject *self, PyObject *args)
+{
+  SGTree *obj;
+  size_t int_ptr;
+  const char* name;
+  PyArrayObject *uids_in = NULL;
+  PyArrayObject *levels_in = NULL;
+  PyArrayObject *counts_in = NULL;
+  Py_ssize_t hot_bytes = 0;
+
+  if (!PyArg_ParseTuple(args, "ns|O!O!O!n:sgtreec_share", &int_ptr, &name, &PyArray_Type, &uids_in,
+                        &PyArray_Type, &levels_in, &PyArray_Type, &counts_in, &hot_bytes))
+    return NULL;
+
+  // visit counts (uids, levels, counts) lay out the hot nodes first
+  FlatSGTree::Heat heat;
+  if (counts_in != NULL)
+  {
+    npy_intp num = PyArray_DIM(counts_in, 0);
+    if (PyArray_DIM(uids_in, 0) != num || PyArray_DIM(levels_in, 0) != num)
+    {
+      PyErr_Format(SGtreecError, "uids, levels and counts must have the same length");
+      return NULL;
+    }
+    const uint32_t *uids = reinterpret_cast<const uint32_t *>(PyArray_DATA(uids_in));
+    const int32_t *levels = reinterpret_cast<const int32_t *>(PyArray_DATA(levels_in));
+    const uint64_t *counts = reinterpret_cast<const uint64_t *>(PyArray_DATA(counts_in));
+    for (npy_intp i = 0; i < num; ++i)
+      heat[FlatSGTree::node_key(uids[i], levels[i])] += counts[i];
+  }
+
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  if (FlatSGTree::write(*obj, name, counts_in != NULL ? &heat : nullptr, size_t(hot_bytes)))
+    Py_RETURN_TRUE;
+
+  Py_RETURN_FALSE;
+}
+
+static PyObject *sgtreec_attach(PyObject *self, PyObject *args)
+{
+  const char* name;
+
+  if (!PyArg_ParseTuple(args, "s:sgtreec_attach", &name))
+    return NULL;
+
+  FlatSGTree* fTree = FlatSGTree::attach(name);
+  if (fTree == nullptr)
+  {
+    PyErr_Format(SGtreecError, "cannot attach shared SG Tree %s", name);
+    return NULL;
+  }
+  size_t int_ptr = reinterpret_cast< size_t >(fTree);
+
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sgtreec_detach(PyObject *self, PyObject *args)
+{
+  FlatSGTree *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_detach", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< FlatSGTree * >(int_ptr);
+  delete obj;
+
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sgtreec_unlink(PyObject *self, PyObject *args)
+{
+  const char* name;
+
+  if (!PyArg_ParseTuple(args, "s:sgtreec_unlink", &name))
+    return NULL;
+
+  if (FlatSGTree::unlink(name))
+    Py_RETURN_TRUE;
+
+  Py_RETURN_FALSE;
+}
+
+static PyObject *sgtreec_shared_size(PyObject *self, PyObject *args)
+{
+  FlatSGTree *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_shared_size", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< FlatSGTree * >(int_ptr);
+  size_t size = obj->size();
+
+  return Py_BuildValue("n", size);
+}
+
+static PyObject *sgtreec_shared_count_visits(PyObject *self, PyObject *args)
+{
+  FlatSGTree *obj;
+  size_t int_ptr;
+  int enable;
+
+  if (!PyArg_ParseTuple(args, "np:sgtreec_shared_count_visits", &int_ptr, &enable))
+    return NULL;
+
+  obj = reinterpret_cast< FlatSGTree * >(int_ptr);
+  obj->count_visits(enable);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *sgtreec_shared_visit_counts(PyObject *self, PyObject *args)
+{
+  FlatSGTree *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_shared_visit_counts", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< FlatSGTree * >(int_ptr);
+  FlatSGTree::Heat heat = obj->visit_counts();
+
+  npy_intp dims[1] = {(npy_intp) heat.size()};
+  PyObject *out_uids = PyArray_SimpleNew(1, dims, NPY_UINT32);
+  PyObject *out_levels = PyArray_SimpleNew(1, dims, NPY_INT32);
+  PyObject *out_counts = PyArray_SimpleNew(1, dims, NPY_UINT64);
+  uint32_t *uids = reinterpret_cast<uint32_t *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_uids)));
+  int32_t *levels = reinterpret_cast<int32_t *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_levels)));
+  uint64_t *counts = reinterpret_cast<uint64_t *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_counts)));
+  size_t i = 0;
+  for (const auto& h : heat)
+  {
+    uids[i] = uint32_t(h.first >> 32);
+    levels[i] = int32_t(uint32_t(h.first));
+    counts[i++] = h.second;
+  }
+
+  return Py_BuildValue("NNN", out_uids, out_levels, out_counts);
+}
+
+static PyObject *sgtreec_shared_lock_hot(PyObject *self, PyObject *args)
+{
+  FlatSGTree *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_shared_lock_hot", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< FlatSGTree * >(int_ptr);
+  if (obj->lock_hot())
+    Py_RETURN_TRUE;
+
+  Py_RETURN_FALSE;
+}
+
+static PyObject *sgtreec_shared_hot_size(PyObject *self, PyObject *args)
+{
+  FlatSGTree *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_shared_hot_size", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< FlatSGTree * >(int_ptr);
+  size_t size = obj->hot_size();
+
+  return Py_BuildValue("n", size);
+}
+
+// Answer k-NN style queries on a shared tree; missing neighbours get index -1
+template<class Query>
+static PyObject *shared_knn_query(FlatSGTree *obj, PyArrayObject *in_array, long k,
+                                  unsigned use_multi_core, int return_points, Query query)
+{
+  npy_intp idx[2] = {0,0};
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> queryPts(fnp, numDims, numPoints);
+
+  npy_intp dims[2] = {numPoints, k};
+  PyObject *out_indices = PyArray_SimpleNew(2, dims, NPY_LONG);
+  PyObject *out_dist = PyArray_SimpleNew(2, dims, MY_NPY_FLOAT);
+  long *indices = reinterpret_cast<long *>(
+      PyArray_GetPtr(reinterpret_cast<PyArrayObject *>(out_indices), idx) );
+  scalar *dist = reinterpret_cast<scalar *>(
+      PyArray_GetPtr(reinterpret_cast<PyArrayObject *>(out_dist), idx) );
+
+  PyObject *out_array = NULL;
+  scalar *results = nullptr;
+  if(return_points!=0)
+  {
+    npy_intp three_idx[3] = {0, 0, 0};
+    npy_intp odims[3] = {numPoints, k, numDims};
+    out_array = PyArray_ZEROS(3, odims, MY_NPY_FLOAT, 0);
+    results = reinterpret_cast<scalar *>(
+      PyArray_GetPtr(reinterpret_cast<PyArrayObject *>(out_array), three_idx) );
+  }
+
+  auto answer = [&](npy_intp i)->void{
+      std::vector<std::pair<unsigned, scalar>> ct_nn = query(queryPts.col(i));
+      npy_intp offset = k*i;
+      for(long t=0; t<k; ++t)
+      {
+          bool found = ct_nn[t].first != unsigned(-1);
+          indices[offset] = found ? long(obj->uid(ct_nn[t].first)) : -1L;
+          dist[offset] = ct_nn[t].second;
+          if (results != nullptr && found)
+          {
+              const scalar *data = obj->point(ct_nn[t].first);
+              std::copy(data, data + numDims, results + offset*numDims);
+          }
+          offset++;
+      }
+  };
+  if(use_multi_core > 0)
+      utils::parallel_for_progressbar(0, numPoints, answer, use_multi_core);
+  else
+      for(npy_intp i = 0; i < numPoints; ++i)
+          answer(i);
+
+  if(return_points!=0)
+    return Py_BuildValue("NNN", out_indices, out_dist, out_array);
+  return Py_BuildValue("NN", out_indices, out_dist);
+}
+
+static PyObject *sgtreec_shared_nn(PyObject *self, PyObject *args) {
+
+  size_t int_ptr;
+  long cores;
+  int return_points;
+  PyArrayObject *in_array;
+
+  /*  parse the input, from python int to c++ int */
+  if (!PyArg_ParseTuple(args, "nO!lp:sgtreec_shared_nn", &int_ptr, &PyArray_Type, &in_array, &cores, &return_points))
+    return NULL;
+
+  FlatSGTree *obj = reinterpret_cast< FlatSGTree * >(int_ptr);
+  return shared_knn_query(obj, in_array, 1, (unsigned) cores, return_points, [&](const pointType& q) {
+    return std::vector<std::pair<unsigned, scalar>>(1, obj->NearestNeighbour(q));
+  });
+}
+
+static PyObject *sgtreec_shared_knn(PyObject *self, PyObject *args) {
+
+  long k=2L;
+  size_t int_ptr;
+  long cores;
+  int return_points;
+  PyArrayObject *in_array;
+
+  /*  parse the input, from python int to c++ int */
+  if (!PyArg_ParseTuple(args, "nO!llp:sgtreec_shared_knn", &int_ptr, &PyArray_Type, &in_array, &k, &cores, &return_points))
+    return NULL;
+
+  FlatSGTree *obj = reinterpret_cast< FlatSGTree * >(int_ptr);
+  return shared_knn_query(obj, in_array, k, (unsigned) cores, return_points, [&](const pointType& q) {
+    return obj->kNearestNeighbours(q, k);
+  });
+}
+
+static PyObject *sgtreec_shared_knn_beam(PyObject *self, PyObject *args) {
+
+  long k=2L;
+  size_t int_ptr;
+  long cores;
+  long beam_size;
+  int return_points;
+  PyArrayObject *in_array;
+
+  /*  parse the input, from python int to c++ int */
+  if (!PyArg_ParseTuple(args, "nO!llpl:sgtreec_shared_knn_beam", &int_ptr, &PyArray_Type, &in_array, &k, &cores, &return_points, &beam_size))
+    return NULL;
+
+  FlatSGTree *obj = reinterpret_cast< FlatSGTree * >(int_ptr);
+  return shared_knn_query(obj, in_array, k, (unsigned) cores, return_points, [&](const pointType& q) {
+    return obj->kNearestNeighboursBeam(q, k, beam_size);
+  });
+}
+
+static PyObject *sgtreec_shared_range(PyObject *self, PyObject *args) {
+
+  scalar r=0.0;
+  size_t int_ptr;
+  long cores;
+  PyArrayObject *in_array;
+
+  /*  parse the input, from python int to c++ int */
+  if (!PyArg_ParseTuple(args, "nO!"PYTHON_FLOAT_CHAR"l:sgtreec_shared_range", &int_ptr, &PyArray_Type, &in_array, &r, &cores))
+    return NULL;
+
+  unsigned use_multi_core = (unsigned) cores;
+  npy_intp idx[2] = {0,0};
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> queryPts(fnp, numDims, numPoints);
+
+  FlatSGTree *obj = reinterpret_cast< FlatSGTree * >(int_ptr);
+
+  std::vector<std::vector<std::pair<unsigned, scalar>>> neighbours(numPoints);
+  auto answer = [&](npy_intp i)->void{
+      neighbours[i] = obj->rangeNeighbours(queryPts.col(i), r);
+  };
+  if(use_multi_core > 0)
+      utils::parallel_for_progressbar(0, numPoints, answer, use_multi_core);
+  else
+      for(npy_intp i = 0; i < numPoints; ++i)
+          answer(i);
+
+  PyObject *indices = PyList_New(numPoints);
+  PyObject *dist = PyList_New(numPoints);
+  for(npy_intp i = 0; i < numPoints; ++i) {
+      npy_intp dims[1] = {(npy_intp)neighbours[i].size()};
+      PyObject *neighbour_indices = PyArray_SimpleNew(1, dims, NPY_LONG);
+      PyObject *neighbour_dist = PyArray_SimpleNew(1, dims, MY_NPY_FLOAT);
+      long *point_indices = reinterpret_cast<long *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(neighbour_indices)));
+      scalar *point_dist = reinterpret_cast<scalar *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(neighbour_dist)));
+      for(size_t t=0; t<neighbours[i].size(); ++t)
+      {
+          point_indices[t] = obj->uid(neighbours[i][t].first);
+          point_dist[t] = neighbours[i][t].second;
+      }
+      PyList_SET_ITEM(indices, i, neighbour_indices);
+      PyList_SET_ITEM(dist, i, neighbour_dist);
+  }
+
+  return Py_BuildValue("NN", indices, dist);
+}
+
+static PyObject *sgtreec_log_open(PyObject *self, PyObject *args)
+{
+  const char* path;
+  unsigned dim;
+  Py_ssize_t sync_bytes;
+  unsigned sync_ms;
+
+  if (!PyArg_ParseTuple(args, "sInI:sgtreec_log_open", &path, &dim, &sync_bytes, &sync_ms))
+    return NULL;
+
+  InsertLog* wal = InsertLog::open(path, dim, (size_t) sync_bytes, sync_ms);
+  if (wal == nullptr)
+  {
+    PyErr_Format(SGtreecError, "cannot open insert log %s", path);
+    return NULL;
+  }
+  size_t int_ptr = reinterpret_cast< size_t >(wal);
+
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sgtreec_log_close(PyObject *self, PyObject *args)
+{
+  InsertLog *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_log_close", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< InsertLog * >(int_ptr);
+  delete obj;
+
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sgtreec_log_batchinsert(PyObject *self, PyObject *args)
+{
+  InsertLog *wal;
+  SGTree *obj;
+  size_t wal_ptr;
+  size_t int_ptr;
+  long use_multi_core;
+  PyArrayObject *in_array;
+  PyArrayObject *uid_array;
+
+  if (!PyArg_ParseTuple(args, "nnO!O!l:sgtreec_log_batchinsert", &wal_ptr, &int_ptr, &PyArray_Type, &in_array, &PyArray_Type, &uid_array, &use_multi_core))
+    return NULL;
+
+  npy_intp idx[2] = {0,0};
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> insPts(fnp, numDims, numPoints);
+
+  npy_intp idx2[1] = {0};
+  if (numPoints != PyArray_DIM(uid_array, 0))
+  {
+    PyErr_SetString(SGtreecError, "Points and UID size do not match");
+    return NULL;
+  }
+  long * unp = reinterpret_cast< long * >( PyArray_GetPtr(uid_array, idx2) );
+
+  wal = reinterpret_cast< InsertLog * >(wal_ptr);
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  size_t failed = wal->insert(*obj, insPts, unp, use_multi_core < 0 ? std::thread::hardware_concurrency() : std::max((unsigned) use_multi_core, 1u));
+
+  return Py_BuildValue("n", failed);
+}
+
+static PyObject *sgtreec_log_sync(PyObject *self, PyObject *args)
+{
+  InsertLog *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_log_sync", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< InsertLog * >(int_ptr);
+  if (obj->sync())
+    Py_RETURN_TRUE;
+
+  Py_RETURN_FALSE;
+}
+
+static PyObject *sgtreec_log_checkpoint(PyObject *self, PyObject *args)
+{
+  InsertLog *wal;
+  SGTree *obj;
+  size_t wal_ptr;
+  size_t int_ptr;
+  const char* snapshot_path;
+
+  if (!PyArg_ParseTuple(args, "nns:sgtreec_log_checkpoint", &wal_ptr, &int_ptr, &snapshot_path))
+    return NULL;
+
+  wal = reinterpret_cast< InsertLog * >(wal_ptr);
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  if (wal->checkpoint(*obj, snapshot_path))
+    Py_RETURN_TRUE;
+
+  Py_RETURN_FALSE;
+}
+
+static PyObject *sgtreec_log_size(PyObject *self, PyObject *args)
+{
+  InsertLog *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_log_size", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< InsertLog * >(int_ptr);
+  size_t size = obj->size();
+
+  return Py_BuildValue("n", size);
+}
+
+static PyObject *sgtreec_log_recover(PyObject *self, PyObject *args)
+{
+  const char* snapshot_path;
+  const char* log_path;
+  long use_multi_core;
+
+  if (!PyArg_ParseTuple(args, "ssl:sgtreec_log_recover", &snapshot_path, &log_path, &use_multi_core))
+    return NULL;
+
+  SGTree* cTree = InsertLog::recover(snapshot_path, log_path, use_multi_core < 0 ? std::thread::hardware_concurrency() : std::max((unsigned) use_multi_core, 1u));
+  if (cTree == nullptr)
+  {
+    PyErr_Format(SGtreecError, "cannot recover SG Tree from %s and %s", snapshot_path, log_path);
+    return NULL;
+  }
+  size_t int_ptr = reinterpret_cast< size_t >(cTree);
+  size_t node_ptr = reinterpret_cast< size_t >(cTree->get_root());
+
+  return Py_BuildValue("nn", int_ptr, node_ptr);
+}
+
+static SubtreeRebalancer::Options rebalance_options(unsigned max_subtrees, double threshold, unsigned min_size, long use_multi_core)
+{
+  SubtreeRebalancer::Options opts;
+  opts.max_subtrees = max_subtrees;
+  opts.threshold = (scalar) threshold;
+  opts.min_size = min_size;
+  opts.cores = use_multi_core < 0 ? std::thread::hardware_concurrency() : std::max((unsigned) use_multi_core, 1u);
+  return opts;
+}
+
+static PyObject *sgtreec_rebalance(PyObject *self, PyObject *args)
+{
+  SGTree *obj;
+  size_t int_ptr;
+  unsigned max_subtrees;
+  double threshold;
+  unsigned min_size;
+  long use_multi_core;
+
+  if (!PyArg_ParseTuple(args, "nIdIl:sgtreec_rebalance", &int_ptr, &max_subtrees, &threshold, &min_size, &use_multi_core))
+    return NULL;
+
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  unsigned swapped = SubtreeRebalancer::rebalance(*obj, rebalance_options(max_subtrees, threshold, min_size, use_multi_core));
+
+  return Py_BuildValue("I", swapped);
+}
+
+static PyObject *sgtreec_rebalancer_start(PyObject *self, PyObject *args)
+{
+  SGTree *obj;
+  size_t int_ptr;
+  unsigned interval_ms;
+  unsigned max_subtrees;
+  double threshold;
+  unsigned min_size;
+  long use_multi_core;
+
+  if (!PyArg_ParseTuple(args, "nIIdIl:sgtreec_rebalancer_start", &int_ptr, &interval_ms, &max_subtrees, &threshold, &min_size, &use_multi_core))
+    return NULL;
+
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  SubtreeRebalancer* rebalancer = new SubtreeRebalancer(*obj, interval_ms, rebalance_options(max_subtrees, threshold, min_size, use_multi_core));
+  size_t rb_ptr = reinterpret_cast< size_t >(rebalancer);
+
+  return Py_BuildValue("n", rb_ptr);
+}
+
+static PyObject *sgtreec_rebalancer_stats(PyObject *self, PyObject *args)
+{
+  SubtreeRebalancer *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_rebalancer_stats", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< SubtreeRebalancer * >(int_ptr);
+
+  return Py_BuildValue("nn", obj->num_passes(), obj->num_rebuilt());
+}
+
+static PyObject *sgtreec_rebalancer_stop(PyObject *self, PyObject *args)
+{
+  SubtreeRebalancer *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_rebalancer_stop", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< SubtreeRebalancer * >(int_ptr);
+  delete obj;
+
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sgtreec_merge(PyObject *self, PyObject *args)
+{
+  SGTree *obj, *other;
+  size_t int_ptr, other_ptr;
+  unsigned uid_offset;
+  long use_multi_core;
+
+  if (!PyArg_ParseTuple(args, "nnIl:sgtreec_merge", &int_ptr, &other_ptr, &uid_offset, &use_multi_core))
+    return NULL;
+
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  other = reinterpret_cast< SGTree * >(other_ptr);
+  if (!obj->merge(*other, uid_offset, unsigned(use_multi_core)))
+  {
+    PyErr_Format(SGtreecError, "Cannot merge an SG Tree with a different dimension or base, or with itself");
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+// Runs on the dispatcher thread, resolves the futures of a finished batch
+static void resolve_futures(std::vector<QueryBatcher::Request*>& batch)
+{
+  PyGILState_STATE gstate = PyGILState_Ensure();
+  for (auto r : batch)
+  {
+    PyObject *future = reinterpret_cast< PyObject * >(r->tag);
+    npy_intp dims[1] = {(npy_intp) r->k};
+    PyObject *out_indices = PyArray_SimpleNew(1, dims, NPY_LONG);
+    PyObject *out_dist = PyArray_SimpleNew(1, dims, MY_NPY_FLOAT);
+    std::copy(r->uids.begin(), r->uids.end(), reinterpret_cast<long *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_indices))));
+    std::copy(r->dists.begin(), r->dists.end(), reinterpret_cast<scalar *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_dist))));
+
+    PyObject *ret = PyObject_CallMethod(future, "set_result", "((NN))", out_indices, out_dist);
+    // a cancelled future refuses the result
+    if (ret == NULL)
+      PyErr_Clear();
+    Py_XDECREF(ret);
+    Py_DECREF(future);
+    delete r;
+  }
+  PyGILState_Release(gstate);
+}
+
+static PyObject *sgtreec_batcher_start(PyObject *self, PyObject *args)
+{
+  SGTree *obj;
+  size_t int_ptr;
+  unsigned max_batch;
+  unsigned max_wait_us;
+  long use_multi_core;
+
+  if (!PyArg_ParseTuple(args, "nIIl:sgtreec_batcher_start", &int_ptr, &max_batch, &max_wait_us, &use_multi_core))
+    return NULL;
+
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  unsigned cores = use_multi_core < 0 ? std::thread::hardware_concurrency() : std::max((unsigned) use_multi_core, 1u);
+  QueryBatcher* batcher = new QueryBatcher(*obj, max_batch, max_wait_us, cores, resolve_futures);
+  size_t qb_ptr = reinterpret_cast< size_t >(batcher);
+
+  return Py_BuildValue("n", qb_ptr);
+}
+
+static PyObject *sgtreec_batcher_submit(PyObject *self, PyObject *args)
+{
+  QueryBatcher *obj;
+  size_t int_ptr;
+  PyArrayObject *in_array;
+  long k;
+  PyObject *future;
+
+  if (!PyArg_ParseTuple(args, "nO!lO:sgtreec_batcher_submit", &int_ptr, &PyArray_Type, &in_array, &k, &future))
+    return NULL;
+
+  obj = reinterpret_cast< QueryBatcher * >(int_ptr);
+  unsigned dim = obj->dim();
+  if (PyArray_SIZE(in_array) != dim || k <= 0)
+  {
+    PyErr_Format(SGtreecError, "expected a query of dimension %u and k > 0", dim);
+    return NULL;
+  }
+  if (PyArray_TYPE(in_array) != MY_NPY_FLOAT || !PyArray_IS_C_CONTIGUOUS(in_array))
+  {
+    PyErr_Format(SGtreecError, "expected a contiguous query of the tree's float type");
+    return NULL;
+  }
+
+  QueryBatcher::Request* r = new QueryBatcher::Request;
+  r->point = Eigen::Map<pointType>(reinterpret_cast< scalar * >(PyArray_DATA(in_array)), dim);
+  r->k = (unsigned) k;
+  Py_INCREF(future);
+  r->tag = future;
+  obj->submit(r);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *sgtreec_batcher_stats(PyObject *self, PyObject *args)
+{
+  QueryBatcher *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_batcher_stats", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< QueryBatcher * >(int_ptr);
+
+  return Py_BuildValue("nn", obj->batches(), obj->requests());
+}
+
+static PyObject *sgtreec_batcher_stop(PyObject *self, PyObject *args)
+{
+  QueryBatcher *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_batcher_stop", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< QueryBatcher * >(int_ptr);
+  // pending futures are resolved on the dispatcher thread, which needs the GIL
+  Py_BEGIN_ALLOW_THREADS
+  delete obj;
+  Py_END_ALLOW_THREADS
+
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sgtreec_cache_new(PyObject *self, PyObject *args)
+{
+  SGTree *obj;
+  size_t int_ptr;
+  Py_ssize_t capacity;
+  unsigned shards;
+  double quantum;
+
+  if (!PyArg_ParseTuple(args, "nnId:sgtreec_cache_new", &int_ptr, &capacity, &shards, &quantum))
+    return NULL;
+
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  QueryCache::Options opts;
+  opts.capacity = (size_t) std::max(capacity, Py_ssize_t(1));
+  opts.shards = shards;
+  opts.quantum = (scalar) quantum;
+  QueryCache* cache = new QueryCache(*obj, opts);
+  size_t qc_ptr = reinterpret_cast< size_t >(cache);
+
+  return Py_BuildValue("n", qc_ptr);
+}
+
+static PyObject *sgtreec_cache_knn(PyObject *self, PyObject *args)
+{
+  QueryCache *obj;
+  size_t int_ptr;
+  PyArrayObject *in_array;
+  long k;
+  long beam_size;
+  long cores;
+
+  if (!PyArg_ParseTuple(args, "nO!lll:sgtreec_cache_knn", &int_ptr, &PyArray_Type, &in_array, &k, &beam_size, &cores))
+    return NULL;
+
+  if (k <= 0 || beam_size < 0)
+  {
+    PyErr_Format(SGtreecError, "expected k > 0 and beam_size >= 0");
+    return NULL;
+  }
+
+  unsigned use_multi_core = (unsigned) cores;
+  npy_intp idx[2] = {0,0};
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> queryPts(fnp, numDims, numPoints);
+
+  obj = reinterpret_cast< QueryCache * >(int_ptr);
+
+  npy_intp dims[2] = {numPoints, k};
+  PyObject *out_indices = PyArray_SimpleNew(2, dims, NPY_LONG);
+  PyObject *out_dist = PyArray_SimpleNew(2, dims, MY_NPY_FLOAT);
+  long *indices = reinterpret_cast<long *>(
+      PyArray_GetPtr(reinterpret_cast<PyArrayObject *>(out_indices), idx) );
+  scalar *dist = reinterpret_cast<scalar *>(
+      PyArray_GetPtr(reinterpret_cast<PyArrayObject *>(out_dist), idx) );
+
+  // hits take microseconds, so run on the shared pool rather than a thread per chunk
+  utils::ThreadPool::shared().run(numPoints, [&](size_t i)->void{
+    obj->kNearestNeighbours(queryPts.col(i), (unsigned) k, (unsigned) beam_size, indices + k*i, dist + k*i);
+  }, utils::pool_cores(use_multi_core));
+
+  return Py_BuildValue("NN", out_indices, out_dist);
+}
+
+static PyObject *sgtreec_cache_stats(PyObject *self, PyObject *args)
+{
+  QueryCache *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_cache_stats", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< QueryCache * >(int_ptr);
+
+  return Py_BuildValue("{s:n,s:n,s:n,s:n}", "hits", obj->hits(), "misses", obj->misses(),
+                       "stale", obj->stale(), "size", obj->size());
+}
+
+static PyObject *sgtreec_cache_clear(PyObject *self, PyObject *args)
+{
+  QueryCache *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_cache_clear", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< QueryCache * >(int_ptr);
+  obj->clear();
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *sgtreec_cache_delete(PyObject *self, PyObject *args)
+{
+  QueryCache *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_cache_delete", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< QueryCache * >(int_ptr);
+  delete obj;
+
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sgtreec_routing_new(PyObject *self, PyObject *args)
+{
+  SGTree *obj;
+  size_t int_ptr;
+  unsigned levels;
+
+  if (!PyArg_ParseTuple(args, "nI:sgtreec_routing_new", &int_ptr, &levels))
+    return NULL;
+
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  RoutingTable* table = new RoutingTable(*obj, levels);
+  size_t rt_ptr = reinterpret_cast< size_t >(table);
+
+  return Py_BuildValue("n", rt_ptr);
+}
+
+static PyObject *sgtreec_routing_knn(PyObject *self, PyObject *args)
+{
+  RoutingTable *obj;
+  size_t int_ptr;
+  PyArrayObject *in_array;
+  long k;
+  long cores;
+
+  if (!PyArg_ParseTuple(args, "nO!ll:sgtreec_routing_knn", &int_ptr, &PyArray_Type, &in_array, &k, &cores))
+    return NULL;
+
+  if (k <= 0)
+  {
+    PyErr_Format(SGtreecError, "expected k > 0");
+    return NULL;
+  }
+
+  npy_intp idx[2] = {0,0};
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> queryPts(fnp, numDims, numPoints);
+
+  obj = reinterpret_cast< RoutingTable * >(int_ptr);
+
+  npy_intp dims[2] = {numPoints, k};
+  PyObject *out_indices = PyArray_SimpleNew(2, dims, NPY_LONG);
+  PyObject *out_dist = PyArray_SimpleNew(2, dims, MY_NPY_FLOAT);
+  long *indices = reinterpret_cast<long *>(
+      PyArray_GetPtr(reinterpret_cast<PyArrayObject *>(out_indices), idx) );
+  scalar *dist = reinterpret_cast<scalar *>(
+      PyArray_GetPtr(reinterpret_cast<PyArrayObject *>(out_dist), idx) );
+
+  obj->kNearestNeighbours(queryPts, (unsigned) k, (unsigned) cores, indices, dist);
+
+  return Py_BuildValue("NN", out_indices, out_dist);
+}
+
+static PyObject *sgtreec_routing_size(PyObject *self, PyObject *args)
+{
+  RoutingTable *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_routing_size", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< RoutingTable * >(int_ptr);
+
+  return Py_BuildValue("n", obj->size());
+}
+
+static PyObject *sgtreec_routing_delete(PyObject *self, PyObject *args)
+{
+  RoutingTable *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_routing_delete", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< RoutingTable * >(int_ptr);
+  delete obj;
+
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sgtreec_density_new(PyObject *self, PyObject *args)
+{
+  SGTree *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_density_new", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< SGTree * >(int_ptr);
+  DensityIndex* index = new DensityIndex(*obj);
+  size_t di_ptr = reinterpret_cast< size_t >(index);
+
+  return Py_BuildValue("n", di_ptr);
+}
+
+static PyObject *sgtreec_density_count(PyObject *self, PyObject *args)
+{
+  DensityIndex *obj;
+  size_t int_ptr;
+  PyArrayObject *in_array;
+  scalar r;
+  long cores;
+
+  if (!PyArg_ParseTuple(args, "nO!"PYTHON_FLOAT_CHAR"l:sgtreec_density_count", &int_ptr, &PyArray_Type, &in_array, &r, &cores))
+    return NULL;
+
+  npy_intp idx[2] = {0,0};
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> queryPts(fnp, numDims, numPoints);
+
+  obj = reinterpret_cast< DensityIndex * >(int_ptr);
+
+  npy_intp dims[1] = {numPoints};
+  PyObject *out_counts = PyArray_SimpleNew(1, dims, NPY_LONG);
+  long *counts = reinterpret_cast<long *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_counts)));
+  obj->rangeCount(queryPts, r, (unsigned) cores, counts);
+
+  return Py_BuildValue("N", out_counts);
+}
+
+static PyObject *sgtreec_density_kernel(PyObject *self, PyObject *args)
+{
+  DensityIndex *obj;
+  size_t int_ptr;
+  PyArrayObject *in_array;
+  scalar bandwidth;
+  scalar atol;
+  long cores;
+
+  if (!PyArg_ParseTuple(args, "nO!"PYTHON_FLOAT_CHAR PYTHON_FLOAT_CHAR"l:sgtreec_density_kernel", &int_ptr, &PyArray_Type, &in_array, &bandwidth, &atol, &cores))
+    return NULL;
+
+  if (bandwidth <= 0 || atol < 0)
+  {
+    PyErr_Format(SGtreecError, "expected bandwidth > 0 and atol >= 0");
+    return NULL;
+  }
+
+  npy_intp idx[2] = {0,0};
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_GetPtr(in_array, idx) );
+  Eigen::Map<matrixType> queryPts(fnp, numDims, numPoints);
+
+  obj = reinterpret_cast< DensityIndex * >(int_ptr);
+
+  npy_intp dims[1] = {numPoints};
+  PyObject *out_sums = PyArray_SimpleNew(1, dims, MY_NPY_FLOAT);
+  PyObject *out_errors = PyArray_SimpleNew(1, dims, MY_NPY_FLOAT);
+  scalar *sums = reinterpret_cast<scalar *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_sums)));
+  scalar *errors = reinterpret_cast<scalar *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_errors)));
+  obj->kernelSum(queryPts, bandwidth, atol, (unsigned) cores, sums, errors);
+
+  return Py_BuildValue("NN", out_sums, out_errors);
+}
+
+static PyObject *sgtreec_density_delete(PyObject *self, PyObject *args)
+{
+  DensityIndex *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_density_delete", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< DensityIndex * >(int_ptr);
+  delete obj;
+
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sgtreec_flat_new(PyObject *self, PyObject *args)
+{
+  unsigned dim;
+  int metric;
+
+  if (!PyArg_ParseTuple(args, "Ii:sgtreec_flat_new", &dim, &metric))
+    return NULL;
+
+  if (metric < 0 || metric > 2)
+  {
+    PyErr_Format(SGtreecError, "metric must be 0 (l2), 1 (inner product) or 2 (cosine)");
+    return NULL;
+  }
+
+  FlatIndex* index = new FlatIndex(dim, FlatIndex::Metric(metric));
+  size_t fi_ptr = reinterpret_cast< size_t >(index);
+
+  return Py_BuildValue("n", fi_ptr);
+}
+
+static PyObject *sgtreec_flat_add(PyObject *self, PyObject *args)
+{
+  FlatIndex *obj;
+  size_t int_ptr;
+  PyArrayObject *in_array;
+
+  if (!PyArg_ParseTuple(args, "nO!:sgtreec_flat_add", &int_ptr, &PyArray_Type, &in_array))
+    return NULL;
+
+  obj = reinterpret_cast< FlatIndex * >(int_ptr);
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  if (numDims != npy_intp(obj->dim()))
+  {
+    PyErr_Format(SGtreecError, "expected points of dimension %u", obj->dim());
+    return NULL;
+  }
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_DATA(in_array) );
+  Eigen::Map<matrixType> points(fnp, numDims, numPoints);
+  obj->add(points);
+
+  return Py_BuildValue("n", (Py_ssize_t) obj->size());
+}
+
+static PyObject *sgtreec_flat_search(PyObject *self, PyObject *args)
+{
+  FlatIndex *obj;
+  size_t int_ptr;
+  PyArrayObject *in_array;
+  PyObject *cand_obj = Py_None;
+  long k;
+  long cores;
+
+  if (!PyArg_ParseTuple(args, "nO!ll|O:sgtreec_flat_search", &int_ptr, &PyArray_Type, &in_array, &k, &cores, &cand_obj))
+    return NULL;
+
+  obj = reinterpret_cast< FlatIndex * >(int_ptr);
+  npy_intp numPoints = PyArray_DIM(in_array, 0);
+  npy_intp numDims = PyArray_DIM(in_array, 1);
+  if (k <= 0 || numDims != npy_intp(obj->dim()))
+  {
+    PyErr_Format(SGtreecError, "expected k > 0 and queries of dimension %u", obj->dim());
+    return NULL;
+  }
+  scalar * fnp = reinterpret_cast< scalar * >( PyArray_DATA(in_array) );
+  Eigen::Map<matrixType> queryPts(fnp, numDims, numPoints);
+
+  // candidate UIDs of re-ranking, one row per query, as int64
+  PyArrayObject *cand_array = NULL;
+  if (cand_obj != Py_None)
+  {
+    cand_array = reinterpret_cast< PyArrayObject * >(PyArray_FROMANY(cand_obj, NPY_LONG, 2, 2, NPY_ARRAY_IN_ARRAY));
+    if (cand_array == NULL)
+      return NULL;
+    if (PyArray_DIM(cand_array, 0) != numPoints)
+    {
+      Py_DECREF(cand_array);
+      PyErr_Format(SGtreecError, "expected one row of candidates per query");
+      return NULL;
+    }
+  }
+
+  npy_intp dims[2] = {numPoints, k};
+  PyObject *out_indices = PyArray_SimpleNew(2, dims, NPY_LONG);
+  PyObject *out_scores = PyArray_SimpleNew(2, dims, MY_NPY_FLOAT);
+  long *indices = reinterpret_cast<long *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_indices)));
+  scalar *scores = reinterpret_cast<scalar *>(PyArray_DATA(reinterpret_cast<PyArrayObject *>(out_scores)));
+
+  if (cand_array == NULL)
+    obj->search(queryPts, (unsigned) k, (unsigned) cores, indices, scores);
+  else
+  {
+    obj->rerank(queryPts, reinterpret_cast< const long * >(PyArray_DATA(cand_array)), (unsigned) PyArray_DIM(cand_array, 1),
+                (unsigned) k, (unsigned) cores, indices, scores);
+    Py_DECREF(cand_array);
+  }
+
+  return Py_BuildValue("NN", out_indices, out_scores);
+}
+
+static PyObject *sgtreec_flat_size(PyObject *self, PyObject *args)
+{
+  FlatIndex *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_flat_size", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< FlatIndex * >(int_ptr);
+
+  return Py_BuildValue("n", (Py_ssize_t) obj->size());
+}
+
+static PyObject *sgtreec_flat_delete(PyObject *self, PyObject *args)
+{
+  FlatIndex *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_flat_delete", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< FlatIndex * >(int_ptr);
+  delete obj;
+
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sgtreec_progress_new(PyObject *self, PyObject *args)
+{
+  utils::Progress *obj = new utils::Progress;
+  size_t int_ptr = reinterpret_cast< size_t >(obj);
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sgtreec_progress_status(PyObject *self, PyObject *args)
+{
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_progress_status", &int_ptr))
+    return NULL;
+
+  utils::Progress *obj = reinterpret_cast< utils::Progress * >(int_ptr);
+  return Py_BuildValue("nnO", Py_ssize_t(obj->done()), Py_ssize_t(obj->expected()), obj->cancelled() ? Py_True : Py_False);
+}
+
+static PyObject *sgtreec_progress_cancel(PyObject *self, PyObject *args)
+{
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_progress_cancel", &int_ptr))
+    return NULL;
+
+  reinterpret_cast< utils::Progress * >(int_ptr)->cancel();
+  Py_RETURN_NONE;
+}
+
+static PyObject *sgtreec_progress_delete(PyObject *self, PyObject *args)
+{
+  utils::Progress *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_progress_delete", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< utils::Progress * >(int_ptr);
+  delete obj;
+
+  return Py_BuildValue("n", int_ptr);
+}
+
+static PyObject *sgtreec_tracer_new(PyObject *self, PyObject *args)
+{
+  unsigned sample_every;
+  Py_ssize_t capacity;
+
+  if (!PyArg_ParseTuple(args, "In:sgtreec_tracer_new", &sample_every, &capacity))
+    return NULL;
+
+  QueryTracer* tracer = new QueryTracer(sample_every, (size_t) std::max(capacity, Py_ssize_t(1)));
+  size_t qt_ptr = reinterpret_cast< size_t >(tracer);
+
+  return Py_BuildValue("n", qt_ptr);
+}
+
+static PyObject *sgtreec_tracer_dump(PyObject *self, PyObject *args)
+{
+  QueryTracer *obj;
+  size_t int_ptr;
+  const char* filename;
+
+  if (!PyArg_ParseTuple(args, "ns:sgtreec_tracer_dump", &int_ptr, &filename))
+    return NULL;
+
+  obj = reinterpret_cast< QueryTracer * >(int_ptr);
+  if (!obj->dump(filename))
+  {
+    PyErr_Format(SGtreecError, "cannot write traces to %s", filename);
+    return NULL;
+  }
+
+  return Py_BuildValue("K", (unsigned long long) obj->sampled());
+}
+
+static PyObject *sgtreec_tracer_delete(PyObject *self, PyObject *args)
+{
+  QueryTracer *obj;
+  size_t int_ptr;
+
+  if (!PyArg_ParseTuple(args, "n:sgtreec_tracer_delete", &int_ptr))
+    return NULL;
+
+  obj = reinterpret_cast< QueryTracer * >(int_ptr);
+  delete obj;
+
+  return Py_BuildValue("n", int_ptr);
+}
+
 PyMODINIT_FUNC PyInit_sgtreec(void)
 {
   PyObject *m;
@@ -959,6 +2535,12 @@ PyMODINIT_FUNC PyInit_sgtreec(void)
     {"NearestNeighbour", sgtreec_nn, METH_VARARGS, "Find the nearest neighbour."},
     {"kNearestNeighbours", sgtreec_knn, METH_VARARGS, "Find the k nearest neighbours."},
     {"kNearestNeighboursBeam", sgtreec_knn_beam, METH_VARARGS, "Find the k nearest neighbours approximately using beam search."},
+    {"kNearestNeighboursMulti", sgtreec_knn_multi, METH_VARARGS, "Find the k nearest neighbours of every vector of multi-vector queries."},
+    {"MultiVectorSearch", sgtreec_multi_search, METH_VARARGS, "Rank documents for multi-vector queries by MaxSim or sum."},
+    {"kNearestNeighboursParallel", sgtreec_knn_parallel, METH_VARARGS, "Find the k nearest neighbours of one query at a time on all cores."},
+    {"kNearestNeighboursExpanded", sgtreec_knn_expanded, METH_VARARGS, "Find the k nearest neighbours, counting duplicates."},
+    {"RangeSearchExpanded", sgtreec_range_expanded, METH_VARARGS, "Find all the neighbours in range, with duplicates."},
+    {"kNearestNeighboursUpdate", sgtreec_knn_update, METH_VARARGS, "Find the k nearest neighbours of inserted points and the points whose neighbours they become."},
     {"RangeSearch", sgtreec_range, METH_VARARGS, "Find all the neighbours in range."},
     {"serialize", sgtreec_serialize, METH_VARARGS, "Serialize the current SG Tree."},
     {"deserialize", sgtreec_deserialize, METH_VARARGS, "Construct a SG Tree from deserializing."},
@@ -968,10 +2550,66 @@ PyMODINIT_FUNC PyInit_sgtreec(void)
     {"size", sgtreec_size, METH_VARARGS, "Return number of points in the SG Tree."},
     {"spreadout", sgtreec_spreadout, METH_VARARGS, "Find well spreadout k points."},
     {"test_covering", sgtreec_test_covering, METH_VARARGS, "Check if covering property is satisfied."},
+    {"verify", sgtreec_verify, METH_VARARGS, "Check the tree invariants in parallel and report the first violations."},
     {"node_children", sgtreec_node_children, METH_VARARGS, "Get children nodes."},
     {"node_property", sgtreec_node_property, METH_VARARGS, "Get node property."},
     {"get_root", sgtreec_get_root, METH_VARARGS, "Get root node."},
     {"node_save", sgtreec_node_save, METH_VARARGS, "Save extra node property."},
+    {"share", sgtreec_share, METH_VARARGS, "Write a read-only image of the SG Tree to shared memory or a file."},
+    {"attach", sgtreec_attach, METH_VARARGS, "Map a shared SG Tree image."},
+    {"detach", sgtreec_detach, METH_VARARGS, "Unmap a shared SG Tree image."},
+    {"unlink", sgtreec_unlink, METH_VARARGS, "Remove a shared SG Tree image."},
+    {"shared_size", sgtreec_shared_size, METH_VARARGS, "Return number of points in the shared SG Tree."},
+    {"shared_count_visits", sgtreec_shared_count_visits, METH_VARARGS, "Start or stop counting the nodes visited by queries."},
+    {"shared_visit_counts", sgtreec_shared_visit_counts, METH_VARARGS, "Return the visits counted per node."},
+    {"shared_lock_hot", sgtreec_shared_lock_hot, METH_VARARGS, "Lock the hot nodes of a shared SG Tree in memory."},
+    {"shared_hot_size", sgtreec_shared_hot_size, METH_VARARGS, "Return the number of hot nodes of a shared SG Tree."},
+    {"shared_NearestNeighbour", sgtreec_shared_nn, METH_VARARGS, "Find the nearest neighbour in a shared SG Tree."},
+    {"shared_kNearestNeighbours", sgtreec_shared_knn, METH_VARARGS, "Find the k nearest neighbours in a shared SG Tree."},
+    {"shared_kNearestNeighboursBeam", sgtreec_shared_knn_beam, METH_VARARGS, "Find the k nearest neighbours in a shared SG Tree using beam search."},
+    {"shared_RangeSearch", sgtreec_shared_range, METH_VARARGS, "Find all the neighbours in range in a shared SG Tree."},
+    {"log_open", sgtreec_log_open, METH_VARARGS, "Open or create an insert log."},
+    {"log_close", sgtreec_log_close, METH_VARARGS, "Sync and close an insert log."},
+    {"log_batchinsert", sgtreec_log_batchinsert, METH_VARARGS, "Log a batch of points and insert it to the SG Tree."},
+    {"log_sync", sgtreec_log_sync, METH_VARARGS, "Force the insert log to disk."},
+    {"log_checkpoint", sgtreec_log_checkpoint, METH_VARARGS, "Snapshot the SG Tree and truncate the insert log."},
+    {"log_size", sgtreec_log_size, METH_VARARGS, "Return the size of the insert log in bytes."},
+    {"log_recover", sgtreec_log_recover, METH_VARARGS, "Load a snapshot and replay the insert log."},
+    {"tune_base", sgtreec_tune_base, METH_VARARGS, "Choose the base of an SG Tree from trial trees on a sample."},
+    {"rebalance", sgtreec_rebalance, METH_VARARGS, "Rebuild the most degraded subtrees of the SG Tree."},
+    {"rebalancer_start", sgtreec_rebalancer_start, METH_VARARGS, "Start rebalancing the SG Tree in the background."},
+    {"rebalancer_stats", sgtreec_rebalancer_stats, METH_VARARGS, "Return passes run and subtrees rebuilt by a rebalancer."},
+    {"rebalancer_stop", sgtreec_rebalancer_stop, METH_VARARGS, "Stop a background rebalancer."},
+    {"merge", sgtreec_merge, METH_VARARGS, "Move all points of another SG Tree into the SG Tree."},
+    {"batcher_start", sgtreec_batcher_start, METH_VARARGS, "Start a micro-batching kNN dispatcher."},
+    {"batcher_submit", sgtreec_batcher_submit, METH_VARARGS, "Queue a single kNN query, resolving a future."},
+    {"batcher_stats", sgtreec_batcher_stats, METH_VARARGS, "Return batches and requests run by a dispatcher."},
+    {"batcher_stop", sgtreec_batcher_stop, METH_VARARGS, "Answer pending queries and stop a dispatcher."},
+    {"cache_new", sgtreec_cache_new, METH_VARARGS, "Create a kNN result cache for an SG Tree."},
+    {"cache_knn", sgtreec_cache_knn, METH_VARARGS, "Find the k nearest neighbours through the result cache."},
+    {"cache_stats", sgtreec_cache_stats, METH_VARARGS, "Return hit and miss counts of a result cache."},
+    {"cache_clear", sgtreec_cache_clear, METH_VARARGS, "Drop all entries of a result cache."},
+    {"cache_delete", sgtreec_cache_delete, METH_VARARGS, "Delete a result cache."},
+    {"routing_new", sgtreec_routing_new, METH_VARARGS, "Flatten the top levels of an SG Tree into a routing table."},
+    {"routing_knn", sgtreec_routing_knn, METH_VARARGS, "Find the k nearest neighbours starting from a routing table."},
+    {"routing_size", sgtreec_routing_size, METH_VARARGS, "Return the number of nodes in a routing table."},
+    {"routing_delete", sgtreec_routing_delete, METH_VARARGS, "Delete a routing table."},
+    {"density_new", sgtreec_density_new, METH_VARARGS, "Count the points below every node of an SG Tree."},
+    {"density_count", sgtreec_density_count, METH_VARARGS, "Count the points within a radius of every query."},
+    {"density_kernel", sgtreec_density_kernel, METH_VARARGS, "Sum a Gaussian kernel over all points for every query."},
+    {"density_delete", sgtreec_density_delete, METH_VARARGS, "Delete subtree counts."},
+    {"flat_new", sgtreec_flat_new, METH_VARARGS, "Create an empty brute force index."},
+    {"flat_add", sgtreec_flat_add, METH_VARARGS, "Append points to a brute force index."},
+    {"flat_search", sgtreec_flat_search, METH_VARARGS, "Find the k best points, or re-rank candidates, by brute force."},
+    {"flat_size", sgtreec_flat_size, METH_VARARGS, "Return the number of points of a brute force index."},
+    {"flat_delete", sgtreec_flat_delete, METH_VARARGS, "Delete a brute force index."},
+    {"progress_new", sgtreec_progress_new, METH_VARARGS, "Create a progress counter for long operations."},
+    {"progress_status", sgtreec_progress_status, METH_VARARGS, "Steps done, steps expected and whether cancelled."},
+    {"progress_cancel", sgtreec_progress_cancel, METH_VARARGS, "Stop the operations reporting into a progress counter."},
+    {"progress_delete", sgtreec_progress_delete, METH_VARARGS, "Delete a progress counter."},
+    {"tracer_new", sgtreec_tracer_new, METH_VARARGS, "Create a sampling tracer for nearest neighbour queries."},
+    {"tracer_dump", sgtreec_tracer_dump, METH_VARARGS, "Write the traced query paths in binary form."},
+    {"tracer_delete", sgtreec_tracer_delete, METH_VARARGS, "Delete a tracer."},
     {NULL, NULL, 0, NULL}
   };
   static struct PyModuleDef mdef = {PyModuleDef_HEAD_INIT,
@@ -26,6 +26,15 @@
 #include <atomic>
 #include <thread>
 #include <future>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <vector>
 
 #include <Eigen/Core>
 
@@ -75,62 +84,423 @@ namespace utils
     }
 
     template<class UnaryFunction>
-    UnaryFunction parallel_for_progressbar(size_t first, size_t last, UnaryFunction f, unsigned cores=-1)
+    UnaryFunction parallel_for(size_t first, size_t last, UnaryFunction f, unsigned cores)
     {
-        if (cores == -1) {
-            cores = std::thread::hardware_concurrency();
+        if (first >= last) {
+            return f;
         }
-        // std::cerr << "Cores: " << cores << std::endl;
+
+        auto task = [&f](size_t start, size_t end)->void{
+            for (; start < end; ++start)
+                f(start);
+        };
+
         const size_t total_length = last - first;
-        const size_t chunk_length = total_length / cores;
+        const size_t chunk_length = std::max(size_t(total_length / cores), size_t(1));
+        size_t chunk_start = first;
+        std::vector<std::future<void>>  for_threads;
+        for (unsigned i = 0; i < (cores - 1) && i < total_length; ++i)
+        {
+            const auto chunk_stop = chunk_start + chunk_length;
+            for_threads.push_back(std::async(std::launch::async, task, chunk_start, chunk_stop));
+            chunk_start = chunk_stop;
+        }
+        for_threads.push_back(std::async(std::launch::async, task, chunk_start, last));
+
+        for (auto& thread : for_threads)
+            thread.get();
+        return f;
+    }
+
+    /*** Progress and cancellation of a long operation ***/
+    // Workers add finished steps to per-thread counters once per block of
+    // elements and stop at the next block once cancelled; a reporting thread
+    // (or another caller) sums the counters whenever it likes.
+    class Progress
+    {
+        // padded by hand to a cache line each, over-aligned types would need aligned new
+        struct Slot
+        {
+            std::atomic<size_t> done{0};
+            char pad[64 - sizeof(std::atomic<size_t>)];
+        };
+        static const unsigned num_slots = 64;
+        Slot slots[num_slots];
+        std::atomic<size_t> total{0};
+        std::atomic<bool> stop{false};
+
+        static unsigned thread_slot()
+        {
+            static std::atomic<unsigned> next{0};
+            thread_local unsigned slot = next++ % num_slots;
+            return slot;
+        }
+
+    public:
+        std::function<void(size_t, size_t)> callback;  // (done, total), called by reporting threads
+
+        void expect(size_t steps) { total.fetch_add(steps, std::memory_order_relaxed); }
+        void add(size_t steps) { slots[thread_slot()].done.fetch_add(steps, std::memory_order_relaxed); }
+        void cancel() { stop.store(true, std::memory_order_relaxed); }
+        bool cancelled() const { return stop.load(std::memory_order_relaxed); }
+
+        size_t expected() const { return total.load(std::memory_order_relaxed); }
+        size_t done() const
+        {
+            size_t sum = 0;
+            for (unsigned i = 0; i < num_slots; ++i)
+                sum += slots[i].done.load(std::memory_order_relaxed);
+            return sum;
+        }
+    };
+
+    /*** Counts one loop into the given progress, or draws a bar on stderr if there is none ***/
+    class Reporter
+    {
+        Progress local;
+        Progress* progress;
+        size_t total;
+        size_t counted = 0;             // steps of a serial loop already added
+        size_t reached = 0;             // and finished
+        bool draw;
+        bool stopped = false;           // a serial loop left before its end
+        int drawn = -1;                 // last tenth drawn
+
+    public:
+        static const size_t block = 1024;
+
+        Reporter(size_t total, Progress* into, bool bar = true)
+            : progress(into), total(total), draw(false)
+        {
+            if (progress == nullptr)
+            {
+                progress = &local;
+                draw = bar;
+            }
+            progress->expect(total);
+        }
 
-        if(total_length <= 10000)
+        ~Reporter()
         {
-            auto task = [&f,&chunk_length](size_t start, size_t end)->void{
-                for (; start < end; ++start){
-                    f(start);
+            progress->add(reached - counted);
+            report();
+            if (draw && drawn >= 0)
+                std::cerr << std::endl;
+        }
+
+        Progress& get() { return *progress; }
+        bool cancelled() const { return progress->cancelled(); }
+        bool stopped_early() const { return stopped; }
+
+        // From the thread that waits for the workers only
+        void report()
+        {
+            size_t done = progress->done();
+            if (progress->callback)
+                progress->callback(done, progress->expected());
+            if (!draw || total == 0)
+                return;
+            int tenth = int(std::min(done, total) * 10 / total);
+            if (tenth == drawn)
+                return;
+            drawn = tenth;
+            const unsigned w = 50, c = unsigned(tenth) * w / 10;
+            std::cerr << std::setw(3) << tenth * 10 << "% [";
+            for (unsigned x = 0; x < c; x++) std::cerr << "=";
+            for (unsigned x = c; x < w; x++) std::cerr << " ";
+            std::cerr << "]\r" << std::flush;
+        }
+
+        // For serial loops, called with the index of every element; false once cancelled
+        bool tick(size_t i)
+        {
+            reached = i + 1;
+            if ((i & (block - 1)) != 0)
+                return true;
+            progress->add(i - counted);
+            counted = i;
+            report();
+            if (!progress->cancelled())
+                return true;
+            reached = i;
+            stopped = true;
+            return false;
+        }
+    };
+
+    /*** True once progress, if any, is cancelled ***/
+    inline bool cancelled(const Progress* progress)
+    {
+        return progress != nullptr && progress->cancelled();
+    }
+
+    /*** f on every index of [first, last), counted into the given progress (a bar if null); false if cancelled before the end ***/
+    template<class UnaryFunction>
+    bool parallel_for_progressbar(size_t first, size_t last, UnaryFunction f, unsigned cores=-1, Progress* into=nullptr)
+    {
+        cores = cores == unsigned(-1) ? std::max(std::thread::hardware_concurrency(), 1u) : std::max(cores, 1u);
+        if (first >= last)
+            return true;
+        const size_t total_length = last - first;
+        Reporter reporter(total_length, into, total_length > 10000);
+        Progress& progress = reporter.get();
+        std::atomic<bool> stopped{false};
+
+        // counting and the check for cancellation happen once per block
+        auto task = [&f, &progress, &stopped](size_t start, size_t end)->void{
+            while (start < end && !progress.cancelled())
+            {
+                const size_t stop = std::min(end, start + Reporter::block);
+                for (size_t i = start; i < stop; ++i)
+                    f(i);
+                progress.add(stop - start);
+                start = stop;
+            }
+            if (start < end)
+                stopped.store(true, std::memory_order_relaxed);
+        };
+
+        const size_t chunk_length = std::max(total_length / cores, size_t(1));
+        size_t chunk_start = first;
+        std::vector<std::future<void>>  for_threads;
+        for (unsigned i = 0; i < cores - 1 && chunk_start + chunk_length < last; ++i)
+        {
+            const auto chunk_stop = chunk_start + chunk_length;
+            for_threads.push_back(std::async(std::launch::async, task, chunk_start, chunk_stop));
+            chunk_start = chunk_stop;
+        }
+        for_threads.push_back(std::async(std::launch::async, task, chunk_start, last));
+
+        // the calling thread only reports
+        for (auto& thread : for_threads)
+        {
+            while (thread.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+                reporter.report();
+            thread.get();
+        }
+        return !stopped.load();
+    }
+
+    /*** Worker threads shared by the parallel build helpers below ***/
+    class ThreadPool
+    {
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool stopping = false;
+
+        void work()
+        {
+            while (true)
+            {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lk(mtx);
+                    cv.wait(lk, [this]{ return stopping || !tasks.empty(); });
+                    if (tasks.empty())
+                        return;
+                    job = std::move(tasks.front());
+                    tasks.pop_front();
                 }
-            };
+                job();
+            }
+        }
 
-            size_t chunk_start = first;
-            std::vector<std::future<void>>  for_threads;
-            for (unsigned i = 0; i < cores - 1; ++i)
+    public:
+        explicit ThreadPool(unsigned num_workers)
+        {
+            for (unsigned i = 0; i < num_workers; ++i)
+                workers.emplace_back(&ThreadPool::work, this);
+        }
+
+        ~ThreadPool()
+        {
             {
-                const auto chunk_stop = chunk_start + chunk_length;
-                for_threads.push_back(std::async(std::launch::async, task, chunk_start, chunk_stop));
-                chunk_start = chunk_stop;
+                std::lock_guard<std::mutex> lk(mtx);
+                stopping = true;
             }
-            for_threads.push_back(std::async(std::launch::async, task, chunk_start, last));
+            cv.notify_all();
+            for (auto& w : workers)
+                w.join();
+        }
 
-            for (auto& thread : for_threads)
-                thread.get();
+        // The calling thread works as well, so one worker less than the cores
+        static ThreadPool& shared()
+        {
+            static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+            return pool;
         }
-        else
+
+        // Run task(0), ..., task(num_tasks-1) on at most cores threads, including the caller
+        template<class Task>
+        void run(size_t num_tasks, Task task, unsigned cores)
         {
-            auto task = [&f,&chunk_length](size_t start, size_t end)->void{
-                for (; start < end; ++start){
-                    progressbar(start%chunk_length, chunk_length);
-                    f(start);
+            struct State
+            {
+                std::atomic<size_t> next;
+                std::atomic<size_t> done;
+                std::mutex mtx;
+                std::condition_variable cv;
+            };
+            auto state = std::make_shared<State>();
+            state->next = 0;
+            state->done = 0;
+            Task* shared_task = &task;
+
+            // helpers starting after all tasks are taken return without touching task
+            auto drain = [state, shared_task, num_tasks]()->void{
+                size_t i;
+                while ((i = state->next++) < num_tasks)
+                {
+                    (*shared_task)(i);
+                    if (++state->done == num_tasks)
+                    {
+                        std::lock_guard<std::mutex> lk(state->mtx);
+                        state->cv.notify_all();
+                    }
                 }
             };
 
-            size_t chunk_start = first;
-            std::vector<std::future<void>>  for_threads;
-            for (unsigned i = 0; i < cores - 1; ++i)
+            size_t helpers = std::min({size_t(cores > 0 ? cores - 1 : 0), workers.size(), num_tasks > 0 ? num_tasks - 1 : 0});
+            if (helpers > 0)
             {
-                const auto chunk_stop = chunk_start + chunk_length;
-                for_threads.push_back(std::async(std::launch::async, task, chunk_start, chunk_stop));
-                chunk_start = chunk_stop;
+                {
+                    std::lock_guard<std::mutex> lk(mtx);
+                    for (size_t i = 0; i < helpers; ++i)
+                        tasks.emplace_back(drain);
+                }
+                cv.notify_all();
             }
-            for_threads.push_back(std::async(std::launch::async, task, chunk_start, last));
+            drain();
 
-            for (auto& thread : for_threads)
-                thread.get();
-            progressbar(chunk_length, chunk_length);
-            std::cerr << std::endl;
+            std::unique_lock<std::mutex> lk(state->mtx);
+            state->cv.wait(lk, [&]{ return state->done.load() == num_tasks; });
         }
+    };
 
-        return f;
+    // -1 (as passed from Python) means all cores
+    inline unsigned pool_cores(unsigned cores)
+    {
+        if (cores == unsigned(-1))
+            return std::max(std::thread::hardware_concurrency(), 1u);
+        return std::max(cores, 1u);
+    }
+
+    /*** Mean of the columns, reducing one partial sum per chunk ***/
+    inline pointType parallel_mean(const Eigen::Map<matrixType>& pMatrix, unsigned cores)
+    {
+        cores = pool_cores(cores);
+        const size_t numPoints = pMatrix.cols();
+        const size_t chunks = std::max(std::min(size_t(cores), numPoints / 1024), size_t(1));
+        std::vector<Eigen::VectorXd> partial(chunks, Eigen::VectorXd::Zero(pMatrix.rows()));
+        ThreadPool::shared().run(chunks, [&](size_t c)->void{
+            for (size_t i = numPoints * c / chunks; i < numPoints * (c + 1) / chunks; ++i)
+                partial[c] += pMatrix.col(i).template cast<double>();
+        }, cores);
+        for (size_t c = 1; c < chunks; ++c)
+            partial[0] += partial[c];
+        return (partial[0] / double(numPoints)).cast<scalar>();
+    }
+
+    /*** Distance of every column from vec, and of every column from vec2 if given ***/
+    inline pointType parallel_distances(const Eigen::Map<matrixType>& pMatrix, const pointType& vec, unsigned cores,
+                                        const pointType* vec2 = nullptr, scalar* max_dist2 = nullptr)
+    {
+        cores = pool_cores(cores);
+        const size_t numPoints = pMatrix.cols();
+        const size_t chunks = std::max(std::min(size_t(cores) * 4, numPoints / 1024), size_t(1));
+        pointType dists(numPoints);
+        std::vector<scalar> partial_max(chunks, 0);
+        ThreadPool::shared().run(chunks, [&](size_t c)->void{
+            for (size_t i = numPoints * c / chunks; i < numPoints * (c + 1) / chunks; ++i)
+            {
+                dists[i] = (pMatrix.col(i) - vec).norm();
+                if (vec2 != nullptr)
+                    partial_max[c] = std::max(partial_max[c], (pMatrix.col(i) - *vec2).norm());
+            }
+        }, cores);
+        if (max_dist2 != nullptr)
+            *max_dist2 = *std::max_element(partial_max.begin(), partial_max.end());
+        return dists;
+    }
+
+    /*** Indices by decreasing value: chunks are sorted in parallel, then merged pairwise ***/
+    inline std::vector<size_t> parallel_argsort_desc(const pointType& values, unsigned cores)
+    {
+        cores = pool_cores(cores);
+        const size_t n = values.size();
+        std::vector<size_t> idx(n);
+        std::iota(std::begin(idx), std::end(idx), 0);
+        auto comp_x = [&values](size_t a, size_t b) { return values[a] > values[b]; };
+
+        const size_t chunks = std::max(std::min(size_t(cores), n / 4096), size_t(1));
+        std::vector<size_t> bounds(chunks + 1);
+        for (size_t c = 0; c <= chunks; ++c)
+            bounds[c] = n * c / chunks;
+        ThreadPool::shared().run(chunks, [&](size_t c)->void{
+            std::sort(idx.begin() + bounds[c], idx.begin() + bounds[c + 1], comp_x);
+        }, cores);
+        for (size_t width = 1; width < chunks; width *= 2)
+        {
+            size_t pairs = (chunks + 2 * width - 1) / (2 * width);
+            ThreadPool::shared().run(pairs, [&](size_t p)->void{
+                size_t first = 2 * width * p;
+                size_t middle = std::min(first + width, chunks);
+                size_t last = std::min(first + 2 * width, chunks);
+                std::inplace_merge(idx.begin() + bounds[first], idx.begin() + bounds[middle], idx.begin() + bounds[last], comp_x);
+            }, cores);
+        }
+        return idx;
+    }
+
+    /*** Insertion order for building a tree: decreasing distance from the mean, approximate medoid last ***/
+    struct BuildOrder
+    {
+        std::vector<size_t> order;      // order.back() is the medoid, i.e. the root
+        pointType dists;                // distance of every point from the mean
+        scalar max_dist;                // distance of the farthest point from the medoid
+    };
+
+    // With medoid_sample > 0 the mean and medoid are estimated from that many random points,
+    // which saves a full pass over the data
+    inline BuildOrder build_order(const Eigen::Map<matrixType>& pMatrix, unsigned cores, size_t medoid_sample = 0)
+    {
+        const size_t numPoints = pMatrix.cols();
+        BuildOrder result;
+
+        if (medoid_sample > 0 && medoid_sample < numPoints)
+        {
+            std::mt19937_64 gen(0);
+            std::uniform_int_distribution<size_t> pick(0, numPoints - 1);
+            std::vector<size_t> sample(medoid_sample);
+            Eigen::VectorXd mean = Eigen::VectorXd::Zero(pMatrix.rows());
+            for (auto& s : sample)
+            {
+                s = pick(gen);
+                mean += pMatrix.col(s).template cast<double>();
+            }
+            pointType mx = (mean / double(medoid_sample)).cast<scalar>();
+            size_t medoid = sample[0];
+            for (const auto& s : sample)
+                if ((pMatrix.col(s) - mx).squaredNorm() < (pMatrix.col(medoid) - mx).squaredNorm())
+                    medoid = s;
+
+            pointType medoid_pt = pMatrix.col(medoid);
+            result.dists = parallel_distances(pMatrix, mx, cores, &medoid_pt, &result.max_dist);
+            result.order = parallel_argsort_desc(result.dists, cores);
+            result.order.erase(std::find(result.order.begin(), result.order.end(), medoid));
+            result.order.push_back(medoid);
+        }
+        else
+        {
+            pointType mx = parallel_mean(pMatrix, cores);
+            result.dists = parallel_distances(pMatrix, mx, cores);
+            result.order = parallel_argsort_desc(result.dists, cores);
+            pointType medoid_pt = pMatrix.col(result.order.back());
+            result.max_dist = parallel_distances(pMatrix, medoid_pt, cores).maxCoeff();
+        }
+        return result;
     }
 
     template<typename T>